@@ -0,0 +1,342 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "base/async_logger.h"
+
+#include <condition_variable>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace base {
+
+using namespace std;
+
+namespace {
+
+struct RecordHeader {
+  uint32_t len;
+  int32_t severity;
+  int64_t timestamp;
+  bool force_flush;
+};
+
+// Single producer, single consumer ring of variable sized records.
+class LogRing {
+ public:
+  explicit LogRing(uint32_t size) {
+    Reset(size);
+  }
+
+  // Must be called when there are no producers and consumers.
+  void Reset(uint32_t size) {
+    if (size != size_) {
+      buf_.reset(new char[size]);
+      size_ = size;
+    }
+    head_.store(0, memory_order_relaxed);
+    tail_.store(0, memory_order_relaxed);
+    dropped.store(0, memory_order_relaxed);
+  }
+
+  // Called by the owning thread.
+  bool TryPush(const RecordHeader& hdr, const char* msg) {
+    uint64_t need = sizeof(hdr) + hdr.len;
+    uint64_t head = head_.load(memory_order_relaxed);
+    uint64_t tail = tail_.load(memory_order_acquire);
+    if (head - tail + need > size_)
+      return false;
+
+    CopyIn(head, &hdr, sizeof(hdr));
+    CopyIn(head + sizeof(hdr), msg, hdr.len);
+    head_.store(head + need, memory_order_release);
+    return true;
+  }
+
+  // Called by the draining thread.
+  bool TryPop(RecordHeader* hdr, string* msg) {
+    uint64_t tail = tail_.load(memory_order_relaxed);
+    uint64_t head = head_.load(memory_order_acquire);
+    if (tail == head)
+      return false;
+
+    CopyOut(tail, hdr, sizeof(*hdr));
+    msg->resize(hdr->len);
+    CopyOut(tail + sizeof(*hdr), msg->data(), hdr->len);
+    tail_.store(tail + sizeof(*hdr) + hdr->len, memory_order_release);
+    return true;
+  }
+
+  atomic_bool owned{true};
+  atomic<uint64_t> dropped{0};
+
+ private:
+  void CopyIn(uint64_t pos, const void* src, size_t len) {
+    size_t offs = pos & (size_ - 1);
+    size_t first = min<size_t>(len, size_ - offs);
+    memcpy(buf_.get() + offs, src, first);
+    memcpy(buf_.get(), static_cast<const char*>(src) + first, len - first);
+  }
+
+  void CopyOut(uint64_t pos, void* dest, size_t len) {
+    size_t offs = pos & (size_ - 1);
+    size_t first = min<size_t>(len, size_ - offs);
+    memcpy(dest, buf_.get() + offs, first);
+    memcpy(static_cast<char*>(dest) + first, buf_.get(), len - first);
+  }
+
+  unique_ptr<char[]> buf_;
+  uint64_t size_ = 0;
+
+  alignas(64) atomic<uint64_t> head_{0};
+  alignas(64) atomic<uint64_t> tail_{0};
+};
+
+class AsyncLogger;
+
+struct State {
+  AsyncLoggerOptions opts;
+
+  mutex rings_mu;  // protects rings.
+  vector<unique_ptr<LogRing>> rings;
+
+  mutex drain_mu;  // serializes the consumers of the rings.
+  vector<LogRing*> snapshot;
+  string scratch;
+
+  mutex stop_mu;
+  condition_variable stop_cv;
+  bool stop = false;
+  thread drainer;
+
+  google::base::Logger* orig[google::NUM_SEVERITIES] = {};
+  AsyncLogger* loggers[google::NUM_SEVERITIES] = {};
+
+  atomic_bool sync_mode{false};
+  atomic<uint64_t> written{0};
+  atomic<uint64_t> sync_writes{0};
+  uint64_t reported_dropped = 0;
+};
+
+// Never destroyed, because rings may be referenced by thread_local destructors.
+State* state = nullptr;
+
+// Set when the thread's ring is released upon the thread exit. Messages logged afterwards,
+// for example from destructors of other thread_local objects, are written synchronously,
+// since the ring may already belong to another thread. Not a member of RingHolder, because
+// the stores to an object in its destructor can be optimized away.
+thread_local bool tl_exited = false;
+
+struct RingHolder {
+  LogRing* ring = nullptr;
+
+  ~RingHolder() {
+    if (ring) {
+      ring->owned.store(false, memory_order_release);
+      ring = nullptr;
+    }
+    tl_exited = true;
+  }
+};
+
+thread_local RingHolder tl_ring;
+
+LogRing* ThreadRing() {
+  if (tl_ring.ring)
+    return tl_ring.ring;
+
+  lock_guard lk(state->rings_mu);
+
+  // Reuse a ring of a thread that exited.
+  for (auto& ring : state->rings) {
+    bool expected = false;
+    if (ring->owned.compare_exchange_strong(expected, true, memory_order_acquire)) {
+      tl_ring.ring = ring.get();
+      return tl_ring.ring;
+    }
+  }
+
+  state->rings.emplace_back(new LogRing(state->opts.ring_size));
+  tl_ring.ring = state->rings.back().get();
+  return tl_ring.ring;
+}
+
+// Must be called with drain_mu locked.
+void DrainLocked() {
+  RecordHeader hdr;
+  string& msg = state->scratch;
+  uint64_t dropped = 0;
+
+  {
+    // Rings are never deleted, so they can be drained without holding rings_mu.
+    lock_guard lk(state->rings_mu);
+    state->snapshot.clear();
+    for (auto& ring : state->rings)
+      state->snapshot.push_back(ring.get());
+  }
+
+  for (LogRing* ring : state->snapshot) {
+    while (ring->TryPop(&hdr, &msg)) {
+      state->orig[hdr.severity]->Write(hdr.force_flush, hdr.timestamp, msg.data(), msg.size());
+      state->written.fetch_add(1, memory_order_relaxed);
+    }
+    dropped += ring->dropped.load(memory_order_relaxed);
+  }
+
+  if (dropped > state->reported_dropped) {
+    char buf[128];
+    int len = snprintf(buf, sizeof(buf), "AsyncLogger dropped %llu messages\n",
+                       (unsigned long long)(dropped - state->reported_dropped));
+    state->orig[google::WARNING]->Write(true, time(nullptr), buf, len);
+    state->reported_dropped = dropped;
+  }
+}
+
+class AsyncLogger : public google::base::Logger {
+ public:
+  explicit AsyncLogger(int severity) : severity_(severity) {
+  }
+
+  void Write(bool force_flush, time_t timestamp, const char* message, int message_len) final;
+
+  void Flush() final {
+    {
+      lock_guard lk(state->drain_mu);
+      DrainLocked();
+    }
+    state->orig[severity_]->Flush();
+  }
+
+  uint32_t LogSize() final {
+    return state->orig[severity_]->LogSize();
+  }
+
+ private:
+  int severity_;
+};
+
+void AsyncLogger::Write(bool force_flush, time_t timestamp, const char* message,
+                        int message_len) {
+  // glog passes a FATAL message to the FATAL logger first and then to the lower ones.
+  if (severity_ == google::FATAL)
+    state->sync_mode.store(true, memory_order_release);
+
+  if (state->sync_mode.load(memory_order_acquire) || tl_exited) {
+    lock_guard lk(state->drain_mu);
+    DrainLocked();
+    state->orig[severity_]->Write(force_flush, timestamp, message, message_len);
+    state->sync_writes.fetch_add(1, memory_order_relaxed);
+    return;
+  }
+
+  LogRing* ring = ThreadRing();
+  RecordHeader hdr{uint32_t(message_len), severity_, timestamp, force_flush};
+  if (!ring->TryPush(hdr, message)) {
+    ring->dropped.fetch_add(1, memory_order_relaxed);
+  }
+}
+
+void DrainerThread() {
+  const auto interval = chrono::milliseconds(state->opts.flush_interval_ms);
+  unique_lock stop_lk(state->stop_mu);
+
+  while (!state->stop) {
+    stop_lk.unlock();
+    {
+      lock_guard lk(state->drain_mu);
+      DrainLocked();
+    }
+    stop_lk.lock();
+    state->stop_cv.wait_for(stop_lk, interval, [] { return state->stop; });
+  }
+}
+
+}  // namespace
+
+void InstallAsyncLogger(const AsyncLoggerOptions& opts) {
+  CHECK(opts.ring_size > sizeof(RecordHeader) && (opts.ring_size & (opts.ring_size - 1)) == 0);
+
+  if (!state) {
+    state = new State;
+  }
+  CHECK(!state->drainer.joinable()) << "AsyncLogger is already installed";
+
+  state->opts = opts;
+  state->stop = false;
+
+  // The loggers are not installed, hence nobody accesses the rings.
+  for (auto& ring : state->rings) {
+    ring->Reset(opts.ring_size);
+  }
+  state->reported_dropped = 0;
+  state->written.store(0, memory_order_relaxed);
+  state->sync_writes.store(0, memory_order_relaxed);
+  state->sync_mode.store(false, memory_order_relaxed);
+
+  for (int i = 0; i < google::NUM_SEVERITIES; ++i) {
+    state->orig[i] = google::base::GetLogger(i);
+    state->loggers[i] = new AsyncLogger(i);
+  }
+  state->drainer = thread(DrainerThread);
+
+  for (int i = 0; i < google::NUM_SEVERITIES; ++i) {
+    google::base::SetLogger(i, state->loggers[i]);
+  }
+}
+
+void ShutdownAsyncLogger() {
+  if (!state || !state->drainer.joinable())
+    return;
+
+  // SetLogger synchronizes with the ongoing writes, so the loggers can be deleted afterwards.
+  for (int i = 0; i < google::NUM_SEVERITIES; ++i) {
+    google::base::SetLogger(i, state->orig[i]);
+  }
+
+  {
+    lock_guard lk(state->stop_mu);
+    state->stop = true;
+  }
+  state->stop_cv.notify_one();
+  state->drainer.join();
+
+  lock_guard lk(state->drain_mu);
+  DrainLocked();
+  for (int i = 0; i < google::NUM_SEVERITIES; ++i) {
+    state->orig[i]->Flush();
+    delete state->loggers[i];
+    state->loggers[i] = nullptr;
+  }
+}
+
+void FlushAsyncLogger() {
+  if (!state)
+    return;
+
+  lock_guard lk(state->drain_mu);
+  DrainLocked();
+  for (int i = 0; i < google::NUM_SEVERITIES; ++i) {
+    state->orig[i]->Flush();
+  }
+}
+
+AsyncLoggerStats GetAsyncLoggerStats() {
+  AsyncLoggerStats res;
+  if (!state)
+    return res;
+
+  res.written = state->written.load(memory_order_relaxed);
+  res.sync_writes = state->sync_writes.load(memory_order_relaxed);
+
+  lock_guard lk(state->rings_mu);
+  for (const auto& ring : state->rings) {
+    res.dropped += ring->dropped.load(memory_order_relaxed);
+  }
+  return res;
+}
+
+}  // namespace base
@@ -0,0 +1,100 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <time.h>
+
+#include <atomic>
+#include <cstdint>
+
+#include "base/logging.h"
+
+namespace base {
+
+// Moves glog file writes off the logging threads.
+// glog formats a message on the calling thread and then passes it to google::base::Logger
+// objects, one per severity, that by default write it synchronously into the log file.
+// InstallAsyncLogger replaces these loggers with ones that copy the message into a per-thread
+// lock-free ring buffer. A background thread drains the rings and passes the messages to the
+// original loggers. Messages are dropped (and counted) if a ring is full, so the calling thread
+// never blocks on I/O.
+// Once a FATAL message is seen, pending messages are drained and all loggers switch to
+// synchronous writes so that nothing is lost when the process aborts.
+// Messages from different threads may be written out of order relative to each other.
+//
+// Note that glog still calls Logger::Write under its global log_mutex, so the logging threads
+// keep serializing on that mutex. The async logger shortens the critical section from a file
+// write (and an occasional fsync or log rotation) to a copy into the ring, which removes the
+// I/O stalls but not the contention itself. See BM_LogLoopLatency in fiber2_test.cc.
+struct AsyncLoggerOptions {
+  // Per-thread ring size in bytes, must be a power of 2.
+  uint32_t ring_size = 1 << 18;
+
+  // How often the background thread polls the rings.
+  uint32_t flush_interval_ms = 5;
+};
+
+struct AsyncLoggerStats {
+  uint64_t written = 0;
+  uint64_t dropped = 0;
+  uint64_t sync_writes = 0;
+};
+
+// Must be called after google::InitGoogleLogging and before the logging threads are started.
+void InstallAsyncLogger(const AsyncLoggerOptions& opts = AsyncLoggerOptions{});
+
+// Drains pending messages, stops the background thread and restores the original loggers.
+void ShutdownAsyncLogger();
+
+// Blocks until all the messages that were enqueued before the call are written.
+void FlushAsyncLogger();
+
+// The counters are reset by InstallAsyncLogger.
+AsyncLoggerStats GetAsyncLoggerStats();
+
+// Allows at most max_per_sec messages per second from a single call site. Lock-free.
+class LogRateLimiter {
+ public:
+  explicit LogRateLimiter(uint32_t max_per_sec) : max_per_sec_(max_per_sec) {
+  }
+
+  bool Allow() {
+    timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    uint64_t sec = ts.tv_sec;
+    uint64_t cur = window_.load(std::memory_order_relaxed);
+    if (cur != sec && window_.compare_exchange_strong(cur, sec, std::memory_order_relaxed)) {
+      count_.store(0, std::memory_order_relaxed);
+    }
+    if (count_.fetch_add(1, std::memory_order_relaxed) < max_per_sec_)
+      return true;
+    suppressed_.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  uint64_t suppressed() const {
+    return suppressed_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  const uint32_t max_per_sec_;
+  std::atomic<uint64_t> window_{0};
+  std::atomic<uint32_t> count_{0};
+  std::atomic<uint64_t> suppressed_{0};
+};
+
+}  // namespace base
+
+#define LOG_RATE_LIMITED_INTERNAL(severity, max_per_sec, name) \
+  static ::base::LogRateLimiter name(max_per_sec);             \
+  LOG_IF(severity, name.Allow())
+
+#define LOG_RATE_LIMITED_CONCAT(a, b) a##b
+#define LOG_RATE_LIMITED_NAME(line) LOG_RATE_LIMITED_CONCAT(log_rate_limiter_, line)
+
+// Like LOG(severity) but emits at most max_per_sec messages per second from this call site.
+// Similarly to LOG_EVERY_N, should not be used as a single statement in an unbraced if/else.
+#define LOG_RATE_LIMITED(severity, max_per_sec) \
+  LOG_RATE_LIMITED_INTERNAL(severity, max_per_sec, LOG_RATE_LIMITED_NAME(__LINE__))
@@ -0,0 +1,176 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "base/async_logger.h"
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+using namespace std;
+
+namespace base {
+
+namespace {
+
+class FakeLogger : public google::base::Logger {
+ public:
+  void Write(bool force_flush, time_t timestamp, const char* message, int message_len) final {
+    lock_guard lk(mu_);
+    lines_.emplace_back(message, message_len);
+  }
+
+  void Flush() final {
+  }
+
+  uint32_t LogSize() final {
+    return 0;
+  }
+
+  vector<string> lines() {
+    lock_guard lk(mu_);
+    return lines_;
+  }
+
+ private:
+  mutex mu_;
+  vector<string> lines_;
+};
+
+size_t CountContaining(const vector<string>& lines, string_view needle) {
+  return count_if(lines.begin(), lines.end(),
+                  [&](const string& s) { return s.find(needle) != string::npos; });
+}
+
+}  // namespace
+
+class AsyncLoggerTest : public testing::Test {
+ protected:
+  void SetUp() final {
+    for (int i = 0; i < google::NUM_SEVERITIES; ++i) {
+      orig_[i] = google::base::GetLogger(i);
+      google::base::SetLogger(i, &fake_);
+    }
+  }
+
+  void TearDown() final {
+    ShutdownAsyncLogger();
+    for (int i = 0; i < google::NUM_SEVERITIES; ++i) {
+      google::base::SetLogger(i, orig_[i]);
+    }
+  }
+
+  FakeLogger fake_;
+  google::base::Logger* orig_[google::NUM_SEVERITIES];
+};
+
+TEST_F(AsyncLoggerTest, Basic) {
+  InstallAsyncLogger();
+  EXPECT_NE(&fake_, google::base::GetLogger(google::INFO));
+
+  vector<thread> threads;
+  for (unsigned j = 0; j < 4; ++j) {
+    threads.emplace_back([j] {
+      for (unsigned i = 0; i < 100; ++i) {
+        LOG(INFO) << "async_line " << j << " " << i;
+      }
+    });
+  }
+  for (auto& t : threads)
+    t.join();
+
+  FlushAsyncLogger();
+  vector<string> lines = fake_.lines();
+  EXPECT_EQ(400, CountContaining(lines, "async_line"));
+
+  // Lines of a single thread preserve their order.
+  auto it = find_if(lines.begin(), lines.end(),
+                    [](const string& s) { return s.find("async_line 0 0\n") != string::npos; });
+  ASSERT_NE(it, lines.end());
+  it = find_if(it, lines.end(),
+               [](const string& s) { return s.find("async_line 0 99\n") != string::npos; });
+  EXPECT_NE(it, lines.end());
+
+  ShutdownAsyncLogger();
+  EXPECT_EQ(&fake_, google::base::GetLogger(google::INFO));
+}
+
+TEST_F(AsyncLoggerTest, Drops) {
+  AsyncLoggerOptions opts;
+  opts.ring_size = 1024;
+  opts.flush_interval_ms = 1000;
+  InstallAsyncLogger(opts);
+
+  string big(100, 'x');
+  for (unsigned i = 0; i < 100; ++i) {
+    LOG(INFO) << "drop_line " << big;
+  }
+  FlushAsyncLogger();
+
+  AsyncLoggerStats stats = GetAsyncLoggerStats();
+  EXPECT_GT(stats.dropped, 0);
+  vector<string> lines = fake_.lines();
+  EXPECT_EQ(100 - stats.dropped, CountContaining(lines, "drop_line"));
+  EXPECT_GE(CountContaining(lines, "AsyncLogger dropped"), 1);
+
+  // Reinstalling starts counting the drops from scratch.
+  ShutdownAsyncLogger();
+  InstallAsyncLogger(opts);
+  EXPECT_EQ(0, GetAsyncLoggerStats().dropped);
+}
+
+TEST_F(AsyncLoggerTest, ThreadExit) {
+  InstallAsyncLogger();
+
+  struct LogOnExit {
+    ~LogOnExit() {
+      LOG(INFO) << "exit_line";
+    }
+  };
+
+  thread th([] {
+    // Constructed before the thread's ring holder, hence destroyed after it.
+    static thread_local LogOnExit log_on_exit;
+    (void)log_on_exit;
+    LOG(INFO) << "first_line";
+  });
+  th.join();
+  FlushAsyncLogger();
+
+  vector<string> lines = fake_.lines();
+  EXPECT_EQ(1, CountContaining(lines, "first_line"));
+  EXPECT_EQ(1, CountContaining(lines, "exit_line"));
+  EXPECT_EQ(1, GetAsyncLoggerStats().sync_writes);
+}
+
+TEST_F(AsyncLoggerTest, RateLimited) {
+  InstallAsyncLogger();
+
+  for (unsigned i = 0; i < 100; ++i) {
+    LOG_RATE_LIMITED(INFO, 10) << "limited_line " << i;
+  }
+  FlushAsyncLogger();
+
+  // The loop may cross a second boundary.
+  size_t count = CountContaining(fake_.lines(), "limited_line");
+  EXPECT_GE(count, 10);
+  EXPECT_LE(count, 20);
+}
+
+TEST(LogRateLimiterTest, Basic) {
+  LogRateLimiter limiter(5);
+  unsigned allowed = 0;
+  for (unsigned i = 0; i < 100; ++i) {
+    allowed += limiter.Allow();
+  }
+  EXPECT_LE(allowed, 10);
+  EXPECT_EQ(100 - allowed, limiter.suppressed());
+}
+
+}  // namespace base
@@ -0,0 +1,600 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <type_traits>
+#include <utility>
+
+#include "base/pmr/pod_array.h"
+
+namespace base {
+
+/*
+  Open addressing variant of redis dict. Keys and values are stored inline in PODArray based
+  tables, allocated from the supplied memory resource, instead of a malloc-ed entry per key.
+  Keys that own memory, like strings, can be kept as views into a PmrArena.
+
+  Keeps the redis semantics:
+  * Incremental rehash - when the table grows or shrinks, the entries are moved to the new table
+    a few at a time by the following operations, so no single operation pays for the whole table.
+  * Safe iterators - while a SafeIterator is alive the entries do not move, so the dictionary can
+    be modified during the iteration.
+  * Scan cursor - Scan() visits one bucket per call and returns a cursor that stays valid across
+    modifications and resizes. Every entry that exists during the whole scan is returned at
+    least once, some may be returned more than once.
+
+  Uses linear probing with one control byte per slot, holding 7 bits of the hash. Entries are
+  erased with backward shift, without tombstones, unless the table is being iterated or
+  rehashed. Scan() enumerates the entries by their home bucket, so the redis reverse binary
+  cursor works unchanged.
+
+  K and V must be trivially copyable. Not thread-safe.
+*/
+template <typename K, typename V, typename Hash = std::hash<K>, typename Eq = std::equal_to<K>>
+class DenseDict {
+  static_assert(std::is_trivially_copyable_v<K> && std::is_trivially_copyable_v<V>,
+                "DenseDict stores keys and values in PODArray");
+
+  struct Slot {
+    K key;
+    V value;
+  };
+
+  struct Table {
+    explicit Table(std::pmr::memory_resource* mr) : ctrl(mr), slots(mr) {
+    }
+
+    size_t capacity() const {
+      return ctrl.size();
+    }
+
+    void Swap(Table& other);
+
+    PODArray<uint8_t> ctrl;
+    PODArray<Slot> slots;
+    size_t mask = 0;
+    size_t used = 0;
+    size_t deleted = 0;
+  };
+
+ public:
+  class SafeIterator;
+
+  explicit DenseDict(std::pmr::memory_resource* mr = nullptr, const Hash& hash = Hash(),
+                     const Eq& eq = Eq());
+
+  DenseDict(const DenseDict&) = delete;
+  void operator=(const DenseDict&) = delete;
+
+  size_t size() const {
+    return ht_[0].used + ht_[1].used;
+  }
+
+  bool empty() const {
+    return size() == 0;
+  }
+
+  // Number of slots in both tables.
+  size_t bucket_count() const {
+    return ht_[0].capacity() + ht_[1].capacity();
+  }
+
+  bool IsRehashing() const {
+    return rehashing_;
+  }
+
+  // Bytes allocated by the tables.
+  size_t MemoryUsage() const;
+
+  // Adds the key if it does not exist. Returns the pointer to the value, and true if the key was
+  // added. Returns {nullptr, false} if the table must grow but a SafeIterator prevents it.
+  std::pair<V*, bool> Insert(const K& key, const V& val);
+
+  V* Find(const K& key);
+
+  // Returns true if the key was found and erased.
+  bool Erase(const K& key);
+
+  void Clear();
+
+  // Grows the table so that it can hold n entries without rehashing. Returns false if
+  // the dictionary is rehashing.
+  bool Reserve(size_t n);
+
+  // Performs up to n steps of incremental rehashing, each step moves a single entry. Returns
+  // true if there are still entries to move.
+  bool Rehash(size_t n);
+
+  // Calls cb(const K&, V&) for the entries of a single bucket. Start with cursor 0 and call
+  // again with the returned cursor until it returns 0. The callback may change the value or
+  // erase entries, but must not insert.
+  template <typename Cb> uint64_t Scan(uint64_t cursor, Cb&& cb);
+
+  // Scans the whole dictionary and calls yield() after every buckets_per_yield buckets, for
+  // example to let other fibers run. The dictionary may be modified while yield() runs.
+  template <typename Cb, typename Yield>
+  void Traverse(Cb&& cb, Yield&& yield, unsigned buckets_per_yield = 64);
+
+ private:
+  static constexpr uint8_t kEmpty = 0;
+  static constexpr uint8_t kDeleted = 1;
+  static constexpr size_t kMinCapacity = 8;
+  static constexpr size_t kNotFound = size_t(-1);
+
+  static uint8_t Tag(uint64_t hash) {
+    return 0x80 | (hash >> 57);
+  }
+
+  static bool IsFull(uint8_t ctrl) {
+    return ctrl & 0x80;
+  }
+
+  // Reverses the bits of v, see dictScan in redis.
+  static uint64_t Rev(uint64_t v);
+
+  uint64_t HashOf(const K& key) const;
+  size_t FindPos(const Table& t, const K& key, uint64_t hash) const;
+
+  // Returns the first empty or deleted slot in the probe sequence of hash.
+  size_t InsertPos(Table* t, uint64_t hash);
+
+  void EraseAt(Table* t, size_t pos);
+
+  // Makes sure the table that receives new entries has a free slot.
+  bool ExpandIfNeeded();
+  void ShrinkIfNeeded();
+  void StartRehash(size_t capacity);
+  void Allocate(size_t capacity, Table* t);
+
+  void RehashStep() {
+    if (rehashing_ && pause_ == 0)
+      Rehash(1);
+  }
+
+  template <typename Cb> void ScanBucket(Table* t, size_t bucket, Cb& cb);
+
+  std::pmr::memory_resource* mr_;
+  Hash hash_;
+  Eq eq_;
+
+  // While rehashing, the entries move from ht_[0] to ht_[1], and new entries go to ht_[1].
+  Table ht_[2];
+  size_t rehash_idx_ = 0;
+  bool rehashing_ = false;
+
+  // Number of safe iterators and scans in progress. Rehashing is paused while it is positive.
+  unsigned pause_ = 0;
+  unsigned scanning_ = 0;
+};
+
+// Iterates over all the entries. The dictionary can be modified during the iteration.
+// Entries that are added during the iteration may or may not be visited.
+template <typename K, typename V, typename Hash, typename Eq>
+class DenseDict<K, V, Hash, Eq>::SafeIterator {
+ public:
+  explicit SafeIterator(DenseDict* dict) : dict_(dict) {
+    ++dict_->pause_;
+    SkipEmpty();
+  }
+
+  ~SafeIterator() {
+    --dict_->pause_;
+  }
+
+  SafeIterator(const SafeIterator&) = delete;
+  void operator=(const SafeIterator&) = delete;
+
+  bool Done() const {
+    return done_;
+  }
+
+  void Next() {
+    ++pos_;
+    SkipEmpty();
+  }
+
+  const K& key() const {
+    return dict_->ht_[table_].slots[pos_].key;
+  }
+
+  V& value() const {
+    return dict_->ht_[table_].slots[pos_].value;
+  }
+
+ private:
+  void SkipEmpty();
+
+  DenseDict* dict_;
+  unsigned table_ = 0;
+  size_t pos_ = 0;
+  bool done_ = false;
+};
+
+template <typename K, typename V, typename Hash, typename Eq>
+void DenseDict<K, V, Hash, Eq>::Table::Swap(Table& other) {
+  ctrl.swap(other.ctrl);
+  slots.swap(other.slots);
+  std::swap(mask, other.mask);
+  std::swap(used, other.used);
+  std::swap(deleted, other.deleted);
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+DenseDict<K, V, Hash, Eq>::DenseDict(std::pmr::memory_resource* mr, const Hash& hash,
+                                     const Eq& eq)
+    : mr_(mr ? mr : std::pmr::get_default_resource()),
+      hash_(hash),
+      eq_(eq),
+      ht_{Table{mr_}, Table{mr_}} {
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+size_t DenseDict<K, V, Hash, Eq>::MemoryUsage() const {
+  size_t res = 0;
+  for (const Table& t : ht_) {
+    res += t.ctrl.allocated_size() + t.slots.allocated_size();
+  }
+  return res;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+auto DenseDict<K, V, Hash, Eq>::Insert(const K& key, const V& val) -> std::pair<V*, bool> {
+  assert(scanning_ == 0);
+  RehashStep();
+
+  uint64_t hash = HashOf(key);
+  for (unsigned i = 0; i <= unsigned(rehashing_); ++i) {
+    size_t pos = FindPos(ht_[i], key, hash);
+    if (pos != kNotFound)
+      return {&ht_[i].slots[pos].value, false};
+  }
+
+  if (!ExpandIfNeeded())
+    return {nullptr, false};
+
+  Table& t = ht_[rehashing_];
+  size_t pos = InsertPos(&t, hash);
+  t.ctrl[pos] = Tag(hash);
+  t.slots[pos] = Slot{key, val};
+  ++t.used;
+
+  return {&t.slots[pos].value, true};
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+V* DenseDict<K, V, Hash, Eq>::Find(const K& key) {
+  if (empty())
+    return nullptr;
+
+  RehashStep();
+  uint64_t hash = HashOf(key);
+  for (unsigned i = 0; i <= unsigned(rehashing_); ++i) {
+    size_t pos = FindPos(ht_[i], key, hash);
+    if (pos != kNotFound)
+      return &ht_[i].slots[pos].value;
+  }
+  return nullptr;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+bool DenseDict<K, V, Hash, Eq>::Erase(const K& key) {
+  if (empty())
+    return false;
+
+  RehashStep();
+  uint64_t hash = HashOf(key);
+  for (unsigned i = 0; i <= unsigned(rehashing_); ++i) {
+    size_t pos = FindPos(ht_[i], key, hash);
+    if (pos != kNotFound) {
+      EraseAt(&ht_[i], pos);
+      ShrinkIfNeeded();
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+void DenseDict<K, V, Hash, Eq>::Clear() {
+  assert(pause_ == 0);
+  for (Table& t : ht_) {
+    Table empty{mr_};
+    t.Swap(empty);
+  }
+  rehashing_ = false;
+  rehash_idx_ = 0;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+bool DenseDict<K, V, Hash, Eq>::Reserve(size_t n) {
+  if (rehashing_)
+    return false;
+
+  size_t capacity = std::max(kMinCapacity, absl::bit_ceil(n + n / 3 + 1));
+  if (capacity > ht_[0].capacity())
+    StartRehash(capacity);
+  return true;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+bool DenseDict<K, V, Hash, Eq>::Rehash(size_t n) {
+  if (!rehashing_ || pause_)
+    return rehashing_;
+
+  Table& src = ht_[0];
+  Table& dest = ht_[1];
+
+  // Like redis, limit the number of empty slots visited by a single call.
+  size_t empty_visits = n * 10;
+  for (; n > 0 && src.used > 0; --n) {
+    while (!IsFull(src.ctrl[rehash_idx_])) {
+      ++rehash_idx_;
+      if (--empty_visits == 0)
+        return true;
+    }
+
+    const Slot& slot = src.slots[rehash_idx_];
+    uint64_t hash = HashOf(slot.key);
+    size_t pos = InsertPos(&dest, hash);
+    dest.ctrl[pos] = Tag(hash);
+    dest.slots[pos] = slot;
+    ++dest.used;
+
+    // Lookups in src must still pass through the slot.
+    src.ctrl[rehash_idx_++] = kDeleted;
+    --src.used;
+    ++src.deleted;
+  }
+
+  if (src.used > 0)
+    return true;
+
+  src.Swap(dest);
+  Table empty{mr_};
+  dest.Swap(empty);
+  rehashing_ = false;
+  rehash_idx_ = 0;
+
+  return false;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+template <typename Cb>
+uint64_t DenseDict<K, V, Hash, Eq>::Scan(uint64_t cursor, Cb&& cb) {
+  if (empty())
+    return 0;
+
+  ++pause_;
+  ++scanning_;
+
+  uint64_t v = cursor;
+  if (!rehashing_) {
+    Table* t = &ht_[0];
+    ScanBucket(t, v & t->mask, cb);
+
+    // Increment the reversed cursor, so that the buckets that were already visited are not
+    // visited again if the table grows.
+    v |= ~t->mask;
+    v = Rev(Rev(v) + 1);
+  } else {
+    Table* small = &ht_[0];
+    Table* large = &ht_[1];
+    if (small->mask > large->mask)
+      std::swap(small, large);
+
+    ScanBucket(small, v & small->mask, cb);
+
+    // Visit all the buckets of the large table that the small table bucket expands to.
+    do {
+      ScanBucket(large, v & large->mask, cb);
+      v |= ~large->mask;
+      v = Rev(Rev(v) + 1);
+    } while (v & (small->mask ^ large->mask));
+  }
+
+  --scanning_;
+  --pause_;
+
+  return v;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+template <typename Cb, typename Yield>
+void DenseDict<K, V, Hash, Eq>::Traverse(Cb&& cb, Yield&& yield, unsigned buckets_per_yield) {
+  uint64_t cursor = 0;
+  unsigned buckets = 0;
+  do {
+    cursor = Scan(cursor, cb);
+    if (cursor && ++buckets == buckets_per_yield) {
+      buckets = 0;
+      yield();
+    }
+  } while (cursor);
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+uint64_t DenseDict<K, V, Hash, Eq>::Rev(uint64_t v) {
+  unsigned s = 64;
+  uint64_t mask = ~0ULL;
+  while ((s >>= 1) > 0) {
+    mask ^= (mask << s);
+    v = ((v >> s) & mask) | ((v << s) & ~mask);
+  }
+  return v;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+uint64_t DenseDict<K, V, Hash, Eq>::HashOf(const K& key) const {
+  // MurmurHash3 finalizer. std::hash of integral types is the identity, and the home bucket
+  // uses the low bits of the hash.
+  uint64_t h = hash_(key);
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+size_t DenseDict<K, V, Hash, Eq>::FindPos(const Table& t, const K& key, uint64_t hash) const {
+  if (t.used == 0)
+    return kNotFound;
+
+  uint8_t tag = Tag(hash);
+  for (size_t i = hash & t.mask;; i = (i + 1) & t.mask) {
+    uint8_t ctrl = t.ctrl[i];
+    if (ctrl == kEmpty)
+      return kNotFound;
+    if (ctrl == tag && eq_(t.slots[i].key, key))
+      return i;
+  }
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+size_t DenseDict<K, V, Hash, Eq>::InsertPos(Table* t, uint64_t hash) {
+  size_t i = hash & t->mask;
+  while (IsFull(t->ctrl[i]))
+    i = (i + 1) & t->mask;
+
+  if (t->ctrl[i] == kDeleted)
+    --t->deleted;
+  return i;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+void DenseDict<K, V, Hash, Eq>::EraseAt(Table* t, size_t pos) {
+  --t->used;
+
+  // Tombstones keep the positions of the other entries, which iterators and the rehash index
+  // rely on. Once a table has tombstones, it keeps using them until it is rehashed, since
+  // backward shift can not move entries across them.
+  if (pause_ || t->deleted || (rehashing_ && t == &ht_[0])) {
+    t->ctrl[pos] = kDeleted;
+    ++t->deleted;
+    return;
+  }
+
+  // Backward shift: move the following entries of the cluster closer to their home bucket.
+  size_t hole = pos;
+  for (size_t i = (pos + 1) & t->mask; t->ctrl[i] != kEmpty; i = (i + 1) & t->mask) {
+    size_t home = HashOf(t->slots[i].key) & t->mask;
+
+    // The entry can move to the hole if its home bucket is not in (hole, i].
+    if (((i - home) & t->mask) >= ((i - hole) & t->mask)) {
+      t->ctrl[hole] = t->ctrl[i];
+      t->slots[hole] = t->slots[i];
+      hole = i;
+    }
+  }
+  t->ctrl[hole] = kEmpty;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+bool DenseDict<K, V, Hash, Eq>::ExpandIfNeeded() {
+  if (rehashing_) {
+    Table& dest = ht_[1];
+    size_t load = dest.used + dest.deleted;
+    if (load < dest.capacity() * 3 / 4)
+      return true;
+
+    // Iterators rely on the positions of the entries, allow a higher load instead.
+    if (pause_)
+      return load + 1 < dest.capacity() - dest.capacity() / 16;
+
+    // The writes outpaced the incremental rehash.
+    while (Rehash(1024)) {
+    }
+  }
+
+  Table& t = ht_[0];
+  if (t.used + t.deleted < t.capacity() * 3 / 4)
+    return true;
+
+  if (t.capacity() == 0) {
+    Allocate(kMinCapacity, &t);
+    return true;
+  }
+
+  // If most of the load is tombstones, rehash into a table of the same size.
+  StartRehash(t.deleted > t.used / 2 ? t.capacity() : t.capacity() * 2);
+  return true;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+void DenseDict<K, V, Hash, Eq>::ShrinkIfNeeded() {
+  if (rehashing_ || pause_)
+    return;
+
+  // Like redis, shrink when less than 10% of the table is used.
+  Table& t = ht_[0];
+  if (t.capacity() > kMinCapacity && t.used * 10 < t.capacity()) {
+    StartRehash(std::max(kMinCapacity, absl::bit_ceil(t.used * 2 + 1)));
+  } else if (t.deleted > t.capacity() / 4) {
+    StartRehash(t.capacity());
+  }
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+void DenseDict<K, V, Hash, Eq>::StartRehash(size_t capacity) {
+  assert(!rehashing_);
+
+  Table fresh{mr_};
+  Allocate(capacity, &fresh);
+  if (ht_[0].used == 0) {
+    ht_[0].Swap(fresh);
+    return;
+  }
+
+  ht_[1].Swap(fresh);
+  rehashing_ = true;
+  rehash_idx_ = 0;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+void DenseDict<K, V, Hash, Eq>::Allocate(size_t capacity, Table* t) {
+  assert(absl::has_single_bit(capacity));
+
+  t->ctrl.resize_fill(capacity, kEmpty);
+  t->slots.resize(capacity);
+  t->mask = capacity - 1;
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+template <typename Cb>
+void DenseDict<K, V, Hash, Eq>::ScanBucket(Table* t, size_t bucket, Cb& cb) {
+  if (t->used == 0)
+    return;
+
+  // Linear probing keeps all the entries of a bucket in the cluster that starts at the bucket.
+  for (size_t i = bucket; t->ctrl[i] != kEmpty; i = (i + 1) & t->mask) {
+    if (IsFull(t->ctrl[i]) && (HashOf(t->slots[i].key) & t->mask) == bucket) {
+      Slot& slot = t->slots[i];
+      cb(slot.key, slot.value);
+    }
+  }
+}
+
+template <typename K, typename V, typename Hash, typename Eq>
+void DenseDict<K, V, Hash, Eq>::SafeIterator::SkipEmpty() {
+  while (table_ <= unsigned(dict_->rehashing_)) {
+    const Table& t = dict_->ht_[table_];
+    for (; pos_ < t.capacity(); ++pos_) {
+      if (IsFull(t.ctrl[pos_]))
+        return;
+    }
+    ++table_;
+    pos_ = 0;
+  }
+  done_ = true;
+}
+
+}  // namespace base
@@ -0,0 +1,468 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "base/dense_dict.h"
+
+#include <malloc.h>
+#include <string.h>
+
+#include <random>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#include <absl/strings/str_cat.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "base/pmr/arena.h"
+
+extern "C" {
+#include "examples/redis_dict/alloc.h"
+#include "examples/redis_dict/dict.h"
+}
+
+namespace base {
+
+using namespace std;
+
+using IntDict = DenseDict<uint64_t, uint64_t>;
+
+class DenseDictTest : public testing::Test {
+ protected:
+  // Scans the whole dictionary, calling between() between the buckets.
+  template <typename Between> unordered_set<uint64_t> ScanAll(Between&& between) {
+    unordered_set<uint64_t> res;
+    uint64_t cursor = 0;
+    do {
+      cursor = dict_.Scan(cursor, [&](uint64_t key, uint64_t) { res.insert(key); });
+      between();
+    } while (cursor);
+    return res;
+  }
+
+  IntDict dict_;
+};
+
+TEST_F(DenseDictTest, Basic) {
+  EXPECT_TRUE(dict_.empty());
+  EXPECT_EQ(nullptr, dict_.Find(1));
+  EXPECT_FALSE(dict_.Erase(1));
+  EXPECT_EQ(0, dict_.MemoryUsage());
+
+  auto [val, added] = dict_.Insert(1, 10);
+  ASSERT_TRUE(added);
+  EXPECT_EQ(10, *val);
+
+  tie(val, added) = dict_.Insert(1, 20);
+  EXPECT_FALSE(added);
+  EXPECT_EQ(10, *val);
+  *val = 20;
+  EXPECT_EQ(20, *dict_.Find(1));
+
+  for (uint64_t i = 2; i <= 1000; ++i) {
+    ASSERT_TRUE(dict_.Insert(i, i * 10).second);
+  }
+  EXPECT_EQ(1000, dict_.size());
+  for (uint64_t i = 2; i <= 1000; ++i) {
+    uint64_t* v = dict_.Find(i);
+    ASSERT_TRUE(v);
+    EXPECT_EQ(i * 10, *v);
+  }
+
+  for (uint64_t i = 1; i <= 1000; i += 2) {
+    ASSERT_TRUE(dict_.Erase(i));
+  }
+  EXPECT_EQ(500, dict_.size());
+  for (uint64_t i = 1; i <= 1000; ++i) {
+    EXPECT_EQ(i % 2 == 0, dict_.Find(i) != nullptr);
+  }
+
+  dict_.Clear();
+  EXPECT_TRUE(dict_.empty());
+  EXPECT_EQ(0, dict_.bucket_count());
+}
+
+TEST_F(DenseDictTest, IncrementalRehash) {
+  ASSERT_TRUE(dict_.Reserve(1000));
+  size_t buckets = dict_.bucket_count();
+  EXPECT_FALSE(dict_.IsRehashing());
+
+  uint64_t i = 0;
+  while (!dict_.IsRehashing()) {
+    dict_.Insert(i++, 0);
+  }
+  EXPECT_GE(i, 1000);
+  EXPECT_EQ(buckets * 3, dict_.bucket_count());
+
+  // A single operation moves only a few entries.
+  dict_.Insert(i++, 0);
+  EXPECT_TRUE(dict_.IsRehashing());
+  EXPECT_FALSE(dict_.Reserve(1 << 20));
+
+  for (uint64_t j = 0; j < i; ++j) {
+    ASSERT_TRUE(dict_.Find(j)) << j;
+  }
+
+  while (dict_.Rehash(10)) {
+  }
+  EXPECT_EQ(buckets * 2, dict_.bucket_count());
+  EXPECT_EQ(i, dict_.size());
+
+  // Shrinks once less than 10% of the table is used.
+  for (uint64_t j = 0; j < i - 10; ++j) {
+    ASSERT_TRUE(dict_.Erase(j));
+  }
+  while (dict_.Rehash(10)) {
+  }
+  EXPECT_LT(dict_.bucket_count(), buckets);
+  for (uint64_t j = i - 10; j < i; ++j) {
+    ASSERT_TRUE(dict_.Find(j)) << j;
+  }
+}
+
+TEST_F(DenseDictTest, Random) {
+  unordered_map<uint64_t, uint64_t> expected;
+  mt19937_64 rand(42);
+
+  // A small key space, so that inserts and erases hit existing keys and the table repeatedly
+  // grows and shrinks.
+  for (unsigned i = 0; i < 500000; ++i) {
+    uint64_t key = rand() % (i % 100000 < 50000 ? 20000 : 200);
+    if (rand() % 2) {
+      auto [val, added] = dict_.Insert(key, i);
+      EXPECT_EQ(expected.emplace(key, i).second, added);
+      ASSERT_EQ(expected[key], *val);
+    } else {
+      ASSERT_EQ(expected.erase(key) == 1, dict_.Erase(key));
+    }
+    ASSERT_EQ(expected.size(), dict_.size());
+  }
+
+  for (const auto& [k, v] : expected) {
+    uint64_t* val = dict_.Find(k);
+    ASSERT_TRUE(val);
+    EXPECT_EQ(v, *val);
+  }
+}
+
+TEST_F(DenseDictTest, SafeIterator) {
+  for (uint64_t i = 0; i < 1000; ++i) {
+    dict_.Insert(i, i);
+  }
+  while (dict_.Rehash(100)) {
+  }
+
+  // Erase all even keys and insert new keys during the iteration.
+  unordered_set<uint64_t> visited;
+  for (IntDict::SafeIterator it(&dict_); !it.Done(); it.Next()) {
+    uint64_t key = it.key();
+    ASSERT_TRUE(visited.insert(key).second) << key;
+    if (key < 1000) {
+      ASSERT_EQ(key, it.value());
+      if (key % 2 == 0)
+        ASSERT_TRUE(dict_.Erase(key));
+      ASSERT_TRUE(dict_.Insert(key + 1000, 0).second);
+    }
+  }
+
+  for (uint64_t i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(visited.count(i)) << i;
+  }
+  EXPECT_EQ(1500, dict_.size());
+
+  // Tombstones are cleaned once the iteration is done.
+  for (uint64_t i = 2000; i < 4000; ++i) {
+    dict_.Insert(i, i);
+  }
+  for (uint64_t i = 0; i < 2000; ++i) {
+    EXPECT_EQ(i % 2 == 1 || i >= 1000, dict_.Find(i) != nullptr) << i;
+  }
+}
+
+TEST_F(DenseDictTest, ScanGrowAndShrink) {
+  constexpr uint64_t kNum = 2000;
+  for (uint64_t i = 0; i < kNum; ++i) {
+    dict_.Insert(i, 0);
+  }
+
+  // The table grows several times during the scan.
+  uint64_t next = kNum;
+  auto visited = ScanAll([&] {
+    for (unsigned j = 0; j < 20 && next < kNum * 10; ++j)
+      dict_.Insert(next++, 0);
+  });
+  ASSERT_GT(dict_.bucket_count(), 8192);
+  for (uint64_t i = 0; i < kNum; ++i) {
+    ASSERT_TRUE(visited.count(i)) << i;
+  }
+
+  // And shrinks during the following one.
+  uint64_t erased = kNum;
+  visited = ScanAll([&] {
+    for (unsigned j = 0; j < 20 && erased < next; ++j)
+      dict_.Erase(erased++);
+  });
+  ASSERT_EQ(kNum, dict_.size());
+  for (uint64_t i = 0; i < kNum; ++i) {
+    ASSERT_TRUE(visited.count(i)) << i;
+  }
+}
+
+TEST_F(DenseDictTest, ScanErase) {
+  for (uint64_t i = 0; i < 10000; ++i) {
+    dict_.Insert(i, i);
+  }
+
+  // The callback may erase the entry it visits.
+  uint64_t cursor = 0;
+  unsigned visited = 0;
+  do {
+    cursor = dict_.Scan(cursor, [&](uint64_t key, uint64_t& val) {
+      ++visited;
+      if (key % 2)
+        dict_.Erase(key);
+      else
+        val = 0;
+    });
+  } while (cursor);
+
+  EXPECT_EQ(10000, visited);
+  EXPECT_EQ(5000, dict_.size());
+  for (uint64_t i = 0; i < 10000; i += 2) {
+    ASSERT_EQ(0, *dict_.Find(i));
+  }
+}
+
+TEST_F(DenseDictTest, Traverse) {
+  for (uint64_t i = 0; i < 10000; ++i) {
+    dict_.Insert(i, i);
+  }
+
+  while (dict_.Rehash(100)) {
+  }
+
+  unsigned yields = 0, visited = 0;
+  dict_.Traverse([&](uint64_t, uint64_t) { ++visited; }, [&] { ++yields; }, 100);
+  EXPECT_EQ(10000, visited);
+  EXPECT_EQ(dict_.bucket_count() / 100, yields);
+}
+
+TEST_F(DenseDictTest, ArenaKeys) {
+  PmrArena arena;
+  DenseDict<string_view, uint32_t> dict;
+
+  for (unsigned i = 0; i < 1000; ++i) {
+    string key = absl::StrCat("key:", i);
+    char* ptr = arena.Allocate(key.size());
+    memcpy(ptr, key.data(), key.size());
+    ASSERT_TRUE(dict.Insert(string_view{ptr, key.size()}, i).second);
+  }
+
+  for (unsigned i = 0; i < 1000; ++i) {
+    uint32_t* val = dict.Find(absl::StrCat("key:", i));
+    ASSERT_TRUE(val);
+    EXPECT_EQ(i, *val);
+  }
+  EXPECT_EQ(nullptr, dict.Find("key:1000"));
+}
+
+/* Comparison with the chained redis dict on the same workload. The memory of redis dict is
+   measured by counting its allocations, including the malloc overhead.
+*/
+
+namespace {
+
+size_t redis_dict_memory = 0;
+
+void* CountingMalloc(size_t sz) {
+  void* res = malloc(sz);
+  redis_dict_memory += malloc_usable_size(res);
+  return res;
+}
+
+void* CountingCalloc(size_t num, size_t sz) {
+  void* res = calloc(num, sz);
+  redis_dict_memory += malloc_usable_size(res);
+  return res;
+}
+
+void* CountingRealloc(void* ptr, size_t sz) {
+  redis_dict_memory -= malloc_usable_size(ptr);
+  void* res = realloc(ptr, sz);
+  redis_dict_memory += malloc_usable_size(res);
+  return res;
+}
+
+char* CountingStrdup(const char* str) {
+  char* res = strdup(str);
+  redis_dict_memory += malloc_usable_size(res);
+  return res;
+}
+
+void CountingFree(void* ptr) {
+  redis_dict_memory -= malloc_usable_size(ptr);
+  free(ptr);
+}
+
+unsigned IntHash(const void* key) {
+  uint64_t k = reinterpret_cast<uintptr_t>(key);
+  return (k * 0x9E3779B97F4A7C15ULL) >> 32;
+}
+
+unsigned StrHash(const void* key) {
+  return dictGenHashFunction(reinterpret_cast<const unsigned char*>(key),
+                             strlen(reinterpret_cast<const char*>(key)));
+}
+
+int StrCompare(void*, const void* a, const void* b) {
+  return strcmp(reinterpret_cast<const char*>(a), reinterpret_cast<const char*>(b)) == 0;
+}
+
+void* StrDup(void*, const void* key) {
+  return hi_strdup(reinterpret_cast<const char*>(key));
+}
+
+void StrFree(void*, void* key) {
+  hi_free(key);
+}
+
+dictType int_dict_type = {IntHash, nullptr, nullptr, nullptr, nullptr, nullptr};
+dictType str_dict_type = {StrHash, StrDup, nullptr, StrCompare, StrFree, nullptr};
+
+class CountRedisAllocations {
+ public:
+  CountRedisAllocations() {
+    hiredisAllocFuncs funcs{CountingMalloc, CountingCalloc, CountingRealloc, CountingStrdup,
+                            CountingFree};
+    hiredisSetAllocators(&funcs);
+    redis_dict_memory = 0;
+  }
+
+  ~CountRedisAllocations() {
+    hiredisResetAllocators();
+  }
+};
+
+vector<uint64_t> RandomKeys(size_t num) {
+  vector<uint64_t> keys(num);
+  mt19937_64 rand(num);
+  for (auto& k : keys)
+    k = rand();
+  return keys;
+}
+
+vector<string> StrKeys(size_t num) {
+  vector<string> keys(num);
+  for (size_t i = 0; i < num; ++i)
+    keys[i] = absl::StrCat("key:", i * 7919);
+  return keys;
+}
+
+}  // namespace
+
+static void BM_RedisDictInsert(benchmark::State& state) {
+  CountRedisAllocations counting;
+  vector<uint64_t> keys = RandomKeys(state.range(0));
+  size_t memory = 0;
+
+  while (state.KeepRunning()) {
+    dict* d = dictCreate(&int_dict_type, nullptr);
+    for (uint64_t k : keys)
+      dictAdd(d, reinterpret_cast<void*>(k), nullptr);
+    memory = redis_dict_memory;
+    dictRelease(d);
+  }
+  state.counters["bytes_per_entry"] = double(memory) / keys.size();
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_RedisDictInsert)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+static void BM_DenseDictInsert(benchmark::State& state) {
+  vector<uint64_t> keys = RandomKeys(state.range(0));
+  size_t memory = 0;
+
+  while (state.KeepRunning()) {
+    IntDict d;
+    for (uint64_t k : keys)
+      d.Insert(k, 0);
+
+    // redis dict expands synchronously, compare the memory once the rehash is done.
+    while (d.Rehash(1024)) {
+    }
+    memory = d.MemoryUsage();
+  }
+  state.counters["bytes_per_entry"] = double(memory) / keys.size();
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_DenseDictInsert)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+static void BM_RedisDictFind(benchmark::State& state) {
+  vector<uint64_t> keys = RandomKeys(state.range(0));
+  dict* d = dictCreate(&int_dict_type, nullptr);
+  for (uint64_t k : keys)
+    dictAdd(d, reinterpret_cast<void*>(k), nullptr);
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(dictFind(d, reinterpret_cast<void*>(keys[i])));
+    i = (i + 1) % keys.size();
+  }
+  dictRelease(d);
+}
+BENCHMARK(BM_RedisDictFind)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+static void BM_DenseDictFind(benchmark::State& state) {
+  vector<uint64_t> keys = RandomKeys(state.range(0));
+  IntDict d;
+  for (uint64_t k : keys)
+    d.Insert(k, 0);
+
+  size_t i = 0;
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(d.Find(keys[i]));
+    i = (i + 1) % keys.size();
+  }
+}
+BENCHMARK(BM_DenseDictFind)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+static void BM_RedisDictStrInsert(benchmark::State& state) {
+  CountRedisAllocations counting;
+  vector<string> keys = StrKeys(state.range(0));
+  size_t memory = 0;
+
+  while (state.KeepRunning()) {
+    dict* d = dictCreate(&str_dict_type, nullptr);
+    for (const string& k : keys)
+      dictAdd(d, const_cast<char*>(k.c_str()), nullptr);
+    memory = redis_dict_memory;
+    dictRelease(d);
+  }
+  state.counters["bytes_per_entry"] = double(memory) / keys.size();
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_RedisDictStrInsert)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+static void BM_DenseDictStrInsert(benchmark::State& state) {
+  vector<string> keys = StrKeys(state.range(0));
+  size_t memory = 0;
+
+  while (state.KeepRunning()) {
+    PmrArena arena;
+    DenseDict<string_view, uint64_t> d;
+    for (const string& k : keys) {
+      char* ptr = arena.Allocate(k.size());
+      memcpy(ptr, k.data(), k.size());
+      d.Insert(string_view{ptr, k.size()}, 0);
+    }
+    while (d.Rehash(1024)) {
+    }
+    memory = d.MemoryUsage() + arena.MemoryUsage();
+  }
+  state.counters["bytes_per_entry"] = double(memory) / keys.size();
+  state.SetItemsProcessed(state.iterations() * keys.size());
+}
+BENCHMARK(BM_DenseDictStrInsert)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+}  // namespace base
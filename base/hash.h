@@ -41,6 +41,11 @@ inline uint32_t Fingerprint32(const std::string& str) {
   return uint32_t(res >> 32) ^ uint32_t(res);
 }
 
+// CRC32C (Castagnoli polynomial) of data, extending crc which is 0 for a new checksum, i.e.
+// Crc32c(Crc32c(0, a), b) == Crc32c(0, a + b). Uses the SSE4.2 or ARMv8 crc32c instructions
+// when the target supports them.
+uint32_t Crc32c(uint32_t crc, const void* data, size_t len);
+
 namespace detail {
 
 // Should use std::has_unique_object_representations but we do not have in C++14.
@@ -39,7 +39,7 @@ class IoBuf {
   }
 
   ~IoBuf() {
-    delete[] buf_;
+    operator delete[](buf_, std::align_val_t{alignment_});
   }
 
   // ============== INPUT =======================
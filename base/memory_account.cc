@@ -0,0 +1,63 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "base/memory_account.h"
+
+namespace base {
+
+using namespace std;
+
+MemoryAccount::MemoryAccount(const char* name) : name_(name) {
+  folly::RWSpinLock::WriteHolder guard(list_lock());
+
+  next_ = global_list();
+  if (next_) {
+    next_->prev_ = this;
+  }
+  global_list() = this;
+}
+
+MemoryAccount::~MemoryAccount() {
+  folly::RWSpinLock::WriteHolder guard(list_lock());
+  if (global_list() == this) {
+    global_list() = next_;
+  } else if (prev_) {
+    prev_->next_ = next_;
+  }
+
+  if (next_) {
+    next_->prev_ = prev_;
+  }
+}
+
+void MemoryAccount::Charge(size_t bytes) {
+  int64_t prev = used_.fetch_add(bytes, memory_order_relaxed);
+  live_.fetch_add(1, memory_order_relaxed);
+  total_.fetch_add(1, memory_order_relaxed);
+
+  size_t current = prev + bytes;
+  size_t peak = peak_.load(memory_order_relaxed);
+  while (current > peak && !peak_.compare_exchange_weak(peak, current, memory_order_relaxed)) {
+  }
+}
+
+MemoryAccount*& MemoryAccount::global_list() {
+  static MemoryAccount* account_list = nullptr;
+  return account_list;
+}
+
+folly::RWSpinLock& MemoryAccount::list_lock() {
+  static folly::RWSpinLock lock;
+  return lock;
+}
+
+void MemoryAccount::Iterate(std::function<void(const MemoryAccount&)> cb) {
+  folly::RWSpinLock::ReadHolder guard(list_lock());
+
+  for (const MemoryAccount* node = global_list(); node != nullptr; node = node->next_) {
+    cb(*node);
+  }
+}
+
+}  // namespace base
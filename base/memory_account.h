@@ -0,0 +1,116 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory_resource>
+
+#include "base/RWSpinLock.h"
+
+namespace base {
+
+// Named, process-wide counter of bytes attributed to a subsystem (fiber stacks, io_uring rings,
+// connection buffers etc). Accounting is opt-in: only memory that is explicitly charged
+// to the account is tracked. Accounts are expected to be long-lived, usually static objects.
+class MemoryAccount {
+ public:
+  explicit MemoryAccount(const char* name);
+  ~MemoryAccount();
+
+  MemoryAccount(const MemoryAccount&) = delete;
+  void operator=(const MemoryAccount&) = delete;
+
+  void Charge(size_t bytes);
+
+  void Release(size_t bytes) {
+    used_.fetch_sub(bytes, std::memory_order_relaxed);
+    live_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  const char* name() const {
+    return name_;
+  }
+
+  // Bytes that are currently charged.
+  size_t used() const {
+    int64_t val = used_.load(std::memory_order_relaxed);
+    return val > 0 ? val : 0;
+  }
+
+  // High watermark of used().
+  size_t peak() const {
+    return peak_.load(std::memory_order_relaxed);
+  }
+
+  // Number of live allocations, i.e. Charge calls that were not released yet.
+  int64_t live() const {
+    return live_.load(std::memory_order_relaxed);
+  }
+
+  // Total number of Charge calls.
+  uint64_t total_charges() const {
+    return total_.load(std::memory_order_relaxed);
+  }
+
+  static void Iterate(std::function<void(const MemoryAccount&)> cb);
+
+ private:
+  const char* name_;
+  std::atomic_int64_t used_{0};
+  std::atomic_int64_t live_{0};
+  std::atomic_uint64_t total_{0};
+  std::atomic_size_t peak_{0};
+
+  MemoryAccount* next_ = nullptr;
+  MemoryAccount* prev_ = nullptr;
+
+  // Function-local statics, since accounts of other translation units may be constructed
+  // during static initialization.
+  static MemoryAccount*& global_list();
+  static folly::RWSpinLock& list_lock();
+};
+
+// memory_resource that charges every allocation to the account and forwards it upstream.
+// Can be passed to pmr containers or to PmrArena in order to attribute their memory.
+class TrackingMemoryResource : public std::pmr::memory_resource {
+ public:
+  explicit TrackingMemoryResource(
+      MemoryAccount* account,
+      std::pmr::memory_resource* upstream = std::pmr::get_default_resource())
+      : account_(account), upstream_(upstream) {
+  }
+
+  MemoryAccount* account() const {
+    return account_;
+  }
+
+  std::pmr::memory_resource* upstream() const {
+    return upstream_;
+  }
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) final {
+    void* res = upstream_->allocate(bytes, alignment);
+    account_->Charge(bytes);
+    return res;
+  }
+
+  void do_deallocate(void* ptr, size_t bytes, size_t alignment) final {
+    upstream_->deallocate(ptr, bytes, alignment);
+    account_->Release(bytes);
+  }
+
+  bool do_is_equal(const std::pmr::memory_resource& o) const noexcept final {
+    return this == &o;
+  }
+
+  MemoryAccount* account_;
+  std::pmr::memory_resource* upstream_;
+};
+
+}  // namespace base
@@ -0,0 +1,60 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "base/memory_account.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+using namespace std;
+
+namespace base {
+
+class MemoryAccountTest : public testing::Test {};
+
+TEST_F(MemoryAccountTest, Basic) {
+  MemoryAccount account("test");
+  account.Charge(100);
+  account.Charge(50);
+  EXPECT_EQ(150, account.used());
+  EXPECT_EQ(2, account.live());
+
+  account.Release(100);
+  EXPECT_EQ(50, account.used());
+  EXPECT_EQ(150, account.peak());
+  EXPECT_EQ(1, account.live());
+  EXPECT_EQ(2, account.total_charges());
+}
+
+TEST_F(MemoryAccountTest, Iterate) {
+  vector<string> names;
+  {
+    MemoryAccount a1("a1"), a2("a2");
+    MemoryAccount::Iterate([&](const MemoryAccount& acc) { names.push_back(acc.name()); });
+    EXPECT_NE(find(names.begin(), names.end(), "a1"), names.end());
+    EXPECT_NE(find(names.begin(), names.end(), "a2"), names.end());
+  }
+
+  names.clear();
+  MemoryAccount::Iterate([&](const MemoryAccount& acc) { names.push_back(acc.name()); });
+  EXPECT_EQ(find(names.begin(), names.end(), "a1"), names.end());
+}
+
+TEST_F(MemoryAccountTest, TrackingResource) {
+  MemoryAccount account("pmr");
+  TrackingMemoryResource mr(&account);
+  {
+    std::pmr::vector<uint64_t> vec(&mr);
+    vec.resize(100);
+    EXPECT_GE(account.used(), 800);
+  }
+  EXPECT_EQ(0, account.used());
+  EXPECT_EQ(0, account.live());
+}
+
+}  // namespace base
@@ -33,23 +33,41 @@ Minor changes by Roman Gershman (romange@gmail.com)
 #pragma once
 
 #include <atomic>
+#include <cstdint>
 #include <memory>
 #include <stdexcept>
 
 namespace base {
 
-template <typename T> class mpmc_bounded_queue {
+// If kSpreadCells is true, adjacent cells are placed on different cache lines, so that
+// producers and consumers working on consecutive positions do not false-share. Cells smaller
+// than half a cache line are interleaved, i.e. position i is mapped to a cell on cache line
+// i % num_lines, and larger cells are padded to the cache line size.
+template <typename T, bool kSpreadCells = false> class mpmc_bounded_queue {
+  static constexpr size_t kCacheLine = 64;
+
+  struct raw_cell_t {
+    std::atomic<size_t> sequence;
+    std::aligned_storage_t<sizeof(T)> storage;
+  };
+
+  static constexpr bool kPadCells = kSpreadCells && sizeof(raw_cell_t) > kCacheLine / 2;
+
+  struct alignas(kPadCells ? kCacheLine : alignof(raw_cell_t)) cell_t : public raw_cell_t {};
+
  public:
   using item_type = T;
 
   explicit mpmc_bounded_queue(size_t buffer_size)
-      : buffer_(new cell_t[buffer_size]), buffer_mask_(buffer_size - 1) {
+      : buffer_(new cell_t[buffer_size]),
+        buffer_mask_(buffer_size - 1),
+        index_bits_(__builtin_popcountll(buffer_mask_)) {
     // queue size must be power of two
     if (buffer_size < 2 || (buffer_size & (buffer_size - 1)) != 0)
       throw std::runtime_error("async logger queue size must be power of two");
 
     for (size_t i = 0; i != buffer_size; i += 1)
-      buffer_[i].sequence.store(i, std::memory_order_relaxed);
+      cell(i).sequence.store(i, std::memory_order_relaxed);
 
     enqueue_pos_.store(0, std::memory_order_relaxed);
     dequeue_pos_.store(0, std::memory_order_relaxed);
@@ -61,20 +79,20 @@ template <typename T> class mpmc_bounded_queue {
   ~mpmc_bounded_queue() {
     for (;;) {
       size_t pos = dequeue_pos_.fetch_add(1, std::memory_order_relaxed);
-      cell_t& cell = buffer_[pos & buffer_mask_];
-      size_t seq = cell.sequence.load(std::memory_order_acquire);
+      cell_t& c = cell(pos);
+      size_t seq = c.sequence.load(std::memory_order_acquire);
       intptr_t dif = (intptr_t)seq - intptr_t(pos + 1);
       if (dif < 0) {
         return;
       }
-      reinterpret_cast<T*>(&cell.storage)->~T();
+      reinterpret_cast<T*>(&c.storage)->~T();
     }
   }
 
   bool is_full() const {
     size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
-    cell_t& cell = buffer_[pos & buffer_mask_];
-    intptr_t seq = cell.sequence.load(std::memory_order_relaxed);
+    const cell_t& c = cell(pos);
+    intptr_t seq = c.sequence.load(std::memory_order_relaxed);
     intptr_t dif = seq - intptr_t(pos);
     return dif < 0;
   }
@@ -86,12 +104,12 @@ template <typename T> class mpmc_bounded_queue {
   // Added bonus, it seems we do not need the "const T&" version of this function.
   template <typename U> bool try_enqueue(U&& data) {
     size_t pos;
-    cell_t* cell;
+    cell_t* c;
 
     while (true) {
       pos = enqueue_pos_.load(std::memory_order_relaxed);
-      cell = &buffer_[pos & buffer_mask_];
-      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      c = &cell(pos);
+      size_t seq = c->sequence.load(std::memory_order_acquire);
       intptr_t dif = intptr_t(seq) - intptr_t(pos);
       if (dif == 0) {  // available cell.
         // advance enque index.
@@ -102,19 +120,54 @@ template <typename T> class mpmc_bounded_queue {
       }
     }
 
-    new (&cell->storage) T(std::forward<U>(data));
-    cell->sequence.store(pos + 1, std::memory_order_release);
+    new (&c->storage) T(std::forward<U>(data));
+    c->sequence.store(pos + 1, std::memory_order_release);
     return true;
   }
 
+  // Enqueues up to count items constructed from *first, *(first + 1)... Claims the whole range
+  // with a single CAS. Returns the number of enqueued items, 0 if the queue is full or count is 0.
+  // Pass std::make_move_iterator(...) to move the items.
+  template <typename It> size_t try_enqueue_bulk(It first, size_t count) {
+    if (count == 0)
+      return 0;
+
+    size_t pos, n;
+
+    while (true) {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+      n = 0;
+      while (n < count && cell(pos + n).sequence.load(std::memory_order_acquire) == pos + n)
+        ++n;
+
+      if (n == 0) {
+        intptr_t dif = intptr_t(cell(pos).sequence.load(std::memory_order_relaxed)) - intptr_t(pos);
+        if (dif < 0)
+          return 0;  // the queue is full.
+        continue;
+      }
+
+      // The cells were free and only the producer that claims a position writes its cell.
+      if (enqueue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+        break;
+    }
+
+    for (size_t i = 0; i < n; ++i, ++first) {
+      cell_t& c = cell(pos + i);
+      new (&c.storage) T(*first);
+      c.sequence.store(pos + i + 1, std::memory_order_release);
+    }
+    return n;
+  }
+
   bool try_dequeue(T& data) {
-    cell_t* cell;
+    cell_t* c;
     size_t pos;
 
     for (;;) {
       pos = dequeue_pos_.load(std::memory_order_relaxed);
-      cell = &buffer_[pos & buffer_mask_];
-      size_t seq = cell->sequence.load(std::memory_order_acquire);
+      c = &cell(pos);
+      size_t seq = c->sequence.load(std::memory_order_acquire);
       intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
       if (dif == 0) {
         if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
@@ -124,15 +177,53 @@ template <typename T> class mpmc_bounded_queue {
       }
     }
 
-    T& src = reinterpret_cast<T&>(cell->storage);
+    T& src = reinterpret_cast<T&>(c->storage);
     data = std::forward<T>(src);
     src.~T();
 
     // Commit transaction, free up the cell.
-    cell->sequence.store(pos + buffer_mask_ + 1, std::memory_order_release);
+    c->sequence.store(pos + buffer_mask_ + 1, std::memory_order_release);
     return true;
   }
 
+  // Dequeues up to max_count items into *dest, *(dest + 1)... Claims the whole range with a
+  // single CAS. Returns the number of dequeued items, 0 if the queue is empty or max_count is 0.
+  template <typename OutIt> size_t try_dequeue_bulk(OutIt dest, size_t max_count) {
+    if (max_count == 0)
+      return 0;
+
+    size_t pos, n;
+
+    while (true) {
+      pos = dequeue_pos_.load(std::memory_order_relaxed);
+      n = 0;
+      while (n < max_count &&
+             cell(pos + n).sequence.load(std::memory_order_acquire) == pos + n + 1) {
+        ++n;
+      }
+
+      if (n == 0) {
+        intptr_t dif =
+            intptr_t(cell(pos).sequence.load(std::memory_order_relaxed)) - intptr_t(pos + 1);
+        if (dif < 0)
+          return 0;  // the queue is empty.
+        continue;
+      }
+
+      if (dequeue_pos_.compare_exchange_weak(pos, pos + n, std::memory_order_relaxed))
+        break;
+    }
+
+    for (size_t i = 0; i < n; ++i, ++dest) {
+      cell_t& c = cell(pos + i);
+      T& src = reinterpret_cast<T&>(c.storage);
+      *dest = std::move(src);
+      src.~T();
+      c.sequence.store(pos + i + buffer_mask_ + 1, std::memory_order_release);
+    }
+    return n;
+  }
+
   size_t capacity() const {
     return buffer_mask_ + 1;
   }
@@ -143,23 +234,42 @@ template <typename T> class mpmc_bounded_queue {
   // deques from it.
   bool empty() const {
     size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
-    cell_t* cell = &buffer_[pos & buffer_mask_];
-    size_t seq = cell->sequence.load(std::memory_order_relaxed);
+    const cell_t* c = &cell(pos);
+    size_t seq = c->sequence.load(std::memory_order_relaxed);
     intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
     return dif < 0;
   }
 
  private:
-  struct cell_t {
-    std::atomic<size_t> sequence;
-    std::aligned_storage_t<sizeof(T)> storage;
-  };
+  static constexpr unsigned CellsPerLineShift() {
+    unsigned shift = 0;
+    while ((sizeof(cell_t) << (shift + 1)) <= kCacheLine)
+      ++shift;
+    return shift;
+  }
+
+  // Number of bits to rotate the cell index by, so that consecutive positions are on
+  // different cache lines.
+  static constexpr unsigned kInterleaveShift = kSpreadCells ? CellsPerLineShift() : 0;
+
+  cell_t& cell(size_t pos) const {
+    size_t index = pos & buffer_mask_;
+    if constexpr (kInterleaveShift > 0) {
+      // Rotate left within the index bits. Capacities below cells per line are not spread.
+      if (index_bits_ > kInterleaveShift) {
+        index = ((index << kInterleaveShift) | (index >> (index_bits_ - kInterleaveShift))) &
+                buffer_mask_;
+      }
+    }
+    return buffer_[index];
+  }
 
   typedef char cacheline_pad_t[64];
 
   cacheline_pad_t pad0_;
   std::unique_ptr<cell_t[]> buffer_;
   size_t const buffer_mask_;
+  unsigned const index_bits_;
   cacheline_pad_t pad1_;
   std::atomic<size_t> enqueue_pos_;
   cacheline_pad_t pad2_;
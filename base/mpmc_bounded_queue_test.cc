@@ -5,6 +5,9 @@
 #include "base/mpmc_bounded_queue.h"
 
 #include <memory>
+#include <thread>
+#include <vector>
+
 #include "base/gtest.h"
 #include "base/logging.h"
 
@@ -106,4 +109,171 @@ TEST_F(MPMCTest, Moveable) {
   EXPECT_EQ(0, Moveable::ref);
 }
 
+TEST_F(MPMCTest, Bulk) {
+  mpmc_bounded_queue<int> q(8);
+  int src[10];
+  for (int i = 0; i < 10; ++i)
+    src[i] = i;
+
+  // Zero counts return right away, even when a cell is free or an item is ready.
+  ASSERT_EQ(0, q.try_enqueue_bulk(src, 0));
+  ASSERT_EQ(0, q.try_dequeue_bulk(src, 0));
+  ASSERT_EQ(5, q.try_enqueue_bulk(src, 5));
+  ASSERT_EQ(0, q.try_enqueue_bulk(src, 0));
+  ASSERT_EQ(0, q.try_dequeue_bulk(src, 0));
+  ASSERT_EQ(3, q.try_enqueue_bulk(src + 5, 5));
+  ASSERT_TRUE(q.is_full());
+  ASSERT_EQ(0, q.try_enqueue_bulk(src, 1));
+
+  int dest[10] = {0};
+  ASSERT_EQ(6, q.try_dequeue_bulk(dest, 6));
+  ASSERT_EQ(2, q.try_enqueue_bulk(src + 8, 2));
+  ASSERT_EQ(4, q.try_dequeue_bulk(dest + 6, 10));
+  ASSERT_EQ(0, q.try_dequeue_bulk(dest, 10));
+  ASSERT_TRUE(q.empty());
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_EQ(i, dest[i]);
+  }
+
+  // Moves only the enqueued items.
+  mpmc_bounded_queue<Moveable> mq(2);
+  vector<Moveable> items(3);
+  EXPECT_EQ(2, mq.try_enqueue_bulk(make_move_iterator(items.begin()), items.size()));
+  EXPECT_EQ(5, Moveable::ref);
+
+  vector<Moveable> out;
+  EXPECT_EQ(2, mq.try_dequeue_bulk(back_inserter(out), 4));
+  EXPECT_EQ(5, Moveable::ref);
+  items.clear();
+  out.clear();
+  EXPECT_EQ(0, Moveable::ref);
+}
+
+TEST_F(MPMCTest, SpreadCells) {
+  // Small cells are interleaved, large cells are padded.
+  for (size_t capacity : {2, 4, 16, 1024}) {
+    mpmc_bounded_queue<uint32_t, true> q(capacity);
+    for (unsigned round = 0; round < 3; ++round) {
+      for (uint32_t i = 0; i < capacity; ++i) {
+        ASSERT_TRUE(q.try_enqueue(i));
+      }
+      ASSERT_TRUE(q.is_full());
+      for (uint32_t i = 0; i < capacity; ++i) {
+        uint32_t val = 0;
+        ASSERT_TRUE(q.try_dequeue(val));
+        ASSERT_EQ(i, val);
+      }
+      ASSERT_TRUE(q.empty());
+    }
+  }
+
+  {
+    mpmc_bounded_queue<A, true> q(4);
+    for (unsigned i = 0; i < 3; ++i) {
+      EXPECT_TRUE(q.try_enqueue(A{}));
+    }
+    EXPECT_EQ(3, A::ref);
+  }
+  EXPECT_EQ(0, A::ref);
+}
+
+// Producers and consumers that use the bulk functions with different batch sizes.
+TEST_F(MPMCTest, BulkThreads) {
+  constexpr unsigned kThreads = 4;
+  constexpr uint64_t kPerThread = 100000;
+
+  mpmc_bounded_queue<uint64_t, true> q(64);
+  vector<thread> threads;
+  atomic<uint64_t> sum{0}, count{0};
+
+  for (unsigned i = 0; i < kThreads; ++i) {
+    threads.emplace_back([&, i] {
+      uint64_t batch[8];
+      size_t batch_size = i + 1;
+      for (uint64_t j = 0; j < kPerThread;) {
+        size_t n = min<size_t>(batch_size, kPerThread - j);
+        for (size_t k = 0; k < n; ++k)
+          batch[k] = j + k;
+        size_t res = q.try_enqueue_bulk(batch, n);
+        if (res == 0)
+          this_thread::yield();
+        j += res;
+      }
+    });
+
+    threads.emplace_back([&, i] {
+      uint64_t batch[8];
+      while (count.load(memory_order_relaxed) < kThreads * kPerThread) {
+        size_t res = q.try_dequeue_bulk(batch, i + 2);
+        if (res == 0) {
+          this_thread::yield();
+          continue;
+        }
+        for (size_t k = 0; k < res; ++k)
+          sum.fetch_add(batch[k], memory_order_relaxed);
+        count.fetch_add(res, memory_order_relaxed);
+      }
+    });
+  }
+
+  for (auto& t : threads)
+    t.join();
+
+  EXPECT_EQ(kThreads * kPerThread, count.load());
+  EXPECT_EQ(kThreads * kPerThread * (kPerThread - 1) / 2, sum.load());
+  EXPECT_TRUE(q.empty());
+}
+
+// Multiple producers and a single consumer, similarly to ProactorBase::FuncQ.
+// Arguments: batch size, producer threads.
+template <typename Q> void BM_Contention(benchmark::State& state) {
+  using T = typename Q::item_type;
+
+  const size_t batch_size = state.range(0);
+  const unsigned num_producers = state.range(1);
+  constexpr unsigned kItems = 1 << 16;
+
+  while (state.KeepRunning()) {
+    Q q(256);
+    vector<thread> producers;
+    for (unsigned i = 0; i < num_producers; ++i) {
+      producers.emplace_back([&] {
+        vector<T> batch(batch_size);
+        for (unsigned j = 0; j < kItems;) {
+          size_t res = batch_size == 1
+                           ? q.try_enqueue(T{})
+                           : q.try_enqueue_bulk(batch.data(), min<size_t>(batch_size, kItems - j));
+          if (res == 0)
+            this_thread::yield();
+          j += res;
+        }
+      });
+    }
+
+    vector<T> batch(batch_size);
+    for (size_t total = 0; total < kItems * num_producers;) {
+      size_t res = batch_size == 1 ? q.try_dequeue(batch[0])
+                                   : q.try_dequeue_bulk(batch.data(), batch_size);
+      if (res == 0)
+        this_thread::yield();
+      total += res;
+    }
+
+    for (auto& t : producers)
+      t.join();
+  }
+  state.SetItemsProcessed(state.iterations() * kItems * num_producers);
+}
+
+struct Item32 {
+  uint64_t val[4];
+};
+
+#define CONTENTION_ARGS ArgsProduct({{1, 8}, {1, 2, 4}})->UseRealTime()
+
+BENCHMARK_TEMPLATE(BM_Contention, mpmc_bounded_queue<uint64_t>)->CONTENTION_ARGS;
+BENCHMARK_TEMPLATE(BM_Contention, mpmc_bounded_queue<uint64_t, true>)->CONTENTION_ARGS;
+BENCHMARK_TEMPLATE(BM_Contention, mpmc_bounded_queue<Item32>)->CONTENTION_ARGS;
+BENCHMARK_TEMPLATE(BM_Contention, mpmc_bounded_queue<Item32, true>)->CONTENTION_ARGS;
+
 }  // namespace base
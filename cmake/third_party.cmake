@@ -305,6 +305,23 @@ add_third_party(
 )
 
 
+add_third_party(
+  zstd
+  URL https://github.com/facebook/zstd/releases/download/v1.5.5/zstd-1.5.5.tar.gz
+  SOURCE_SUBDIR build/cmake
+  CMAKE_PASS_FLAGS "-DCMAKE_POSITION_INDEPENDENT_CODE=ON -DCMAKE_INSTALL_LIBDIR=lib \
+                    -DZSTD_BUILD_SHARED=OFF -DZSTD_BUILD_PROGRAMS=OFF -DZSTD_BUILD_TESTS=OFF"
+)
+
+add_third_party(
+  lz4
+  URL https://github.com/lz4/lz4/archive/refs/tags/v1.9.4.tar.gz
+  SOURCE_SUBDIR build/cmake
+  CMAKE_PASS_FLAGS "-DCMAKE_POSITION_INDEPENDENT_CODE=ON -DCMAKE_INSTALL_LIBDIR=lib \
+                    -DBUILD_SHARED_LIBS=OFF -DBUILD_STATIC_LIBS=ON -DLZ4_BUILD_CLI=OFF \
+                    -DLZ4_BUILD_LEGACY_LZ4C=OFF"
+)
+
 add_third_party(
   uring
   URL https://github.com/axboe/liburing/archive/refs/tags/liburing-2.2.tar.gz
@@ -16,6 +16,7 @@
 #include "base/init.h"
 #include "util/accept_server.h"
 #include "util/asio_stream_adapter.h"
+#include "util/concurrency_limiter.h"
 #include "util/http/http_handler.h"
 #include "util/varz.h"
 
@@ -74,9 +75,18 @@ ABSL_FLAG(bool, raw, true,
           "If true, does not send/receive size parameter during "
           "the connection handshake");
 ABSL_FLAG(bool, tcp_nodelay, false, "if true - use tcp_nodelay option for server sockets");
+ABSL_FLAG(uint32, max_connections, 0, "Maximum number of echo connections, 0 for unlimited");
+ABSL_FLAG(uint32, max_proactor_connections, 0,
+          "Maximum number of echo connections per thread, 0 for unlimited");
+ABSL_FLAG(bool, limiter, false,
+          "If true, the server sheds requests above an adaptive concurrency limit by responding "
+          "with an empty message. Requires --raw=false");
+ABSL_FLAG(uint32, work_usec, 0,
+          "Server cpu time per request, spent in 10us slices that yield to other connections");
 
 VarzQps ping_qps("ping-qps");
 VarzCount connections("connections");
+ProactorConcurrencyLimiter request_limiter("request-limiter");
 
 namespace {
 
@@ -186,6 +196,20 @@ std::error_code EchoConnection::ReadMsg(size_t* sz) {
 
 static thread_local base::Histogram send_hist;
 
+// Simulates request processing that shares the cpu with other connections.
+static void DoWork(uint32_t usec) {
+  constexpr uint32_t kSliceUsec = 10;
+
+  while (usec > 0) {
+    uint32_t slice = std::min(usec, kSliceUsec);
+    uint64_t until = absl::GetCurrentTimeNanos() + slice * 1000ULL;
+    while (absl::GetCurrentTimeNanos() < until) {
+    }
+    usec -= slice;
+    ThisFiber::Yield();
+  }
+}
+
 void EchoConnection::HandleRequests() {
   ThisFiber::SetName("HandleRequests");
 
@@ -209,6 +233,8 @@ void EchoConnection::HandleRequests() {
   VLOG(1) << "New connection from " << ep;
 
   bool is_raw = GetFlag(FLAGS_raw);
+  bool use_limiter = GetFlag(FLAGS_limiter);
+  uint32_t work_usec = GetFlag(FLAGS_work_usec);
 
   if (is_raw) {
     req_len_ = GetFlag(FLAGS_size);
@@ -244,6 +270,22 @@ void EchoConnection::HandleRequests() {
     CHECK(!ec) << ec;
     ping_qps.Inc();
 
+    optional<AdaptiveConcurrencyLimiter::Permit> permit;
+    if (use_limiter) {
+      permit.emplace(request_limiter.local());
+      if (!*permit) {
+        // Shed requests get an empty response.
+        absl::little_endian::Store32(buf, 0);
+        ec = socket_->Write(io::Bytes(buf, 4));
+        if (ec)
+          break;
+        continue;
+      }
+    }
+
+    if (work_usec)
+      DoWork(work_usec);
+
     vec[0].iov_base = buf;
     vec[0].iov_len = 4;
     absl::little_endian::Store32(buf, sz);
@@ -282,11 +324,21 @@ class EchoListener : public ListenerInterface {
 void RunServer(ProactorPool* pp) {
   ping_qps.Init(pp);
   connections.Init(pp);
+  CHECK(!GetFlag(FLAGS_limiter) || !GetFlag(FLAGS_raw)) << "--limiter requires --raw=false";
+  request_limiter.Init(pp);
 
   AcceptServer acceptor(pp);
   acceptor.set_back_log(GetFlag(FLAGS_backlog));
 
-  acceptor.AddListener(GetFlag(FLAGS_port), new EchoListener);
+  EchoListener* echo_listener = new EchoListener;
+  echo_listener->SetMaxConnections(GetFlag(FLAGS_max_connections),
+                                   GetFlag(FLAGS_max_proactor_connections));
+  VarzFunction rejected_conns("rejected-connections", [echo_listener] {
+    VarzFunction::KeyValMap res;
+    res.emplace_back("rejected", base::VarzValue::FromInt(echo_listener->num_rejected()));
+    return res;
+  });
+  acceptor.AddListener(GetFlag(FLAGS_port), echo_listener);
   if (GetFlag(FLAGS_http_port) >= 0) {
     uint16_t port = acceptor.AddListener(GetFlag(FLAGS_http_port), new HttpListener<>);
     LOG(INFO) << "Started http server on port " << port;
@@ -341,6 +393,8 @@ void RunServer(ProactorPool* pp) {
   LOG(INFO) << "Send histogram " << send_res.ToString();
 }
 
+atomic_uint64_t shed_reqs{0}, rejected_conns{0};
+
 class Driver {
   std::unique_ptr<LinuxSocketBase> socket_;
 
@@ -354,6 +408,7 @@ class Driver {
 
  private:
   uint8_t buf_[8];
+  bool rejected_ = false;
 };
 
 Driver::Driver(ProactorBase* p) {
@@ -396,20 +451,28 @@ void Driver::Connect(unsigned index, const tcp::endpoint& ep) {
     delta_msec = (absl::GetCurrentTimeNanos() - start2) / 1000000;
     LOG_IF(ERROR, delta_msec > 2000) << "Slow connect3 " << index << " " << delta_msec << " ms";
 
-    if (es) {
-      CHECK_EQ(1U, es.value());
+    if (es && es.value() == 1) {
       break;
     }
 
     // There could be scenario where tcp Connect succeeds, but socket in fact is not really
     // connected (which I suspect happens due to small accept queue) and
     // we discover this upon first Recv. I am not sure why it happens. Right now I retry.
-    CHECK(es.error() == std::errc::connection_reset) << es.error();
+    // An empty read means that the server rejected the connection.
+    CHECK(!es || es.value() == 0) << es.value();
+    CHECK(es || es.error() == std::errc::connection_reset) << es.error();
 
     socket_->Close();
     LOG(WARNING) << "Driver " << index << " retries";
   }
 
+  if (iter == kMaxIter && !is_raw) {
+    LOG(WARNING) << "Driver " << index << " was rejected";
+    rejected_ = true;
+    rejected_conns.fetch_add(1, memory_order_relaxed);
+    return;
+  }
+
   int bufferlen = 1 << 14;
   CHECK_EQ(0, setsockopt(socket_->native_handle(), SOL_SOCKET, SO_SNDBUF, &bufferlen,
                          sizeof(bufferlen)));
@@ -421,6 +484,9 @@ void Driver::Connect(unsigned index, const tcp::endpoint& ep) {
 }
 
 size_t Driver::Run(base::Histogram* dest) {
+  if (rejected_)
+    return 0;
+
   base::Histogram hist;
 
   std::unique_ptr<uint8_t[]> msg(new uint8_t[absl::GetFlag(FLAGS_size)]);
@@ -458,6 +524,7 @@ size_t Driver::Run(base::Histogram* dest) {
     if (conn_close)
       break;
 
+    size_t served = 0;
     for (size_t j = 0; j < pipeline_cnt; ++j) {
       // DVLOG(1) << "Recv " << lep << " " << i;
       if (!is_raw) {
@@ -468,19 +535,30 @@ size_t Driver::Run(base::Histogram* dest) {
         }
 
         CHECK(es.has_value()) << "RecvError: " << es.error() << "/" << lep;
+        if (absl::little_endian::Load32(buf_) == 0) {
+          shed_reqs.fetch_add(1, memory_order_relaxed);
+          continue;
+        }
       }
 
       ::boost::system::error_code ec;
       size_t sz = ::boost::asio::read(
           adapter, ::boost::asio::buffer(msg.get(), absl::GetFlag(FLAGS_size)), ec);
 
+      if (ec == ::boost::asio::error::eof || ec == ::boost::asio::error::connection_reset) {
+        conn_close = true;  // rejected by the server.
+        break;
+      }
       CHECK(!ec) << ec.message();
       CHECK_EQ(sz, absl::GetFlag(FLAGS_size));
+      ++served;
     }
 
     uint64_t dur = absl::GetCurrentTimeNanos() - start;
 
-    hist.Add(dur / 1000);
+    // Fast failures of shed requests do not count towards the latency.
+    if (served)
+      hist.Add(dur / 1000);
     if (conn_close)
       break;
   }
@@ -610,6 +688,8 @@ int main(int argc, char* argv[]) {
     CONSOLE_INFO << "Total time " << dur_ms << " ms, num reqs: " << num_reqs.load()
                  << " qps: " << (num_reqs.load() * 1000 / dur_ms) << "\n";
     CONSOLE_INFO << "Overall latency (usec) \n" << lat_hist.ToString();
+    CONSOLE_INFO << "Shed requests: " << shed_reqs.load()
+                 << ", rejected connections: " << rejected_conns.load() << "\n";
   }
   pp->Stop();
 
@@ -0,0 +1,527 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+// Measures the throughput and the enqueue-to-dequeue latency of the queues in base/ and of
+// SimpleChannel, for different numbers of producers and consumers and payload sizes.
+//
+// Example:
+//   queue_bench --queues=mpmc,channel_mpmc --producers=1,4 --consumers=1,4 --payloads=16,256 \
+//     --pin --numa=cross
+//
+// Queues:
+//   mpmc          base::mpmc_bounded_queue, spinning on try_enqueue/try_dequeue.
+//   mpsc          base::MPSCIntrusiveQueue, each producer recycles a ring of nodes.
+//   spsc          folly::ProducerConsumerQueue, runs only with a single producer and consumer.
+//   ring          base::RingBuffer, single threaded: the same thread fills and drains it.
+//   channel_spsc  SimpleChannel over folly::ProducerConsumerQueue, blocking Push/Pop.
+//   channel_mpmc  SimpleChannel over base::mpmc_bounded_queue, blocking Push/Pop.
+
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
+
+#include <array>
+#include <atomic>
+#include <fstream>
+#include <functional>
+#include <memory>
+
+#include "base/ProducerConsumerQueue.h"
+#include "base/histogram.h"
+#include "base/init.h"
+#include "base/logging.h"
+#include "base/mpmc_bounded_queue.h"
+#include "base/mpsc_intrusive_queue.h"
+#include "base/pthread_utils.h"
+#include "base/ring_buffer.h"
+#include "util/fibers/simple_channel.h"
+
+using namespace std;
+
+ABSL_FLAG(string, queues, "mpmc,mpsc,spsc,ring,channel_spsc,channel_mpmc",
+          "Comma separated list of queues to benchmark");
+ABSL_FLAG(string, producers, "1,2,4", "Comma separated list of producer thread counts");
+ABSL_FLAG(string, consumers, "1,2,4", "Comma separated list of consumer thread counts");
+ABSL_FLAG(string, payloads, "16,64,256",
+          "Comma separated list of message sizes: 16, 64, 256 or 1024");
+ABSL_FLAG(uint64_t, ops, 1 << 20, "Number of messages each producer sends");
+ABSL_FLAG(uint32_t, capacity, 1024, "Queue capacity, must be a power of 2");
+ABSL_FLAG(uint32_t, sample_every, 64, "Measure the latency of every n-th message");
+ABSL_FLAG(bool, pin, false, "Pin each producer and consumer thread to its own cpu");
+ABSL_FLAG(string, numa, "any",
+          "With --pin: 'any' takes the cpus in order, 'same' places all the threads on a single "
+          "NUMA node and 'cross' places producers and consumers on different nodes");
+
+#ifdef USE_FB2
+using util::fb2::SimpleChannel;
+#else
+using util::fibers_ext::SimpleChannel;
+#endif
+
+namespace {
+
+inline void CpuPause() {
+#if defined(__i386__) || defined(__amd64__)
+  __asm__ __volatile__("pause");
+#elif defined(__aarch64__)
+  __asm__ __volatile__("isb");
+#endif
+}
+
+// Spins first, then yields the cpu, since the other side can not make progress when the threads
+// share cpus.
+class Backoff {
+ public:
+  void Wait() {
+    if (++spins_ < 64) {
+      CpuPause();
+    } else {
+      spins_ = 0;
+      sched_yield();
+    }
+  }
+
+ private:
+  unsigned spins_ = 0;
+};
+
+inline uint64_t NowNs() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+template <size_t N> struct Msg {
+  static_assert(N >= 16);
+
+  uint64_t ts_ns;  // 0 if the latency of the message is not sampled.
+  uint64_t seq;    // The producer index is kept in the high 16 bits.
+  array<char, N - 16> data;
+};
+
+constexpr unsigned kProducerShift = 48;
+
+template <size_t N> struct Node {
+  using Ptr = Node*;
+
+  atomic<Node*> next{nullptr};
+  Msg<N> msg;
+};
+
+template <size_t N> Node<N>* MPSC_intrusive_load_next(const Node<N>& src) {
+  return src.next.load(memory_order_acquire);
+}
+
+// next_node is not deduced, so that nullptr can be passed.
+template <size_t N>
+void MPSC_intrusive_store_next(Node<N>* dest, typename Node<N>::Ptr next_node) {
+  dest->next.store(next_node, memory_order_release);
+}
+
+struct Config {
+  unsigned producers;
+  unsigned consumers;
+  uint64_t ops;
+  uint32_t capacity;
+  uint32_t sample_every;
+};
+
+struct Result {
+  uint64_t msgs = 0;
+  double secs = 0;
+  base::Histogram latency;
+};
+
+vector<unsigned> ParseList(string_view flag_name, const string& val) {
+  vector<unsigned> res;
+  for (string_view item : absl::StrSplit(val, ',', absl::SkipEmpty())) {
+    unsigned num;
+    CHECK(absl::SimpleAtoi(item, &num)) << "Invalid --" << flag_name << " " << val;
+    res.push_back(num);
+  }
+  return res;
+}
+
+// Parses the cpulist format of sysfs, e.g. "0-3,8-11".
+vector<int> ParseCpuList(string_view list) {
+  vector<int> res;
+  for (string_view range : absl::StrSplit(list, ',', absl::SkipWhitespace())) {
+    vector<string_view> ends = absl::StrSplit(range, '-');
+    int from, to;
+    if (!absl::SimpleAtoi(ends[0], &from))
+      continue;
+    if (ends.size() < 2 || !absl::SimpleAtoi(ends[1], &to))
+      to = from;
+    for (int cpu = from; cpu <= to; ++cpu)
+      res.push_back(cpu);
+  }
+  return res;
+}
+
+// Returns the allowed cpus of each NUMA node. Machines without NUMA have a single node.
+vector<vector<int>> NumaNodes() {
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  CHECK_EQ(0, sched_getaffinity(0, sizeof(allowed), &allowed));
+
+  vector<vector<int>> nodes;
+  for (unsigned node = 0;; ++node) {
+    ifstream is(absl::StrCat("/sys/devices/system/node/node", node, "/cpulist"));
+    if (!is)
+      break;
+    string line;
+    getline(is, line);
+
+    vector<int> cpus;
+    for (int cpu : ParseCpuList(line)) {
+      if (CPU_ISSET(cpu, &allowed))
+        cpus.push_back(cpu);
+    }
+    if (!cpus.empty())
+      nodes.push_back(std::move(cpus));
+  }
+
+  if (nodes.empty()) {
+    nodes.emplace_back();
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+      if (CPU_ISSET(cpu, &allowed))
+        nodes.back().push_back(cpu);
+    }
+  }
+  return nodes;
+}
+
+// Returns the cpus of the producers followed by the cpus of the consumers, -1 for unpinned.
+vector<int> AssignCpus(unsigned producers, unsigned consumers) {
+  unsigned total = producers + consumers;
+  vector<int> res(total, -1);
+  if (!absl::GetFlag(FLAGS_pin))
+    return res;
+
+  static const vector<vector<int>> nodes = NumaNodes();
+  string numa = absl::GetFlag(FLAGS_numa);
+
+  vector<int> prod_cpus, cons_cpus;
+  if (numa == "cross" && nodes.size() > 1) {
+    prod_cpus = nodes[0];
+    cons_cpus = nodes[1];
+  } else {
+    if (numa == "cross")
+      LOG_FIRST_N(WARNING, 1) << "Single NUMA node, --numa=cross falls back to 'same'";
+    vector<int> all;
+    if (numa == "any") {
+      for (const auto& node : nodes)
+        all.insert(all.end(), node.begin(), node.end());
+    } else {
+      all = nodes[0];
+    }
+    if (all.size() >= total) {
+      prod_cpus.assign(all.begin(), all.begin() + producers);
+      cons_cpus.assign(all.begin() + producers, all.end());
+    } else {
+      prod_cpus = cons_cpus = all;
+    }
+  }
+
+  if (prod_cpus.size() < producers || cons_cpus.size() < consumers) {
+    LOG_FIRST_N(WARNING, 1) << "Not enough cpus, some threads share cpus";
+  }
+  for (unsigned i = 0; i < producers; ++i)
+    res[i] = prod_cpus[i % prod_cpus.size()];
+  for (unsigned i = 0; i < consumers; ++i)
+    res[producers + i] = cons_cpus[i % cons_cpus.size()];
+  return res;
+}
+
+// Runs the producers and the consumers on their own threads. The clock starts once all the
+// threads are ready. consume returns the number of messages it received.
+Result RunThreads(const Config& cfg, function<void(unsigned)> produce,
+                  function<uint64_t(unsigned, base::Histogram*)> consume) {
+  vector<int> cpus = AssignCpus(cfg.producers, cfg.consumers);
+  vector<base::Histogram> hist(cfg.consumers);
+  vector<uint64_t> received(cfg.consumers, 0);
+  vector<pthread_t> threads;
+  atomic_uint32_t ready{0};
+  atomic_bool go{false};
+
+  auto start_thread = [&](string name, int cpu, function<void()> f) {
+    pthread_t tid = base::StartThread(name.c_str(), [&ready, &go, f = std::move(f)] {
+      ready.fetch_add(1, memory_order_relaxed);
+      for (Backoff backoff; !go.load(memory_order_acquire);)
+        backoff.Wait();
+      f();
+    });
+    if (cpu >= 0) {
+      cpu_set_t cps;
+      CPU_ZERO(&cps);
+      CPU_SET(cpu, &cps);
+      PTHREAD_CHECK(setaffinity_np(tid, sizeof(cps), &cps));
+    }
+    threads.push_back(tid);
+  };
+
+  for (unsigned i = 0; i < cfg.producers; ++i) {
+    start_thread(absl::StrCat("producer", i), cpus[i], [&produce, i] { produce(i); });
+  }
+  for (unsigned i = 0; i < cfg.consumers; ++i) {
+    start_thread(absl::StrCat("consumer", i), cpus[cfg.producers + i],
+                 [&, i] { received[i] = consume(i, &hist[i]); });
+  }
+
+  for (Backoff backoff; ready.load(memory_order_relaxed) < threads.size();)
+    backoff.Wait();
+
+  uint64_t start = NowNs();
+  go.store(true, memory_order_release);
+  for (pthread_t tid : threads) {
+    PTHREAD_CHECK(join(tid, nullptr));
+  }
+
+  Result res;
+  res.secs = (NowNs() - start) / 1e9;
+  for (unsigned i = 0; i < cfg.consumers; ++i) {
+    res.msgs += received[i];
+    res.latency.Merge(hist[i]);
+  }
+  CHECK_EQ(res.msgs, cfg.producers * cfg.ops);
+  return res;
+}
+
+template <size_t N> Msg<N> MakeMsg(const Config& cfg, unsigned producer, uint64_t seq) {
+  Msg<N> msg;
+  msg.seq = seq | (uint64_t(producer) << kProducerShift);
+  msg.ts_ns = seq % cfg.sample_every == 0 ? NowNs() : 0;
+  return msg;
+}
+
+template <size_t N> inline void Record(const Msg<N>& msg, base::Histogram* hist) {
+  if (msg.ts_ns)
+    hist->Add(NowNs() - msg.ts_ns);
+}
+
+// Spinning producers and consumers over a non-blocking queue. push(producer, msg) and
+// pop(msg) return false if the queue is full or empty respectively.
+template <size_t N, typename Push, typename Pop>
+Result RunSpinning(const Config& cfg, Push push, Pop pop) {
+  atomic_uint32_t producers_done{0};
+
+  auto produce = [&](unsigned id) {
+    for (uint64_t seq = 0; seq < cfg.ops; ++seq) {
+      Msg<N> msg = MakeMsg<N>(cfg, id, seq);
+      for (Backoff backoff; !push(id, msg);)
+        backoff.Wait();
+    }
+    producers_done.fetch_add(1, memory_order_release);
+  };
+
+  auto consume = [&](unsigned, base::Histogram* hist) {
+    uint64_t cnt = 0;
+    Msg<N> msg;
+    Backoff backoff;
+    while (true) {
+      if (pop(&msg)) {
+        Record(msg, hist);
+        ++cnt;
+        backoff = Backoff{};
+        continue;
+      }
+
+      // Once all the producers are done, an empty queue stays empty.
+      if (producers_done.load(memory_order_acquire) == cfg.producers) {
+        while (pop(&msg)) {
+          Record(msg, hist);
+          ++cnt;
+        }
+        return cnt;
+      }
+      backoff.Wait();
+    }
+  };
+
+  return RunThreads(cfg, produce, consume);
+}
+
+template <size_t N> Result RunMPMC(const Config& cfg) {
+  base::mpmc_bounded_queue<Msg<N>> q(cfg.capacity);
+  return RunSpinning<N>(
+      cfg, [&](unsigned, const Msg<N>& msg) { return q.try_enqueue(msg); },
+      [&](Msg<N>* msg) { return q.try_dequeue(*msg); });
+}
+
+template <size_t N> Result RunSPSC(const Config& cfg) {
+  folly::ProducerConsumerQueue<Msg<N>> q(cfg.capacity);
+  return RunSpinning<N>(
+      cfg, [&](unsigned, const Msg<N>& msg) { return q.write(msg); },
+      [&](Msg<N>* msg) { return q.read(*msg); });
+}
+
+// The queue is intrusive, so each producer owns capacity nodes and reuses a node once the
+// consumer has copied its message.
+template <size_t N> Result RunMPSC(const Config& cfg) {
+  struct alignas(64) NodeRing {
+    unique_ptr<Node<N>[]> nodes;
+    uint64_t sent = 0;
+    alignas(64) atomic_uint64_t consumed{0};
+  };
+
+  base::MPSCIntrusiveQueue<Node<N>> q;
+  vector<NodeRing> rings(cfg.producers);
+  for (auto& ring : rings)
+    ring.nodes.reset(new Node<N>[cfg.capacity]);
+
+  auto push = [&](unsigned id, const Msg<N>& msg) {
+    NodeRing& ring = rings[id];
+    if (ring.sent - ring.consumed.load(memory_order_acquire) >= cfg.capacity)
+      return false;
+    Node<N>* node = &ring.nodes[ring.sent++ % cfg.capacity];
+    node->msg = msg;
+    q.Push(node);
+    return true;
+  };
+
+  auto pop = [&](Msg<N>* msg) {
+    Node<N>* node = q.Pop();
+    if (!node)
+      return false;
+    *msg = node->msg;
+    rings[msg->seq >> kProducerShift].consumed.fetch_add(1, memory_order_release);
+    return true;
+  };
+
+  return RunSpinning<N>(cfg, push, pop);
+}
+
+template <size_t N, typename Queue> Result RunChannel(const Config& cfg) {
+  SimpleChannel<Msg<N>, Queue> channel(cfg.capacity, cfg.producers);
+
+  auto produce = [&](unsigned id) {
+    for (uint64_t seq = 0; seq < cfg.ops; ++seq) {
+      channel.Push(MakeMsg<N>(cfg, id, seq));
+    }
+    channel.StartClosing();
+  };
+
+  auto consume = [&](unsigned, base::Histogram* hist) {
+    uint64_t cnt = 0;
+    Msg<N> msg;
+    while (channel.Pop(msg)) {
+      Record(msg, hist);
+      ++cnt;
+    }
+    return cnt;
+  };
+
+  return RunThreads(cfg, produce, consume);
+}
+
+// RingBuffer is not thread-safe, the same thread fills it and drains it.
+template <size_t N> Result RunRing(const Config& cfg) {
+  base::RingBuffer<Msg<N>> ring(cfg.capacity);
+  Result res;
+  Msg<N> msg;
+
+  uint64_t start = NowNs();
+  for (uint64_t seq = 0; seq < cfg.ops; ++seq) {
+    Msg<N> src = MakeMsg<N>(cfg, 0, seq);
+    if (ring.TryEmplace(src))
+      continue;
+
+    while (ring.TryDeque(msg))
+      Record(msg, &res.latency);
+    ring.TryEmplace(src);
+  }
+  while (ring.TryDeque(msg))
+    Record(msg, &res.latency);
+
+  res.secs = (NowNs() - start) / 1e9;
+  res.msgs = cfg.ops;
+  return res;
+}
+
+template <size_t N> void RunPayload(string_view queue, const Config& cfg) {
+  Result res;
+  bool single = cfg.producers == 1 && cfg.consumers == 1;
+
+  if (queue == "mpmc") {
+    res = RunMPMC<N>(cfg);
+  } else if (queue == "mpsc") {
+    if (cfg.consumers != 1)
+      return;
+    res = RunMPSC<N>(cfg);
+  } else if (queue == "spsc") {
+    if (!single)
+      return;
+    res = RunSPSC<N>(cfg);
+  } else if (queue == "ring") {
+    if (!single)
+      return;
+    res = RunRing<N>(cfg);
+  } else if (queue == "channel_spsc") {
+    if (!single)
+      return;
+    res = RunChannel<N, folly::ProducerConsumerQueue<Msg<N>>>(cfg);
+  } else if (queue == "channel_mpmc") {
+    res = RunChannel<N, base::mpmc_bounded_queue<Msg<N>>>(cfg);
+  } else {
+    LOG(FATAL) << "Unknown queue " << queue;
+  }
+
+  const base::Histogram& lat = res.latency;
+  printf("%-13s %4u %4u %6zu %10.2f %8.1f %9.0f %9.0f %9.0f %10.0f\n", string(queue).c_str(),
+         cfg.producers, cfg.consumers, N, res.msgs / res.secs / 1e6, res.secs * 1e9 / res.msgs,
+         lat.Percentile(50), lat.Percentile(99), lat.Percentile(99.9), lat.max());
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  MainInitGuard guard(&argc, &argv);
+
+  Config cfg;
+  cfg.ops = absl::GetFlag(FLAGS_ops);
+  cfg.capacity = absl::GetFlag(FLAGS_capacity);
+  cfg.sample_every = max(1u, absl::GetFlag(FLAGS_sample_every));
+  CHECK(cfg.capacity >= 2 && (cfg.capacity & (cfg.capacity - 1)) == 0)
+      << "--capacity must be a power of 2";
+
+  vector<unsigned> producers = ParseList("producers", absl::GetFlag(FLAGS_producers));
+  vector<unsigned> consumers = ParseList("consumers", absl::GetFlag(FLAGS_consumers));
+  vector<unsigned> payloads = ParseList("payloads", absl::GetFlag(FLAGS_payloads));
+  vector<string> queues = absl::StrSplit(absl::GetFlag(FLAGS_queues), ',', absl::SkipEmpty());
+
+  printf("%-13s %4s %4s %6s %10s %8s %9s %9s %9s %10s\n", "queue", "prod", "cons", "bytes",
+         "Mops/s", "ns/op", "p50_ns", "p99_ns", "p999_ns", "max_ns");
+
+  for (const string& queue : queues) {
+    for (unsigned payload : payloads) {
+      for (unsigned p : producers) {
+        for (unsigned c : consumers) {
+          cfg.producers = p;
+          cfg.consumers = c;
+          switch (payload) {
+            case 16:
+              RunPayload<16>(queue, cfg);
+              break;
+            case 64:
+              RunPayload<64>(queue, cfg);
+              break;
+            case 256:
+              RunPayload<256>(queue, cfg);
+              break;
+            case 1024:
+              RunPayload<1024>(queue, cfg);
+              break;
+            default:
+              LOG(FATAL) << "Unsupported payload size " << payload;
+          }
+        }
+      }
+    }
+  }
+
+  return 0;
+}
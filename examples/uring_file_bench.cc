@@ -0,0 +1,308 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+// fio-like random read benchmark for uring files. Measures how many random-read IOPS a single
+// UringProactor drives per core. Each thread runs its own proactor that keeps --iodepth reads
+// of --bs bytes in flight against a local file, resubmitting from the completion callbacks.
+//
+// Example:
+//   uring_file_bench --path=/mnt/nvme/bench.dat --file_size=4294967296 --iodepth=128
+//     --fixed_buffers --registered_files --iopoll --threads=2
+//
+// --iopoll requires --direct and a device with polled queues, for example NVMe with
+// nvme.poll_queues set. Otherwise the reads fail with EOPNOTSUPP.
+
+#include <absl/strings/str_cat.h>
+#include <absl/time/clock.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <random>
+#include <thread>
+
+#include "base/flags.h"
+#include "base/histogram.h"
+#include "base/init.h"
+#include "base/logging.h"
+#include "util/fibers/synchronization.h"
+#include "util/fibers/uring_proactor.h"
+#include "util/uring/uring_file.h"
+
+using namespace std;
+using namespace util;
+using fb2::UringProactor;
+
+ABSL_DECLARE_FLAG(bool, proactor_register_fd);
+
+ABSL_FLAG(string, path, "uring_file_bench.dat",
+          "File to read from. Created or extended to --file_size if it is smaller");
+ABSL_FLAG(uint64_t, file_size, 1ULL << 30, "Size of the file region to read from");
+ABSL_FLAG(uint32_t, bs, 4096, "Block size of each read");
+ABSL_FLAG(uint32_t, iodepth, 32, "Number of reads in flight per thread");
+ABSL_FLAG(uint32_t, threads, 1, "Number of threads, each running its own proactor");
+ABSL_FLAG(uint32_t, runtime, 10, "Duration of the benchmark in seconds");
+ABSL_FLAG(uint32_t, ring_size, 256, "Size of the io_uring submission queue, a power of 2");
+ABSL_FLAG(bool, direct, true, "Open the file with O_DIRECT, bypassing the page cache");
+ABSL_FLAG(bool, fixed_buffers, false, "Use registered buffers with READ_FIXED");
+ABSL_FLAG(bool, registered_files, false, "Register the file with the ring");
+ABSL_FLAG(bool, iopoll, false, "Create the rings with IORING_SETUP_IOPOLL");
+
+namespace {
+
+struct Params {
+  uint64_t num_blocks;
+  uint32_t bs;
+  uint32_t iodepth;
+  uint64_t duration_ns;
+  bool fixed_buffers;
+};
+
+struct Result {
+  uint64_t ios = 0;
+  uint64_t errors = 0;
+  base::Histogram lat_usec;
+  UringProactor::SubmitStats submit_stats;
+};
+
+// Keeps params.iodepth random reads in flight on the proactor of the calling fiber. Like the
+// io_uring engine of fio, completions resubmit the next read directly from the proactor loop.
+class RandReadEngine {
+ public:
+  // fd is a fixed file index if fixed_fd is true.
+  RandReadEngine(UringProactor* proactor, int fd, bool fixed_fd, const Params& params,
+                 unsigned seed)
+      : proactor_(proactor), fd_(fd), fixed_fd_(fixed_fd), params_(params), rand_(seed) {
+  }
+
+  Result Run();
+
+ private:
+  struct Slot {
+    uint8_t* buf = nullptr;
+    int buf_index = -1;  // Index of the registered buffer, -1 for plain reads.
+    uint64_t start_ns = 0;
+  };
+
+  void Submit(Slot* slot);
+  void OnComplete(Slot* slot, UringProactor::IoResult res);
+
+  UringProactor* proactor_;
+  int fd_;
+  bool fixed_fd_;
+  Params params_;
+  mt19937_64 rand_;
+
+  uint64_t deadline_ns_ = 0;
+  fb2::BlockingCounter done_{0};
+  Result result_;
+};
+
+Result RandReadEngine::Run() {
+  vector<Slot> slots(params_.iodepth);
+  vector<fb2::RegisteredBufferPool::Buffer> leased;
+  unique_ptr<uint8_t, decltype(&free)> arena(nullptr, &free);
+
+  if (params_.fixed_buffers) {
+    fb2::RegisteredBufferPool::Options opts;
+    opts.classes = {{params_.bs, params_.iodepth}};
+    int res = proactor_->RegisterBufferPool(opts);
+    CHECK_EQ(0, res) << "Could not register buffers: " << strerror(res);
+
+    for (Slot& slot : slots) {
+      leased.push_back(proactor_->buffer_pool()->Lease(params_.bs));
+      CHECK(leased.back());
+      slot.buf = leased.back().data();
+      slot.buf_index = leased.back().buf_index();
+    }
+  } else {
+    // O_DIRECT requires aligned buffers.
+    size_t len = size_t(params_.bs) * params_.iodepth;
+    arena.reset(reinterpret_cast<uint8_t*>(aligned_alloc(4096, (len + 4095) & ~4095ULL)));
+    CHECK(arena);
+    for (unsigned i = 0; i < slots.size(); ++i) {
+      slots[i].buf = arena.get() + size_t(i) * params_.bs;
+    }
+  }
+
+  UringProactor::SubmitStats start_stats = proactor_->GetSubmitStats();
+  deadline_ns_ = absl::GetCurrentTimeNanos() + params_.duration_ns;
+  done_.Add(slots.size());
+  for (Slot& slot : slots) {
+    Submit(&slot);
+  }
+  done_.Wait();
+
+  UringProactor::SubmitStats stats = proactor_->GetSubmitStats();
+  result_.submit_stats.enter_calls = stats.enter_calls - start_stats.enter_calls;
+  result_.submit_stats.submitted = stats.submitted - start_stats.submitted;
+  return std::move(result_);
+}
+
+void RandReadEngine::Submit(Slot* slot) {
+  uint64_t offset = (rand_() % params_.num_blocks) * params_.bs;
+  auto cb = [this, slot](fb2::detail::FiberInterface*, UringProactor::IoResult res, uint32_t) {
+    OnComplete(slot, res);
+  };
+
+  slot->start_ns = absl::GetCurrentTimeNanos();
+  fb2::SubmitEntry se = proactor_->GetSubmitEntry(std::move(cb));
+  if (slot->buf_index >= 0) {
+    se.PrepReadFixed(fd_, slot->buf, params_.bs, offset, slot->buf_index);
+  } else {
+    se.PrepRead(fd_, slot->buf, params_.bs, offset);
+  }
+  if (fixed_fd_) {
+    se.sqe()->flags |= IOSQE_FIXED_FILE;
+  }
+}
+
+void RandReadEngine::OnComplete(Slot* slot, UringProactor::IoResult res) {
+  uint64_t now = absl::GetCurrentTimeNanos();
+  if (res == int(params_.bs)) {
+    ++result_.ios;
+    result_.lat_usec.Add((now - slot->start_ns) / 1000);
+  } else {
+    ++result_.errors;
+    LOG_FIRST_N(ERROR, 10) << "Read failed: "
+                           << (res < 0 ? strerror(-res) : absl::StrCat("short read ", res));
+  }
+
+  if (now < deadline_ns_) {
+    Submit(slot);
+  } else {
+    done_.Dec();
+  }
+}
+
+// Fills the file with non-zero data up to size bytes.
+void PrepareFile(const string& path, uint64_t size) {
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0 && uint64_t(st.st_size) >= size)
+    return;
+
+  LOG(INFO) << "Preparing " << path << " of " << size << " bytes";
+  int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+  CHECK_GE(fd, 0) << "Could not open " << path << ": " << strerror(errno);
+
+  string chunk(1 << 20, '\0');
+  mt19937_64 rand(0);
+  for (size_t i = 0; i < chunk.size(); i += 8) {
+    uint64_t val = rand();
+    memcpy(&chunk[i], &val, 8);
+  }
+
+  for (uint64_t offset = 0; offset < size; offset += chunk.size()) {
+    size_t len = min<uint64_t>(chunk.size(), size - offset);
+    CHECK_EQ(ssize_t(len), pwrite(fd, chunk.data(), len, offset)) << strerror(errno);
+  }
+  CHECK_EQ(0, fsync(fd));
+  close(fd);
+}
+
+Result RunThread(UringProactor* proactor, const string& path, const Params& params,
+                 unsigned index) {
+  int flags = O_RDONLY | O_CLOEXEC | (absl::GetFlag(FLAGS_direct) ? O_DIRECT : 0);
+  auto file = fb2::OpenLinux(path, flags, 0);
+  CHECK(file) << "Could not open " << path << ": " << file.error().message();
+
+  int fd = (*file)->fd();
+  bool fixed_fd = absl::GetFlag(FLAGS_registered_files);
+  if (fixed_fd) {
+    fd = proactor->RegisterFd(fd);
+  }
+
+  RandReadEngine engine(proactor, fd, fixed_fd, params, index + 1);
+  Result res = engine.Run();
+
+  if (fixed_fd) {
+    proactor->UnregisterFd(fd);
+  }
+  (*file)->Close();
+  return res;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+  MainInitGuard guard(&argc, &argv);
+
+  string path = absl::GetFlag(FLAGS_path);
+  Params params;
+  params.bs = absl::GetFlag(FLAGS_bs);
+  params.iodepth = absl::GetFlag(FLAGS_iodepth);
+  params.duration_ns = absl::GetFlag(FLAGS_runtime) * 1000000000ULL;
+  params.fixed_buffers = absl::GetFlag(FLAGS_fixed_buffers);
+  params.num_blocks = absl::GetFlag(FLAGS_file_size) / params.bs;
+
+  CHECK_GT(params.bs, 0u);
+  CHECK_GT(params.iodepth, 0u);
+  CHECK_GT(params.num_blocks, 0u) << "--file_size must be at least --bs";
+  CHECK(!absl::GetFlag(FLAGS_direct) || params.bs % 512 == 0)
+      << "--bs must be a multiple of 512 with --direct";
+  CHECK(!absl::GetFlag(FLAGS_iopoll) || absl::GetFlag(FLAGS_direct)) << "--iopoll needs --direct";
+
+  PrepareFile(path, params.num_blocks * params.bs);
+
+  // Proactors read the flag in Init.
+  if (absl::GetFlag(FLAGS_registered_files)) {
+    absl::SetFlag(&FLAGS_proactor_register_fd, true);
+  }
+
+  unsigned num_threads = max(1u, absl::GetFlag(FLAGS_threads));
+  vector<unique_ptr<UringProactor>> proactors(num_threads);
+  vector<thread> threads;
+  for (unsigned i = 0; i < num_threads; ++i) {
+    proactors[i].reset(new UringProactor);
+    threads.emplace_back([p = proactors[i].get(), i] {
+      p->SetIndex(i);
+      p->Init(absl::GetFlag(FLAGS_ring_size), -1, absl::GetFlag(FLAGS_iopoll));
+      p->Run();
+    });
+  }
+
+  vector<Result> results(num_threads);
+  vector<thread> runners;
+  for (unsigned i = 0; i < num_threads; ++i) {
+    runners.emplace_back([&, i] {
+      UringProactor* p = proactors[i].get();
+      results[i] = p->Await([&] { return RunThread(p, path, params, i); });
+    });
+  }
+  for (auto& t : runners) {
+    t.join();
+  }
+
+  for (unsigned i = 0; i < num_threads; ++i) {
+    proactors[i]->Stop();
+    threads[i].join();
+  }
+
+  Result total;
+  for (const Result& res : results) {
+    total.ios += res.ios;
+    total.errors += res.errors;
+    total.lat_usec.Merge(res.lat_usec);
+    total.submit_stats.enter_calls += res.submit_stats.enter_calls;
+    total.submit_stats.submitted += res.submit_stats.submitted;
+  }
+
+  double secs = absl::GetFlag(FLAGS_runtime);
+  double iops = total.ios / secs;
+  CONSOLE_INFO << "bs=" << params.bs << " iodepth=" << params.iodepth
+               << " threads=" << num_threads << " direct=" << absl::GetFlag(FLAGS_direct)
+               << " fixed_buffers=" << params.fixed_buffers
+               << " registered_files=" << absl::GetFlag(FLAGS_registered_files)
+               << " iopoll=" << absl::GetFlag(FLAGS_iopoll);
+  CONSOLE_INFO << "IOPS: " << uint64_t(iops) << ", per thread: " << uint64_t(iops / num_threads)
+               << ", bandwidth: " << iops * params.bs / (1 << 20) << " MB/s"
+               << ", errors: " << total.errors;
+  CONSOLE_INFO << "Latency usec avg/p50/p99/p99.9/max: " << total.lat_usec.Average() << "/"
+               << total.lat_usec.Percentile(50) << "/" << total.lat_usec.Percentile(99) << "/"
+               << total.lat_usec.Percentile(99.9) << "/" << total.lat_usec.max();
+  CONSOLE_INFO << "sqes per io_uring_enter: " << total.submit_stats.per_enter();
+
+  return 0;
+}
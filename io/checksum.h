@@ -0,0 +1,192 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include "base/hash.h"
+#include "io/file.h"
+
+namespace io {
+
+// Incremental checksums for the pass-through adapters below.
+class Crc32cHasher {
+ public:
+  void Update(Bytes data) {
+    crc_ = base::Crc32c(crc_, data.data(), data.size());
+  }
+
+  uint32_t Digest() const {
+    return crc_;
+  }
+
+  void Reset() {
+    crc_ = 0;
+  }
+
+ private:
+  uint32_t crc_ = 0;
+};
+
+class Xxh3Hasher {
+ public:
+  Xxh3Hasher() {
+    Reset();
+  }
+
+  void Update(Bytes data) {
+    XXH3_64bits_update(&state_, data.data(), data.size());
+  }
+
+  uint64_t Digest() const {
+    return XXH3_64bits_digest(&state_);
+  }
+
+  void Reset() {
+    XXH3_64bits_reset(&state_);
+  }
+
+ private:
+  XXH3_state_t state_;
+};
+
+namespace detail {
+
+// Hashes the first n bytes of the io vector.
+template <typename Hasher> void HashPrefix(const iovec* v, size_t n, Hasher* hasher) {
+  for (; n > 0; ++v) {
+    size_t sz = std::min(n, v->iov_len);
+    hasher->Update(Bytes{static_cast<const uint8_t*>(v->iov_base), sz});
+    n -= sz;
+  }
+}
+
+}  // namespace detail
+
+// Checksums the data while it is written into upstream, so that no separate pass is needed.
+// Only the bytes accepted by upstream are hashed.
+template <typename Hasher> class ChecksumSink final : public Sink {
+ public:
+  // Does not take ownership over upstream.
+  explicit ChecksumSink(Sink* upstream) : upstream_(upstream) {
+  }
+
+  using Sink::WriteSome;
+  Result<size_t> WriteSome(const iovec* v, uint32_t len) final {
+    Result<size_t> res = upstream_->WriteSome(v, len);
+    if (res) {
+      detail::HashPrefix(v, *res, &hasher_);
+      size_ += *res;
+    }
+    return res;
+  }
+
+  auto digest() const {
+    return hasher_.Digest();
+  }
+
+  // Number of bytes that were checksummed.
+  uint64_t size() const {
+    return size_;
+  }
+
+  void Reset(Sink* upstream) {
+    upstream_ = upstream;
+    hasher_.Reset();
+    size_ = 0;
+  }
+
+ private:
+  Sink* upstream_;
+  Hasher hasher_;
+  uint64_t size_ = 0;
+};
+
+// Checksums the data while it is read from upstream.
+template <typename Hasher> class ChecksumSource final : public Source {
+ public:
+  // Does not take ownership over upstream.
+  explicit ChecksumSource(Source* upstream) : upstream_(upstream) {
+  }
+
+  using Source::ReadSome;
+  Result<size_t> ReadSome(const iovec* v, uint32_t len) final {
+    Result<size_t> res = upstream_->ReadSome(v, len);
+    if (res) {
+      detail::HashPrefix(v, *res, &hasher_);
+      size_ += *res;
+    }
+    return res;
+  }
+
+  auto digest() const {
+    return hasher_.Digest();
+  }
+
+  uint64_t size() const {
+    return size_;
+  }
+
+  void Reset(Source* upstream) {
+    upstream_ = upstream;
+    hasher_.Reset();
+    size_ = 0;
+  }
+
+ private:
+  Source* upstream_;
+  Hasher hasher_;
+  uint64_t size_ = 0;
+};
+
+// Checksums the prefix of the file that was read sequentially: digest() covers
+// the range [0, size()). Reads at other offsets pass through without hashing, so reading a
+// file in order with a single outstanding read yields the checksum of the whole file.
+template <typename Hasher> class ChecksumReadonlyFile final : public ReadonlyFile {
+ public:
+  // Does not take ownership over upstream.
+  explicit ChecksumReadonlyFile(ReadonlyFile* upstream) : upstream_(upstream) {
+  }
+
+  using ReadonlyFile::Read;
+  Result<size_t> Read(size_t offset, const iovec* v, uint32_t len) final {
+    Result<size_t> res = upstream_->Read(offset, v, len);
+    if (res && offset == size_) {
+      detail::HashPrefix(v, *res, &hasher_);
+      size_ += *res;
+    }
+    return res;
+  }
+
+  std::error_code Close() final {
+    return upstream_->Close();
+  }
+
+  size_t Size() const final {
+    return upstream_->Size();
+  }
+
+  int Handle() const final {
+    return upstream_->Handle();
+  }
+
+  auto digest() const {
+    return hasher_.Digest();
+  }
+
+  uint64_t size() const {
+    return size_;
+  }
+
+ private:
+  ReadonlyFile* upstream_;
+  Hasher hasher_;
+  uint64_t size_ = 0;
+};
+
+using Crc32cSink = ChecksumSink<Crc32cHasher>;
+using Crc32cSource = ChecksumSource<Crc32cHasher>;
+using Xxh3Sink = ChecksumSink<Xxh3Hasher>;
+using Xxh3Source = ChecksumSource<Xxh3Hasher>;
+
+}  // namespace io
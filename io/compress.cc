@@ -0,0 +1,333 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "io/compress.h"
+
+#include <lz4frame.h>
+#include <zstd.h>
+
+#include <cstring>
+
+#include "base/logging.h"
+
+using namespace std;
+
+namespace io {
+
+using nonstd::make_unexpected;
+
+namespace {
+
+// LZ4 input is compressed in chunks so that the output buffer can hold the worst case.
+constexpr size_t kLz4Chunk = 64 << 10;
+
+LZ4F_preferences_t Lz4Prefs(int level) {
+  LZ4F_preferences_t prefs;
+  memset(&prefs, 0, sizeof(prefs));
+  prefs.compressionLevel = level;
+  prefs.frameInfo.blockSizeID = LZ4F_max64KB;
+  prefs.frameInfo.contentChecksumFlag = LZ4F_contentChecksumEnabled;
+  return prefs;
+}
+
+inline void RunOffloaded(const OffloadFn& offload, absl::FunctionRef<void()> cb) {
+  if (offload)
+    offload(cb);
+  else
+    cb();
+}
+
+}  // namespace
+
+CompressSinkBase::CompressSinkBase(Sink* upstream, size_t out_capacity)
+    : upstream_(upstream), out_buf_(new uint8_t[out_capacity]), out_capacity_(out_capacity) {
+}
+
+Result<size_t> CompressSinkBase::WriteSome(const iovec* v, uint32_t len) {
+  size_t total = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    error_code ec = Run(CONTINUE, Bytes{static_cast<const uint8_t*>(v[i].iov_base), v[i].iov_len});
+    if (ec)
+      return make_unexpected(ec);
+    total += v[i].iov_len;
+  }
+  return total;
+}
+
+error_code CompressSinkBase::Flush() {
+  return Run(FLUSH, Bytes{});
+}
+
+error_code CompressSinkBase::Close() {
+  return Run(END, Bytes{});
+}
+
+void CompressSinkBase::Reset(Sink* upstream) {
+  ResetContext();
+  upstream_ = upstream;
+  out_size_ = 0;
+  bytes_in_ = bytes_out_ = 0;
+}
+
+error_code CompressSinkBase::Run(Op op, Bytes src) {
+  while (true) {
+    MutableBytes out{out_buf_.get() + out_size_, out_capacity_ - out_size_};
+    size_t src_size = src.size();
+    Result<bool> res;
+
+    RunOffloaded(offload_, [&] { res = Compress(op, &src, &out); });
+    if (!res)
+      return res.error();
+
+    bytes_in_ += src_size - src.size();
+    out_size_ = out_capacity_ - out.size();
+
+    // Compressed data is accumulated in the output buffer to reduce the number of upstream
+    // writes.
+    if (*res)
+      return op == CONTINUE ? error_code{} : WriteOut();
+
+    // The output buffer is full.
+    DCHECK_GT(out_size_, 0u);
+    error_code ec = WriteOut();
+    if (ec)
+      return ec;
+  }
+}
+
+error_code CompressSinkBase::WriteOut() {
+  if (out_size_ == 0)
+    return {};
+
+  error_code ec = upstream_->Write(Bytes{out_buf_.get(), out_size_});
+  if (ec)
+    return ec;
+  bytes_out_ += out_size_;
+  out_size_ = 0;
+  return {};
+}
+
+DecompressSourceBase::DecompressSourceBase(Source* upstream, size_t in_capacity)
+    : upstream_(upstream), in_buf_(new uint8_t[in_capacity]), in_capacity_(in_capacity) {
+}
+
+Result<size_t> DecompressSourceBase::ReadSome(const iovec* v, uint32_t len) {
+  size_t total = 0;
+
+  for (uint32_t i = 0; i < len; ++i) {
+    MutableBytes out{static_cast<uint8_t*>(v[i].iov_base), v[i].iov_len};
+
+    while (!out.empty()) {
+      size_t src_size = pending_.size(), out_size = out.size();
+      error_code ec;
+
+      RunOffloaded(offload_, [&] { ec = Decompress(&pending_, &out, &frame_done_); });
+      if (ec)
+        return make_unexpected(ec);
+
+      total += out_size - out.size();
+      if (src_size != pending_.size() || out_size != out.size())
+        continue;
+
+      // No progress - the decompressor needs more input. Do not block on upstream
+      // if we already have something to return.
+      if (total > 0)
+        return total;
+
+      if (eof_) {
+        if (!frame_done_) {
+          VLOG(1) << "Compressed stream is truncated";
+          return make_unexpected(make_error_code(errc::illegal_byte_sequence));
+        }
+        return 0;
+      }
+
+      // Keep the unconsumed tail, if any, and read after it.
+      size_t tail = pending_.size();
+      if (tail)
+        memmove(in_buf_.get(), pending_.data(), tail);
+      auto res = upstream_->ReadSome(MutableBytes{in_buf_.get() + tail, in_capacity_ - tail});
+      if (!res)
+        return make_unexpected(res.error());
+      eof_ = (*res == 0);
+      pending_ = Bytes{in_buf_.get(), tail + *res};
+    }
+  }
+
+  return total;
+}
+
+void DecompressSourceBase::Reset(Source* upstream) {
+  ResetContext();
+  upstream_ = upstream;
+  pending_ = Bytes{};
+  frame_done_ = true;
+  eof_ = false;
+}
+
+ZstdSink::ZstdSink(Sink* upstream) : ZstdSink(upstream, ZSTD_CLEVEL_DEFAULT) {
+}
+
+ZstdSink::ZstdSink(Sink* upstream, int level)
+    : CompressSinkBase(upstream, ZSTD_CStreamOutSize()), cctx_(ZSTD_createCCtx()) {
+  CHECK(cctx_);
+  size_t rc = ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, level);
+  CHECK(!ZSTD_isError(rc)) << ZSTD_getErrorName(rc);
+}
+
+ZstdSink::~ZstdSink() {
+  ZSTD_freeCCtx(cctx_);
+}
+
+Result<bool> ZstdSink::Compress(Op op, Bytes* src, MutableBytes* out) {
+  static constexpr ZSTD_EndDirective kDirective[] = {ZSTD_e_continue, ZSTD_e_flush, ZSTD_e_end};
+
+  ZSTD_inBuffer in{src->data(), src->size(), 0};
+  ZSTD_outBuffer output{out->data(), out->size(), 0};
+  size_t rc = ZSTD_compressStream2(cctx_, &output, &in, kDirective[op]);
+  if (ZSTD_isError(rc)) {
+    LOG(ERROR) << "zstd compression failed: " << ZSTD_getErrorName(rc);
+    return make_unexpected(make_error_code(errc::io_error));
+  }
+
+  *src = src->subspan(in.pos);
+  *out = out->subspan(output.pos);
+  return op == CONTINUE ? src->empty() : rc == 0;
+}
+
+void ZstdSink::ResetContext() {
+  ZSTD_CCtx_reset(cctx_, ZSTD_reset_session_only);
+}
+
+ZstdSource::ZstdSource(Source* upstream)
+    : DecompressSourceBase(upstream, ZSTD_DStreamInSize()), dctx_(ZSTD_createDCtx()) {
+  CHECK(dctx_);
+}
+
+ZstdSource::~ZstdSource() {
+  ZSTD_freeDCtx(dctx_);
+}
+
+error_code ZstdSource::Decompress(Bytes* src, MutableBytes* out, bool* frame_done) {
+  ZSTD_inBuffer in{src->data(), src->size(), 0};
+  ZSTD_outBuffer output{out->data(), out->size(), 0};
+  size_t rc = ZSTD_decompressStream(dctx_, &output, &in);
+  if (ZSTD_isError(rc)) {
+    VLOG(1) << "zstd decompression failed: " << ZSTD_getErrorName(rc);
+    return make_error_code(errc::illegal_byte_sequence);
+  }
+
+  // A call without progress starts waiting for the next frame.
+  if (in.pos || output.pos)
+    *frame_done = (rc == 0);
+  *src = src->subspan(in.pos);
+  *out = out->subspan(output.pos);
+  return {};
+}
+
+void ZstdSource::ResetContext() {
+  ZSTD_DCtx_reset(dctx_, ZSTD_reset_session_only);
+}
+
+Lz4Sink::Lz4Sink(Sink* upstream) : Lz4Sink(upstream, 0) {
+}
+
+Lz4Sink::Lz4Sink(Sink* upstream, int level)
+    : CompressSinkBase(upstream, [level] {
+        LZ4F_preferences_t prefs = Lz4Prefs(level);
+        return LZ4F_compressBound(kLz4Chunk, &prefs) + LZ4F_HEADER_SIZE_MAX;
+      }()),
+      level_(level) {
+  LZ4F_errorCode_t rc = LZ4F_createCompressionContext(&cctx_, LZ4F_VERSION);
+  CHECK(!LZ4F_isError(rc)) << LZ4F_getErrorName(rc);
+}
+
+Lz4Sink::~Lz4Sink() {
+  LZ4F_freeCompressionContext(cctx_);
+}
+
+Result<bool> Lz4Sink::Compress(Op op, Bytes* src, MutableBytes* out) {
+  LZ4F_preferences_t prefs = Lz4Prefs(level_);
+  auto advance = [out](size_t rc) -> bool {
+    if (LZ4F_isError(rc)) {
+      LOG(ERROR) << "lz4 compression failed: " << LZ4F_getErrorName(rc);
+      return false;
+    }
+    *out = out->subspan(rc);
+    return true;
+  };
+  const auto kError = make_unexpected(make_error_code(errc::io_error));
+
+  if (!started_) {
+    if (out->size() < LZ4F_HEADER_SIZE_MAX)
+      return false;
+    if (!advance(LZ4F_compressBegin(cctx_, out->data(), out->size(), &prefs)))
+      return kError;
+    started_ = true;
+  }
+
+  while (!src->empty()) {
+    size_t chunk = min(src->size(), kLz4Chunk);
+    if (out->size() < LZ4F_compressBound(chunk, &prefs))
+      return false;
+
+    if (!advance(LZ4F_compressUpdate(cctx_, out->data(), out->size(), src->data(), chunk,
+                                     nullptr))) {
+      return kError;
+    }
+    *src = src->subspan(chunk);
+  }
+
+  if (op == CONTINUE)
+    return true;
+
+  if (out->size() < LZ4F_compressBound(0, &prefs))
+    return false;
+
+  size_t rc;
+  if (op == FLUSH) {
+    rc = LZ4F_flush(cctx_, out->data(), out->size(), nullptr);
+  } else {
+    rc = LZ4F_compressEnd(cctx_, out->data(), out->size(), nullptr);
+    started_ = false;
+  }
+  if (!advance(rc))
+    return kError;
+  return true;
+}
+
+void Lz4Sink::ResetContext() {
+  // compressBegin starts a new frame regardless of the context state.
+  started_ = false;
+}
+
+Lz4Source::Lz4Source(Source* upstream) : DecompressSourceBase(upstream, kLz4Chunk) {
+  LZ4F_errorCode_t rc = LZ4F_createDecompressionContext(&dctx_, LZ4F_VERSION);
+  CHECK(!LZ4F_isError(rc)) << LZ4F_getErrorName(rc);
+}
+
+Lz4Source::~Lz4Source() {
+  LZ4F_freeDecompressionContext(dctx_);
+}
+
+error_code Lz4Source::Decompress(Bytes* src, MutableBytes* out, bool* frame_done) {
+  size_t src_size = src->size(), dst_size = out->size();
+  size_t rc = LZ4F_decompress(dctx_, out->data(), &dst_size, src->data(), &src_size, nullptr);
+  if (LZ4F_isError(rc)) {
+    VLOG(1) << "lz4 decompression failed: " << LZ4F_getErrorName(rc);
+    return make_error_code(errc::illegal_byte_sequence);
+  }
+
+  if (src_size || dst_size)
+    *frame_done = (rc == 0);
+  *src = src->subspan(src_size);
+  *out = out->subspan(dst_size);
+  return {};
+}
+
+void Lz4Source::ResetContext() {
+  LZ4F_resetDecompressionContext(dctx_);
+}
+
+}  // namespace io
@@ -0,0 +1,176 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <functional>
+#include <memory>
+
+#include "io/io.h"
+
+typedef struct ZSTD_CCtx_s ZSTD_CCtx;
+typedef struct ZSTD_DCtx_s ZSTD_DCtx;
+typedef struct LZ4F_cctx_s LZ4F_cctx;
+typedef struct LZ4F_dctx_s LZ4F_dctx;
+
+namespace io {
+
+// Runs the callback, possibly on another thread, and returns once it finished.
+// Allows moving CPU heavy (de)compression off proactor threads, for example:
+//   sink.set_offload([&](auto cb) { fq_pool.Await([&] { cb(); }); });
+// The upstream i/o always runs in the calling fiber.
+using OffloadFn = std::function<void(absl::FunctionRef<void()>)>;
+
+// Compressor sinks write into upstream with bounded memory: a single output buffer.
+// Close() must be called to complete the stream, the destructor does not do it.
+// The compression context is kept between streams, see Reset().
+class CompressSinkBase : public Sink {
+ public:
+  using Sink::WriteSome;
+  Result<size_t> WriteSome(const iovec* v, uint32_t len) final;
+
+  // Writes all the buffered data to upstream, so that it can be decompressed by the reader.
+  // Worsens the compression ratio if called often.
+  std::error_code Flush();
+
+  // Completes the stream.
+  std::error_code Close();
+
+  // Starts a new stream into upstream, reusing the compression context.
+  void Reset(Sink* upstream);
+
+  void set_offload(OffloadFn fn) {
+    offload_ = std::move(fn);
+  }
+
+  // Uncompressed bytes written so far into the current stream.
+  uint64_t bytes_in() const {
+    return bytes_in_;
+  }
+
+  // Compressed bytes written so far into upstream.
+  uint64_t bytes_out() const {
+    return bytes_out_;
+  }
+
+ protected:
+  enum Op { CONTINUE, FLUSH, END };
+
+  CompressSinkBase(Sink* upstream, size_t out_capacity);
+
+  // Compresses (part of) src into out, advances both. Returns true if the operation is done:
+  // for CONTINUE when src was consumed, for FLUSH and END when nothing remains buffered.
+  virtual Result<bool> Compress(Op op, Bytes* src, MutableBytes* out) = 0;
+
+  // Resets the compression context.
+  virtual void ResetContext() = 0;
+
+  std::error_code Run(Op op, Bytes src);
+  std::error_code WriteOut();
+
+  Sink* upstream_;
+  OffloadFn offload_;
+  std::unique_ptr<uint8_t[]> out_buf_;
+  size_t out_capacity_;
+  size_t out_size_ = 0;
+  uint64_t bytes_in_ = 0, bytes_out_ = 0;
+};
+
+// Decompressor sources read compressed data from upstream in chunks of bounded size.
+class DecompressSourceBase : public Source {
+ public:
+  using Source::ReadSome;
+
+  // Returns 0 at the end of upstream. Fails with errc::illegal_byte_sequence on corrupted data
+  // and if upstream ends in the middle of a frame.
+  Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+  // Starts reading a new stream from upstream, reusing the decompression context.
+  void Reset(Source* upstream);
+
+  void set_offload(OffloadFn fn) {
+    offload_ = std::move(fn);
+  }
+
+ protected:
+  DecompressSourceBase(Source* upstream, size_t in_capacity);
+
+  // Decompresses (part of) *src into *out, advances both. Sets frame_done if src ends
+  // exactly at the frame boundary.
+  virtual std::error_code Decompress(Bytes* src, MutableBytes* out, bool* frame_done) = 0;
+
+  virtual void ResetContext() = 0;
+
+  Source* upstream_;
+  OffloadFn offload_;
+  std::unique_ptr<uint8_t[]> in_buf_;
+  size_t in_capacity_;
+  Bytes pending_;  // unconsumed part of in_buf_.
+  bool frame_done_ = true;
+  bool eof_ = false;
+};
+
+// Zstandard (RFC 8878) streams.
+class ZstdSink final : public CompressSinkBase {
+ public:
+  // Does not take ownership over upstream.
+  explicit ZstdSink(Sink* upstream);
+  ZstdSink(Sink* upstream, int level);
+  ~ZstdSink();
+
+ private:
+  Result<bool> Compress(Op op, Bytes* src, MutableBytes* out) final;
+  void ResetContext() final;
+
+  ZSTD_CCtx* cctx_;
+};
+
+class ZstdSource final : public DecompressSourceBase {
+ public:
+  // Does not take ownership over upstream.
+  explicit ZstdSource(Source* upstream);
+  ~ZstdSource();
+
+ private:
+  std::error_code Decompress(Bytes* src, MutableBytes* out, bool* frame_done) final;
+  void ResetContext() final;
+
+  ZSTD_DCtx* dctx_;
+};
+
+// LZ4 frame format streams.
+class Lz4Sink final : public CompressSinkBase {
+ public:
+  // Does not take ownership over upstream.
+  explicit Lz4Sink(Sink* upstream);
+
+  // level 0 is the fast mode, levels 3 and above use LZ4 HC.
+  Lz4Sink(Sink* upstream, int level);
+  ~Lz4Sink();
+
+ private:
+  Result<bool> Compress(Op op, Bytes* src, MutableBytes* out) final;
+  void ResetContext() final;
+
+  LZ4F_cctx* cctx_;
+  int level_;
+  bool started_ = false;
+};
+
+class Lz4Source final : public DecompressSourceBase {
+ public:
+  // Does not take ownership over upstream.
+  explicit Lz4Source(Source* upstream);
+  ~Lz4Source();
+
+ private:
+  std::error_code Decompress(Bytes* src, MutableBytes* out, bool* frame_done) final;
+  void ResetContext() final;
+
+  LZ4F_dctx* dctx_;
+};
+
+}  // namespace io
@@ -0,0 +1,307 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "io/compress.h"
+
+#include <absl/strings/str_cat.h>
+
+#include <random>
+#include <thread>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+using namespace std;
+
+namespace io {
+
+namespace {
+
+// Semi-compressible text.
+string MakeData(size_t size, unsigned seed = 0) {
+  mt19937 gen(seed);
+  string res;
+  res.reserve(size + 32);
+  while (res.size() < size) {
+    absl::StrAppend(&res, "key:", gen() % 1000, " value:", gen() % 50, "\n");
+  }
+  res.resize(size);
+  return res;
+}
+
+// Returns the data in small chunks to exercise partial reads.
+class ChunkedSource : public Source {
+ public:
+  ChunkedSource(string_view data, size_t chunk) : data_(data), chunk_(chunk) {
+  }
+
+  Result<size_t> ReadSome(const iovec* v, uint32_t len) final {
+    size_t sz = min({v->iov_len, chunk_, data_.size()});
+    memcpy(v->iov_base, data_.data(), sz);
+    data_.remove_prefix(sz);
+    return sz;
+  }
+
+ private:
+  string_view data_;
+  size_t chunk_;
+};
+
+template <typename Src> Result<string> ReadAll(Src* src, size_t buf_size = 4096) {
+  string res;
+  unique_ptr<uint8_t[]> buf(new uint8_t[buf_size]);
+  while (true) {
+    Result<size_t> n = src->ReadSome(MutableBytes{buf.get(), buf_size});
+    if (!n)
+      return n.get_unexpected();
+    if (*n == 0)
+      return res;
+    res.append(reinterpret_cast<char*>(buf.get()), *n);
+  }
+}
+
+struct Zstd {
+  using SinkT = ZstdSink;
+  using SourceT = ZstdSource;
+};
+
+struct Lz4 {
+  using SinkT = Lz4Sink;
+  using SourceT = Lz4Source;
+};
+
+}  // namespace
+
+template <typename Codec> class CompressTest : public testing::Test {
+ protected:
+  using SinkT = typename Codec::SinkT;
+  using SourceT = typename Codec::SourceT;
+
+  string Compress(string_view data) {
+    StringSink dest;
+    SinkT sink(&dest);
+    if (!data.empty()) {
+      EXPECT_FALSE(sink.Write(Buffer(data)));
+    }
+    EXPECT_FALSE(sink.Close());
+    EXPECT_EQ(data.size(), sink.bytes_in());
+    EXPECT_EQ(dest.str().size(), sink.bytes_out());
+    return dest.str();
+  }
+};
+
+using Codecs = testing::Types<Zstd, Lz4>;
+TYPED_TEST_SUITE(CompressTest, Codecs);
+
+TYPED_TEST(CompressTest, RoundTrip) {
+  for (size_t size : {0, 1, 1000, 1 << 20}) {
+    string data = MakeData(size, size);
+    string compressed = this->Compress(data);
+    if (size >= 100000) {
+      EXPECT_LT(compressed.size(), data.size() / 2);
+    }
+
+    BytesSource bsrc(compressed);
+    typename TestFixture::SourceT src(&bsrc);
+    Result<string> res = ReadAll(&src);
+    ASSERT_TRUE(res) << res.error();
+    EXPECT_EQ(data, *res) << size;
+  }
+}
+
+TYPED_TEST(CompressTest, SmallChunks) {
+  string data = MakeData(300000);
+
+  // Many small writes in a single call.
+  StringSink dest;
+  typename TestFixture::SinkT sink(&dest);
+  vector<iovec> vec;
+  for (size_t i = 0; i < data.size(); i += 7) {
+    vec.push_back(iovec{data.data() + i, min<size_t>(7, data.size() - i)});
+  }
+  ASSERT_TRUE(sink.WriteSome(vec.data(), vec.size()));
+  ASSERT_FALSE(sink.Close());
+
+  // Compressed input arrives in small pieces and is read into small buffers.
+  ChunkedSource csrc(dest.str(), 13);
+  typename TestFixture::SourceT src(&csrc);
+  Result<string> res = ReadAll(&src, 100);
+  ASSERT_TRUE(res) << res.error();
+  EXPECT_EQ(data, *res);
+}
+
+TYPED_TEST(CompressTest, Flush) {
+  string data = MakeData(5000);
+  StringSink dest;
+  typename TestFixture::SinkT sink(&dest);
+  ASSERT_FALSE(sink.Write(Buffer(data)));
+  ASSERT_FALSE(sink.Flush());
+
+  // Whatever was written before the flush can be decompressed from the unfinished stream.
+  string prefix = dest.str();
+  BytesSource bsrc(prefix);
+  typename TestFixture::SourceT src(&bsrc);
+  string out(data.size(), '\0');
+  size_t read = 0;
+  while (read < data.size()) {
+    Result<size_t> n = src.ReadSome(MutableBytes{reinterpret_cast<uint8_t*>(out.data()) + read,
+                                                 out.size() - read});
+    ASSERT_TRUE(n) << n.error();
+    ASSERT_GT(*n, 0u);
+    read += *n;
+  }
+  EXPECT_EQ(data, out);
+
+  ASSERT_FALSE(sink.Write(Buffer(data)));
+  ASSERT_FALSE(sink.Close());
+  BytesSource bsrc2(dest.str());
+  typename TestFixture::SourceT src2(&bsrc2);
+  Result<string> res = ReadAll(&src2);
+  ASSERT_TRUE(res) << res.error();
+  EXPECT_EQ(data + data, *res);
+}
+
+TYPED_TEST(CompressTest, Reset) {
+  string data1 = MakeData(100000, 1), data2 = MakeData(70000, 2);
+  StringSink dest1, dest2;
+
+  typename TestFixture::SinkT sink(&dest1);
+  ASSERT_FALSE(sink.Write(Buffer(data1)));
+  ASSERT_FALSE(sink.Close());
+
+  // Abandon a stream in the middle.
+  sink.Reset(&dest2);
+  ASSERT_FALSE(sink.Write(Buffer(data1)));
+  sink.Reset(&dest2);
+  dest2.Clear();
+  ASSERT_FALSE(sink.Write(Buffer(data2)));
+  ASSERT_FALSE(sink.Close());
+  EXPECT_EQ(data2.size(), sink.bytes_in());
+
+  BytesSource bsrc1(dest1.str()), bsrc2(dest2.str());
+  typename TestFixture::SourceT src(&bsrc1);
+
+  // Abandon the first stream after a partial read.
+  uint8_t buf[100];
+  ASSERT_TRUE(src.ReadSome(MutableBytes{buf}));
+  src.Reset(&bsrc2);
+  Result<string> res = ReadAll(&src);
+  ASSERT_TRUE(res) << res.error();
+  EXPECT_EQ(data2, *res);
+}
+
+TYPED_TEST(CompressTest, Concatenated) {
+  string data1 = MakeData(1000, 1), data2 = MakeData(2000, 2);
+  string compressed = this->Compress(data1) + this->Compress(data2);
+  BytesSource bsrc(compressed);
+  typename TestFixture::SourceT src(&bsrc);
+  Result<string> res = ReadAll(&src);
+  ASSERT_TRUE(res) << res.error();
+  EXPECT_EQ(data1 + data2, *res);
+}
+
+TYPED_TEST(CompressTest, Corrupted) {
+  string data = MakeData(100000);
+  string compressed = this->Compress(data);
+
+  string truncated = compressed.substr(0, compressed.size() / 2);
+  BytesSource bsrc(truncated);
+  typename TestFixture::SourceT src(&bsrc);
+  Result<string> res = ReadAll(&src);
+  ASSERT_FALSE(res);
+  EXPECT_EQ(errc::illegal_byte_sequence, res.error());
+
+  string garbage = compressed;
+  for (size_t i = 0; i < 16; ++i)
+    garbage[i] ^= 0x5a;
+  BytesSource bsrc2(garbage);
+  typename TestFixture::SourceT src2(&bsrc2);
+  res = ReadAll(&src2);
+  ASSERT_FALSE(res);
+  EXPECT_EQ(errc::illegal_byte_sequence, res.error());
+}
+
+TYPED_TEST(CompressTest, Offload) {
+  string data = MakeData(200000);
+  thread::id caller = this_thread::get_id();
+  unsigned offloaded = 0;
+
+  // Stands in for a FiberQueueThreadPool.
+  OffloadFn offload = [&](absl::FunctionRef<void()> cb) {
+    thread th([&] {
+      EXPECT_NE(caller, this_thread::get_id());
+      cb();
+    });
+    th.join();
+    ++offloaded;
+  };
+
+  StringSink dest;
+  typename TestFixture::SinkT sink(&dest);
+  sink.set_offload(offload);
+  ASSERT_FALSE(sink.Write(Buffer(data)));
+  ASSERT_FALSE(sink.Close());
+  EXPECT_GT(offloaded, 0u);
+
+  offloaded = 0;
+  BytesSource bsrc(dest.str());
+  typename TestFixture::SourceT src(&bsrc);
+  src.set_offload(offload);
+  Result<string> res = ReadAll(&src);
+  ASSERT_TRUE(res) << res.error();
+  EXPECT_EQ(data, *res);
+  EXPECT_GT(offloaded, 0u);
+}
+
+// Compression alone, into a NullSink.
+template <typename Codec> void BM_Compress(benchmark::State& state) {
+  string data = MakeData(4 << 20);
+  NullSink null_sink;
+  typename Codec::SinkT sink(&null_sink, state.range(0));
+  uint64_t in = 0, out = 0;
+
+  while (state.KeepRunning()) {
+    sink.Reset(&null_sink);
+    CHECK(!sink.Write(Buffer(data)));
+    CHECK(!sink.Close());
+    in += sink.bytes_in();
+    out += sink.bytes_out();
+  }
+  state.SetBytesProcessed(in);
+  state.counters["ratio"] = double(in) / out;
+}
+BENCHMARK_TEMPLATE(BM_Compress, Zstd)->Arg(1)->Arg(3)->Arg(9)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Compress, Lz4)->Arg(0)->Arg(3)->Arg(9)->Unit(benchmark::kMillisecond);
+
+template <typename Codec> void BM_Decompress(benchmark::State& state) {
+  string data = MakeData(4 << 20);
+  StringSink dest;
+  typename Codec::SinkT sink(&dest, state.range(0));
+  CHECK(!sink.Write(Buffer(data)));
+  CHECK(!sink.Close());
+
+  const string& compressed = dest.str();
+  BytesSource bsrc(compressed);
+  typename Codec::SourceT src(&bsrc);
+  unique_ptr<uint8_t[]> buf(new uint8_t[1 << 16]);
+  uint64_t out = 0;
+
+  while (state.KeepRunning()) {
+    BytesSource bsrc(compressed);
+    src.Reset(&bsrc);
+    while (true) {
+      Result<size_t> n = src.ReadSome(MutableBytes{buf.get(), 1 << 16});
+      CHECK(n);
+      if (*n == 0)
+        break;
+      out += *n;
+    }
+  }
+  state.SetBytesProcessed(out);
+  state.counters["ratio"] = double(data.size()) / compressed.size();
+}
+BENCHMARK_TEMPLATE(BM_Decompress, Zstd)->Arg(1)->Arg(9)->Unit(benchmark::kMillisecond);
+BENCHMARK_TEMPLATE(BM_Decompress, Lz4)->Arg(0)->Arg(9)->Unit(benchmark::kMillisecond);
+
+}  // namespace io
@@ -69,6 +69,26 @@ class LocalWriteFile : public WriteFile {
   int flags_;
 };
 
+// pwrite() based O_DIRECT file.
+class PosixDirectWriteFile final : public DirectWriteFile {
+ public:
+  PosixDirectWriteFile(std::string_view file_name, size_t prealloc_size)
+      : DirectWriteFile(file_name, prealloc_size) {
+  }
+
+  ~PosixDirectWriteFile() {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  error_code Open(int flags, bool append);
+
+ private:
+  error_code WriteAt(Bytes data, off_t offset) final;
+  error_code Allocate(off_t offset, off_t len) final;
+  error_code CloseHandle() final;
+};
+
 // pread() based access.
 class PosixReadFile final : public ReadonlyFile {
  private:
@@ -168,6 +188,37 @@ Result<size_t> LocalWriteFile::WriteSome(const iovec* v, uint32_t len) {
   return nonstd::make_unexpected(StatusFileError());
 }
 
+error_code PosixDirectWriteFile::Open(int flags, bool append) {
+  int fd = open(create_file_name_.c_str(), flags, 0644);
+  if (fd < 0)
+    return StatusFileError();
+  return Init(fd, append);
+}
+
+error_code PosixDirectWriteFile::WriteAt(Bytes data, off_t offset) {
+  while (!data.empty()) {
+    ssize_t res = pwrite(fd_, data.data(), data.size(), offset);
+    if (res < 0) {
+      if (errno == EINTR)
+        continue;
+      return StatusFileError();
+    }
+    data.remove_prefix(res);
+    offset += res;
+  }
+  return {};
+}
+
+error_code PosixDirectWriteFile::Allocate(off_t offset, off_t len) {
+  return fallocate(fd_, FALLOC_FL_KEEP_SIZE, offset, len) ? StatusFileError() : error_code{};
+}
+
+error_code PosixDirectWriteFile::CloseHandle() {
+  int res = close(fd_);
+  fd_ = -1;
+  return res < 0 ? StatusFileError() : error_code{};
+}
+
 }  // namespace
 
 bool Exists(std::string_view fname) {
@@ -203,6 +254,16 @@ expected<ReadonlyFile*, ::error_code> OpenRead(std::string_view name,
 }
 
 expected<WriteFile*, error_code> OpenWrite(std::string_view file_name, WriteFile::Options opts) {
+  if (opts.direct) {
+    int flags = O_CREAT | O_RDWR | O_CLOEXEC | O_DIRECT | (opts.append ? 0 : O_TRUNC);
+    unique_ptr<PosixDirectWriteFile> file(
+        new PosixDirectWriteFile(file_name, opts.prealloc_size));
+    error_code ec = file->Open(flags, opts.append);
+    if (ec)
+      return make_unexpected(ec);
+    return file.release();
+  }
+
   int flags = O_CREAT | O_WRONLY | O_CLOEXEC;
   if (opts.append)
     flags |= O_APPEND;
@@ -223,6 +284,105 @@ WriteFile::WriteFile(std::string_view name) : create_file_name_(name) {
 WriteFile::~WriteFile() {
 }
 
+DirectWriteFile::DirectWriteFile(std::string_view file_name, size_t prealloc_size)
+    : WriteFile(file_name), buf_(kBufSize, align_val_t{kAlignment}),
+      prealloc_size_(prealloc_size) {
+}
+
+error_code DirectWriteFile::Init(int fd, bool append) {
+  fd_ = fd;
+  if (!append)
+    return {};
+
+  struct stat sb;
+  if (fstat(fd_, &sb) < 0)
+    return StatusFileError();
+
+  offset_ = sb.st_size & ~off_t(kAlignment - 1);
+  allocated_ = offset_;
+  size_t tail = sb.st_size - offset_;
+  if (tail) {
+    ssize_t res = pread(fd_, buf_.AppendBuffer().data(), kAlignment, offset_);
+    if (res < 0)
+      return StatusFileError();
+    if (size_t(res) != tail)
+      return make_error_code(errc::io_error);  // the file is being modified concurrently.
+    buf_.CommitWrite(tail);
+  }
+  return {};
+}
+
+Result<size_t> DirectWriteFile::WriteSome(const iovec* v, uint32_t len) {
+  size_t total = 0;
+  for (uint32_t i = 0; i < len; ++i) {
+    Bytes src{static_cast<const uint8_t*>(v[i].iov_base), v[i].iov_len};
+    while (!src.empty()) {
+      size_t sz = min(src.size(), buf_.AppendLen());
+      memcpy(buf_.AppendBuffer().data(), src.data(), sz);
+      buf_.CommitWrite(sz);
+      src.remove_prefix(sz);
+      total += sz;
+
+      if (buf_.AppendLen() == 0) {
+        error_code ec = FlushBuf(false);
+        if (ec)
+          return make_unexpected(ec);
+      }
+    }
+  }
+  return total;
+}
+
+error_code DirectWriteFile::Close() {
+  if (fd_ < 0)
+    return {};
+
+  error_code ec = FlushBuf(true);
+
+  // Drops the padding of the last block and the preallocated space.
+  off_t size = offset_ + buf_.InputLen();
+  if (ftruncate(fd_, size) < 0 && !ec)
+    ec = StatusFileError();
+
+  error_code close_ec = CloseHandle();
+  fd_ = -1;
+  return ec ? ec : close_ec;
+}
+
+error_code DirectWriteFile::FlushBuf(bool last) {
+  size_t len = buf_.InputLen();
+  size_t aligned = last ? (len + kAlignment - 1) & ~(kAlignment - 1) : len & ~(kAlignment - 1);
+  if (aligned == 0)
+    return {};
+
+  uint8_t* data = buf_.InputBuffer().data();
+  if (aligned > len)
+    memset(data + len, 0, aligned - len);
+
+  if (prealloc_size_ && offset_ + off_t(aligned) > allocated_) {
+    off_t extent = max(prealloc_size_, aligned);
+    error_code ec = Allocate(allocated_, extent);
+    if (ec) {
+      if (ec != errc::operation_not_supported)
+        return ec;
+      prealloc_size_ = 0;
+    }
+    allocated_ += extent;
+  }
+
+  error_code ec = WriteAt(Bytes{data, aligned}, offset_);
+  if (ec || last)
+    return ec;
+
+  // Keep the unaligned remainder at the beginning of the buffer.
+  size_t rest = len - aligned;
+  memmove(data, data + aligned, rest);
+  buf_.Clear();
+  buf_.CommitWrite(rest);
+  offset_ += aligned;
+  return {};
+}
+
 Result<size_t> StringFile::WriteSome(const iovec* v, uint32_t len) {
   size_t res = 0;
   for (uint32_t i = 0; i < len; ++i) {
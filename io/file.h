@@ -68,6 +68,12 @@ class WriteFile : public Sink {
  public:
   struct Options {
     bool append = false;  // if true - does not overwrite the existing file on open.
+
+    // Bypasses the page cache with O_DIRECT, see DirectWriteFile.
+    bool direct = false;
+
+    // With direct, preallocates the file space with fallocate in extents of this size.
+    size_t prealloc_size = 0;
   };
 
   virtual ~WriteFile();
@@ -100,6 +106,45 @@ class WriteFile : public Sink {
   const std::string create_file_name_;
 };
 
+// Base class for files opened with O_DIRECT. Large sequential writes bypass the page cache
+// and do not evict hot data. The data is staged in an aligned buffer and written in aligned
+// chunks. The last partial block is written padded and the file is truncated to its real size
+// on Close(). The i/o primitives are virtual so that they can be submitted via io_uring.
+class DirectWriteFile : public WriteFile {
+ public:
+  static constexpr size_t kAlignment = 4096;
+  static constexpr size_t kBufSize = 1 << 20;
+
+  Result<size_t> WriteSome(const iovec* v, uint32_t len) final;
+
+  std::error_code Close() final;
+
+ protected:
+  DirectWriteFile(std::string_view file_name, size_t prealloc_size);
+
+  // Must be called after the file is opened. With append, reads back the last partial block of
+  // the file so that the writes stay aligned. The file must be opened with O_RDWR.
+  std::error_code Init(int fd, bool append);
+
+  // Writes the whole range. offset and data size are aligned.
+  virtual std::error_code WriteAt(Bytes data, off_t offset) = 0;
+
+  // fallocate(2) without changing the file size.
+  virtual std::error_code Allocate(off_t offset, off_t len) = 0;
+
+  virtual std::error_code CloseHandle() = 0;
+
+  int fd_ = -1;
+
+ private:
+  std::error_code FlushBuf(bool last);
+
+  base::IoBuf buf_;
+  off_t offset_ = 0;  // file offset of buf_.
+  off_t allocated_ = 0;
+  size_t prealloc_size_;
+};
+
 class StringFile : public WriteFile {
  public:
   std::string val;
@@ -156,7 +201,8 @@ ABSL_MUST_USE_RESULT ReadonlyFileOrError OpenRead(std::string_view name,
 using WriteFileOrError = Result<WriteFile*>;
 
 //! Factory method to create a new writable file object. Calls Open on the
-//! resulting object to open the file.
+//! resulting object to open the file. With opts.direct, fails with errc::invalid_argument
+//! if the file system does not support O_DIRECT.
 ABSL_MUST_USE_RESULT Result<WriteFile*> OpenWrite(std::string_view path,
                                                   WriteFile::Options opts = WriteFile::Options());
 
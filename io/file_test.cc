@@ -4,15 +4,22 @@
 
 #include "io/file.h"
 
+#include <absl/strings/str_cat.h>
+#include <fcntl.h>
+#include <glob.h>
 #include <gmock/gmock.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "base/gtest.h"
+#include "base/logging.h"
 #include "io/file_util.h"
 
 namespace io {
 
 using namespace std;
 using testing::SizeIs;
+using testing::ElementsAre;
 using testing::EndsWith;
 class FileTest : public ::testing::Test {
  protected:
@@ -36,4 +43,180 @@ TEST_F(FileTest, Util) {
   EXPECT_EQ(res2.value(), "foo");
 }
 
+TEST_F(FileTest, DirectWrite) {
+  string path = base::GetTestTempPath("direct.bin");
+  string data(3 * DirectWriteFile::kBufSize + 5000, '\0');
+  for (size_t i = 0; i < data.size(); ++i)
+    data[i] = i % 251;
+
+  WriteFile::Options opts;
+  opts.direct = true;
+  opts.prealloc_size = 1 << 21;
+  Result<WriteFile*> res = OpenWrite(path, opts);
+  if (!res && res.error() == errc::invalid_argument) {
+    GTEST_SKIP() << "O_DIRECT is not supported";
+  }
+  ASSERT_TRUE(res) << res.error();
+  unique_ptr<WriteFile> file(*res);
+
+  // Unaligned writes of various sizes.
+  for (size_t offs = 0, sz = 1; offs < data.size(); offs += sz, sz = sz * 3 + 7) {
+    sz = min(sz, data.size() - offs);
+    ASSERT_FALSE(file->Write(string_view{data}.substr(offs, sz)));
+  }
+  ASSERT_FALSE(file->Close());
+
+  Result<string> content = ReadFileToString(path);
+  ASSERT_TRUE(content);
+  EXPECT_TRUE(*content == data);
+
+  // Appending to a file with an unaligned size.
+  opts.append = true;
+  res = OpenWrite(path, opts);
+  ASSERT_TRUE(res) << res.error();
+  file.reset(*res);
+  ASSERT_FALSE(file->Write("foo"));
+  ASSERT_FALSE(file->Close());
+
+  content = ReadFileToString(path);
+  ASSERT_TRUE(content);
+  EXPECT_TRUE(*content == data + "foo");
+}
+
+TEST_F(FileTest, ListFiles) {
+  string dir = base::GetTestTempPath("list");
+  for (const char* sub : {"", "/a", "/a/x", "/b", "/b/x", "/.c", "/.c/x"}) {
+    string path = dir + sub;
+    ASSERT_TRUE(mkdir(path.c_str(), 0755) == 0 || errno == EEXIST) << path;
+  }
+  for (const char* file : {"/a/x/1.log", "/a/x/2.txt", "/b/x/3.log", "/b/4.log", "/.c/x/5.log",
+                           "/a/.6.log"}) {
+    WriteStringToFileOrDie("foo", dir + file);
+  }
+
+  auto list = [](string pattern) {
+    vector<string> res;
+    error_code ec = ListFiles(pattern, [&](string_view path, unsigned char) {
+      res.emplace_back(path);
+    });
+    EXPECT_FALSE(ec);
+    sort(res.begin(), res.end());
+    return res;
+  };
+
+  EXPECT_THAT(list(dir + "/*/x/*.log"), ElementsAre(dir + "/a/x/1.log", dir + "/b/x/3.log"));
+  EXPECT_THAT(list(dir + "/?/*"), ElementsAre(dir + "/a/x", dir + "/b/4.log", dir + "/b/x"));
+  EXPECT_THAT(list(dir + "/a/.*"), ElementsAre(dir + "/a/.6.log"));
+  EXPECT_THAT(list(dir + "/[b]/4.log"), ElementsAre(dir + "/b/4.log"));
+  EXPECT_THAT(list(dir + "/b/4.log"), ElementsAre(dir + "/b/4.log"));
+  EXPECT_THAT(list(dir + "/b/5.log"), ElementsAre());
+  EXPECT_THAT(list(dir + "/nodir/*"), ElementsAre());
+
+  Result<StatShortVec> res = StatFiles(dir + "/*/x/*");
+  ASSERT_TRUE(res);
+  ASSERT_THAT(res.value(), SizeIs(3));
+  EXPECT_THAT(res.value()[0].name, EndsWith("/a/x/1.log"));
+  EXPECT_THAT(res.value()[2].name, EndsWith("/b/x/3.log"));
+  EXPECT_EQ(3u, res.value()[2].size);
+}
+
+// A tree of 100 directories with 1000 empty files each. Created once per test binary.
+static string StatBenchDir() {
+  static string dir = [] {
+    string dir = base::GetTestTempPath("stat_bench");
+    for (unsigned i = 0; i <= 100; ++i) {
+      string sub = i ? absl::StrCat(dir, "/d", i) : dir;
+      CHECK(mkdir(sub.c_str(), 0755) == 0 || errno == EEXIST);
+      for (unsigned j = 0; i && j < 1000; ++j) {
+        string path = absl::StrCat(sub, "/seg", j, ".dat");
+        int fd = open(path.c_str(), O_CREAT | O_WRONLY | O_CLOEXEC, 0644);
+        CHECK_GE(fd, 0);
+        close(fd);
+      }
+    }
+    return dir;
+  }();
+  return dir;
+}
+
+// The previous implementation of StatFiles.
+static void BM_GlobStat(benchmark::State& state) {
+  string pattern = StatBenchDir() + "/*/seg*.dat";
+  while (state.KeepRunning()) {
+    glob_t glob_result;
+    CHECK_EQ(0, glob(pattern.c_str(), GLOB_TILDE_CHECK, nullptr, &glob_result));
+    struct stat sbuf;
+    for (size_t i = 0; i < glob_result.gl_pathc; i++) {
+      CHECK_EQ(0, fstatat(AT_FDCWD, glob_result.gl_pathv[i], &sbuf, 0));
+    }
+    state.SetItemsProcessed(state.items_processed() + glob_result.gl_pathc);
+    globfree(&glob_result);
+  }
+}
+BENCHMARK(BM_GlobStat)->Unit(benchmark::kMillisecond);
+
+static void BM_ListFiles(benchmark::State& state) {
+  string pattern = StatBenchDir() + "/*/seg*.dat";
+  while (state.KeepRunning()) {
+    size_t count = 0;
+    CHECK(!ListFiles(pattern, [&](string_view, unsigned char) { ++count; }));
+    state.SetItemsProcessed(state.items_processed() + count);
+  }
+}
+BENCHMARK(BM_ListFiles)->Unit(benchmark::kMillisecond);
+
+static void BM_StatFiles(benchmark::State& state) {
+  string pattern = StatBenchDir() + "/*/seg*.dat";
+  while (state.KeepRunning()) {
+    Result<StatShortVec> res = StatFiles(pattern);
+    CHECK(res);
+    state.SetItemsProcessed(state.items_processed() + res->size());
+  }
+}
+BENCHMARK(BM_StatFiles)->Unit(benchmark::kMillisecond);
+
+// Returns the fraction of the file pages that reside in the page cache.
+static double CachedFraction(const string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  CHECK_GE(fd, 0);
+  struct stat sb;
+  CHECK_EQ(0, fstat(fd, &sb));
+  size_t page = getpagesize(), pages = (sb.st_size + page - 1) / page;
+  void* addr = mmap(nullptr, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  CHECK(addr != MAP_FAILED);
+  vector<unsigned char> vec(pages);
+  CHECK_EQ(0, mincore(addr, sb.st_size, vec.data()));
+  munmap(addr, sb.st_size);
+  close(fd);
+
+  size_t cached = 0;
+  for (unsigned char c : vec)
+    cached += (c & 1);
+  return double(cached) / pages;
+}
+
+// Writes 256MB with range(0) = 1 for O_DIRECT. Reports how much of the file remained in the
+// page cache.
+static void BM_WriteFile(benchmark::State& state) {
+  string path = base::GetTestTempPath("bm_write.bin");
+  string chunk(1 << 16, 'a');
+  WriteFile::Options opts;
+  opts.direct = state.range(0);
+  opts.prealloc_size = opts.direct ? 64 << 20 : 0;
+
+  while (state.KeepRunning()) {
+    Result<WriteFile*> res = OpenWrite(path, opts);
+    CHECK(res) << res.error();
+    unique_ptr<WriteFile> file(*res);
+    for (unsigned i = 0; i < 4096; ++i) {
+      CHECK(!file->Write(chunk));
+    }
+    CHECK(!file->Close());
+    state.SetBytesProcessed(state.bytes_processed() + 4096 * chunk.size());
+  }
+  state.counters["cached"] = CachedFraction(path);
+  unlink(path.c_str());
+}
+BENCHMARK(BM_WriteFile)->Arg(0)->Arg(1)->Unit(benchmark::kMillisecond)->UseRealTime();
+
 }  // namespace io
@@ -4,9 +4,16 @@
 
 #include "io/file_util.h"
 
+#include <absl/strings/str_split.h>
+#include <dirent.h>
 #include <fcntl.h>
-#include <glob.h>
+#include <fnmatch.h>
+#include <pwd.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
 
 #include "base/logging.h"
 #include "io/file.h"
@@ -14,39 +21,180 @@
 namespace io {
 using namespace std;
 
-static int glob_errfunc(const char* epath, int eerrno) {
-  LOG(ERROR) << "Error in glob() path: <" << epath << ">. errno: " << eerrno;
-  return 0;
+namespace {
+
+// glibc provides getdents64() only since 2.30, and musl not at all.
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+};
+
+constexpr size_t kDirentBufSize = 1 << 16;
+
+bool IsPattern(string_view str) {
+  return str.find_first_of("*?[\\") != string_view::npos;
 }
 
-Result<vector<StatShort>> StatFiles(std::string_view path) {
-  glob_t glob_result;
-  vector<StatShort> res;
-  int rv = glob(path.data(), GLOB_TILDE_CHECK, glob_errfunc, &glob_result);
-  if (rv) {
-    switch (rv) {
-      case GLOB_NOSPACE:
-        return nonstd::make_unexpected(make_error_code(errc::not_enough_memory));
-      case GLOB_ABORTED:
-        return nonstd::make_unexpected(make_error_code(errc::io_error));
-      case GLOB_NOMATCH:
-        return res;
+class DirWalker {
+ public:
+  explicit DirWalker(ListFilesCb cb) : cb_(cb), buf_(new char[kDirentBufSize]) {
+  }
+
+  // path is empty or ends with '/'.
+  error_code Walk(string* path, absl::Span<const string> comps);
+
+ private:
+  error_code ListDir(const string& dir, const string& pattern, bool last, vector<string>* subdirs);
+
+  ListFilesCb cb_;
+  unique_ptr<char[]> buf_;
+};
+
+error_code DirWalker::Walk(string* path, absl::Span<const string> comps) {
+  const string& comp = comps.front();
+  bool last = comps.size() == 1;
+  size_t len = path->size();
+  error_code ec;
+
+  if (!IsPattern(comp)) {
+    path->append(comp);
+    if (last) {
+      if (faccessat(AT_FDCWD, path->c_str(), F_OK, AT_SYMLINK_NOFOLLOW) == 0)
+        cb_(*path, DT_UNKNOWN);
+    } else {
+      path->push_back('/');
+      ec = Walk(path, comps.subspan(1));
+    }
+    path->resize(len);
+    return ec;
+  }
+
+  vector<string> subdirs;
+  ec = ListDir(*path, comp, last, &subdirs);
+
+  // Descend after the directory is closed, so that at most one descriptor is open.
+  for (const string& name : subdirs) {
+    if (ec)
+      break;
+    path->append(name).push_back('/');
+    ec = Walk(path, comps.subspan(1));
+    path->resize(len);
+  }
+  return ec;
+}
+
+error_code DirWalker::ListDir(const string& dir, const string& pattern, bool last,
+                              vector<string>* subdirs) {
+  int fd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) {
+    // Similarly to glob(), unreadable directories are skipped.
+    if (errno != ENOENT && errno != ENOTDIR) {
+      LOG(ERROR) << "Error opening " << dir << ": " << strerror(errno);
+    }
+    return {};
+  }
+
+  string path = dir;
+  error_code ec;
+  while (true) {
+    long res = syscall(SYS_getdents64, fd, buf_.get(), kDirentBufSize);
+    if (res <= 0) {
+      if (res < 0)
+        ec = StatusFileError();
+      break;
+    }
+
+    for (long offs = 0; offs < res;) {
+      const LinuxDirent64* entry = reinterpret_cast<const LinuxDirent64*>(buf_.get() + offs);
+      offs += entry->d_reclen;
+
+      const char* name = entry->d_name;
+      if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+        continue;
+
+      // FNM_PERIOD: as with glob(), a leading period must be matched explicitly.
+      if (fnmatch(pattern.c_str(), name, FNM_PERIOD) != 0)
+        continue;
+
+      if (last) {
+        path.append(name);
+        cb_(path, entry->d_type);
+        path.resize(dir.size());
+      } else if (entry->d_type == DT_DIR || entry->d_type == DT_LNK ||
+                 entry->d_type == DT_UNKNOWN) {
+        subdirs->emplace_back(name);
+      }
+    }
+  }
+  close(fd);
+
+  return ec;
+}
+
+}  // namespace
+
+error_code ListFiles(string_view pattern, ListFilesCb cb) {
+  string path;
+
+  // Tilde expansion, like GLOB_TILDE_CHECK for the current user.
+  if (!pattern.empty() && pattern[0] == '~' && (pattern.size() == 1 || pattern[1] == '/')) {
+    const char* home = getenv("HOME");
+    if (!home) {
+      struct passwd* pw = getpwuid(getuid());
+      if (!pw)
+        return {};
+      home = pw->pw_dir;
     }
+    path = home;
+    pattern.remove_prefix(1);
+    if (path.back() != '/')
+      path.push_back('/');
+  } else if (!pattern.empty() && pattern[0] == '/') {
+    path = "/";
   }
 
+  vector<string> comps = absl::StrSplit(pattern, '/', absl::SkipEmpty());
+  if (comps.empty()) {
+    if (path.size() > 1)
+      path.pop_back();
+    if (!path.empty())
+      cb(path, DT_DIR);
+    return {};
+  }
+
+  DirWalker walker(cb);
+  return walker.Walk(&path, comps);
+}
+
+Result<StatShort> StatFile(string path) {
   struct stat sbuf;
+
   // statx is not implemented in musl-dev
-  for (size_t i = 0; i < glob_result.gl_pathc; i++) {
-    if (fstatat(AT_FDCWD, glob_result.gl_pathv[i], &sbuf, 0) == 0) {
-      time_t ns = sbuf.st_mtim.tv_sec * 1000000000ULL + sbuf.st_mtim.tv_nsec;
-      StatShort sshort{glob_result.gl_pathv[i], ns, uint64_t(sbuf.st_size), sbuf.st_mode};
-      res.emplace_back(std::move(sshort));
+  if (fstatat(AT_FDCWD, path.c_str(), &sbuf, 0) != 0)
+    return nonstd::make_unexpected(StatusFileError());
+
+  time_t ns = sbuf.st_mtim.tv_sec * 1000000000ULL + sbuf.st_mtim.tv_nsec;
+  return StatShort{std::move(path), ns, uint64_t(sbuf.st_size), sbuf.st_mode};
+}
+
+Result<vector<StatShort>> StatFiles(std::string_view path) {
+  vector<StatShort> res;
+  error_code ec = ListFiles(path, [&](string_view name, unsigned char) {
+    Result<StatShort> sshort = StatFile(string{name});
+    if (sshort) {
+      res.emplace_back(std::move(*sshort));
     } else {
-      LOG(WARNING) << "Bad stat for " << glob_result.gl_pathv[i] << " " << strerror(errno);
+      LOG(WARNING) << "Bad stat for " << name << " " << sshort.error().message();
     }
-  }
-  globfree(&glob_result);
+  });
+  if (ec)
+    return nonstd::make_unexpected(ec);
 
+  sort(res.begin(), res.end(),
+       [](const StatShort& a, const StatShort& b) { return a.name < b.name; });
   return res;
 }
 
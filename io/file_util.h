@@ -3,6 +3,7 @@
 //
 #pragma once
 
+#include <absl/functional/function_ref.h>
 #include <sys/types.h>
 
 #include <vector>
@@ -20,8 +21,18 @@ struct StatShort {
 
 using StatShortVec = std::vector<StatShort>;
 
+// Returns the files matching the glob pattern, sorted by name.
 Result<StatShortVec> StatFiles(std::string_view path);
 
+Result<StatShort> StatFile(std::string path);
+
+// Calls cb for every path that matches the glob pattern. d_type is one of DT_xxx constants
+// from dirent.h and may be DT_UNKNOWN. Unlike glob(), does not sort or stat the entries:
+// directories are read with getdents64 and matched in user space, so huge directories are
+// streamed with constant memory. Tilde is expanded only for the current user.
+using ListFilesCb = absl::FunctionRef<void(std::string_view path, unsigned char d_type)>;
+std::error_code ListFiles(std::string_view pattern, ListFilesCb cb);
+
 // Create a file and write a std::string to it.
 void WriteStringToFileOrDie(std::string_view contents, std::string_view name);
 
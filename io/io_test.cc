@@ -10,6 +10,7 @@
 
 #include "base/gtest.h"
 #include "base/logging.h"
+#include "io/checksum.h"
 #include "io/line_reader.h"
 #include "io/proc_reader.h"
 
@@ -101,6 +102,71 @@ TEST_F(IoTest, ProcReader) {
   EXPECT_GT(mdata->mem_cached, 0);
   EXPECT_GT(mdata->mem_SReclaimable, 0);
   EXPECT_GT(mdata->mem_total, 1ul << 30);
+
+  StatusReader status_reader;
+  for (unsigned i = 0; i < 3; ++i) {
+    auto sdata = status_reader.Read();
+    ASSERT_TRUE(sdata.has_value());
+    EXPECT_GT(sdata->vm_rss, 0);
+  }
+
+  ProcStatReader stat_reader;
+  auto pstat = stat_reader.Read();
+  ASSERT_TRUE(pstat.has_value());
+  EXPECT_GE(pstat->num_threads, 1);
+  EXPECT_GT(pstat->rss, 0);
+
+  auto tstat = ReadProcStat(gettid());
+  ASSERT_TRUE(tstat.has_value());
+  EXPECT_EQ('R', tstat->state);
+
+  auto sockstat = ReadSockStat();
+  ASSERT_TRUE(sockstat.has_value());
+
+  SchedStatReader sched_reader(gettid());
+  auto sched = sched_reader.Read();
+  ASSERT_TRUE(sched.has_value());
+  EXPECT_GT(sched->run_ns, 0);
+}
+
+TEST_F(IoTest, ProcParsers) {
+  ProcStat pstat;
+  string_view stat_line =
+      "12 (my (weird) prog) S 1 12 12 0 -1 4194560 500 0 7 0 300 200 0 0 20 0 4 0 100 "
+      "1048576 64 18446744073709551615 1 1 0 0 0 0 0 0 0 0 0 0 17 3 0 0 0 0 0\n";
+  ASSERT_FALSE(detail::ParseProcStat(stat_line, &pstat));
+  EXPECT_EQ('S', pstat.state);
+  EXPECT_EQ(500, pstat.minflt);
+  EXPECT_EQ(7, pstat.majflt);
+  EXPECT_EQ(300 * 1000000 / sysconf(_SC_CLK_TCK), pstat.utime_usec);
+  EXPECT_EQ(200 * 1000000 / sysconf(_SC_CLK_TCK), pstat.stime_usec);
+  EXPECT_EQ(4, pstat.num_threads);
+  EXPECT_EQ(1048576, pstat.vsize);
+  EXPECT_EQ(64 * sysconf(_SC_PAGESIZE), pstat.rss);
+
+  EXPECT_TRUE(detail::ParseProcStat("12 (foo) S 1 2", &pstat));
+
+  SchedStat sched;
+  ASSERT_FALSE(detail::ParseSchedStat("1234 567 89\n", &sched));
+  EXPECT_EQ(1234, sched.run_ns);
+  EXPECT_EQ(567, sched.wait_ns);
+  EXPECT_EQ(89, sched.timeslices);
+  EXPECT_TRUE(detail::ParseSchedStat("1234\n", &sched));
+
+  SockStatData sdata;
+  string_view sockstat =
+      "sockets: used 290\n"
+      "TCP: inuse 5 orphan 1 tw 2 alloc 7 mem 3\n"
+      "UDP: inuse 4 mem 1\n"
+      "UDPLITE: inuse 0\n";
+  ASSERT_FALSE(detail::ParseSockStat(sockstat, &sdata));
+  EXPECT_EQ(290, sdata.sockets_used);
+  EXPECT_EQ(5, sdata.tcp_inuse);
+  EXPECT_EQ(1, sdata.tcp_orphan);
+  EXPECT_EQ(2, sdata.tcp_tw);
+  EXPECT_EQ(7, sdata.tcp_alloc);
+  EXPECT_EQ(3 * sysconf(_SC_PAGESIZE), sdata.tcp_mem);
+  EXPECT_EQ(4, sdata.udp_inuse);
 }
 
 TEST_F(IoTest, IniReader) {
@@ -140,4 +206,157 @@ TEST_F(IoTest, IoBuf) {
   ASSERT_EQ(fetched, test);
 }
 
+// ReadonlyFile over a string.
+class StringReadonlyFile : public ReadonlyFile {
+ public:
+  explicit StringReadonlyFile(string_view data) : data_(data) {
+  }
+
+  Result<size_t> Read(size_t offset, const iovec* v, uint32_t len) final {
+    size_t res = 0;
+    for (; len && offset < data_.size(); ++v, --len) {
+      size_t sz = min(v->iov_len, data_.size() - offset);
+      memcpy(v->iov_base, data_.data() + offset, sz);
+      offset += sz;
+      res += sz;
+    }
+    return res;
+  }
+
+  error_code Close() final {
+    return {};
+  }
+
+  size_t Size() const final {
+    return data_.size();
+  }
+
+  int Handle() const final {
+    return -1;
+  }
+
+ private:
+  string_view data_;
+};
+
+// Bitwise reference implementation of crc32c, reflected 0x1EDC6F41.
+uint32_t Crc32cBytewise(uint32_t crc, const uint8_t* p, size_t len) {
+  crc = ~crc;
+  for (; len; --len) {
+    crc ^= *p++;
+    for (unsigned j = 0; j < 8; ++j)
+      crc = (crc >> 1) ^ ((crc & 1) ? 0x82F63B78 : 0);
+  }
+  return ~crc;
+}
+
+TEST_F(IoTest, Checksum) {
+  EXPECT_EQ(0xE3069283u, base::Crc32c(0, "123456789", 9));
+
+  string data(10000, '\0');
+  for (size_t i = 0; i < data.size(); ++i)
+    data[i] = i * 7 + (i >> 8);
+  const uint32_t crc = base::Crc32c(0, data.data(), data.size());
+  const uint64_t xxh = XXH3_64bits(data.data(), data.size());
+  EXPECT_EQ(crc, base::Crc32c(base::Crc32c(0, data.data(), 333), data.data() + 333,
+                              data.size() - 333));
+
+  // Large inputs go through the interleaved 3 x 4KB stripes. Unaligned starts and lengths
+  // exercise the word and byte tails.
+  string large(300007, '\0');
+  for (size_t i = 0; i < large.size(); ++i)
+    large[i] = i * 13 + (i >> 9);
+  const uint8_t* lp = reinterpret_cast<const uint8_t*>(large.data());
+  for (size_t len : {12287ul, 12288ul, 12291ul, 65536ul + 5, 100001ul, 300000ul}) {
+    for (size_t start : {0ul, 1ul, 7ul}) {
+      const uint8_t* p = lp + start;
+      uint32_t expected = Crc32cBytewise(0, p, len);
+      ASSERT_EQ(expected, base::Crc32c(0, p, len)) << len << " " << start;
+
+      for (size_t split : {3ul, 12289ul, len / 2 + 1}) {
+        if (split > len)
+          continue;
+        EXPECT_EQ(expected, base::Crc32c(base::Crc32c(0, p, split), p + split, len - split))
+            << len << " " << start << " " << split;
+      }
+    }
+  }
+
+  // Only the bytes accepted by upstream are checksummed.
+  FakeSink fake;
+  fake.call_sz = {100, 5000, 20000};
+  Crc32cSink crc_sink(&fake);
+  ASSERT_FALSE(crc_sink.Write(Buffer(data)));
+  EXPECT_EQ(data, fake.value);
+  EXPECT_EQ(crc, crc_sink.digest());
+  EXPECT_EQ(data.size(), crc_sink.size());
+
+  StringSink str_sink;
+  Xxh3Sink xxh_sink(&str_sink);
+  iovec v[3] = {{data.data(), 10}, {data.data() + 10, 4000}, {data.data() + 4010, 5990}};
+  ASSERT_FALSE(xxh_sink.Write(v, 3));
+  EXPECT_EQ(xxh, xxh_sink.digest());
+
+  xxh_sink.Reset(&str_sink);
+  EXPECT_EQ(XXH3_64bits(nullptr, 0), xxh_sink.digest());
+
+  BytesSource bsrc(data);
+  Xxh3Source xxh_src(&bsrc);
+  string dest(data.size() + 10, '\0');
+  auto res = xxh_src.Read(MutableBytes{reinterpret_cast<uint8_t*>(dest.data()), dest.size()});
+  ASSERT_TRUE(res);
+  EXPECT_EQ(data.size(), *res);
+  EXPECT_EQ(xxh, xxh_src.digest());
+
+  StringReadonlyFile file(data);
+  ChecksumReadonlyFile<Crc32cHasher> crc_file(&file);
+  uint8_t buf[1024];
+  for (size_t offs = 0; offs < data.size();) {
+    res = crc_file.Read(offs, MutableBytes{buf});
+    ASSERT_TRUE(res);
+    offs += *res;
+
+    // Out of order reads do not affect the checksum.
+    ASSERT_TRUE(crc_file.Read(0, MutableBytes{buf}));
+  }
+  EXPECT_EQ(crc, crc_file.digest());
+  EXPECT_EQ(data.size(), crc_file.size());
+}
+
+void BM_Crc32c(benchmark::State& state) {
+  string data(state.range(0), 'a');
+  uint32_t crc = 0;
+  while (state.KeepRunning()) {
+    crc = base::Crc32c(crc, data.data(), data.size());
+  }
+  benchmark::DoNotOptimize(crc);
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Crc32c)->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+void BM_Xxh3(benchmark::State& state) {
+  string data(state.range(0), 'a');
+  Xxh3Hasher hasher;
+  while (state.KeepRunning()) {
+    hasher.Update(Buffer(data));
+  }
+  benchmark::DoNotOptimize(hasher.Digest());
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK(BM_Xxh3)->Arg(64)->Arg(4096)->Arg(1 << 20);
+
+// Overhead of checksumming on the write path.
+template <typename Hasher> void BM_ChecksumSink(benchmark::State& state) {
+  string data(state.range(0), 'a');
+  NullSink null_sink;
+  ChecksumSink<Hasher> sink(&null_sink);
+  while (state.KeepRunning()) {
+    CHECK(!sink.Write(Buffer(data)));
+  }
+  benchmark::DoNotOptimize(sink.digest());
+  state.SetBytesProcessed(state.iterations() * data.size());
+}
+BENCHMARK_TEMPLATE(BM_ChecksumSink, Crc32cHasher)->Arg(4096)->Arg(1 << 20);
+BENCHMARK_TEMPLATE(BM_ChecksumSink, Xxh3Hasher)->Arg(4096)->Arg(1 << 20);
+
 }  // namespace io
@@ -5,11 +5,11 @@
 #include "io/proc_reader.h"
 
 #include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
 #include <absl/strings/strip.h>
 #include <fcntl.h>
 #include <unistd.h>
 
-#include "base/io_buf.h"
 #include "base/logging.h"
 
 namespace io {
@@ -20,118 +20,335 @@ using absl::SimpleAtoi;
 
 namespace {
 
-// Reads proc files like /proc/self/status  or /proc/meminfo
-// passes to cb: (key, value)
-error_code ReadProcFile(const char* name, function<void(string_view, string_view)> cb) {
-  int fd = open(name, O_RDONLY | O_CLOEXEC);
-  if (fd == -1)
-    return error_code{errno, system_category()};
+constexpr size_t kInitialCapacity = 4096;
 
-  base::IoBuf buf;
-
-  while (true) {
-    auto dest = buf.AppendBuffer();
-
-    int res = read(fd, dest.data(), dest.size());
-    if (res == -1) {
-      close(fd);
-      return error_code{errno, system_category()};
-    }
-
-    if (res == 0) {
-      break;
-    }
-
-    buf.CommitWrite(res);
-
-    while (true) {
-      auto input = buf.InputBuffer();
-      uint8_t* eol = reinterpret_cast<uint8_t*>(memchr(input.data(), '\n', input.size()));
-      if (!eol)
-        break;
-
-      string_view line(reinterpret_cast<char*>(input.data()), eol - input.data());
-      size_t pos = line.find(':');
-      if (pos == string_view::npos)
-        break;
+// Calls cb(key, value) for each "key: value" line in content. Does not allocate.
+template <typename F> void ForEachKeyValue(string_view content, F&& cb) {
+  while (!content.empty()) {
+    size_t eol = content.find('\n');
+    string_view line = content.substr(0, eol);
+    size_t pos = line.find(':');
+    if (pos != string_view::npos) {
       string_view key = line.substr(0, pos);
       string_view value = absl::StripLeadingAsciiWhitespace(line.substr(pos + 1));
-
       cb(key, value);
-
-      buf.ConsumeInput(line.size() + 1);
     }
+
+    if (eol == string_view::npos)
+      break;
+    content.remove_prefix(eol + 1);
   }
-  close(fd);
+}
 
-  return error_code{};
+// Returns the first space delimited token of value and removes it from value.
+inline string_view NextToken(string_view* value) {
+  *value = absl::StripLeadingAsciiWhitespace(*value);
+  size_t space = value->find_first_of(" \n");
+  string_view res = value->substr(0, space);
+  value->remove_prefix(res.size());
+  return res;
 }
 
-inline void ParseKb(string_view num, size_t* dest) {
+inline void ParseKb(string_view value, size_t* dest) {
+  string_view num = NextToken(&value);
   CHECK(SimpleAtoi(num, dest));
   *dest *= 1024;
 };
 
+inline uint64_t TicksToUsec(uint64_t ticks) {
+  static const uint64_t kTicksPerSec = sysconf(_SC_CLK_TCK);
+  return ticks * 1000000 / kTicksPerSec;
+}
+
+inline size_t PageSize() {
+  static const size_t kPageSize = sysconf(_SC_PAGESIZE);
+  return kPageSize;
+}
+
+inline error_code BadMessage() {
+  return make_error_code(errc::bad_message);
+}
+
 }  // namespace
 
+ProcReader::ProcReader(string path) : path_(std::move(path)) {
+}
 
+ProcReader::~ProcReader() {
+  if (fd_ >= 0)
+    close(fd_);
+}
 
-Result<StatusData> ReadStatusInfo() {
-  StatusData sdata;
+Result<string_view> ProcReader::Read() {
+  if (fd_ < 0) {
+    fd_ = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0)
+      return make_unexpected(error_code{errno, system_category()});
+  }
+
+  if (!buf_) {
+    capacity_ = kInitialCapacity;
+    buf_.reset(new char[capacity_]);
+  }
+
+  while (true) {
+    size_t total = 0;
+
+    // proc files can return less than requested, hence we read until EOF.
+    while (total < capacity_) {
+      ssize_t res = pread(fd_, buf_.get() + total, capacity_ - total, total);
+      if (res < 0) {
+        if (errno == EINTR)
+          continue;
+        return make_unexpected(error_code{errno, system_category()});
+      }
+      if (res == 0)
+        break;
+      total += res;
+    }
+
+    if (total < capacity_)
+      return string_view{buf_.get(), total};
+
+    // The file did not fit, grow the buffer and re-read it from the start.
+    capacity_ *= 2;
+    buf_.reset(new char[capacity_]);
+  }
+}
 
-  auto cb = [&sdata](string_view key, string_view value) {
-    size_t space = value.find(' ');
-    string_view num = value.substr(0, space);
+Result<StatusData> StatusReader::Read() {
+  Result<string_view> content = reader_.Read();
+  if (!content)
+    return make_unexpected(content.error());
 
+  StatusData sdata;
+  ForEachKeyValue(*content, [&sdata](string_view key, string_view value) {
     if (key == "VmPeak") {
-      ParseKb(num, &sdata.vm_peak);
+      ParseKb(value, &sdata.vm_peak);
     } else if (key == "VmSize") {
-      ParseKb(num, &sdata.vm_size);
+      ParseKb(value, &sdata.vm_size);
     } else if (key == "VmRSS") {
-      ParseKb(num, &sdata.vm_rss);
+      ParseKb(value, &sdata.vm_rss);
     }
-  };
-
-  error_code ec = ReadProcFile("/proc/self/status", move(cb));
-  if (ec)
-    return make_unexpected(ec);
+  });
 
   return sdata;
 }
 
-Result<MemInfoData> ReadMemInfo() {
-  MemInfoData mdata;
-
-  auto cb = [&mdata](string_view key, string_view value) {
-    size_t space = value.find(' ');
-    string_view num = value.substr(0, space);
+Result<MemInfoData> MemInfoReader::Read() {
+  Result<string_view> content = reader_.Read();
+  if (!content)
+    return make_unexpected(content.error());
 
+  MemInfoData mdata;
+  ForEachKeyValue(*content, [&mdata](string_view key, string_view value) {
     if (key == "MemTotal") {
-      ParseKb(num, &mdata.mem_total);
+      ParseKb(value, &mdata.mem_total);
     } else if (key == "MemFree") {
-      ParseKb(num, &mdata.mem_free);
+      ParseKb(value, &mdata.mem_free);
     } else if (key == "MemAvailable") {
-      ParseKb(num, &mdata.mem_avail);
+      ParseKb(value, &mdata.mem_avail);
     } else if (key == "Buffers") {
-      ParseKb(num, &mdata.mem_buffers);
+      ParseKb(value, &mdata.mem_buffers);
     } else if (key == "Cached") {
-      ParseKb(num, &mdata.mem_cached);
+      ParseKb(value, &mdata.mem_cached);
     } else if (key == "SReclaimable") {
-      ParseKb(num, &mdata.mem_SReclaimable);
+      ParseKb(value, &mdata.mem_SReclaimable);
     } else if (key == "SwapCached") {
-      ParseKb(num, &mdata.swap_cached);
+      ParseKb(value, &mdata.swap_cached);
     } else if (key == "SwapTotal") {
-      ParseKb(num, &mdata.swap_total);
+      ParseKb(value, &mdata.swap_total);
     } else if (key == "SwapFree") {
-      ParseKb(num, &mdata.swap_free);
+      ParseKb(value, &mdata.swap_free);
     }
-  };
+  });
+
+  return mdata;
+}
+
+ProcStatReader::ProcStatReader(pid_t tid)
+    : reader_(tid ? absl::StrCat("/proc/self/task/", tid, "/stat") : string("/proc/self/stat")) {
+}
 
-  error_code ec = ReadProcFile("/proc/meminfo", move(cb));
+Result<ProcStat> ProcStatReader::Read() {
+  Result<string_view> content = reader_.Read();
+  if (!content)
+    return make_unexpected(content.error());
+
+  ProcStat stat;
+  error_code ec = detail::ParseProcStat(*content, &stat);
   if (ec)
     return make_unexpected(ec);
+  return stat;
+}
 
-  return mdata;
+SchedStatReader::SchedStatReader(pid_t tid)
+    : reader_(tid ? absl::StrCat("/proc/self/task/", tid, "/schedstat")
+                  : string("/proc/self/schedstat")) {
+}
+
+Result<SchedStat> SchedStatReader::Read() {
+  Result<string_view> content = reader_.Read();
+  if (!content)
+    return make_unexpected(content.error());
+
+  SchedStat sstat;
+  error_code ec = detail::ParseSchedStat(*content, &sstat);
+  if (ec)
+    return make_unexpected(ec);
+  return sstat;
+}
+
+Result<SockStatData> SockStatReader::Read() {
+  Result<string_view> content = reader_.Read();
+  if (!content)
+    return make_unexpected(content.error());
+
+  SockStatData sdata;
+  error_code ec = detail::ParseSockStat(*content, &sdata);
+  if (ec)
+    return make_unexpected(ec);
+  return sdata;
 }
 
+Result<StatusData> ReadStatusInfo() {
+  return StatusReader{}.Read();
+}
+
+Result<MemInfoData> ReadMemInfo() {
+  return MemInfoReader{}.Read();
+}
+
+Result<ProcStat> ReadProcStat(pid_t tid) {
+  return ProcStatReader{tid}.Read();
+}
+
+Result<SockStatData> ReadSockStat() {
+  return SockStatReader{}.Read();
+}
+
+namespace detail {
+
+// Format: "pid (comm) state ppid ...", see proc(5). comm may contain spaces and parentheses,
+// therefore we start parsing after the last ')'.
+error_code ParseProcStat(string_view content, ProcStat* dest) {
+  size_t rparen = content.rfind(')');
+  if (rparen == string_view::npos)
+    return BadMessage();
+
+  string_view rest = content.substr(rparen + 1);
+  uint64_t utime = 0, stime = 0, rss_pages = 0;
+  bool ok = true;
+
+  // rest starts with field 3 (state). We need fields up to 24 (rss).
+  unsigned field = 3;
+  for (; field <= 24; ++field) {
+    string_view token = NextToken(&rest);
+    if (token.empty())
+      return BadMessage();
+
+    switch (field) {
+      case 3:
+        dest->state = token[0];
+        break;
+      case 10:
+        ok &= SimpleAtoi(token, &dest->minflt);
+        break;
+      case 12:
+        ok &= SimpleAtoi(token, &dest->majflt);
+        break;
+      case 14:
+        ok &= SimpleAtoi(token, &utime);
+        break;
+      case 15:
+        ok &= SimpleAtoi(token, &stime);
+        break;
+      case 20:
+        ok &= SimpleAtoi(token, &dest->num_threads);
+        break;
+      case 23:
+        ok &= SimpleAtoi(token, &dest->vsize);
+        break;
+      case 24:
+        ok &= SimpleAtoi(token, &rss_pages);
+        break;
+    }
+  }
+
+  if (!ok)
+    return BadMessage();
+
+  dest->utime_usec = TicksToUsec(utime);
+  dest->stime_usec = TicksToUsec(stime);
+  dest->rss = rss_pages * PageSize();
+
+  return error_code{};
+}
+
+// Format: "run_ns wait_ns timeslices".
+error_code ParseSchedStat(string_view content, SchedStat* dest) {
+  string_view run = NextToken(&content);
+  string_view wait = NextToken(&content);
+  string_view slices = NextToken(&content);
+
+  if (!SimpleAtoi(run, &dest->run_ns) || !SimpleAtoi(wait, &dest->wait_ns) ||
+      !SimpleAtoi(slices, &dest->timeslices)) {
+    return BadMessage();
+  }
+  return error_code{};
+}
+
+// Format:
+// sockets: used 290
+// TCP: inuse 5 orphan 0 tw 0 alloc 7 mem 1
+// UDP: inuse 2 mem 0
+// Memory is reported in pages.
+error_code ParseSockStat(string_view content, SockStatData* dest) {
+  bool ok = true;
+  ForEachKeyValue(content, [&](string_view key, string_view value) {
+    while (true) {
+      string_view name = NextToken(&value);
+      string_view num = NextToken(&value);
+      if (name.empty() || num.empty())
+        break;
+
+      size_t* field = nullptr;
+      size_t multiplier = 1;
+      if (key == "sockets") {
+        if (name == "used")
+          field = &dest->sockets_used;
+      } else if (key == "TCP") {
+        if (name == "inuse") {
+          field = &dest->tcp_inuse;
+        } else if (name == "orphan") {
+          field = &dest->tcp_orphan;
+        } else if (name == "tw") {
+          field = &dest->tcp_tw;
+        } else if (name == "alloc") {
+          field = &dest->tcp_alloc;
+        } else if (name == "mem") {
+          field = &dest->tcp_mem;
+          multiplier = PageSize();
+        }
+      } else if (key == "UDP") {
+        if (name == "inuse") {
+          field = &dest->udp_inuse;
+        } else if (name == "mem") {
+          field = &dest->udp_mem;
+          multiplier = PageSize();
+        }
+      }
+
+      if (field) {
+        ok &= SimpleAtoi(num, field);
+        *field *= multiplier;
+      }
+    }
+  });
+
+  return ok ? error_code{} : BadMessage();
+}
+
+}  // namespace detail
+
 }  // namespace io
@@ -4,6 +4,11 @@
 
 #pragma once
 
+#include <sys/types.h>
+
+#include <memory>
+#include <string>
+
 #include "io/io.h"
 
 namespace io {
@@ -31,7 +36,130 @@ struct MemInfoData {
   // equals to: total - (free + buffers + cached + SReclaimable).
 };
 
+// Parsed /proc/self/stat or /proc/self/task/<tid>/stat. Sizes in bytes.
+struct ProcStat {
+  uint64_t utime_usec = 0;  // cpu time spent in user mode.
+  uint64_t stime_usec = 0;  // cpu time spent in kernel mode.
+  uint64_t minflt = 0;
+  uint64_t majflt = 0;
+  size_t num_threads = 0;
+  size_t vsize = 0;
+  size_t rss = 0;
+  char state = 0;
+};
+
+// Parsed /proc/self/task/<tid>/schedstat. Times in nanoseconds.
+struct SchedStat {
+  uint64_t run_ns = 0;   // time spent on the cpu.
+  uint64_t wait_ns = 0;  // time spent waiting on a runqueue.
+  uint64_t timeslices = 0;
+};
+
+// Parsed /proc/net/sockstat. Sizes in bytes.
+struct SockStatData {
+  size_t sockets_used = 0;
+  size_t tcp_inuse = 0;
+  size_t tcp_orphan = 0;
+  size_t tcp_tw = 0;
+  size_t tcp_alloc = 0;
+  size_t tcp_mem = 0;
+  size_t udp_inuse = 0;
+  size_t udp_mem = 0;
+};
+
+// Keeps a proc file open and re-reads it with pread from offset 0 into a buffer that is
+// reused between the calls. After the buffer has grown to fit the file, reads do not allocate.
+// Not thread-safe.
+class ProcReader {
+ public:
+  explicit ProcReader(std::string path);
+  ~ProcReader();
+
+  ProcReader(const ProcReader&) = delete;
+  void operator=(const ProcReader&) = delete;
+
+  // Returns the contents of the file. The view is valid until the next call to Read().
+  Result<std::string_view> Read();
+
+  const std::string& path() const {
+    return path_;
+  }
+
+ private:
+  std::string path_;
+  int fd_ = -1;
+  size_t capacity_ = 0;
+  std::unique_ptr<char[]> buf_;
+};
+
+class StatusReader {
+ public:
+  StatusReader() : reader_("/proc/self/status") {
+  }
+
+  Result<StatusData> Read();
+
+ private:
+  ProcReader reader_;
+};
+
+class MemInfoReader {
+ public:
+  MemInfoReader() : reader_("/proc/meminfo") {
+  }
+
+  Result<MemInfoData> Read();
+
+ private:
+  ProcReader reader_;
+};
+
+class ProcStatReader {
+ public:
+  // Reads /proc/self/stat if tid is 0, otherwise /proc/self/task/<tid>/stat.
+  explicit ProcStatReader(pid_t tid = 0);
+
+  Result<ProcStat> Read();
+
+ private:
+  ProcReader reader_;
+};
+
+class SchedStatReader {
+ public:
+  // Reads /proc/self/schedstat if tid is 0, otherwise /proc/self/task/<tid>/schedstat.
+  explicit SchedStatReader(pid_t tid = 0);
+
+  Result<SchedStat> Read();
+
+ private:
+  ProcReader reader_;
+};
+
+class SockStatReader {
+ public:
+  SockStatReader() : reader_("/proc/net/sockstat") {
+  }
+
+  Result<SockStatData> Read();
+
+ private:
+  ProcReader reader_;
+};
+
+// One-shot variants. Prefer the reader classes above for periodic polling.
 Result<StatusData> ReadStatusInfo();
 Result<MemInfoData> ReadMemInfo();
+Result<ProcStat> ReadProcStat(pid_t tid = 0);
+Result<SockStatData> ReadSockStat();
+
+// Parsers that are used by the readers above. Exposed for testing.
+namespace detail {
+
+std::error_code ParseProcStat(std::string_view content, ProcStat* dest);
+std::error_code ParseSchedStat(std::string_view content, SchedStat* dest);
+std::error_code ParseSockStat(std::string_view content, SockStatData* dest);
+
+}  // namespace detail
 
 }  // namespace io
@@ -41,6 +41,10 @@ void AcceptServer::Run() {
 
     for (auto& lw : list_interface_) {
       ProactorBase* proactor = lw->socket()->proactor();
+
+      // Before the dispatch, so that StopAccepting waits for the loop even if it has not
+      // started yet.
+      lw->accept_bc_.Add(1);
       proactor->Dispatch([li = lw.get(), this] {
         li->RunAcceptLoop();
         ref_bc_.Dec();
@@ -60,6 +64,22 @@ void AcceptServer::Stop(bool wait) {
     Wait();
 }
 
+void AcceptServer::Drain(chrono::steady_clock::duration timeout) {
+  VLOG(1) << "AcceptServer::Drain";
+
+  for (auto& lw : list_interface_) {
+    lw->StopAccepting(timeout);
+  }
+}
+
+vector<int> AcceptServer::GetListenerFds() const {
+  vector<int> res;
+  for (const auto& lw : list_interface_) {
+    res.push_back(lw->socket()->native_handle());
+  }
+  return res;
+}
+
 void AcceptServer::Wait() {
   VLOG(1) << "AcceptServer::Wait";
   if (was_run_) {
@@ -160,8 +180,36 @@ error_code AcceptServer::AddUDSListener(const char* path, ListenerInterface* lis
   return ec;
 }
 
+error_code AcceptServer::AdoptListener(int fd, ListenerInterface* listener) {
+  CHECK(listener && !listener->socket());
+
+  int val = 0;
+  socklen_t len = sizeof(val);
+  if (getsockopt(fd, SOL_SOCKET, SO_ACCEPTCONN, &val, &len) < 0)
+    return error_code(errno, system_category());
+  if (!val)
+    return make_error_code(errc::invalid_argument);
+
+  ProactorBase* next = pool_->GetNextProactor();
+  unique_ptr<LinuxSocketBase> fs{next->CreateSocket()};
+
+  error_code ec = next->Await([&] { return fs->Adopt(fd); });
+  if (ec)
+    return ec;
+
+  listener->RegisterPool(pool_);
+  listener->sock_ = std::move(fs);
+  list_interface_.emplace_back(listener);
+
+  return ec;
+}
+
 void AcceptServer::BreakListeners() {
   for (auto& lw : list_interface_) {
+    // A drained listener may share its socket with another process, shutting it down
+    // would break that process as well.
+    if (lw->IsDraining())
+      continue;
     ProactorBase* proactor = lw->socket()->proactor();
     proactor->Dispatch([sock = lw->socket()] { sock->Shutdown(SHUT_RDWR); });
   }
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <functional>
 #include <vector>
 
@@ -31,6 +32,17 @@ class AcceptServer {
 
   void Wait();
 
+  // Graceful alternative to Stop(): stops accepting new connections but keeps the listening
+  // sockets open, so their fds can be handed off to a new process (see listener_handoff.h).
+  // Existing connections are given up to timeout to close on their own before they are
+  // shut down. Returns once the listeners stopped accepting, call Wait() to wait for the drain
+  // to finish. Must be called from a non-proactor thread or from a fiber.
+  void Drain(std::chrono::steady_clock::duration timeout);
+
+  // Returns the listening fds in the order the listeners were added. The fds stay owned by
+  // the server and remain valid until it is destroyed.
+  std::vector<int> GetListenerFds() const;
+
   // Returns the port number to which the listener was bound.
   // Check-fails in case of an error.
   uint16_t AddListener(uint16_t port, ListenerInterface* listener);
@@ -43,6 +55,10 @@ class AcceptServer {
   // Adds a listener on unix domain sockets.
   std::error_code AddUDSListener(const char* path, ListenerInterface* listener);
 
+  // Adds a listener on an already listening socket, for example one that was received from
+  // another process. Takes ownership over fd, unless an error is returned.
+  std::error_code AdoptListener(int fd, ListenerInterface* listener);
+
   void TriggerOnBreakSignal(std::function<void()> f) {
     on_break_hook_ = std::move(f);
   }
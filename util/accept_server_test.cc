@@ -10,6 +10,7 @@
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "util/asio_stream_adapter.h"
+#include "util/connection_placement.h"
 #include "util/listener_interface.h"
 
 #ifdef USE_FB2
@@ -66,6 +67,36 @@ class TestListener : public ListenerInterface {
   }
 };
 
+struct PlacementCounts {
+  atomic_uint32_t picks{0}, closes{0};
+};
+
+class CountingPlacement : public PlacementPolicy {
+ public:
+  explicit CountingPlacement(PlacementCounts* counts) : counts_(counts) {
+  }
+
+  unsigned Pick(LinuxSocketBase* sock) final {
+    counts_->picks.fetch_add(1, memory_order_relaxed);
+    return 0;
+  }
+
+  void OnConnectionClose(unsigned index) final {
+    counts_->closes.fetch_add(1, memory_order_relaxed);
+  }
+
+ private:
+  PlacementCounts* counts_;
+};
+
+// Places connections by itself even though it has a placement policy.
+class CustomPickListener : public TestListener {
+ public:
+  ProactorBase* PickConnectionProactor(LinuxSocketBase* sock) final {
+    return pool()->at(1);
+  }
+};
+
 class AcceptServerTest : public testing::Test {
  protected:
   void SetUp() override;
@@ -78,9 +109,16 @@ class AcceptServerTest : public testing::Test {
   static void SetUpTestCase() {
   }
 
+  // Connects a new client and returns whether the server serves it.
+  bool ConnectAndPing();
+
   std::unique_ptr<ProactorPool> pp_;
   std::unique_ptr<AcceptServer> as_;
   std::unique_ptr<FiberSocketBase> client_sock_;
+  TestListener* listener_ = nullptr;
+
+  // TestConnection does not expect clients to close, so they live until the server stops.
+  std::vector<std::unique_ptr<FiberSocketBase>> extra_socks_;
 };
 
 void AcceptServerTest::SetUp() {
@@ -94,7 +132,8 @@ void AcceptServerTest::SetUp() {
   pp_->Run();
 
   as_.reset(new AcceptServer{up});
-  as_->AddListener("localhost", kPort, new TestListener);
+  listener_ = new TestListener;
+  as_->AddListener("localhost", kPort, listener_);
   as_->Run();
 
   ProactorBase* pb = pp_->GetNextProactor();
@@ -108,6 +147,24 @@ void AcceptServerTest::SetUp() {
   });
 }
 
+bool AcceptServerTest::ConnectAndPing() {
+  ProactorBase* pb = pp_->GetNextProactor();
+  FiberSocketBase* sock = pb->CreateSocket();
+  extra_socks_.emplace_back(sock);
+  FiberSocketBase::endpoint_type ep{boost::asio::ip::make_address("127.0.0.1"), 1234};
+
+  return pb->Await([&] {
+    FiberSocketBase::error_code ec = sock->Connect(ep);
+    CHECK(!ec) << ec;
+
+    uint8_t buf[128] = {1};
+    if (sock->Write(io::Bytes(buf, 1)))
+      return false;
+    auto res = sock->Recv(io::MutableBytes(buf, sizeof(buf)));
+    return res && *res > 0;
+  });
+}
+
 void RunClient(FiberSocketBase* fs) {
   LOG(INFO) << ": Ping-client started";
   AsioStreamAdapter<> asa(*fs);
@@ -126,6 +183,64 @@ TEST_F(AcceptServerTest, Basic) {
   client_sock_->proactor()->Await([&] { RunClient(client_sock_.get()); });
 }
 
+TEST_F(AcceptServerTest, MaxConnections) {
+  listener_->SetMaxConnections(2, 0);
+
+  EXPECT_TRUE(ConnectAndPing());  // along with client_sock_, reaches the limit.
+  EXPECT_FALSE(ConnectAndPing());
+  EXPECT_EQ(1, listener_->num_rejected());
+  EXPECT_EQ(2, listener_->num_connections());
+
+  // Raising the limit takes effect immediately.
+  listener_->SetMaxConnections(3, 0);
+  EXPECT_TRUE(ConnectAndPing());
+}
+
+TEST_F(AcceptServerTest, MaxProactorConnections) {
+  // Each of the 2 proactors serves at most a single connection.
+  listener_->SetMaxConnections(0, 1);
+
+  EXPECT_TRUE(ConnectAndPing());
+  EXPECT_FALSE(ConnectAndPing());
+  EXPECT_EQ(1, listener_->num_rejected());
+}
+
+// The policy is notified only about the connections it placed.
+TEST_F(AcceptServerTest, PlacementNotifications) {
+  for (bool custom_pick : {false, true}) {
+    PlacementCounts counts;
+    AcceptServer as(pp_.get(), false);
+    ListenerInterface* listener = custom_pick ? new CustomPickListener : new TestListener;
+    listener->SetPlacementPolicy(make_unique<CountingPlacement>(&counts));
+    listener->SetMaxConnections(1, 0);
+    uint16_t port = as.AddListener(0, listener);
+    as.Run();
+
+    // The second connection is rejected.
+    vector<unique_ptr<FiberSocketBase>> socks;
+    for (unsigned i = 0; i < 2; ++i) {
+      ProactorBase* pb = pp_->GetNextProactor();
+      socks.emplace_back(pb->CreateSocket());
+      pb->Await([&] {
+        FiberSocketBase::endpoint_type ep{boost::asio::ip::make_address("127.0.0.1"), port};
+        FiberSocketBase::error_code ec = socks.back()->Connect(ep);
+        CHECK(!ec) << ec;
+        uint8_t buf[1] = {1};
+        CHECK(!socks.back()->Write(io::Bytes(buf, 1)));
+        socks.back()->Recv(io::MutableBytes(buf, 1));
+      });
+    }
+    EXPECT_EQ(1, listener->num_rejected()) << custom_pick;
+
+    as.Stop(true);
+    EXPECT_EQ(custom_pick ? 0 : 2, counts.picks) << custom_pick;
+    EXPECT_EQ(counts.picks, counts.closes) << custom_pick;
+
+    for (auto& sock : socks)
+      sock->proactor()->Await([&] { sock->Close(); });
+  }
+}
+
 TEST_F(AcceptServerTest, Break) {
   usleep(1000);
   as_->Stop(true);
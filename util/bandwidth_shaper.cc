@@ -0,0 +1,232 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/bandwidth_shaper.h"
+
+#include <algorithm>
+#include <chrono>
+
+#include "base/logging.h"
+
+#ifdef USE_FB2
+#include "util/fibers/fiber2.h"
+#else
+#include "util/fibers/fiber.h"
+#endif
+
+namespace util {
+
+using namespace std;
+
+namespace {
+
+// The prefix of an iovec array of at most limit bytes. A single iovec larger than the limit
+// is trimmed, otherwise only whole iovecs are taken, so the array is never copied.
+// Leading empty iovecs are skipped, so that a non-empty array never yields an empty prefix.
+struct TrimmedIov {
+  TrimmedIov(const iovec* src, uint32_t src_len, size_t limit) {
+    while (src_len > 0 && src[0].iov_len == 0) {
+      ++src;
+      --src_len;
+    }
+    v = src;
+
+    if (src_len > 0 && src[0].iov_len >= limit) {
+      single = iovec{src[0].iov_base, limit};
+      v = &single;
+      len = 1;
+      size = limit;
+      return;
+    }
+
+    while (len < src_len && size + src[len].iov_len <= limit) {
+      size += src[len].iov_len;
+      ++len;
+    }
+  }
+
+  TrimmedIov(const TrimmedIov&) = delete;
+
+  iovec single;
+  const iovec* v;
+  uint32_t len = 0;
+  size_t size = 0;
+};
+
+size_t IovSize(const iovec* v, uint32_t len) {
+  size_t res = 0;
+  for (uint32_t i = 0; i < len; ++i)
+    res += v[i].iov_len;
+  return res;
+}
+
+}  // namespace
+
+TokenBucket::TokenBucket(uint64_t rate, uint64_t burst) {
+  SetRate(rate, burst);
+}
+
+void TokenBucket::SetRate(uint64_t rate, uint64_t burst) {
+  double ns_per_token = rate ? 1e9 / rate : 0;
+
+  // Rescale the outstanding debt to the new rate.
+  double now = NowNs();
+  if (tat_ > now && ns_per_token_ > 0) {
+    tat_ = now + (tat_ - now) * ns_per_token / ns_per_token_;
+  }
+
+  rate_ = rate;
+  burst_ = max<uint64_t>(burst, 1);
+  ns_per_token_ = ns_per_token;
+}
+
+uint64_t TokenBucket::NowNs() const {
+  return chrono::duration_cast<chrono::nanoseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+uint64_t TokenBucket::Advance(uint64_t n, uint64_t now) {
+  double tat = max<double>(tat_, now);
+  double allowed_at = tat + (double(n) - burst_) * ns_per_token_;
+  tat_ = tat + n * ns_per_token_;
+  return allowed_at > now ? uint64_t(allowed_at) : now;
+}
+
+void TokenBucket::Acquire(uint64_t n) {
+  if (rate_ == 0)
+    return;
+
+  uint64_t now = NowNs();
+  uint64_t allowed_at = Advance(n, now);
+  if (allowed_at > now) {
+    ThisFiber::SleepUntil(chrono::steady_clock::time_point{chrono::nanoseconds(allowed_at)});
+  }
+}
+
+bool TokenBucket::TryAcquire(uint64_t n) {
+  if (rate_ == 0)
+    return true;
+
+  uint64_t now = NowNs();
+  double tat = max<double>(tat_, now);
+  if (tat + (double(n) - burst_) * ns_per_token_ > now)
+    return false;
+
+  tat_ = tat + n * ns_per_token_;
+  return true;
+}
+
+void TokenBucket::Charge(uint64_t n) {
+  if (rate_ != 0)
+    Advance(n, NowNs());
+}
+
+void TokenBucket::Refund(uint64_t n) {
+  tat_ -= n * ns_per_token_;
+}
+
+uint64_t TokenBucket::ChunkSize(uint64_t want) const {
+  return rate_ ? min(want, burst_) : want;
+}
+
+io::Result<size_t> ShapedSink::WriteSome(const iovec* v, uint32_t len) {
+  if (bucket_->rate() == 0)
+    return upstream_->WriteSome(v, len);
+
+  TrimmedIov iov(v, len, bucket_->ChunkSize(IovSize(v, len)));
+  bucket_->Acquire(iov.size);
+
+  io::Result<size_t> res = upstream_->WriteSome(iov.v, iov.len);
+  size_t written = res ? *res : 0;
+  bucket_->Refund(iov.size - written);
+
+  return res;
+}
+
+io::Result<size_t> ShapedSource::ReadSome(const iovec* v, uint32_t len) {
+  if (bucket_->rate() == 0)
+    return upstream_->ReadSome(v, len);
+
+  // Reads are accounted after they complete, so that a reader that waits for data does not
+  // hold tokens that other users of the bucket could use.
+  TrimmedIov iov(v, len, bucket_->ChunkSize(IovSize(v, len)));
+  io::Result<size_t> res = upstream_->ReadSome(iov.v, iov.len);
+  if (res)
+    bucket_->Acquire(*res);
+
+  return res;
+}
+
+ShapedSocket::ShapedSocket(FiberSocketBase* next, TokenBucket* read_bucket,
+                           TokenBucket* write_bucket)
+    : FiberSocketBase(next->proactor()),
+      next_(next),
+      read_bucket_(read_bucket),
+      write_bucket_(write_bucket) {
+}
+
+auto ShapedSocket::Shutdown(int how) -> error_code {
+  return next_->Shutdown(how);
+}
+
+auto ShapedSocket::Accept() -> AcceptResult {
+  return next_->Accept();
+}
+
+auto ShapedSocket::Connect(const endpoint_type& ep) -> error_code {
+  return next_->Connect(ep);
+}
+
+auto ShapedSocket::Close() -> error_code {
+  return next_->Close();
+}
+
+io::Result<size_t> ShapedSocket::RecvMsg(const msghdr& msg, int flags) {
+  if (!read_bucket_ || read_bucket_->rate() == 0)
+    return next_->RecvMsg(msg, flags);
+
+  size_t want = IovSize(msg.msg_iov, msg.msg_iovlen);
+  TrimmedIov iov(msg.msg_iov, msg.msg_iovlen, read_bucket_->ChunkSize(want));
+
+  msghdr trimmed = msg;
+  trimmed.msg_iov = const_cast<iovec*>(iov.v);
+  trimmed.msg_iovlen = iov.len;
+
+  io::Result<size_t> res = next_->RecvMsg(trimmed, flags);
+  if (res)
+    read_bucket_->Acquire(*res);
+  return res;
+}
+
+io::Result<size_t> ShapedSocket::Recv(const io::MutableBytes& mb, int flags) {
+  if (!read_bucket_ || read_bucket_->rate() == 0)
+    return next_->Recv(mb, flags);
+
+  io::Result<size_t> res = next_->Recv(mb.first(read_bucket_->ChunkSize(mb.size())), flags);
+  if (res)
+    read_bucket_->Acquire(*res);
+  return res;
+}
+
+io::Result<size_t> ShapedSocket::WriteSome(const iovec* ptr, uint32_t len) {
+  if (!write_bucket_ || write_bucket_->rate() == 0)
+    return next_->WriteSome(ptr, len);
+
+  TrimmedIov iov(ptr, len, write_bucket_->ChunkSize(IovSize(ptr, len)));
+  write_bucket_->Acquire(iov.size);
+
+  io::Result<size_t> res = next_->WriteSome(iov.v, iov.len);
+  size_t written = res ? *res : 0;
+  write_bucket_->Refund(iov.size - written);
+  return res;
+}
+
+void ShapedSocket::AsyncWriteSome(const iovec* v, uint32_t len, AsyncWriteCb cb) {
+  if (write_bucket_)
+    write_bucket_->Charge(IovSize(v, len));
+  next_->AsyncWriteSome(v, len, std::move(cb));
+}
+
+}  // namespace util
@@ -0,0 +1,137 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+
+#include "util/fiber_socket_base.h"
+
+namespace util {
+
+// Token bucket implemented as GCRA (virtual scheduling): every acquisition advances a virtual
+// clock by its cost, a fiber whose acquisition is ahead of the bucket capacity sleeps until
+// the real time catches up. Waiting fibers are therefore served in FIFO order and do not spin.
+//
+// Not thread-safe. A bucket can be shared by multiple connections, i.e. a tenant, as long as
+// all of them run on the same proactor thread.
+class TokenBucket {
+ public:
+  // rate - tokens (bytes) per second, 0 means unlimited.
+  // burst - bucket capacity, the amount that can be acquired without waiting after idling.
+  TokenBucket(uint64_t rate, uint64_t burst);
+
+  // Can be called at any time, affects the following acquisitions.
+  void SetRate(uint64_t rate, uint64_t burst);
+
+  uint64_t rate() const {
+    return rate_;
+  }
+
+  uint64_t burst() const {
+    return burst_;
+  }
+
+  // Suspends the calling fiber until n tokens are available and takes them.
+  // n may exceed the burst size, in which case the fiber waits for the difference to refill.
+  void Acquire(uint64_t n);
+
+  // Takes n tokens if they are available now. Does not block.
+  bool TryAcquire(uint64_t n);
+
+  // Takes n tokens without waiting, so that following acquisitions wait for them. Used when
+  // the caller can not block, e.g. for asynchronous writes.
+  void Charge(uint64_t n);
+
+  // Returns tokens that were acquired but not used.
+  void Refund(uint64_t n);
+
+  // Returns the amount of tokens to acquire before a single i/o operation, so that large
+  // operations do not take the whole bucket at once.
+  uint64_t ChunkSize(uint64_t want) const;
+
+ private:
+  uint64_t NowNs() const;
+
+  // Returns the time the acquisition of n tokens is allowed at.
+  uint64_t Advance(uint64_t n, uint64_t now);
+
+  uint64_t rate_ = 0, burst_ = 0;
+  double ns_per_token_ = 0;
+  double tat_ = 0;  // theoretical arrival time in ns.
+};
+
+// Shapes the bandwidth of the wrapped sink.
+class ShapedSink : public io::Sink {
+ public:
+  // Does not take ownership over upstream and bucket.
+  ShapedSink(io::Sink* upstream, TokenBucket* bucket) : upstream_(upstream), bucket_(bucket) {
+  }
+
+  using io::Sink::WriteSome;
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final;
+
+ private:
+  io::Sink* upstream_;
+  TokenBucket* bucket_;
+};
+
+// Shapes the bandwidth of the wrapped source.
+class ShapedSource : public io::Source {
+ public:
+  // Does not take ownership over upstream and bucket.
+  ShapedSource(io::Source* upstream, TokenBucket* bucket) : upstream_(upstream), bucket_(bucket) {
+  }
+
+  using io::Source::ReadSome;
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+ private:
+  io::Source* upstream_;
+  TokenBucket* bucket_;
+};
+
+// Socket wrapper that shapes the bandwidth of reads and writes. Reads are accounted after the
+// data arrives, writes before the data is sent. Asynchronous writes do not wait, instead they
+// delay the following operations.
+class ShapedSocket : public FiberSocketBase {
+ public:
+  //! Does not take ownership over next and the buckets. Each of the buckets can be null,
+  //! in which case the corresponding direction is not limited.
+  ShapedSocket(FiberSocketBase* next, TokenBucket* read_bucket, TokenBucket* write_bucket);
+
+  error_code Shutdown(int how) final;
+
+  // Accepted sockets are not shaped.
+  AcceptResult Accept() final;
+
+  error_code Connect(const endpoint_type& ep) final;
+
+  error_code Close() final;
+
+  bool IsOpen() const final {
+    return next_->IsOpen();
+  }
+
+  io::Result<size_t> RecvMsg(const msghdr& msg, int flags) final;
+  io::Result<size_t> Recv(const io::MutableBytes& mb, int flags = 0) final;
+
+  io::Result<size_t> WriteSome(const iovec* ptr, uint32_t len) final;
+  void AsyncWriteSome(const iovec* v, uint32_t len, AsyncWriteCb cb) final;
+
+  void set_read_bucket(TokenBucket* bucket) {
+    read_bucket_ = bucket;
+  }
+
+  void set_write_bucket(TokenBucket* bucket) {
+    write_bucket_ = bucket;
+  }
+
+ private:
+  FiberSocketBase* next_;
+  TokenBucket* read_bucket_;
+  TokenBucket* write_bucket_;
+};
+
+}  // namespace util
@@ -0,0 +1,163 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/bandwidth_shaper.h"
+
+#include <chrono>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "util/fibers/fibers_ext.h"
+
+#ifdef USE_FB2
+#include "util/fibers/pool.h"
+#else
+#include "util/uring/uring_pool.h"
+#endif
+
+namespace util {
+
+using namespace std;
+
+class BandwidthShaperTest : public testing::Test {
+ protected:
+  void SetUp() final {
+#ifdef USE_FB2
+    pp_.reset(fb2::Pool::IOUring(16, 1));
+#else
+    pp_.reset(new uring::UringPool(16, 1));
+#endif
+    pp_->Run();
+  }
+
+  void TearDown() final {
+    pp_->Stop();
+  }
+
+  // Writes total bytes in chunks through a sink shaped by bucket. Returns the elapsed seconds.
+  static double WriteShaped(TokenBucket* bucket, size_t total, size_t chunk);
+
+  unique_ptr<ProactorPool> pp_;
+};
+
+double BandwidthShaperTest::WriteShaped(TokenBucket* bucket, size_t total, size_t chunk) {
+  io::NullSink null_sink;
+  ShapedSink sink(&null_sink, bucket);
+  vector<uint8_t> buf(chunk);
+
+  auto start = chrono::steady_clock::now();
+  for (size_t written = 0; written < total;) {
+    auto res = sink.WriteSome(io::Bytes(buf.data(), min(chunk, total - written)));
+    CHECK(res);
+    written += *res;
+  }
+  return chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+TEST_F(BandwidthShaperTest, TryAcquire) {
+  TokenBucket bucket(1000, 100);
+  EXPECT_TRUE(bucket.TryAcquire(100));
+  EXPECT_FALSE(bucket.TryAcquire(10));
+
+  bucket.Refund(50);
+  EXPECT_TRUE(bucket.TryAcquire(50));
+  EXPECT_FALSE(bucket.TryAcquire(10));
+
+  EXPECT_EQ(100, bucket.ChunkSize(1000));
+
+  // Unlimited.
+  bucket.SetRate(0, 100);
+  EXPECT_TRUE(bucket.TryAcquire(1 << 30));
+  EXPECT_EQ(1000, bucket.ChunkSize(1000));
+}
+
+TEST_F(BandwidthShaperTest, Accuracy) {
+  constexpr uint64_t kRate = 1 << 20;
+
+  double elapsed = pp_->at(0)->Await([] {
+    TokenBucket bucket(kRate, 64 << 10);
+    return WriteShaped(&bucket, 512 << 10, 16 << 10);
+  });
+
+  // The first 64KB are the burst.
+  double expected = double((512 - 64) << 10) / kRate;
+  LOG(INFO) << "elapsed " << elapsed << "s, expected " << expected << "s";
+  EXPECT_GT(elapsed, expected * 0.95);
+  EXPECT_LT(elapsed, expected * 1.15);
+}
+
+TEST_F(BandwidthShaperTest, SharedBucket) {
+  constexpr uint64_t kRate = 1 << 20;
+
+  TokenBucket bucket(kRate, 16 << 10);
+  double elapsed[2];
+  BlockingCounter bc(2);
+
+  // Both connections share the same tenant limit.
+  for (unsigned i = 0; i < 2; ++i) {
+    pp_->at(0)->Dispatch([&, i] {
+      elapsed[i] = WriteShaped(&bucket, 256 << 10, 8 << 10);
+      bc.Dec();
+    });
+  }
+  bc.Wait();
+
+  double expected = double((512 - 16) << 10) / kRate;
+  LOG(INFO) << "elapsed " << elapsed[0] << "s, " << elapsed[1] << "s, expected " << expected;
+  for (double e : elapsed) {
+    EXPECT_GT(e, expected * 0.9);
+    EXPECT_LT(e, expected * 1.15);
+  }
+}
+
+TEST_F(BandwidthShaperTest, SetRate) {
+  constexpr uint64_t kRate = 1 << 20;
+
+  double elapsed = pp_->at(0)->Await([] {
+    TokenBucket bucket(kRate, 16 << 10);
+    double res = WriteShaped(&bucket, 256 << 10, 16 << 10);
+    bucket.SetRate(kRate * 4, 16 << 10);
+    return res + WriteShaped(&bucket, 512 << 10, 16 << 10);
+  });
+
+  double expected = double((256 - 16) << 10) / kRate + double(512 << 10) / (kRate * 4);
+  LOG(INFO) << "elapsed " << elapsed << "s, expected " << expected << "s";
+  EXPECT_GT(elapsed, expected * 0.9);
+  EXPECT_LT(elapsed, expected * 1.15);
+}
+
+// A leading empty iovec must not hide the next one when that one exceeds the burst.
+TEST_F(BandwidthShaperTest, LeadingEmptyIovec) {
+  pp_->at(0)->Await([] {
+    TokenBucket bucket(1 << 30, 1 << 10);
+    io::StringSink string_sink;
+    ShapedSink sink(&string_sink, &bucket);
+
+    string data(4 << 10, 'a');
+    iovec v[2] = {{nullptr, 0}, {data.data(), data.size()}};
+    auto res = sink.WriteSome(v, 2);
+    ASSERT_TRUE(res);
+    EXPECT_EQ(1u << 10, *res);
+
+    string_sink.Clear();
+    EXPECT_FALSE(sink.Write(v, 2));
+    EXPECT_EQ(data, string_sink.str());
+  });
+}
+
+// Overhead of shaping for writes that never wait: unlimited bucket vs one with a huge rate.
+static void BM_ShapedSinkOverhead(benchmark::State& state) {
+  TokenBucket bucket(state.range(0) ? 1ULL << 50 : 0, 1ULL << 40);
+  io::NullSink null_sink;
+  ShapedSink sink(&null_sink, &bucket);
+  uint8_t buf[4096];
+
+  while (state.KeepRunning()) {
+    auto res = sink.WriteSome(io::Bytes(buf, sizeof(buf)));
+    benchmark::DoNotOptimize(res);
+  }
+}
+BENCHMARK(BM_ShapedSinkOverhead)->Arg(0)->Arg(1);
+
+}  // namespace util
@@ -7,6 +7,7 @@
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
 #include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
 #include <absl/time/clock.h>
 #include <openssl/evp.h>
 #include <openssl/hmac.h>
@@ -137,6 +138,17 @@ inline std::string_view std_sv(const ::boost::beast::string_view s) {
 
 constexpr char kAlgo[] = "AWS4-HMAC-SHA256";
 
+string CanonicalHeaders(string_view host, string_view payload_sig, string_view amz_date,
+                        string_view session_token) {
+  string res = absl::StrCat("host", ":", host, "\n");
+  absl::StrAppend(&res, "x-amz-content-sha256", ":", payload_sig, "\n");
+  absl::StrAppend(&res, "x-amz-date", ":", amz_date, "\n");
+  if (!session_token.empty()) {
+    absl::StrAppend(&res, "x-amz-security-token", ":", session_token, "\n");
+  }
+  return res;
+}
+
 // Try reading AwsConnectionData from env.
 std::optional<AwsConnectionData> GetConnectionDataFromEnv() {
   const char* access_key = getenv("AWS_ACCESS_KEY_ID");
@@ -388,13 +400,8 @@ void AwsSignKey::Sign(string_view payload_sig, HttpHeader* header) const {
 
   // TODO: right now I hardcoded the list but if we need more flexible headers,
   // this code much change.
-  string canonical_headers =
-      absl::StrCat("host", ":", std_sv(header->find(h2::field::host)->value()), "\n");
-  absl::StrAppend(&canonical_headers, "x-amz-content-sha256", ":", payload_sig, "\n");
-  absl::StrAppend(&canonical_headers, "x-amz-date", ":", amz_date, "\n");
-  if (!session_token.empty()) {
-    absl::StrAppend(&canonical_headers, "x-amz-security-token", ":", session_token, "\n");
-  }
+  string canonical_headers = CanonicalHeaders(std_sv(header->find(h2::field::host)->value()),
+                                              payload_sig, amz_date, session_token);
 
   SignHeaders sheaders;
   sheaders.method = std_sv(header->method_string());
@@ -453,6 +460,50 @@ string AwsSignKey::AuthHeader(const SignHeaders& headers) const {
   return authorization_header;
 }
 
+bool AwsSignKey::Verify(const AwsConnectionData& connection_data, string_view service,
+                        const HttpHeader& header, string_view body) {
+  // Credential=<access_key>/<date>/<region>/<service>/aws4_request,SignedHeaders=...
+  string_view auth = std_sv(header[h2::field::authorization]);
+  string_view credential = absl::StripPrefix(auth, absl::StrCat(kAlgo, " Credential="));
+  if (credential.size() == auth.size())
+    return false;
+
+  vector<string_view> scope = absl::StrSplit(credential.substr(0, credential.find(',')), '/');
+  if (scope.size() != 5 || scope[0] != connection_data.access_key || scope[3] != service ||
+      scope[4] != "aws4_request") {
+    return false;
+  }
+
+  string_view payload_sig = std_sv(header["x-amz-content-sha256"]);
+  if (payload_sig != AWS::kUnsignedPayloadSig) {
+    char hexdigest[65];
+    Sha256String(body, hexdigest);
+    if (payload_sig != hexdigest)
+      return false;
+  }
+
+  string_view session_token = std_sv(header["x-amz-security-token"]);
+  if (session_token != connection_data.session_token)
+    return false;
+
+  string_view amz_date = std_sv(header["x-amz-date"]);
+  SignHeaders sheaders;
+  sheaders.method = std_sv(header.method_string());
+  sheaders.target = std_sv(header.target());
+  sheaders.content_sha256 = payload_sig;
+  sheaders.amz_date = amz_date;
+  string canonical_headers =
+      CanonicalHeaders(std_sv(header[h2::field::host]), payload_sig, amz_date, session_token);
+  sheaders.headers = canonical_headers;
+
+  AwsConnectionData cd = connection_data;
+  cd.region = scope[2];
+  AwsSignKey key(DeriveSigKey(cd.secret_key, scope[1], scope[2], service),
+                 absl::StrCat(scope[1], "/", scope[2], "/", service, "/aws4_request"), move(cd));
+
+  return key.AuthHeader(sheaders) == auth;
+}
+
 bool AWS::RefreshToken() {
   if (!connection_data_.role_name.empty()) {
     VLOG(1) << "Trying to update expired session token";
@@ -34,6 +34,12 @@ class AwsSignKey {
 
   void Sign(std::string_view payload_sig, HttpHeader* header) const;
 
+  // Checks the signature of a request signed by Sign() with the credentials of connection_data.
+  // Supports only the subset of SigV4 that Sign() produces and does not check the clock skew.
+  // Used by test servers.
+  static bool Verify(const AwsConnectionData& connection_data, std::string_view service,
+                     const HttpHeader& header, std::string_view body);
+
   const AwsConnectionData& connection_data() const {
     return connection_data_;
   }
@@ -0,0 +1,214 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/cloud/chunk_cache.h"
+
+#include <absl/strings/str_cat.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "base/logging.h"
+#include "util/uring/uring_file.h"
+
+namespace util {
+namespace cloud {
+
+using namespace std;
+using nonstd::make_unexpected;
+
+#ifdef USE_FB2
+namespace ufile = fb2;
+#else
+namespace ufile = uring;
+#endif
+
+namespace {
+
+inline error_code LastError() {
+  return error_code{errno, system_category()};
+}
+
+}  // namespace
+
+ChunkCache::ChunkCache(const Options& opts, const char* varz_name) : opts_(opts) {
+  CHECK_GT(opts_.chunk_size, 0u);
+
+  if (varz_name) {
+    varz_.reset(new VarzFunction(varz_name, [this] {
+      Stats stats = GetStats();
+      VarzFunction::KeyValMap res;
+      res.emplace_back("hits", base::VarzValue::FromInt(stats.hits));
+      res.emplace_back("misses", base::VarzValue::FromInt(stats.misses));
+      res.emplace_back("hit_rate", base::VarzValue::FromDouble(stats.hit_rate()));
+      res.emplace_back("hit_bytes", base::VarzValue::FromInt(stats.hit_bytes));
+      res.emplace_back("inserted_bytes", base::VarzValue::FromInt(stats.inserted_bytes));
+      res.emplace_back("evictions", base::VarzValue::FromInt(stats.evictions));
+      res.emplace_back("used_bytes", base::VarzValue::FromInt(stats.used_bytes));
+      res.emplace_back("chunks", base::VarzValue::FromInt(stats.num_chunks));
+      return res;
+    }));
+  }
+}
+
+ChunkCache::~ChunkCache() {
+}
+
+error_code ChunkCache::Init() {
+  if (mkdir(opts_.dir.c_str(), 0755) != 0 && errno != EEXIST)
+    return LastError();
+
+  DIR* dirp = opendir(opts_.dir.c_str());
+  if (!dirp)
+    return LastError();
+
+  while (dirent* entry = readdir(dirp)) {
+    if (entry->d_type == DT_DIR)
+      continue;
+    if (unlinkat(dirfd(dirp), entry->d_name, 0) != 0) {
+      LOG(WARNING) << "Could not remove " << opts_.dir << "/" << entry->d_name << ": "
+                   << LastError().message();
+    }
+  }
+  closedir(dirp);
+
+  return {};
+}
+
+io::Result<size_t> ChunkCache::Read(string_view key, io::MutableBytes dest) {
+  uint64_t id;
+  size_t size;
+  {
+    lock_guard lk(mu_);
+    auto it = index_.find(key);
+    if (it == index_.end()) {
+      misses_.fetch_add(1, memory_order_relaxed);
+      return make_unexpected(make_error_code(errc::no_such_file_or_directory));
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru_it);
+    id = it->second.id;
+    size = it->second.size;
+  }
+  DCHECK_GE(dest.size(), size);
+
+  // The chunk may be evicted concurrently. Once the file is open, its data stays readable
+  // even if it is unlinked.
+  io::Result<io::ReadonlyFile*> file = ufile::OpenRead(ChunkPath(id));
+  if (!file) {
+    misses_.fetch_add(1, memory_order_relaxed);
+    LOG_IF(WARNING, file.error() != errc::no_such_file_or_directory)
+        << "Could not open cached chunk " << key << ": " << file.error().message();
+    return make_unexpected(file.error());
+  }
+
+  unique_ptr<io::ReadonlyFile> fl(*file);
+  io::Result<size_t> res = fl->Read(0, dest.subspan(0, size));
+  error_code ec = fl->Close();
+  if (res && *res != size)
+    res = make_unexpected(make_error_code(errc::io_error));
+  if (res && ec)
+    res = make_unexpected(ec);
+
+  if (!res) {
+    misses_.fetch_add(1, memory_order_relaxed);
+    LOG(WARNING) << "Could not read cached chunk " << key << ": " << res.error().message();
+    return res;
+  }
+
+  hits_.fetch_add(1, memory_order_relaxed);
+  hit_bytes_.fetch_add(size, memory_order_relaxed);
+  return size;
+}
+
+error_code ChunkCache::Insert(string_view key, io::Bytes data) {
+  if (data.size() > opts_.chunk_size)
+    return make_error_code(errc::invalid_argument);
+
+  uint64_t id;
+  {
+    lock_guard lk(mu_);
+    if (index_.contains(key))
+      return {};
+    id = next_id_++;
+  }
+
+  string path = ChunkPath(id);
+  io::Result<io::WriteFile*> file = ufile::OpenWrite(path);
+  if (!file)
+    return file.error();
+
+  unique_ptr<io::WriteFile> fl(*file);
+  error_code ec;
+  if (!data.empty())
+    ec = fl->Write(data);
+  error_code close_ec = fl->Close();
+  if (!ec)
+    ec = close_ec;
+  if (ec) {
+    unlink(path.c_str());
+    return ec;
+  }
+
+  vector<uint64_t> evicted;
+  bool inserted;
+  {
+    lock_guard lk(mu_);
+    auto [it, res] = index_.try_emplace(key);
+    inserted = res;
+
+    // Otherwise another fiber has inserted the same chunk meanwhile.
+    if (inserted) {
+      lru_.emplace_front(key);
+      it->second = Entry{id, data.size(), lru_.begin()};
+      used_bytes_ += data.size();
+      evicted = EvictLocked();
+    }
+  }
+
+  if (inserted) {
+    inserted_bytes_.fetch_add(data.size(), memory_order_relaxed);
+  } else {
+    unlink(path.c_str());
+  }
+
+  for (uint64_t evicted_id : evicted) {
+    unlink(ChunkPath(evicted_id).c_str());
+  }
+  return {};
+}
+
+auto ChunkCache::GetStats() const -> Stats {
+  Stats res;
+  res.hits = hits_.load(memory_order_relaxed);
+  res.misses = misses_.load(memory_order_relaxed);
+  res.hit_bytes = hit_bytes_.load(memory_order_relaxed);
+  res.inserted_bytes = inserted_bytes_.load(memory_order_relaxed);
+  res.evictions = evictions_.load(memory_order_relaxed);
+
+  lock_guard lk(mu_);
+  res.used_bytes = used_bytes_;
+  res.num_chunks = index_.size();
+  return res;
+}
+
+string ChunkCache::ChunkPath(uint64_t id) const {
+  return absl::StrCat(opts_.dir, "/", id);
+}
+
+vector<uint64_t> ChunkCache::EvictLocked() {
+  vector<uint64_t> res;
+  while (used_bytes_ > opts_.capacity && !lru_.empty()) {
+    auto it = index_.find(lru_.back());
+    DCHECK(it != index_.end());
+    res.push_back(it->second.id);
+    used_bytes_ -= it->second.size;
+    index_.erase(it);
+    lru_.pop_back();
+  }
+  evictions_.fetch_add(res.size(), memory_order_relaxed);
+  return res;
+}
+
+}  // namespace cloud
+}  // namespace util
@@ -0,0 +1,110 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "io/io.h"
+#include "util/varz.h"
+
+namespace util {
+namespace cloud {
+
+// Caches fixed-size chunks of remote objects in files under a local directory and evicts
+// the least recently used chunks once their total size exceeds the capacity.
+// The callers build the keys, which should identify the object version, for example
+// "bucket/key/etag/chunk_index", so that the entries of replaced objects are never served and
+// just age out.
+//
+// The index is kept in memory only, Init() clears the leftovers of previous runs.
+// Thread-safe: a single cache can be shared by all proactors. The index is protected by a mutex
+// that is never held during I/O. Files are read and written with uring based files, hence the
+// methods must be called within a proactor thread.
+class ChunkCache {
+ public:
+  struct Options {
+    std::string dir;
+    size_t chunk_size = 1 << 20;
+    size_t capacity = 1ULL << 30;
+  };
+
+  struct Stats {
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    // Bytes served from the cache, i.e. not downloaded again.
+    uint64_t hit_bytes = 0;
+
+    // Bytes that were fetched and inserted into the cache.
+    uint64_t inserted_bytes = 0;
+    uint64_t evictions = 0;
+
+    size_t used_bytes = 0;
+    size_t num_chunks = 0;
+
+    double hit_rate() const {
+      return hits ? double(hits) / (hits + misses) : 0;
+    }
+  };
+
+  // Exports the stats under varz_name if it is not null.
+  explicit ChunkCache(const Options& opts, const char* varz_name = nullptr);
+  ~ChunkCache();
+
+  ChunkCache(const ChunkCache&) = delete;
+  void operator=(const ChunkCache&) = delete;
+
+  // Creates the directory and removes the files it contains.
+  std::error_code Init();
+
+  // Copies the cached chunk into dest, which must be able to hold chunk_size bytes.
+  // Returns the size of the chunk or errc::no_such_file_or_directory on miss.
+  io::Result<size_t> Read(std::string_view key, io::MutableBytes dest);
+
+  // Inserts the chunk, data.size() must not exceed chunk_size. Does nothing if the key
+  // is already cached.
+  std::error_code Insert(std::string_view key, io::Bytes data);
+
+  Stats GetStats() const;
+
+  size_t chunk_size() const {
+    return opts_.chunk_size;
+  }
+
+ private:
+  struct Entry {
+    uint64_t id;
+    size_t size;
+    std::list<std::string>::iterator lru_it;
+  };
+
+  std::string ChunkPath(uint64_t id) const;
+
+  // Removes entries from the lru tail until the cache fits the capacity. Returns the ids of
+  // the removed chunk files. Must be called under mu_.
+  std::vector<uint64_t> EvictLocked();
+
+  Options opts_;
+
+  mutable std::mutex mu_;
+  absl::flat_hash_map<std::string, Entry> index_;
+  std::list<std::string> lru_;  // Most recently used at the front.
+  size_t used_bytes_ = 0;
+  uint64_t next_id_ = 0;
+
+  std::atomic_uint64_t hits_{0}, misses_{0}, hit_bytes_{0}, inserted_bytes_{0}, evictions_{0};
+
+  std::unique_ptr<VarzFunction> varz_;
+};
+
+}  // namespace cloud
+}  // namespace util
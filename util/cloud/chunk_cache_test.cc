@@ -0,0 +1,175 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/cloud/chunk_cache.h"
+
+#include <absl/strings/str_cat.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "io/file_util.h"
+
+#ifdef USE_FB2
+#include "util/fibers/pool.h"
+#else
+#include "util/uring/uring_pool.h"
+#endif
+
+namespace util {
+namespace cloud {
+
+using namespace std;
+
+class ChunkCacheTest : public testing::Test {
+ protected:
+  void SetUp() final {
+#ifdef USE_FB2
+    pp_.reset(fb2::Pool::IOUring(16, 2));
+#else
+    pp_.reset(new uring::UringPool(16, 2));
+#endif
+    pp_->Run();
+
+    dir_ = base::GetTestTempPath("chunk_cache");
+    CHECK_EQ(0, system(("rm -rf " + dir_).c_str()));
+  }
+
+  void TearDown() final {
+    cache_.reset();
+    pp_->Stop();
+  }
+
+  void Create(size_t chunk_size, size_t capacity) {
+    ChunkCache::Options opts;
+    opts.dir = dir_;
+    opts.chunk_size = chunk_size;
+    opts.capacity = capacity;
+    cache_.reset(new ChunkCache(opts));
+    ASSERT_FALSE(cache_->Init());
+  }
+
+  error_code Insert(string_view key, string_view data) {
+    return pp_->GetNextProactor()->Await([&] {
+      return cache_->Insert(key, io::Bytes{reinterpret_cast<const uint8_t*>(data.data()),
+                                           data.size()});
+    });
+  }
+
+  io::Result<string> Read(string_view key) {
+    return pp_->GetNextProactor()->Await([&]() -> io::Result<string> {
+      string res(cache_->chunk_size(), '\0');
+      io::Result<size_t> sz =
+          cache_->Read(key, io::MutableBytes{reinterpret_cast<uint8_t*>(res.data()), res.size()});
+      if (!sz)
+        return nonstd::make_unexpected(sz.error());
+      res.resize(*sz);
+      return res;
+    });
+  }
+
+  size_t NumFiles() {
+    io::Result<io::StatShortVec> files = io::StatFiles(dir_ + "/*");
+    CHECK(files);
+    return files->size();
+  }
+
+  unique_ptr<ProactorPool> pp_;
+  unique_ptr<ChunkCache> cache_;
+  string dir_;
+};
+
+TEST_F(ChunkCacheTest, Basic) {
+  Create(100, 1000);
+
+  io::Result<string> res = Read("obj/0");
+  ASSERT_FALSE(res);
+  EXPECT_EQ(errc::no_such_file_or_directory, res.error());
+
+  ASSERT_FALSE(Insert("obj/0", string(100, 'a')));
+  ASSERT_FALSE(Insert("obj/1", "bbb"));
+  EXPECT_EQ(string(100, 'a'), Read("obj/0"));
+  EXPECT_EQ("bbb", Read("obj/1"));
+  EXPECT_EQ("bbb", Read("obj/1"));
+
+  // Duplicates are ignored, chunks larger than chunk_size are rejected.
+  ASSERT_FALSE(Insert("obj/1", "ccc"));
+  EXPECT_EQ("bbb", Read("obj/1"));
+  EXPECT_EQ(errc::invalid_argument, Insert("obj/2", string(101, 'd')));
+
+  ChunkCache::Stats stats = cache_->GetStats();
+  EXPECT_EQ(4u, stats.hits);
+  EXPECT_EQ(1u, stats.misses);
+  EXPECT_EQ(109u, stats.hit_bytes);
+  EXPECT_EQ(103u, stats.inserted_bytes);
+  EXPECT_EQ(103u, stats.used_bytes);
+  EXPECT_EQ(2u, stats.num_chunks);
+  EXPECT_DOUBLE_EQ(0.8, stats.hit_rate());
+  EXPECT_EQ(2u, NumFiles());
+}
+
+TEST_F(ChunkCacheTest, Evict) {
+  Create(100, 300);
+
+  for (unsigned i = 0; i < 3; ++i) {
+    ASSERT_FALSE(Insert(absl::StrCat("k", i), string(100, 'a' + i)));
+  }
+
+  // k0 becomes the most recently used, hence k1 is evicted.
+  EXPECT_EQ(string(100, 'a'), Read("k0"));
+  ASSERT_FALSE(Insert("k3", string(100, 'd')));
+
+  EXPECT_FALSE(Read("k1"));
+  EXPECT_EQ(string(100, 'a'), Read("k0"));
+  EXPECT_EQ(string(100, 'c'), Read("k2"));
+  EXPECT_EQ(string(100, 'd'), Read("k3"));
+
+  ChunkCache::Stats stats = cache_->GetStats();
+  EXPECT_EQ(1u, stats.evictions);
+  EXPECT_EQ(300u, stats.used_bytes);
+  EXPECT_EQ(3u, stats.num_chunks);
+  EXPECT_EQ(3u, NumFiles());
+}
+
+TEST_F(ChunkCacheTest, InitClears) {
+  Create(100, 1000);
+  ASSERT_FALSE(Insert("k", "value"));
+  EXPECT_EQ(1u, NumFiles());
+
+  // The index does not survive restarts, hence the files of the previous run are stale.
+  Create(100, 1000);
+  EXPECT_EQ(0u, NumFiles());
+  EXPECT_FALSE(Read("k"));
+}
+
+TEST_F(ChunkCacheTest, Shared) {
+  constexpr unsigned kNumKeys = 50;
+  Create(64, 64 * kNumKeys / 2);
+
+  // Both threads insert and read the same keys, while the chunks are being evicted.
+  pp_->AwaitFiberOnAll([&](unsigned index, ProactorBase*) {
+    for (unsigned i = 0; i < kNumKeys; ++i) {
+      string key = absl::StrCat("k", i);
+      string value(64, 'a' + i % 26);
+      ASSERT_FALSE(cache_->Insert(key, io::Bytes{reinterpret_cast<const uint8_t*>(value.data()),
+                                                 value.size()}));
+
+      string dest(64, '\0');
+      io::Result<size_t> res =
+          cache_->Read(key, io::MutableBytes{reinterpret_cast<uint8_t*>(dest.data()), 64});
+      if (res) {
+        EXPECT_EQ(value, dest);
+      } else {
+        EXPECT_EQ(errc::no_such_file_or_directory, res.error());
+      }
+    }
+  });
+
+  ChunkCache::Stats stats = cache_->GetStats();
+  EXPECT_EQ(kNumKeys / 2, stats.num_chunks);
+  EXPECT_EQ(64u * kNumKeys / 2, stats.used_bytes);
+  EXPECT_EQ(kNumKeys / 2, NumFiles());
+}
+
+}  // namespace cloud
+}  // namespace util
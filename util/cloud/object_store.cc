@@ -0,0 +1,399 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/cloud/object_store.h"
+
+#include <absl/strings/match.h>
+#include <absl/strings/str_cat.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#include "base/logging.h"
+#include "util/uring/uring_file.h"
+
+namespace util {
+namespace cloud {
+
+using namespace std;
+using nonstd::make_unexpected;
+
+#ifdef USE_FB2
+namespace ufile = fb2;
+#else
+namespace ufile = uring;
+#endif
+
+namespace {
+
+constexpr string_view kUploadsDir = ".uploads";
+
+atomic_uint64_t next_upload_id{0};
+
+inline error_code LastError() {
+  return error_code{errno, system_category()};
+}
+
+// A key that is used both as an object and as a directory of another object, see the
+// comment of LocalObjectStore.
+inline bool IsKeyConflict(const error_code& ec) {
+  return ec == errc::not_a_directory || ec == errc::is_a_directory;
+}
+
+// Creates the parent directories of path that are below root.
+error_code MakeParentDirs(const string& root, const string& path) {
+  for (size_t pos = path.find('/', root.size() + 1); pos != string::npos;
+       pos = path.find('/', pos + 1)) {
+    string dir = path.substr(0, pos);
+    if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+      return LastError();
+  }
+  return {};
+}
+
+// Removes the parent directories of path that became empty, up to root.
+void RemoveEmptyParents(const string& root, string path) {
+  for (size_t pos = path.rfind('/'); pos != string::npos && pos > root.size();
+       pos = path.rfind('/')) {
+    path.resize(pos);
+    if (rmdir(path.c_str()) != 0)
+      break;
+  }
+}
+
+// Recursively collects the regular files under dir whose keys start with prefix.
+// Subdirectories that can not contain such keys are skipped.
+error_code CollectFiles(const string& dir, const string& key_prefix, string_view prefix,
+                        vector<pair<string, size_t>>* res) {
+  DIR* dirp = opendir(dir.c_str());
+  if (!dirp)
+    return LastError();
+
+  error_code ec;
+  while (dirent* entry = readdir(dirp)) {
+    string_view name = entry->d_name;
+    if (name == "." || name == ".." || (key_prefix.empty() && name == kUploadsDir))
+      continue;
+
+    string key = absl::StrCat(key_prefix, name);
+    struct stat st;
+    if (fstatat(dirfd(dirp), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      if (errno == ENOENT)  // deleted concurrently.
+        continue;
+      ec = LastError();
+      break;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+      key.push_back('/');
+      if (absl::StartsWith(key, prefix) || absl::StartsWith(prefix, key)) {
+        ec = CollectFiles(absl::StrCat(dir, "/", name), key, prefix, res);
+        if (ec)
+          break;
+      }
+    } else if (S_ISREG(st.st_mode) && absl::StartsWith(key, prefix)) {
+      res->emplace_back(std::move(key), st.st_size);
+    }
+  }
+  closedir(dirp);
+
+  return ec;
+}
+
+// Stages the object in a temporary file, similarly to S3 multipart upload.
+class LocalWriteFile final : public io::WriteFile {
+ public:
+  LocalWriteFile(string_view key, io::WriteFile* staged, string staged_path, string path,
+                 string root)
+      : WriteFile(key), staged_(staged), staged_path_(std::move(staged_path)),
+        path_(std::move(path)), root_(std::move(root)) {
+  }
+
+  ~LocalWriteFile() final;
+
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final {
+    return staged_->WriteSome(v, len);
+  }
+
+  error_code Close() final;
+
+ private:
+  unique_ptr<io::WriteFile> staged_;
+  // root_ is a copy since the file may outlive the store.
+  string staged_path_, path_, root_;
+  bool closed_ = false;
+};
+
+LocalWriteFile::~LocalWriteFile() {
+  if (closed_)
+    return;
+
+  // Abandoned upload.
+  error_code ec = staged_->Close();
+  LOG_IF(WARNING, ec) << "Error closing " << staged_path_ << ": " << ec.message();
+  unlink(staged_path_.c_str());
+}
+
+error_code LocalWriteFile::Close() {
+  if (closed_)
+    return {};
+
+  error_code ec = staged_->Close();
+  if (!ec)
+    ec = MakeParentDirs(root_, path_);
+  if (!ec && rename(staged_path_.c_str(), path_.c_str()) != 0)
+    ec = LastError();
+  if (ec) {
+    unlink(staged_path_.c_str());
+    RemoveEmptyParents(root_, path_);
+    if (IsKeyConflict(ec)) {
+      VLOG(1) << "Key " << create_file_name_ << " conflicts with another object";
+      ec = make_error_code(errc::file_exists);
+    }
+  }
+  closed_ = true;
+
+  return ec;
+}
+
+class MemoryReadFile final : public io::ReadonlyFile {
+ public:
+  explicit MemoryReadFile(MemoryObjectStore::Value value) : value_(std::move(value)) {
+  }
+
+  io::Result<size_t> Read(size_t offset, const iovec* v, uint32_t len) final {
+    size_t total = 0;
+    for (; len > 0 && offset < value_->size(); ++v, --len) {
+      size_t sz = min(v->iov_len, value_->size() - offset);
+      memcpy(v->iov_base, value_->data() + offset, sz);
+      offset += sz;
+      total += sz;
+    }
+    return total;
+  }
+
+  error_code Close() final {
+    return {};
+  }
+
+  size_t Size() const final {
+    return value_->size();
+  }
+
+  int Handle() const final {
+    return -1;
+  }
+
+ private:
+  MemoryObjectStore::Value value_;
+};
+
+class MemoryWriteFile final : public io::WriteFile {
+ public:
+  using PutCb = function<void(string_view, string)>;
+
+  MemoryWriteFile(string_view key, PutCb put) : WriteFile(key), put_(std::move(put)) {
+  }
+
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final {
+    size_t total = 0;
+    for (uint32_t i = 0; i < len; ++i) {
+      value_.append(static_cast<const char*>(v[i].iov_base), v[i].iov_len);
+      total += v[i].iov_len;
+    }
+    return total;
+  }
+
+  error_code Close() final {
+    if (put_) {
+      put_(create_file_name_, std::move(value_));
+      put_ = nullptr;
+    }
+    return {};
+  }
+
+ private:
+  PutCb put_;  // Keeps the objects of the store alive.
+  string value_;
+};
+
+}  // namespace
+
+LocalObjectStore::LocalObjectStore(string_view root) : root_(root) {
+  while (root_.size() > 1 && root_.back() == '/')
+    root_.pop_back();
+}
+
+error_code LocalObjectStore::List(string_view prefix, ListObjectCb cb) {
+  vector<pair<string, size_t>> files;
+  error_code ec = CollectFiles(root_, "", prefix, &files);
+  if (ec)
+    return ec;
+
+  // S3 returns keys in lexicographical order.
+  sort(files.begin(), files.end());
+  for (const auto& [key, size] : files) {
+    cb(size, key);
+  }
+  return ec;
+}
+
+io::Result<io::ReadonlyFile*> LocalObjectStore::OpenReadFile(string_view key,
+                                                             const io::ReadonlyFile::Options&) {
+  io::Result<string> path = KeyPath(key);
+  if (!path)
+    return make_unexpected(path.error());
+
+  // Directories are prefixes of other objects and not objects by themselves.
+  struct stat st;
+  if (stat(path->c_str(), &st) != 0) {
+    error_code ec = LastError();
+    return make_unexpected(IsKeyConflict(ec) ? make_error_code(errc::no_such_file_or_directory)
+                                             : ec);
+  }
+  if (S_ISDIR(st.st_mode))
+    return make_unexpected(make_error_code(errc::no_such_file_or_directory));
+
+  return ufile::OpenRead(*path);
+}
+
+io::Result<io::WriteFile*> LocalObjectStore::OpenWriteFile(string_view key) {
+  io::Result<string> path = KeyPath(key);
+  if (!path)
+    return make_unexpected(path.error());
+
+  string uploads = absl::StrCat(root_, "/", kUploadsDir);
+  if (mkdir(uploads.c_str(), 0755) != 0 && errno != EEXIST)
+    return make_unexpected(LastError());
+
+  // Unique across stores that share the root within the process and across processes.
+  string staged_path = absl::StrCat(uploads, "/", getpid(), "-", next_upload_id.fetch_add(1));
+  io::Result<io::WriteFile*> staged = ufile::OpenWrite(staged_path);
+  if (!staged)
+    return staged;
+
+  return new LocalWriteFile(key, *staged, std::move(staged_path), std::move(*path), root_);
+}
+
+error_code LocalObjectStore::Delete(string_view key) {
+  io::Result<string> path = KeyPath(key);
+  if (!path)
+    return path.error();
+
+  if (unlink(path->c_str()) != 0) {
+    error_code ec = LastError();
+    return (ec == errc::no_such_file_or_directory || IsKeyConflict(ec)) ? error_code{} : ec;
+  }
+  RemoveEmptyParents(root_, *path);
+  return {};
+}
+
+io::Result<size_t> LocalObjectStore::ReadRange(string_view key, size_t offset,
+                                               io::MutableBytes dest) {
+  io::Result<io::ReadonlyFile*> file = OpenReadFile(key);
+  if (!file)
+    return make_unexpected(file.error());
+
+  unique_ptr<io::ReadonlyFile> fl(*file);
+  io::Result<size_t> res = offset < fl->Size() ? fl->Read(offset, dest) : 0;
+  error_code ec = fl->Close();
+  if (res && ec)
+    return make_unexpected(ec);
+  return res;
+}
+
+io::Result<string> LocalObjectStore::KeyPath(string_view key) const {
+  bool valid = !key.empty() && key.front() != '/' && key.back() != '/';
+  for (size_t start = 0; valid && start < key.size();) {
+    size_t end = min(key.find('/', start), key.size());
+    string_view part = key.substr(start, end - start);
+    valid = !part.empty() && part != "." && part != ".." && (start > 0 || part != kUploadsDir);
+    start = end + 1;
+  }
+
+  if (!valid) {
+    VLOG(1) << "Unsupported key " << key;
+    return make_unexpected(make_error_code(errc::invalid_argument));
+  }
+  return absl::StrCat(root_, "/", key);
+}
+
+MemoryObjectStore::MemoryObjectStore() : objects_(make_shared<Objects>()) {
+}
+
+error_code MemoryObjectStore::List(string_view prefix, ListObjectCb cb) {
+  vector<pair<string, size_t>> objects;
+  {
+    lock_guard lk(objects_->mu);
+    for (auto it = objects_->map.lower_bound(prefix);
+         it != objects_->map.end() && absl::StartsWith(it->first, prefix); ++it) {
+      objects.emplace_back(it->first, it->second->size());
+    }
+  }
+
+  // The callback runs without the lock, so it may access the store.
+  for (const auto& [key, size] : objects) {
+    cb(size, key);
+  }
+  return {};
+}
+
+io::Result<io::ReadonlyFile*> MemoryObjectStore::OpenReadFile(string_view key,
+                                                              const io::ReadonlyFile::Options&) {
+  Value value = Get(key);
+  if (!value)
+    return make_unexpected(make_error_code(errc::no_such_file_or_directory));
+  return new MemoryReadFile(std::move(value));
+}
+
+io::Result<io::WriteFile*> MemoryObjectStore::OpenWriteFile(string_view key) {
+  return new MemoryWriteFile(key, [objects = objects_](string_view key, string value) {
+    Put(objects.get(), key, std::move(value));
+  });
+}
+
+error_code MemoryObjectStore::Delete(string_view key) {
+  lock_guard lk(objects_->mu);
+  auto it = objects_->map.find(key);
+  if (it != objects_->map.end())
+    objects_->map.erase(it);
+  return {};
+}
+
+io::Result<size_t> MemoryObjectStore::ReadRange(string_view key, size_t offset,
+                                                io::MutableBytes dest) {
+  Value value = Get(key);
+  if (!value)
+    return make_unexpected(make_error_code(errc::no_such_file_or_directory));
+  if (offset >= value->size())
+    return 0;
+
+  size_t sz = min(dest.size(), value->size() - offset);
+  memcpy(dest.data(), value->data() + offset, sz);
+  return sz;
+}
+
+MemoryObjectStore::Value MemoryObjectStore::Get(string_view key) const {
+  lock_guard lk(objects_->mu);
+  auto it = objects_->map.find(key);
+  return it == objects_->map.end() ? nullptr : it->second;
+}
+
+void MemoryObjectStore::Put(string_view key, string value) {
+  Put(objects_.get(), key, std::move(value));
+}
+
+void MemoryObjectStore::Put(Objects* objects, string_view key, string value) {
+  auto ptr = make_shared<const string>(std::move(value));
+  lock_guard lk(objects->mu);
+  objects->map.insert_or_assign(string{key}, std::move(ptr));
+}
+
+}  // namespace cloud
+}  // namespace util
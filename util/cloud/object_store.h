@@ -0,0 +1,124 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "io/file.h"
+
+namespace util {
+namespace cloud {
+
+// Flat key/value object storage. Keys are '/' separated paths without a leading slash.
+// Implementations follow S3 semantics:
+//   * List() returns the objects whose keys start with the prefix, in lexicographical order.
+//   * Objects written via OpenWriteFile() are uploaded in parts and become visible atomically
+//     on a successful Close(). Destroying a write file without closing it abandons the upload.
+//   * Files returned by OpenReadFile() must be read sequentially. ReadRange() serves random
+//     access without downloading the rest of the object.
+// Similarly to the rest of the io classes, stores and the files they open must be used
+// in the context of the proactor thread they were created on.
+class ObjectStore {
+ public:
+  //! Called with (size, key_name) pairs.
+  using ListObjectCb = std::function<void(size_t, std::string_view)>;
+
+  virtual ~ObjectStore() = default;
+
+  virtual std::error_code List(std::string_view prefix, ListObjectCb cb) = 0;
+
+  virtual io::Result<io::ReadonlyFile*> OpenReadFile(
+      std::string_view key,
+      const io::ReadonlyFile::Options& opts = io::ReadonlyFile::Options{}) = 0;
+
+  virtual io::Result<io::WriteFile*> OpenWriteFile(std::string_view key) = 0;
+
+  // Deleting a missing object is not an error, like in S3.
+  virtual std::error_code Delete(std::string_view key) = 0;
+
+  // Reads up to dest.size() bytes starting at offset. Returns less than requested only
+  // if the object ends before, and 0 if offset is past its end.
+  virtual io::Result<size_t> ReadRange(std::string_view key, size_t offset,
+                                       io::MutableBytes dest) = 0;
+};
+
+// Stores objects as files under a local directory, so that code written against S3 can be
+// tested and benchmarked offline. Keys map to relative paths; intermediate directories are
+// created on write. Parts of pending uploads are staged under "<root>/.uploads" and renamed
+// into place on Close(). Uses uring based files, hence must be used within a proactor thread.
+// Unlike S3, an object can not coexist with objects under its key as a prefix, e.g. "a" and
+// "a/b", since "a" can not be both a file and a directory. Close() of the conflicting upload
+// fails with errc::file_exists, while reading or deleting such a key treats it as missing.
+class LocalObjectStore : public ObjectStore {
+ public:
+  explicit LocalObjectStore(std::string_view root);
+
+  std::error_code List(std::string_view prefix, ListObjectCb cb) final;
+
+  io::Result<io::ReadonlyFile*> OpenReadFile(
+      std::string_view key,
+      const io::ReadonlyFile::Options& opts = io::ReadonlyFile::Options{}) final;
+
+  io::Result<io::WriteFile*> OpenWriteFile(std::string_view key) final;
+
+  std::error_code Delete(std::string_view key) final;
+
+  io::Result<size_t> ReadRange(std::string_view key, size_t offset, io::MutableBytes dest) final;
+
+  const std::string& root() const {
+    return root_;
+  }
+
+ private:
+  // Returns the file path for the key or an error if the key can not be mapped safely.
+  io::Result<std::string> KeyPath(std::string_view key) const;
+
+  std::string root_;
+};
+
+// Keeps objects in memory. Can be shared by multiple threads. Open files keep a snapshot of the
+// object, i.e. overwriting or deleting an object does not affect its readers. Write files may
+// outlive the store, like with LocalObjectStore; closing them after the store is destroyed
+// succeeds but the object is dropped together with the rest of the objects.
+class MemoryObjectStore : public ObjectStore {
+ public:
+  using Value = std::shared_ptr<const std::string>;
+
+  MemoryObjectStore();
+
+  std::error_code List(std::string_view prefix, ListObjectCb cb) final;
+
+  io::Result<io::ReadonlyFile*> OpenReadFile(
+      std::string_view key,
+      const io::ReadonlyFile::Options& opts = io::ReadonlyFile::Options{}) final;
+
+  io::Result<io::WriteFile*> OpenWriteFile(std::string_view key) final;
+
+  std::error_code Delete(std::string_view key) final;
+
+  io::Result<size_t> ReadRange(std::string_view key, size_t offset, io::MutableBytes dest) final;
+
+  // Returns null if the object does not exist.
+  Value Get(std::string_view key) const;
+  void Put(std::string_view key, std::string value);
+
+ private:
+  // Shared with the write files.
+  struct Objects {
+    std::mutex mu;
+    std::map<std::string, Value, std::less<>> map;
+  };
+
+  static void Put(Objects* objects, std::string_view key, std::string value);
+
+  std::shared_ptr<Objects> objects_;
+};
+
+}  // namespace cloud
+}  // namespace util
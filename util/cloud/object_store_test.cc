@@ -0,0 +1,250 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/cloud/object_store.h"
+
+#include <gmock/gmock.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "io/file_util.h"
+
+#ifdef USE_FB2
+#include "util/fibers/pool.h"
+#else
+#include "util/uring/uring_pool.h"
+#endif
+
+namespace util {
+namespace cloud {
+
+using namespace std;
+using testing::ElementsAre;
+using testing::Pair;
+
+// The parameter is true for LocalObjectStore and false for MemoryObjectStore.
+class ObjectStoreTest : public testing::TestWithParam<bool> {
+ protected:
+  void SetUp() final {
+#ifdef USE_FB2
+    pp_.reset(fb2::Pool::IOUring(16, 1));
+#else
+    pp_.reset(new uring::UringPool(16, 1));
+#endif
+    pp_->Run();
+
+    if (GetParam()) {
+      root_ = base::GetTestTempPath("object_store");
+      CHECK_EQ(0, system(("rm -rf " + root_ + " && mkdir -p " + root_).c_str()));
+      store_.reset(new LocalObjectStore(root_));
+    } else {
+      store_.reset(new MemoryObjectStore);
+    }
+  }
+
+  void TearDown() final {
+    store_.reset();
+    pp_->Stop();
+  }
+
+  error_code Put(string_view key, string_view value) {
+    return pp_->GetNextProactor()->Await([&]() -> error_code {
+      io::Result<io::WriteFile*> res = store_->OpenWriteFile(key);
+      if (!res)
+        return res.error();
+      unique_ptr<io::WriteFile> file(*res);
+      if (!value.empty()) {
+        error_code ec = file->Write(value);
+        if (ec)
+          return ec;
+      }
+      return file->Close();
+    });
+  }
+
+  io::Result<string> Get(string_view key) {
+    return pp_->GetNextProactor()->Await([&]() -> io::Result<string> {
+      io::Result<io::ReadonlyFile*> res = store_->OpenReadFile(key);
+      if (!res)
+        return nonstd::make_unexpected(res.error());
+      unique_ptr<io::ReadonlyFile> file(*res);
+      string value(file->Size(), '\0');
+      io::Result<size_t> sz = file->Read(0, io::MutableBytes{
+                                                reinterpret_cast<uint8_t*>(value.data()),
+                                                value.size()});
+      if (!sz)
+        return nonstd::make_unexpected(sz.error());
+      value.resize(*sz);
+      return value;
+    });
+  }
+
+  vector<pair<string, size_t>> List(string_view prefix) {
+    vector<pair<string, size_t>> res;
+    error_code ec = pp_->GetNextProactor()->Await([&] {
+      return store_->List(prefix, [&](size_t sz, string_view key) {
+        res.emplace_back(key, sz);
+      });
+    });
+    EXPECT_FALSE(ec) << ec;
+    return res;
+  }
+
+  unique_ptr<ProactorPool> pp_;
+  unique_ptr<ObjectStore> store_;
+  string root_;
+};
+
+TEST_P(ObjectStoreTest, PutGetList) {
+  ASSERT_FALSE(Put("b", "1"));
+  ASSERT_FALSE(Put("a/y/z", "22"));
+  ASSERT_FALSE(Put("a/x", "333"));
+  ASSERT_FALSE(Put("ab", ""));
+  ASSERT_FALSE(Put(".hidden", "4444"));
+
+  EXPECT_THAT(List(""), ElementsAre(Pair(".hidden", 4), Pair("a/x", 3), Pair("a/y/z", 2),
+                                    Pair("ab", 0), Pair("b", 1)));
+
+  // Prefixes are not required to end on a path separator.
+  EXPECT_THAT(List("a"), ElementsAre(Pair("a/x", 3), Pair("a/y/z", 2), Pair("ab", 0)));
+  EXPECT_THAT(List("a/"), ElementsAre(Pair("a/x", 3), Pair("a/y/z", 2)));
+  EXPECT_THAT(List("a/y"), ElementsAre(Pair("a/y/z", 2)));
+  EXPECT_THAT(List("c"), ElementsAre());
+
+  EXPECT_EQ("333", Get("a/x"));
+  EXPECT_EQ("", Get("ab"));
+
+  // Overwrite.
+  ASSERT_FALSE(Put("a/x", "55555"));
+  EXPECT_EQ("55555", Get("a/x"));
+
+  io::Result<string> res = Get("missing");
+  ASSERT_FALSE(res);
+  EXPECT_EQ(errc::no_such_file_or_directory, res.error());
+}
+
+TEST_P(ObjectStoreTest, Upload) {
+  pp_->GetNextProactor()->Await([&] {
+    io::Result<io::WriteFile*> res = store_->OpenWriteFile("dir/obj");
+    ASSERT_TRUE(res);
+    unique_ptr<io::WriteFile> file(*res);
+    ASSERT_FALSE(file->Write(string(100000, 'a')));
+
+    // The object is not visible until the upload completes.
+    io::Result<io::ReadonlyFile*> rres = store_->OpenReadFile("dir/obj");
+    EXPECT_FALSE(rres);
+    ASSERT_FALSE(file->Close());
+
+    // Abandoned uploads leave no trace.
+    res = store_->OpenWriteFile("dir/abandoned");
+    ASSERT_TRUE(res);
+    file.reset(*res);
+    ASSERT_FALSE(file->Write(string(100, 'b')));
+    file.reset();
+  });
+
+  EXPECT_THAT(List(""), ElementsAre(Pair("dir/obj", 100000)));
+  if (GetParam()) {
+    EXPECT_THAT(List(".uploads"), ElementsAre());
+    io::Result<io::StatShortVec> staged = io::StatFiles(root_ + "/.uploads/*");
+    ASSERT_TRUE(staged);
+    EXPECT_TRUE(staged->empty());
+  }
+}
+
+TEST_P(ObjectStoreTest, Delete) {
+  ASSERT_FALSE(Put("a/b/c", "1"));
+  ASSERT_FALSE(Put("a/d", "2"));
+
+  pp_->GetNextProactor()->Await([&] {
+    EXPECT_FALSE(store_->Delete("a/b/c"));
+    EXPECT_FALSE(store_->Delete("a/b/c"));
+    EXPECT_FALSE(store_->Delete("missing/key"));
+  });
+  EXPECT_THAT(List(""), ElementsAre(Pair("a/d", 1)));
+
+  // The key that was a directory before can become an object.
+  ASSERT_FALSE(Put("a/b", "3"));
+  EXPECT_EQ("3", Get("a/b"));
+}
+
+TEST_P(ObjectStoreTest, ReadRange) {
+  string value;
+  for (unsigned i = 0; i < 1000; ++i)
+    value.append(to_string(i));
+  ASSERT_FALSE(Put("obj", value));
+
+  auto read_range = [&](size_t offset, size_t len) -> io::Result<string> {
+    string res(len, '\0');
+    io::Result<size_t> sz = pp_->GetNextProactor()->Await([&] {
+      return store_->ReadRange(
+          "obj", offset, io::MutableBytes{reinterpret_cast<uint8_t*>(res.data()), len});
+    });
+    if (!sz)
+      return nonstd::make_unexpected(sz.error());
+    res.resize(*sz);
+    return res;
+  };
+
+  EXPECT_EQ(value.substr(0, 10), read_range(0, 10));
+  EXPECT_EQ(value.substr(1234, 100), read_range(1234, 100));
+  EXPECT_EQ(value.substr(value.size() - 5), read_range(value.size() - 5, 100));
+  EXPECT_EQ("", read_range(value.size(), 10));
+  EXPECT_EQ("", read_range(value.size() + 10, 10));
+}
+
+TEST_P(ObjectStoreTest, WriteFileOutlivesStore) {
+  unique_ptr<io::WriteFile> file;
+  pp_->GetNextProactor()->Await([&] {
+    io::Result<io::WriteFile*> res = store_->OpenWriteFile("dir/obj");
+    ASSERT_TRUE(res);
+    file.reset(*res);
+    ASSERT_FALSE(file->Write("abc"));
+  });
+
+  store_.reset();
+  pp_->GetNextProactor()->Await([&] { EXPECT_FALSE(file->Close()); });
+  file.reset();
+
+  if (GetParam()) {
+    store_.reset(new LocalObjectStore(root_));
+    EXPECT_EQ("abc", Get("dir/obj"));
+  } else {
+    store_.reset(new MemoryObjectStore);
+  }
+}
+
+// Local objects are files, hence "a" can not coexist with "a/b".
+TEST_P(ObjectStoreTest, LocalKeyConflict) {
+  if (!GetParam())
+    return;
+
+  ASSERT_FALSE(Put("a", "1"));
+  EXPECT_EQ(errc::file_exists, Put("a/b", "2"));
+  EXPECT_EQ(errc::no_such_file_or_directory, Get("a/b").error());
+  EXPECT_FALSE(pp_->GetNextProactor()->Await([&] { return store_->Delete("a/b"); }));
+
+  ASSERT_FALSE(Put("c/d", "3"));
+  EXPECT_EQ(errc::file_exists, Put("c", "4"));
+  EXPECT_EQ(errc::no_such_file_or_directory, Get("c").error());
+  EXPECT_FALSE(pp_->GetNextProactor()->Await([&] { return store_->Delete("c"); }));
+
+  EXPECT_THAT(List(""), ElementsAre(Pair("a", 1), Pair("c/d", 1)));
+}
+
+TEST_P(ObjectStoreTest, InvalidKey) {
+  if (!GetParam())
+    return;
+
+  for (string_view key : {"", "/abs", "dir/", "a//b", "../up", "a/./b", ".uploads/x"}) {
+    EXPECT_EQ(errc::invalid_argument, Put(key, "x")) << key;
+  }
+  EXPECT_THAT(List(""), ElementsAre());
+}
+
+INSTANTIATE_TEST_SUITE_P(Stores, ObjectStoreTest, testing::Bool(),
+                         [](const auto& info) { return info.param ? "Local" : "Memory"; });
+
+}  // namespace cloud
+}  // namespace util
@@ -6,6 +6,7 @@
 
 #include <absl/cleanup/cleanup.h>
 #include <absl/strings/match.h>
+#include <absl/strings/str_cat.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 
@@ -261,24 +262,43 @@ error_code S3Bucket::ListAllObjects(string_view bucket_path, ListObjectCb cb) {
 
 io::Result<io::ReadonlyFile*> S3Bucket::OpenReadFile(string_view path,
                                                      const io::ReadonlyFile::Options& opts) {
-  string host = http_client_->host();
-  string full_path{path};
-  if (IsAwsEndpoint(host)) {
-  } else {
-    full_path = absl::StrCat(bucket_, "/", path);
+  if (read_cache_) {
+    return OpenCachedS3ReadFile(region_, ObjectPath(path), absl::StrCat(bucket_, "/", path),
+                                read_cache_, &aws_, http_client_.get());
   }
-  return OpenS3ReadFile(region_, full_path, &aws_, http_client_.get(), opts);
+  return OpenS3ReadFile(region_, ObjectPath(path), &aws_, http_client_.get(), opts);
 }
 
 io::Result<io::WriteFile*> S3Bucket::OpenWriteFile(std::string_view path) {
-  string host = http_client_->host();
-  string full_path{path};
-  if (IsAwsEndpoint(host)) {
-  } else {
-    full_path = absl::StrCat(bucket_, "/", path);
+  return OpenS3WriteFile(region_, ObjectPath(path), &aws_, http_client_.get());
+}
+
+error_code S3Bucket::Delete(string_view path) {
+  h2::request<h2::empty_body> req{h2::verb::delete_, absl::StrCat("/", ObjectPath(path)), 11};
+  req.set(h2::field::host, http_client_->host());
+  h2::response<h2::string_body> resp;
+
+  error_code ec = aws_.SendRequest(http_client_.get(), &skey_, &req, &resp);
+  if (ec)
+    return ec;
+
+  // S3 responds with 204 even if the object does not exist.
+  if (resp.result() != h2::status::no_content && resp.result() != h2::status::ok) {
+    LOG(ERROR) << "http error: " << resp;
+    return make_error_code(errc::io_error);
   }
+  return ec;
+}
+
+io::Result<size_t> S3Bucket::ReadRange(string_view path, size_t offset, io::MutableBytes dest) {
+  return ReadS3Range(region_, ObjectPath(path), offset, dest, &aws_, http_client_.get());
+}
 
-  return OpenS3WriteFile(region_, full_path, &aws_, http_client_.get());
+string S3Bucket::ObjectPath(string_view path) const {
+  // With AWS endpoints the bucket is part of the host name.
+  if (IsAwsEndpoint(http_client_->host()))
+    return string{path};
+  return absl::StrCat(bucket_, "/", path);
 }
 
 string S3Bucket::GetHost() const {
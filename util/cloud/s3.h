@@ -8,6 +8,8 @@
 #include "io/io.h"
 #include "io/file.h"
 #include "util/cloud/aws.h"
+#include "util/cloud/chunk_cache.h"
+#include "util/cloud/object_store.h"
 #include "util/http/http_client.h"
 
 namespace util {
@@ -25,7 +27,7 @@ ListBucketsResult ListS3Buckets(AWS* aws, http::Client* http_client);
 // Please note that all S3 paths should already be url encoded.
 // We can not do inside S3Bucket because then "/" will be encoded as well.
 // We expect that each path component is already encoded and "/" is being preserved.
-class S3Bucket {
+class S3Bucket : public ObjectStore {
  public:
   S3Bucket(const S3Bucket&) = delete;
   S3Bucket(S3Bucket&&) = default;
@@ -36,9 +38,6 @@ class S3Bucket {
 
   std::error_code Connect(uint32_t ms);
 
-  //! Called with (size, key_name) pairs.
-  using ListObjectCb = std::function<void(size_t, std::string_view)>;
-
   // Iterate over bucket objects for given path, starting from a marker (default none).
   // Up to max_keys entries are returned, possible maximum is 1000.
   // Returns key to start next query from is result is truncated.
@@ -48,12 +47,29 @@ class S3Bucket {
   // Iterate over all bucket objects for the given path.
   std::error_code ListAllObjects(std::string_view path, ListObjectCb cb);
 
+  std::error_code List(std::string_view path, ListObjectCb cb) final {
+    return ListAllObjects(path, std::move(cb));
+  }
+
   io::Result<io::ReadonlyFile*> OpenReadFile(std::string_view path,
-      const io::ReadonlyFile::Options& opts = io::ReadonlyFile::Options{});
+      const io::ReadonlyFile::Options& opts = io::ReadonlyFile::Options{}) final;
+
+  io::Result<io::WriteFile*> OpenWriteFile(std::string_view path) final;
+
+  std::error_code Delete(std::string_view path) final;
+
+  io::Result<size_t> ReadRange(std::string_view path, size_t offset,
+                               io::MutableBytes dest) final;
 
-  io::Result<io::WriteFile*> OpenWriteFile(std::string_view path);
+  // If set, OpenReadFile() reads the objects through the cache, see OpenCachedS3ReadFile().
+  // Does not take ownership, the cache can be shared by buckets on different proactors.
+  void set_read_cache(ChunkCache* cache) {
+    read_cache_ = cache;
+  }
 
  private:
+  // Path of the object in http requests.
+  std::string ObjectPath(std::string_view path) const;
   std::string GetHost() const;
   std::error_code ConnectInternal();
   std::error_code DeriveRegion();
@@ -65,6 +81,7 @@ class S3Bucket {
   std::string region_;
   AwsSignKey skey_;
   std::unique_ptr<http::Client> http_client_;
+  ChunkCache* read_cache_ = nullptr;
 };
 
 }  // namespace cloud
@@ -5,6 +5,7 @@
 
 #include <absl/cleanup/cleanup.h>
 #include <absl/strings/str_cat.h>
+#include <absl/strings/strip.h>
 #include <libxml/xpath.h>
 
 #include <boost/beast/http/buffer_body.hpp>
@@ -47,6 +48,36 @@ std::ostream& operator<<(std::ostream& os, const h2::response<h2::buffer_body>&
   return os;
 }
 
+// Parses "bytes <first>-<last>/<object size>" of a Content-Range header.
+bool ParseContentRange(string_view range, size_t* first, size_t* object_size) {
+  if (!absl::ConsumePrefix(&range, "bytes "))
+    return false;
+  size_t dash = range.find('-'), slash = range.rfind('/');
+  if (dash == string_view::npos || slash == string_view::npos || slash < dash)
+    return false;
+  return absl::SimpleAtoi(range.substr(0, dash), first) &&
+         absl::SimpleAtoi(range.substr(slash + 1), object_size);
+}
+
+// Reads and discards len bytes of the response body.
+error_code SkipBody(http::Client* client, h2::response_parser<h2::buffer_body>* parser,
+                    size_t len) {
+  char buf[4096];
+  auto& body = parser->get().body();
+  while (len > 0 && !parser->is_done()) {
+    size_t chunk = min(len, sizeof(buf));
+    body.data = buf;
+    body.size = chunk;
+
+    http::Client::BoostError ec = client->Recv(parser);
+    if (ec && ec != h2::error::need_buffer) {
+      return ec;
+    }
+    len -= chunk - body.size;
+  }
+  return len ? make_error_code(errc::io_error) : error_code{};
+}
+
 error_code DrainResponse(http::Client* client, h2::response_parser<h2::buffer_body>* parser) {
   char resp[512];
   auto& body = parser->get().body();
@@ -106,8 +137,17 @@ class S3ReadFile : public io::ReadonlyFile {
       : aws_(*aws), client_(client), read_obj_url_(std::move(read_obj_url)) {
   }
 
+  // Reads only the range [offset, end) of the object.
+  S3ReadFile(AWS* aws, http::Client* client, string read_obj_url, size_t offset, size_t end)
+      : S3ReadFile(aws, client, std::move(read_obj_url)) {
+    offs_ = offset;
+    end_ = end;
+  }
+
   virtual ~S3ReadFile() final;
 
+  using io::ReadonlyFile::Read;
+
   // Reads upto length bytes and updates the result to point to the data.
   // May use buffer for storing data. In case, EOF reached sets result.size() < length but still
   // returns Status::OK.
@@ -126,6 +166,26 @@ class S3ReadFile : public io::ReadonlyFile {
     return -1;
   }
 
+  // Reads the rest of the response so that the connection could be reused.
+  error_code Drain() {
+    return DrainResponse(client_, &parser_);
+  }
+
+  // Makes Open() fail with errc::resource_unavailable_try_again if the object has been replaced.
+  void set_if_match(string etag) {
+    if_match_ = std::move(etag);
+  }
+
+  // Valid after Open().
+  const string& etag() const {
+    return etag_;
+  }
+
+  // Size of the whole object, unlike Size() which is the size of the requested range.
+  size_t object_size() const {
+    return object_size_;
+  }
+
  private:
   AWS::HttpParser* parser() {
     return &parser_;
@@ -137,10 +197,51 @@ class S3ReadFile : public io::ReadonlyFile {
   const string read_obj_url_;
 
   AWS::HttpParser parser_;
-  size_t size_ = 0, offs_ = 0;
+  size_t size_ = 0, offs_ = 0, end_ = kuint64max;
+  size_t object_size_ = 0;
+  string etag_, if_match_;
   AwsSignKey sign_key_;
 };
 
+// Reads the object chunk by chunk via the cache and fetches the missing chunks with ranged GETs.
+// The chunks are requested with If-Match, so all of them belong to the same version of
+// the object. Unlike S3ReadFile, supports random access.
+class CachedS3ReadFile final : public io::ReadonlyFile {
+ public:
+  CachedS3ReadFile(string_view region, string path, string key_prefix, size_t size, string etag,
+                   ChunkCache* cache, AWS* aws, http::Client* client)
+      : region_(region), path_(std::move(path)), key_prefix_(std::move(key_prefix)),
+        etag_(std::move(etag)), size_(size), cache_(cache), aws_(aws), client_(client) {
+  }
+
+  io::Result<size_t> Read(size_t offset, const iovec* v, uint32_t len) final;
+
+  error_code Close() final {
+    return error_code{};
+  }
+
+  size_t Size() const final {
+    return size_;
+  }
+
+  int Handle() const final {
+    return -1;
+  }
+
+ private:
+  // Loads the chunk into chunk_buf_.
+  error_code LoadChunk(size_t index);
+
+  const string region_, path_, key_prefix_, etag_;
+  size_t size_;
+  ChunkCache* cache_;
+  AWS* aws_;
+  http::Client* client_;
+
+  unique_ptr<uint8_t[]> chunk_buf_;
+  size_t chunk_index_ = SIZE_MAX, chunk_len_ = 0;
+};
+
 class S3WriteFile : public io::WriteFile {
  public:
   /**
@@ -180,8 +281,11 @@ error_code S3ReadFile::Open(string_view region) {
   h2::request<h2::empty_body> req{h2::verb::get, url, 11};
   req.set(h2::field::host, client_->host());
 
-  if (offs_)
-    SetRange(offs_, kuint64max, &req);
+  const bool has_range = offs_ || end_ < kuint64max;
+  if (has_range)
+    SetRange(offs_, end_, &req);
+  if (!if_match_.empty())
+    req.set(h2::field::if_match, if_match_);
 
   VLOG(1) << "Unsigned request: " << req;
   sign_key_ = aws_.GetSignKey(region);
@@ -200,10 +304,34 @@ error_code S3ReadFile::Open(string_view region) {
     return make_error_code(errc::no_such_file_or_directory);
   }
 
+  if (msg.result() == h2::status::range_not_satisfiable) {
+    ec = DrainResponse(client_, &parser_);
+    if (ec)
+      return ec;
+    return make_error_code(errc::result_out_of_range);
+  }
+
+  if (msg.result() == h2::status::precondition_failed) {
+    ec = DrainResponse(client_, &parser_);
+    if (ec)
+      return ec;
+    return make_error_code(errc::resource_unavailable_try_again);
+  }
+
   if (msg.result() == h2::status::bad_request) {
     return make_error_code(errc::bad_message);
   }
 
+  if (h2::to_status_class(msg.result()) != h2::status_class::successful) {
+    LOG(ERROR) << "S3ReadFile::Open: " << msg.result_int() << " " << msg;
+    h2::status status = msg.result();
+    ec = DrainResponse(client_, &parser_);
+    if (ec)
+      return ec;
+    return make_error_code(status == h2::status::forbidden ? errc::permission_denied
+                                                           : errc::io_error);
+  }
+
   CHECK(parser_.keep_alive()) << "TBD";
 
   auto content_len_it = msg.find(h2::field::content_length);
@@ -218,6 +346,36 @@ error_code S3ReadFile::Open(string_view region) {
     }
   }
 
+  object_size_ = size_;
+  if (msg.result() == h2::status::partial_content) {
+    // The body must start exactly at the requested offset.
+    auto range_it = msg.find(h2::field::content_range);
+    string_view range = range_it == msg.end() ? string_view{} : ToSv(range_it->value());
+    size_t first = 0;
+    if (!ParseContentRange(range, &first, &object_size_) || first != offs_) {
+      LOG(ERROR) << "Unexpected content range '" << range << "' for offset " << offs_;
+      return make_error_code(errc::bad_message);
+    }
+  } else if (has_range) {
+    // The server ignored the range and sends the whole object, skip the bytes before offs_.
+    if (offs_ >= object_size_) {
+      ec = DrainResponse(client_, &parser_);
+      if (ec)
+        return ec;
+      return make_error_code(errc::result_out_of_range);
+    }
+
+    VLOG(1) << "Range was ignored, skipping " << offs_ << " bytes";
+    ec = SkipBody(client_, &parser_, offs_);
+    if (ec)
+      return ec;
+    size_ = min(end_, object_size_) - offs_;
+  }
+
+  auto etag_it = msg.find(h2::field::etag);
+  if (etag_it != msg.end())
+    etag_ = string{ToSv(etag_it->value())};
+
   return ec;
 }
 
@@ -280,6 +438,91 @@ io::Result<size_t> S3ReadFile::Read(size_t offset, const iovec* v, uint32_t len)
   return read_sofar;
 }
 
+io::Result<size_t> CachedS3ReadFile::Read(size_t offset, const iovec* v, uint32_t len) {
+  const size_t chunk_size = cache_->chunk_size();
+  size_t read_sofar = 0;
+
+  for (; len > 0 && offset < size_; ++v, --len) {
+    uint8_t* dest = reinterpret_cast<uint8_t*>(v->iov_base);
+    size_t left = v->iov_len;
+
+    while (left > 0 && offset < size_) {
+      size_t index = offset / chunk_size;
+      if (index != chunk_index_) {
+        error_code ec = LoadChunk(index);
+        if (ec)
+          return nonstd::make_unexpected(ec);
+      }
+
+      size_t chunk_offs = offset - index * chunk_size;
+      size_t sz = std::min(left, chunk_len_ - chunk_offs);
+      memcpy(dest, chunk_buf_.get() + chunk_offs, sz);
+      dest += sz;
+      left -= sz;
+      offset += sz;
+      read_sofar += sz;
+    }
+  }
+
+  return read_sofar;
+}
+
+error_code CachedS3ReadFile::LoadChunk(size_t index) {
+  const size_t chunk_size = cache_->chunk_size();
+  if (!chunk_buf_)
+    chunk_buf_.reset(new uint8_t[chunk_size]);
+
+  size_t start = index * chunk_size;
+  size_t len = std::min(chunk_size, size_ - start);
+  io::MutableBytes dest{chunk_buf_.get(), len};
+  string key = absl::StrCat(key_prefix_, "/", index);
+
+  // Invalidate the current chunk, the buffer is overwritten below.
+  chunk_index_ = SIZE_MAX;
+
+  io::Result<size_t> res = cache_->Read(key, io::MutableBytes{chunk_buf_.get(), chunk_size});
+  if (res && *res == len) {
+    chunk_index_ = index;
+    chunk_len_ = len;
+    return error_code{};
+  }
+
+  S3ReadFile fl(aws_, client_, path_, start, start + len);
+  fl.set_if_match(etag_);
+  error_code ec = fl.Open(region_);
+  if (ec)
+    return ec;
+
+  // Open verified that the body starts at the chunk start. It must also cover the whole chunk
+  // of an object with the expected size, otherwise a wrong chunk would be cached.
+  if (fl.Size() != len || fl.object_size() != size_) {
+    LOG(ERROR) << "Unexpected response for " << path_ << " at " << start << ": " << fl.Size()
+               << "/" << len << ", object size " << fl.object_size() << "/" << size_;
+    ec = fl.Drain();
+    return ec ? ec : make_error_code(errc::bad_message);
+  }
+
+  res = fl.Read(start, dest);
+  if (!res)
+    return res.error();
+  ec = fl.Drain();
+  if (ec)
+    return ec;
+  if (*res != len) {
+    LOG(ERROR) << "Short read of " << path_ << " at " << start << ": " << *res << "/" << len;
+    return make_error_code(errc::io_error);
+  }
+
+  chunk_index_ = index;
+  chunk_len_ = len;
+
+  // Failing to cache the chunk does not fail the read.
+  ec = cache_->Insert(key, dest);
+  LOG_IF(WARNING, ec) << "Could not cache " << key << ": " << ec.message();
+
+  return error_code{};
+}
+
 S3WriteFile::S3WriteFile(string_view name, string upload_id, AwsSignKey skey, AWS* aws,
                          http::Client* client)
     : WriteFile(name), skey_(std::move(skey)), aws_(aws), upload_id_(move(upload_id)),
@@ -287,14 +530,12 @@ S3WriteFile::S3WriteFile(string_view name, string upload_id, AwsSignKey skey, AW
 }
 
 error_code S3WriteFile::Close() {
+  // An empty object is uploaded as a single empty part, otherwise it would not be created.
   error_code ec = Upload();
   if (ec) {
     return ec;
   }
 
-  if (parts_.empty())
-    return ec;
-
   string url("/");
   url.append(create_file_name_);
 
@@ -377,7 +618,7 @@ size_t S3WriteFile::FillBody(const uint8* buffer, size_t length) {
 
 error_code S3WriteFile::Upload() {
   size_t body_size = body_mb_.size();
-  if (body_size == 0)
+  if (body_size == 0 && !parts_.empty())
     return error_code{};
 
   string url("/");
@@ -438,6 +679,58 @@ io::Result<io::ReadonlyFile*> OpenS3ReadFile(std::string_view region, string_vie
   return fl.release();
 }
 
+io::Result<io::ReadonlyFile*> OpenCachedS3ReadFile(string_view region, string_view path,
+                                                   string_view cache_key, ChunkCache* cache,
+                                                   AWS* aws, http::Client* client) {
+  VLOG(1) << "OpenCachedS3ReadFile: " << path;
+
+  // Fetches the size and the ETag of the object with a single byte request.
+  S3ReadFile probe(aws, client, string{path}, 0, 1);
+  error_code ec = probe.Open(region);
+
+  // Empty objects do not satisfy any range, there is nothing to cache.
+  if (ec == errc::result_out_of_range)
+    return OpenS3ReadFile(region, path, aws, client);
+  if (ec)
+    return nonstd::make_unexpected(ec);
+
+  ec = probe.Drain();
+  if (ec)
+    return nonstd::make_unexpected(ec);
+
+  if (probe.etag().empty()) {
+    LOG(WARNING) << "No ETag for " << path << ", reading without the cache";
+    return OpenS3ReadFile(region, path, aws, client);
+  }
+
+  return new CachedS3ReadFile(region, string{path}, absl::StrCat(cache_key, "/", probe.etag()),
+                              probe.object_size(), probe.etag(), cache, aws, client);
+}
+
+io::Result<size_t> ReadS3Range(string_view region, string_view path, size_t offset,
+                               io::MutableBytes dest, AWS* aws, http::Client* client) {
+  if (dest.empty())
+    return 0;
+
+  VLOG(1) << "ReadS3Range: " << path << " " << offset << "/" << dest.size();
+  S3ReadFile fl(aws, client, string{path}, offset, offset + dest.size());
+  error_code ec = fl.Open(region);
+  if (ec == errc::result_out_of_range)
+    return 0;
+  if (ec)
+    return nonstd::make_unexpected(ec);
+
+  io::Result<size_t> res = fl.Read(offset, dest);
+  if (!res)
+    return res;
+
+  // If the server ignored the range header, the rest of the object follows.
+  ec = fl.Drain();
+  if (ec)
+    return nonstd::make_unexpected(ec);
+  return res;
+}
+
 io::Result<io::WriteFile*> OpenS3WriteFile(string_view region, string_view key_path, AWS* aws,
                                            http::Client* client) {
   string url("/");
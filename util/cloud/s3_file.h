@@ -6,6 +6,7 @@
 
 #include "io/file.h"
 #include "util/cloud/aws.h"
+#include "util/cloud/chunk_cache.h"
 #include "util/http/http_client.h"
 
 namespace util {
@@ -15,6 +16,19 @@ io::Result<io::ReadonlyFile*> OpenS3ReadFile(
     std::string_view region, std::string_view path, AWS* aws, http::Client* client,
     const io::ReadonlyFile::Options& opts = io::ReadonlyFile::Options{});
 
+// Reads the object through the cache. The chunks are keyed by cache_key and the ETag of the object,
+// hence cache_key should identify the object across buckets, for example "bucket/path".
+// Costs a single byte request to find the current ETag, even if all the chunks are cached.
+// The returned file supports random access reads.
+io::Result<io::ReadonlyFile*> OpenCachedS3ReadFile(std::string_view region, std::string_view path,
+                                                   std::string_view cache_key, ChunkCache* cache,
+                                                   AWS* aws, http::Client* client);
+
+// Reads up to dest.size() bytes of the object starting at offset with a single ranged GET.
+// Returns 0 if offset is past the end of the object.
+io::Result<size_t> ReadS3Range(std::string_view region, std::string_view path, size_t offset,
+                               io::MutableBytes dest, AWS* aws, http::Client* client);
+
 io::Result<io::WriteFile*> OpenS3WriteFile(std::string_view region, std::string_view key_path,
                                            AWS* aws, http::Client* client);
 
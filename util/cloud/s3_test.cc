@@ -0,0 +1,456 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include <gmock/gmock.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "util/accept_server.h"
+#include "util/cloud/chunk_cache.h"
+#include "util/cloud/s3.h"
+#include "util/cloud/s3_test_server.h"
+
+#ifdef USE_FB2
+#include "util/fibers/pool.h"
+#else
+#include "util/uring/uring_pool.h"
+#endif
+
+namespace util {
+namespace cloud {
+
+using namespace std;
+using testing::ElementsAre;
+using testing::Pair;
+
+namespace {
+
+constexpr char kAccessKey[] = "AKIDTEST";
+constexpr char kSecretKey[] = "test-secret";
+
+ProactorPool* CreatePool() {
+#ifdef USE_FB2
+  return fb2::Pool::IOUring(16, 1);
+#else
+  return new uring::UringPool(16, 1);
+#endif
+}
+
+string MakeValue(size_t size, char seed) {
+  string res(size, '\0');
+  for (size_t i = 0; i < size; ++i)
+    res[i] = seed + i % 61;
+  return res;
+}
+
+// Runs S3 client against S3TestServer over loopback.
+class S3TestEnv {
+ public:
+  template <typename F> auto Await(F&& f) {
+    return pp_->GetNextProactor()->Await(std::forward<F>(f));
+  }
+
+  explicit S3TestEnv(S3TestServer::Options opts = S3TestServer::Options{}) {
+    setenv("AWS_ACCESS_KEY_ID", kAccessKey, 1);
+    setenv("AWS_SECRET_ACCESS_KEY", kSecretKey, 1);
+    opts.credentials.access_key = kAccessKey;
+    opts.credentials.secret_key = kSecretKey;
+    bucket_name_ = opts.bucket;
+
+    pp_.reset(CreatePool());
+    pp_->Run();
+    server_ = new S3TestServer(&store_, std::move(opts));
+    as_.reset(new AcceptServer{pp_.get(), false});
+    port_ = as_->AddListener(0, server_);
+    as_->Run();
+  }
+
+  ~S3TestEnv() {
+    Await([this] { bucket_.reset(); });
+    as_->Stop(true);
+    pp_->Stop();
+  }
+
+  // Connects the bucket with the given secret key.
+  error_code Connect(string_view secret_key = kSecretKey) {
+    setenv("AWS_SECRET_ACCESS_KEY", string(secret_key).c_str(), 1);
+    return Await([&]() -> error_code {
+      aws_.reset(new AWS{"s3", "us-east-1"});
+      error_code ec = aws_->Init();
+      if (ec)
+        return ec;
+      bucket_.reset(new S3Bucket(
+          S3Bucket::FromEndpoint(*aws_, absl::StrCat("127.0.0.1:", port_), bucket_name_)));
+      return bucket_->Connect(1000);
+    });
+  }
+
+  S3Bucket* bucket() {
+    return bucket_.get();
+  }
+
+  S3TestServer* server() {
+    return server_;
+  }
+
+  MemoryObjectStore* store() {
+    return &store_;
+  }
+
+ private:
+  unique_ptr<ProactorPool> pp_;
+  unique_ptr<AcceptServer> as_;
+  MemoryObjectStore store_;
+  S3TestServer* server_;
+  uint16_t port_;
+  string bucket_name_;
+  unique_ptr<AWS> aws_;
+  unique_ptr<S3Bucket> bucket_;
+};
+
+// Helpers that go through ObjectStore interface and run in the proactor thread.
+error_code Put(ObjectStore* store, string_view key, string_view value) {
+  io::Result<io::WriteFile*> res = store->OpenWriteFile(key);
+  if (!res)
+    return res.error();
+  unique_ptr<io::WriteFile> file(*res);
+  if (!value.empty()) {
+    error_code ec = file->Write(value);
+    if (ec)
+      return ec;
+  }
+  return file->Close();
+}
+
+io::Result<string> Get(ObjectStore* store, string_view key) {
+  io::Result<io::ReadonlyFile*> res = store->OpenReadFile(key);
+  if (!res)
+    return nonstd::make_unexpected(res.error());
+
+  unique_ptr<io::ReadonlyFile> file(*res);
+  string value(file->Size(), '\0');
+  size_t offset = 0;
+
+  // Sequential reads in small chunks.
+  while (offset < value.size()) {
+    size_t len = min<size_t>(value.size() - offset, 1 << 20);
+    io::Result<size_t> sz = file->Read(
+        offset, io::MutableBytes{reinterpret_cast<uint8_t*>(value.data()) + offset, len});
+    if (!sz)
+      return nonstd::make_unexpected(sz.error());
+    if (*sz == 0)
+      break;
+    offset += *sz;
+  }
+  value.resize(offset);
+  return value;
+}
+
+io::Result<string> ReadRange(ObjectStore* store, string_view key, size_t offset, size_t len) {
+  string res(len, '\0');
+  io::Result<size_t> sz =
+      store->ReadRange(key, offset, io::MutableBytes{reinterpret_cast<uint8_t*>(res.data()), len});
+  if (!sz)
+    return nonstd::make_unexpected(sz.error());
+  res.resize(*sz);
+  return res;
+}
+
+vector<pair<string, size_t>> List(ObjectStore* store, string_view prefix) {
+  vector<pair<string, size_t>> res;
+  error_code ec =
+      store->List(prefix, [&](size_t sz, string_view key) { res.emplace_back(key, sz); });
+  EXPECT_FALSE(ec) << ec;
+  return res;
+}
+
+}  // namespace
+
+class S3Test : public testing::Test {
+ protected:
+  void SetUp() final {
+    env_.reset(new S3TestEnv);
+    ASSERT_FALSE(env_->Connect());
+  }
+
+  void TearDown() final {
+    env_.reset();
+  }
+
+  unique_ptr<S3TestEnv> env_;
+};
+
+TEST_F(S3Test, Multipart) {
+  // 8MB parts.
+  string value = MakeValue(20 << 20, 'a');
+
+  env_->Await([&] {
+    ASSERT_FALSE(Put(env_->bucket(), "dir/big", value));
+    ASSERT_FALSE(Put(env_->bucket(), "small", "hello"));
+
+    io::Result<string> res = Get(env_->bucket(), "dir/big");
+    ASSERT_TRUE(res) << res.error();
+    EXPECT_TRUE(*res == value);
+    EXPECT_EQ("hello", Get(env_->bucket(), "small"));
+
+    EXPECT_THAT(List(env_->bucket(), ""), ElementsAre(Pair("dir/big", 20 << 20),
+                                                      Pair("small", 5)));
+    EXPECT_THAT(List(env_->bucket(), "dir/"), ElementsAre(Pair("dir/big", 20 << 20)));
+
+    res = Get(env_->bucket(), "missing");
+    ASSERT_FALSE(res);
+    EXPECT_EQ(errc::no_such_file_or_directory, res.error());
+  });
+  EXPECT_EQ(0u, env_->server()->num_pending_uploads());
+  EXPECT_TRUE(*env_->store()->Get("dir/big") == value);
+}
+
+TEST_F(S3Test, EmptyObject) {
+  env_->Await([&] {
+    ASSERT_FALSE(Put(env_->bucket(), "empty", ""));
+    EXPECT_EQ("", Get(env_->bucket(), "empty"));
+    EXPECT_THAT(List(env_->bucket(), ""), ElementsAre(Pair("empty", 0)));
+  });
+}
+
+TEST_F(S3Test, ReadRange) {
+  string value = MakeValue(100000, '0');
+  env_->store()->Put("obj", value);
+
+  env_->Await([&] {
+    ObjectStore* bucket = env_->bucket();
+    EXPECT_EQ(value.substr(0, 10), ReadRange(bucket, "obj", 0, 10));
+    EXPECT_EQ(value.substr(5000, 30000), ReadRange(bucket, "obj", 5000, 30000));
+    EXPECT_EQ(value.substr(99990), ReadRange(bucket, "obj", 99990, 100));
+    EXPECT_EQ("", ReadRange(bucket, "obj", 100000, 10));
+
+    // The connection is still usable.
+    EXPECT_EQ(value, Get(bucket, "obj"));
+  });
+}
+
+TEST_F(S3Test, Delete) {
+  env_->store()->Put("a", "1");
+  env_->store()->Put("b", "2");
+
+  env_->Await([&] {
+    EXPECT_FALSE(env_->bucket()->Delete("a"));
+    EXPECT_FALSE(env_->bucket()->Delete("missing"));
+    EXPECT_THAT(List(env_->bucket(), ""), ElementsAre(Pair("b", 1)));
+  });
+}
+
+TEST_F(S3Test, ReadCache) {
+  ChunkCache::Options opts;
+  opts.dir = base::GetTestTempPath("s3_read_cache");
+  opts.chunk_size = 1 << 20;
+  ChunkCache cache(opts);
+
+  string value = MakeValue((7 << 20) / 2, 'a');
+  env_->store()->Put("obj", value);
+
+  env_->Await([&] {
+    ASSERT_FALSE(cache.Init());
+    env_->bucket()->set_read_cache(&cache);
+    EXPECT_EQ(value, Get(env_->bucket(), "obj"));
+  });
+  ChunkCache::Stats stats = cache.GetStats();
+  EXPECT_EQ(4u, stats.misses);
+  EXPECT_EQ(0u, stats.hits);
+  EXPECT_EQ(value.size(), stats.inserted_bytes);
+
+  // Only the probe request reaches the server.
+  uint64_t requests = env_->server()->num_requests();
+  env_->Await([&] { EXPECT_EQ(value, Get(env_->bucket(), "obj")); });
+  EXPECT_EQ(1u, env_->server()->num_requests() - requests);
+  stats = cache.GetStats();
+  EXPECT_EQ(4u, stats.hits);
+  EXPECT_EQ(value.size(), stats.hit_bytes);
+
+  env_->Await([&] {
+    io::Result<io::ReadonlyFile*> res = env_->bucket()->OpenReadFile("obj");
+    ASSERT_TRUE(res);
+    unique_ptr<io::ReadonlyFile> file(*res);
+
+    // Random access within the cached chunks.
+    string dest(100, '\0');
+    io::MutableBytes mb{reinterpret_cast<uint8_t*>(dest.data()), dest.size()};
+    ASSERT_EQ(100u, file->Read((3 << 20) / 2, mb));
+    EXPECT_EQ(value.substr((3 << 20) / 2, 100), dest);
+    ASSERT_EQ(100u, file->Read(10, mb));
+    EXPECT_EQ(value.substr(10, 100), dest);
+
+    // The chunks of the replaced object are not served.
+    string value2 = MakeValue(value.size(), 'b');
+    env_->store()->Put("obj", value2);
+    EXPECT_EQ(value2, Get(env_->bucket(), "obj"));
+
+    // The open file keeps reading the cached chunks of its version.
+    ASSERT_EQ(10u, file->Read(value.size() - 10, mb));
+    EXPECT_EQ(value.substr(value.size() - 10), dest.substr(0, 10));
+  });
+}
+
+TEST_F(S3Test, ReadCacheReplaced) {
+  ChunkCache::Options opts;
+  opts.dir = base::GetTestTempPath("s3_read_cache");
+  opts.chunk_size = 1 << 20;
+  ChunkCache cache(opts);
+
+  string value = MakeValue(3 << 20, 'a');
+  env_->store()->Put("obj", value);
+
+  env_->Await([&] {
+    ASSERT_FALSE(cache.Init());
+    env_->bucket()->set_read_cache(&cache);
+
+    io::Result<io::ReadonlyFile*> res = env_->bucket()->OpenReadFile("obj");
+    ASSERT_TRUE(res);
+    unique_ptr<io::ReadonlyFile> file(*res);
+    string dest(100, '\0');
+    io::MutableBytes mb{reinterpret_cast<uint8_t*>(dest.data()), dest.size()};
+    ASSERT_EQ(100u, file->Read(0, mb));
+
+    // The rest of the chunks are fetched with If-Match and must not mix the versions.
+    env_->store()->Put("obj", MakeValue(3 << 20, 'b'));
+    io::Result<size_t> sz = file->Read(2 << 20, mb);
+    ASSERT_FALSE(sz);
+    EXPECT_EQ(errc::resource_unavailable_try_again, sz.error());
+  });
+}
+
+TEST(S3ServerTest, RangeIgnored) {
+  S3TestServer::Options opts;
+  opts.ignore_range = true;
+  S3TestEnv env(opts);
+  ASSERT_FALSE(env.Connect());
+
+  string value = MakeValue(100000, '0');
+  env.store()->Put("obj", value);
+
+  env.Await([&] {
+    ObjectStore* bucket = env.bucket();
+    EXPECT_EQ(value.substr(0, 10), ReadRange(bucket, "obj", 0, 10));
+    EXPECT_EQ(value.substr(5000, 30000), ReadRange(bucket, "obj", 5000, 30000));
+    EXPECT_EQ(value.substr(99990), ReadRange(bucket, "obj", 99990, 100));
+    EXPECT_EQ("", ReadRange(bucket, "obj", 100000, 10));
+    EXPECT_EQ(value, Get(bucket, "obj"));
+  });
+}
+
+// Chunks of a server that ignores ranges are cut from the whole object before caching.
+TEST(S3ServerTest, ReadCacheRangeIgnored) {
+  S3TestServer::Options opts;
+  opts.ignore_range = true;
+  S3TestEnv env(opts);
+  ASSERT_FALSE(env.Connect());
+
+  ChunkCache::Options cache_opts;
+  cache_opts.dir = base::GetTestTempPath("s3_read_cache_range_ignored");
+  cache_opts.chunk_size = 1 << 20;
+  ChunkCache cache(cache_opts);
+
+  string value = MakeValue((3 << 20) + 1000, 'a');
+  env.store()->Put("obj", value);
+
+  env.Await([&] {
+    ASSERT_FALSE(cache.Init());
+    env.bucket()->set_read_cache(&cache);
+    EXPECT_EQ(value, Get(env.bucket(), "obj"));
+
+    // Served from the cache.
+    EXPECT_EQ(value, Get(env.bucket(), "obj"));
+  });
+  EXPECT_EQ(4u, cache.GetStats().hits);
+}
+
+TEST(S3ServerTest, Pagination) {
+  S3TestServer::Options opts;
+  opts.max_keys = 3;
+  S3TestEnv env(opts);
+  ASSERT_FALSE(env.Connect());
+
+  for (unsigned i = 0; i < 10; ++i)
+    env.store()->Put(absl::StrCat("key", i), string(i, 'x'));
+
+  uint64_t requests = env.server()->num_requests();
+  vector<pair<string, size_t>> res = env.Await([&] { return List(env.bucket(), "key"); });
+  ASSERT_EQ(10u, res.size());
+  for (unsigned i = 0; i < 10; ++i)
+    EXPECT_THAT(res[i], Pair(absl::StrCat("key", i), i));
+  EXPECT_EQ(4u, env.server()->num_requests() - requests);
+}
+
+TEST(S3ServerTest, ListMaxKeysZero) {
+  MemoryObjectStore store;
+  store.Put("key0", "a");
+  store.Put("key1", "b");
+  S3TestServer server(&store, S3TestServer::Options{});
+
+  auto list = [&](const char* query) {
+    S3TestServer::RequestType req{boost::beast::http::verb::get,
+                                  absl::StrCat("/test-bucket?list-type=2&", query), 11};
+    return server.Handle(req).body();
+  };
+
+  // A truncated page without a continuation token would make clients list forever.
+  for (const char* query : {"max-keys=0", "max-keys=0&start-after=key0"}) {
+    string body = list(query);
+    EXPECT_THAT(body,
+                testing::HasSubstr("<IsTruncated>false</IsTruncated><KeyCount>0</KeyCount>"))
+        << query;
+    EXPECT_THAT(body, testing::Not(testing::HasSubstr("NextContinuationToken"))) << query;
+  }
+
+  string body = list("max-keys=1");
+  EXPECT_THAT(body, testing::HasSubstr("<NextContinuationToken>key0</NextContinuationToken>"));
+  EXPECT_THAT(body, testing::HasSubstr("<Key>key0</Key>"));
+}
+
+TEST(S3ServerTest, BadSignature) {
+  S3TestEnv env;
+  env.store()->Put("a", "1");
+
+  // Connect does not fail because, like S3, the server reports the region regardless of
+  // the signature.
+  ASSERT_FALSE(env.Connect("wrong-secret"));
+  env.Await([&] {
+    EXPECT_FALSE(env.bucket()->ListObjects("", [](size_t, string_view) {}));
+    io::Result<string> res = Get(env.bucket(), "a");
+    ASSERT_FALSE(res);
+    EXPECT_EQ(errc::permission_denied, res.error());
+  });
+}
+
+void BM_S3Write(benchmark::State& state) {
+  S3TestServer::Options opts;
+  opts.conn_bandwidth = state.range(0) << 20;
+  S3TestEnv env(opts);
+  CHECK(!env.Connect());
+
+  string value = MakeValue(32 << 20, 'a');
+  while (state.KeepRunning()) {
+    env.Await([&] { CHECK(!Put(env.bucket(), "obj", value)); });
+  }
+  state.SetBytesProcessed(state.iterations() * value.size());
+}
+BENCHMARK(BM_S3Write)->Arg(0)->Arg(200)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+void BM_S3Read(benchmark::State& state) {
+  S3TestServer::Options opts;
+  opts.conn_bandwidth = state.range(0) << 20;
+  S3TestEnv env(opts);
+  CHECK(!env.Connect());
+
+  string value = MakeValue(32 << 20, 'a');
+  env.store()->Put("obj", value);
+  while (state.KeepRunning()) {
+    env.Await([&] { CHECK(Get(env.bucket(), "obj")); });
+  }
+  state.SetBytesProcessed(state.iterations() * value.size());
+}
+BENCHMARK(BM_S3Read)->Arg(0)->Arg(200)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+}  // namespace cloud
+}  // namespace util
@@ -0,0 +1,491 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/cloud/s3_test_server.h"
+
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
+
+#include <optional>
+
+#include "base/logging.h"
+#include "util/bandwidth_shaper.h"
+#include "util/http/encoding.h"
+#include "util/http/http_common.h"
+
+#ifdef USE_FB2
+#include "util/fibers/fiber2.h"
+#else
+#include "util/fibers/fiber.h"
+#endif
+
+namespace util {
+namespace cloud {
+
+using namespace std;
+namespace h2 = boost::beast::http;
+using http::StringResponse;
+
+namespace {
+
+constexpr char kXmlHeader[] = R"(<?xml version="1.0" encoding="UTF-8"?>)";
+constexpr char kXmlNs[] = R"( xmlns="http://s3.amazonaws.com/doc/2006-03-01/")";
+
+inline string_view std_sv(const ::boost::beast::string_view s) {
+  return string_view{s.data(), s.size()};
+}
+
+string XmlEscape(string_view src) {
+  string res;
+  res.reserve(src.size());
+  for (char c : src) {
+    switch (c) {
+      case '&':
+        res.append("&amp;");
+        break;
+      case '<':
+        res.append("&lt;");
+        break;
+      case '>':
+        res.append("&gt;");
+        break;
+      case '"':
+        res.append("&quot;");
+        break;
+      case '\'':
+        res.append("&apos;");
+        break;
+      default:
+        res.push_back(c);
+    }
+  }
+  return res;
+}
+
+// Returns the text of the first <tag> element at or after pos and advances pos past it.
+// Returns nullopt if there are no more elements.
+optional<string_view> NextElement(string_view xml, string_view tag, size_t* pos) {
+  string open_tag = absl::StrCat("<", tag, ">"), close_tag = absl::StrCat("</", tag, ">");
+  size_t start = xml.find(open_tag, *pos);
+  if (start == string_view::npos)
+    return nullopt;
+  start += open_tag.size();
+  size_t end = xml.find(close_tag, start);
+  if (end == string_view::npos)
+    return nullopt;
+  *pos = end + close_tag.size();
+  return xml.substr(start, end - start);
+}
+
+string ETag(string_view data) {
+  return absl::StrCat("\"", absl::Hex(hash<string_view>{}(data), absl::kZeroPad16), "\"");
+}
+
+StringResponse XmlResponse(h2::status status, string body) {
+  StringResponse resp = http::MakeStringResponse(status);
+  http::SetMime(http::kXmlMime, &resp);
+  resp.body() = std::move(body);
+  return resp;
+}
+
+StringResponse ErrorResponse(h2::status status, string_view code, string_view msg = "") {
+  VLOG(1) << "S3 error " << code << ": " << msg;
+  return XmlResponse(status, absl::StrCat(kXmlHeader, "<Error><Code>", code, "</Code><Message>",
+                                          XmlEscape(msg), "</Message></Error>"));
+}
+
+// Parses "bytes=from-to" or "bytes=from-" into [from, to).
+bool ParseRange(string_view range, size_t size, size_t* from, size_t* to) {
+  if (!absl::ConsumePrefix(&range, "bytes="))
+    return false;
+  size_t dash = range.find('-');
+  if (dash == string_view::npos || !absl::SimpleAtoi(range.substr(0, dash), from))
+    return false;
+  range.remove_prefix(dash + 1);
+  *to = size;
+  if (!range.empty()) {
+    size_t last;
+    if (!absl::SimpleAtoi(range, &last) || last < *from)
+      return false;
+    *to = min(size, last + 1);
+  }
+  return true;
+}
+
+class S3Connection : public HttpConnection {
+ public:
+  explicit S3Connection(S3TestServer* server)
+      : HttpConnection(server), server_(server),
+        bucket_(server->options().conn_bandwidth, 64 << 10) {
+  }
+
+ protected:
+  void HandleSingleRequest(const RequestType& req, HttpContext* cntx) final;
+
+ private:
+  S3TestServer* server_;
+  TokenBucket bucket_;
+};
+
+void S3Connection::HandleSingleRequest(const RequestType& req, HttpContext* cntx) {
+  StringResponse resp = server_->Handle(req);
+  resp.keep_alive(req.keep_alive());
+
+  const S3TestServer::Options& opts = server_->options();
+  if (opts.latency.count())
+    ThisFiber::SleepFor(opts.latency);
+  if (opts.conn_bandwidth)
+    bucket_.Acquire(req.body().size() + resp.body().size());
+
+  cntx->Invoke(std::move(resp));
+}
+
+}  // namespace
+
+S3TestServer::S3TestServer(ObjectStore* store, Options opts)
+    : store_(store), opts_(std::move(opts)) {
+  // Multipart uploads send up to 8MB parts.
+  set_body_limit(64 << 20);
+}
+
+Connection* S3TestServer::NewConnection(ProactorBase* pb) {
+  return new S3Connection(this);
+}
+
+size_t S3TestServer::num_pending_uploads() const {
+  lock_guard lk(mu_);
+  return uploads_.size();
+}
+
+StringResponse S3TestServer::Handle(const RequestType& req) {
+  num_requests_.fetch_add(1, memory_order_relaxed);
+  VLOG(1) << "S3 request: " << req.method_string() << " " << req.target();
+
+  if (!opts_.credentials.access_key.empty() &&
+      !AwsSignKey::Verify(opts_.credentials, "s3", req, req.body())) {
+    StringResponse resp = ErrorResponse(h2::status::forbidden, "SignatureDoesNotMatch");
+    resp.set("x-amz-bucket-region", opts_.region);
+    return resp;
+  }
+
+  string_view target = std_sv(req.target());
+  size_t qpos = target.find('?');
+  string path = http::UrlDecode(target.substr(0, qpos));
+
+  QueryArgs args;
+  if (qpos != string_view::npos) {
+    for (string_view param : absl::StrSplit(target.substr(qpos + 1), '&', absl::SkipEmpty())) {
+      size_t eq = param.find('=');
+      args.emplace(param.substr(0, eq), eq == string_view::npos ? "" : param.substr(eq + 1));
+    }
+  }
+
+  if (path == "/") {
+    if (req.method() != h2::verb::get)
+      return ErrorResponse(h2::status::method_not_allowed, "MethodNotAllowed");
+    return XmlResponse(h2::status::ok,
+                       absl::StrCat(kXmlHeader, "<ListAllMyBucketsResult", kXmlNs,
+                                    "><Buckets><Bucket><Name>", XmlEscape(opts_.bucket),
+                                    "</Name></Bucket></Buckets></ListAllMyBucketsResult>"));
+  }
+
+  string_view bucket = string_view{path}.substr(1), key;
+  size_t slash = bucket.find('/');
+  if (slash != string_view::npos) {
+    key = bucket.substr(slash + 1);
+    bucket = bucket.substr(0, slash);
+  }
+
+  if (bucket != opts_.bucket)
+    return ErrorResponse(h2::status::not_found, "NoSuchBucket", bucket);
+
+  if (!key.empty())
+    return HandleObject(req, key, args);
+
+  if (req.method() != h2::verb::get)
+    return ErrorResponse(h2::status::method_not_allowed, "MethodNotAllowed");
+
+  if (args.contains("location")) {
+    StringResponse resp =
+        XmlResponse(h2::status::ok, absl::StrCat(kXmlHeader, "<LocationConstraint", kXmlNs, ">",
+                                                 opts_.region, "</LocationConstraint>"));
+    resp.set("x-amz-bucket-region", opts_.region);
+    return resp;
+  }
+
+  return List(args);
+}
+
+StringResponse S3TestServer::HandleObject(const RequestType& req, string_view key,
+                                          const QueryArgs& args) {
+  switch (req.method()) {
+    case h2::verb::get:
+      return GetObject(req, key);
+    case h2::verb::put:
+      if (args.contains("uploadId"))
+        return UploadPart(req, args);
+      return PutObject(key, req.body());
+    case h2::verb::post:
+      if (args.contains("uploads"))
+        return CreateUpload(key);
+      if (args.contains("uploadId"))
+        return CompleteUpload(req, key, args);
+      break;
+    case h2::verb::delete_:
+      if (args.contains("uploadId")) {
+        lock_guard lk(mu_);
+        if (uploads_.erase(args.at("uploadId")) == 0)
+          return ErrorResponse(h2::status::not_found, "NoSuchUpload");
+      } else if (error_code ec = store_->Delete(key); ec) {
+        return ErrorResponse(h2::status::internal_server_error, "InternalError", ec.message());
+      }
+      return http::MakeStringResponse(h2::status::no_content);
+    default:
+      break;
+  }
+
+  return ErrorResponse(h2::status::method_not_allowed, "MethodNotAllowed");
+}
+
+StringResponse S3TestServer::GetObject(const RequestType& req, string_view key) {
+  io::Result<io::ReadonlyFile*> res = store_->OpenReadFile(key);
+  if (!res) {
+    if (res.error() == errc::no_such_file_or_directory)
+      return ErrorResponse(h2::status::not_found, "NoSuchKey", key);
+    return ErrorResponse(h2::status::internal_server_error, "InternalError",
+                         res.error().message());
+  }
+
+  // The whole object is read to derive its ETag, which is good enough for tests.
+  unique_ptr<io::ReadonlyFile> file(*res);
+  string value(file->Size(), '\0');
+  if (!value.empty()) {
+    io::Result<size_t> read = file->Read(0, io::MutableBytes{
+                                                reinterpret_cast<uint8_t*>(value.data()),
+                                                value.size()});
+    if (!read)
+      return ErrorResponse(h2::status::internal_server_error, "InternalError",
+                           read.error().message());
+    value.resize(*read);
+  }
+  (void)file->Close();
+
+  string etag = ETag(value);
+  auto match_it = req.find(h2::field::if_match);
+  if (match_it != req.end() && std_sv(match_it->value()) != etag)
+    return ErrorResponse(h2::status::precondition_failed, "PreconditionFailed", key);
+
+  size_t size = value.size(), from = 0, to = size;
+  h2::status status = h2::status::ok;
+
+  auto range_it = req.find(h2::field::range);
+  if (range_it != req.end() && !opts_.ignore_range) {
+    if (!ParseRange(std_sv(range_it->value()), size, &from, &to) || from >= size) {
+      StringResponse resp = ErrorResponse(h2::status::range_not_satisfiable, "InvalidRange");
+      resp.set(h2::field::content_range, absl::StrCat("bytes */", size));
+      return resp;
+    }
+    status = h2::status::partial_content;
+  }
+
+  StringResponse resp = http::MakeStringResponse(status);
+  http::SetMime(http::kBinMime, &resp);
+  resp.set(h2::field::etag, etag);
+  resp.body() = value.substr(from, to - from);
+
+  if (status == h2::status::partial_content) {
+    resp.set(h2::field::content_range, absl::StrCat("bytes ", from, "-", to - 1, "/", size));
+  }
+  return resp;
+}
+
+StringResponse S3TestServer::PutObject(string_view key, string_view value) {
+  io::Result<io::WriteFile*> res = store_->OpenWriteFile(key);
+  if (!res)
+    return ErrorResponse(h2::status::internal_server_error, "InternalError", res.error().message());
+
+  unique_ptr<io::WriteFile> file(*res);
+  error_code ec;
+  if (!value.empty())
+    ec = file->Write(value);
+  if (!ec)
+    ec = file->Close();
+  if (ec)
+    return ErrorResponse(h2::status::internal_server_error, "InternalError", ec.message());
+
+  StringResponse resp = http::MakeStringResponse(h2::status::ok);
+  resp.set(h2::field::etag, ETag(value));
+  return resp;
+}
+
+StringResponse S3TestServer::UploadPart(const RequestType& req, const QueryArgs& args) {
+  auto it = args.find("partNumber");
+  unsigned part_num = 0;
+  if (it == args.end() || !absl::SimpleAtoi(it->second, &part_num) || part_num < 1 ||
+      part_num > 10000) {
+    return ErrorResponse(h2::status::bad_request, "InvalidArgument", "partNumber");
+  }
+
+  string_view body = req.body();
+  {
+    lock_guard lk(mu_);
+    auto upload_it = uploads_.find(args.at("uploadId"));
+    if (upload_it == uploads_.end())
+      return ErrorResponse(h2::status::not_found, "NoSuchUpload");
+    upload_it->second.parts[part_num] = string{body};
+  }
+
+  StringResponse resp = http::MakeStringResponse(h2::status::ok);
+  resp.set(h2::field::etag, ETag(body));
+  return resp;
+}
+
+StringResponse S3TestServer::CreateUpload(string_view key) {
+  string upload_id;
+  {
+    lock_guard lk(mu_);
+    upload_id = absl::StrCat("upload-", next_upload_id_++);
+    uploads_[upload_id].key = key;
+  }
+
+  return XmlResponse(
+      h2::status::ok,
+      absl::StrCat(kXmlHeader, "<InitiateMultipartUploadResult", kXmlNs, "><Bucket>",
+                   XmlEscape(opts_.bucket), "</Bucket><Key>", XmlEscape(key), "</Key><UploadId>",
+                   upload_id, "</UploadId></InitiateMultipartUploadResult>"));
+}
+
+StringResponse S3TestServer::CompleteUpload(const RequestType& req, string_view key,
+                                            const QueryArgs& args) {
+  string_view xml = req.body();
+  vector<pair<unsigned, string_view>> parts;  // (part number, etag)
+  size_t pos = 0;
+  while (auto part = NextElement(xml, "Part", &pos)) {
+    size_t part_pos = 0;
+    optional<string_view> etag = NextElement(*part, "ETag", &part_pos);
+    part_pos = 0;
+    optional<string_view> num = NextElement(*part, "PartNumber", &part_pos);
+    parts.emplace_back(0, etag.value_or(""));
+    if (!num || !absl::SimpleAtoi(*num, &parts.back().first))
+      return ErrorResponse(h2::status::bad_request, "MalformedXML");
+  }
+  if (parts.empty())
+    return ErrorResponse(h2::status::bad_request, "MalformedXML");
+
+  Upload upload;
+  {
+    lock_guard lk(mu_);
+    auto it = uploads_.find(args.at("uploadId"));
+    if (it == uploads_.end() || it->second.key != key)
+      return ErrorResponse(h2::status::not_found, "NoSuchUpload");
+
+    // Validate before taking the upload, so that a failed request could be retried.
+    for (size_t i = 0; i < parts.size(); ++i) {
+      if (i > 0 && parts[i].first <= parts[i - 1].first)
+        return ErrorResponse(h2::status::bad_request, "InvalidPartOrder");
+
+      auto part_it = it->second.parts.find(parts[i].first);
+      if (part_it == it->second.parts.end() ||
+          absl::StrCat("\"", absl::StripPrefix(absl::StripSuffix(parts[i].second, "\""), "\""),
+                       "\"") != ETag(part_it->second)) {
+        return ErrorResponse(h2::status::bad_request, "InvalidPart");
+      }
+      if (i + 1 < parts.size() && part_it->second.size() < opts_.min_part_size)
+        return ErrorResponse(h2::status::bad_request, "EntityTooSmall");
+    }
+    upload = std::move(it->second);
+    uploads_.erase(it);
+  }
+
+  io::Result<io::WriteFile*> res = store_->OpenWriteFile(key);
+  if (!res)
+    return ErrorResponse(h2::status::internal_server_error, "InternalError", res.error().message());
+
+  unique_ptr<io::WriteFile> file(*res);
+  error_code ec;
+  for (const auto& [num, etag] : parts) {
+    const string& data = upload.parts[num];
+    if (!data.empty() && (ec = file->Write(data)))
+      break;
+  }
+  if (!ec)
+    ec = file->Close();
+  if (ec)
+    return ErrorResponse(h2::status::internal_server_error, "InternalError", ec.message());
+
+  return XmlResponse(
+      h2::status::ok,
+      absl::StrCat(kXmlHeader, "<CompleteMultipartUploadResult", kXmlNs, "><Bucket>",
+                   XmlEscape(opts_.bucket), "</Bucket><Key>", XmlEscape(key),
+                   "</Key></CompleteMultipartUploadResult>"));
+}
+
+StringResponse S3TestServer::List(const QueryArgs& args) {
+  auto arg = [&args](string_view name) -> string {
+    auto it = args.find(name);
+    return it == args.end() ? string{} : http::UrlDecode(it->second);
+  };
+
+  bool v2 = arg("list-type") == "2";
+  string prefix = arg("prefix");
+
+  // Both the v1 marker and the v2 continuation token are the last returned key.
+  string marker = v2 ? arg("continuation-token") : arg("marker");
+  string start_after = v2 ? arg("start-after") : "";
+  if (marker < start_after)
+    marker = start_after;
+
+  unsigned max_keys = opts_.max_keys;
+  string max_keys_arg = arg("max-keys");
+  if (!max_keys_arg.empty()) {
+    unsigned val;
+    if (!absl::SimpleAtoi(max_keys_arg, &val))
+      return ErrorResponse(h2::status::bad_request, "InvalidArgument", "max-keys");
+    max_keys = min(max_keys, val);
+  }
+
+  vector<pair<string, size_t>> keys;
+  bool truncated = false;
+  error_code ec = store_->List(prefix, [&](size_t size, string_view key) {
+    if (key <= marker)
+      return;
+    if (keys.size() < max_keys)
+      keys.emplace_back(key, size);
+    else
+      truncated = max_keys > 0;  // Like S3, an empty page has nothing to continue from.
+  });
+  if (ec)
+    return ErrorResponse(h2::status::internal_server_error, "InternalError", ec.message());
+
+  string body = absl::StrCat(kXmlHeader, "<ListBucketResult", kXmlNs, "><Name>",
+                             XmlEscape(opts_.bucket), "</Name><Prefix>", XmlEscape(prefix),
+                             "</Prefix><MaxKeys>", max_keys, "</MaxKeys><IsTruncated>",
+                             truncated ? "true" : "false", "</IsTruncated>");
+  if (v2) {
+    absl::StrAppend(&body, "<KeyCount>", keys.size(), "</KeyCount>");
+    if (args.contains("continuation-token")) {
+      absl::StrAppend(&body, "<ContinuationToken>", XmlEscape(arg("continuation-token")),
+                      "</ContinuationToken>");
+    }
+    if (truncated) {
+      absl::StrAppend(&body, "<NextContinuationToken>", XmlEscape(keys.back().first),
+                      "</NextContinuationToken>");
+    }
+  } else {
+    absl::StrAppend(&body, "<Marker>", XmlEscape(marker), "</Marker>");
+  }
+
+  for (const auto& [key, size] : keys) {
+    absl::StrAppend(&body, "<Contents><Key>", XmlEscape(key), "</Key><Size>", size,
+                    "</Size></Contents>");
+  }
+  body.append("</ListBucketResult>");
+
+  return XmlResponse(h2::status::ok, std::move(body));
+}
+
+}  // namespace cloud
+}  // namespace util
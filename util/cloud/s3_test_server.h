@@ -0,0 +1,109 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+
+#include "util/cloud/aws.h"
+#include "util/cloud/object_store.h"
+#include "util/http/http_handler.h"
+
+namespace util {
+namespace cloud {
+
+// Minimal S3 compatible server that allows testing and benchmarking the S3 client code without
+// network access. Serves a single bucket with path-style urls, i.e. http://host:port/bucket/key,
+// and keeps the objects in an ObjectStore. Supports:
+//   * GetObject with ranges and If-Match, PutObject and DeleteObject.
+//   * Multipart uploads: create, upload part, complete and abort. Parts are kept in memory
+//     until the upload completes.
+//   * ListObjects and ListObjectsV2 without delimiters.
+//   * ListBuckets and GetBucketLocation.
+//   * SigV4 verification of the requests, see AwsSignKey::Verify.
+// Latency and per-connection bandwidth can be injected to simulate a remote server.
+//
+// Should be registered with AcceptServer, that takes the ownership over it:
+//   uint16_t port = accept_server->AddListener(0, new S3TestServer(&store, opts));
+class S3TestServer : public HttpListenerBase {
+ public:
+  struct Options {
+    std::string bucket = "test-bucket";
+    std::string region = "us-east-1";
+
+    // Requests must be signed with these credentials. If access_key is empty, signatures are
+    // not checked.
+    AwsConnectionData credentials;
+
+    // Added to every response.
+    std::chrono::microseconds latency{0};
+
+    // Bytes per second that each connection transfers, both ways. 0 - unlimited.
+    uint64_t conn_bandwidth = 0;
+
+    // Like S3, rejects multipart uploads with smaller parts, except the last one.
+    size_t min_part_size = 5 << 20;
+
+    // Maximal number of keys in a single list response. Lower values allow testing pagination.
+    unsigned max_keys = 1000;
+
+    // Serves the whole object with 200 OK regardless of the Range header, like servers
+    // that do not support ranges.
+    bool ignore_range = false;
+  };
+
+  // Does not take ownership over store.
+  S3TestServer(ObjectStore* store, Options opts);
+
+  Connection* NewConnection(ProactorBase* pb) final;
+
+  const Options& options() const {
+    return opts_;
+  }
+
+  // Number of requests that were served.
+  uint64_t num_requests() const {
+    return num_requests_.load(std::memory_order_relaxed);
+  }
+
+  // Number of multipart uploads that were started but neither completed nor aborted.
+  size_t num_pending_uploads() const;
+
+  // Handles a single request. Thread-safe.
+  http::StringResponse Handle(const RequestType& req);
+
+ private:
+  struct Upload {
+    std::string key;
+    std::map<unsigned, std::string> parts;  // part number -> data.
+  };
+
+  using QueryArgs = absl::flat_hash_map<std::string_view, std::string_view>;
+
+  http::StringResponse HandleObject(const RequestType& req, std::string_view key,
+                                    const QueryArgs& args);
+  http::StringResponse GetObject(const RequestType& req, std::string_view key);
+  http::StringResponse PutObject(std::string_view key, std::string_view value);
+  http::StringResponse UploadPart(const RequestType& req, const QueryArgs& args);
+  http::StringResponse CreateUpload(std::string_view key);
+  http::StringResponse CompleteUpload(const RequestType& req, std::string_view key,
+                                      const QueryArgs& args);
+  http::StringResponse List(const QueryArgs& args);
+
+  ObjectStore* store_;
+  Options opts_;
+
+  mutable std::mutex mu_;
+  absl::flat_hash_map<std::string, Upload> uploads_;
+  uint64_t next_upload_id_ = 1;
+  std::atomic_uint64_t num_requests_{0};
+};
+
+}  // namespace cloud
+}  // namespace util
@@ -0,0 +1,178 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/concurrency_limiter.h"
+
+#include <absl/time/clock.h>
+
+#include <algorithm>
+#include <cmath>
+
+#include "base/logging.h"
+#include "util/proactor_pool.h"
+
+namespace util {
+
+using namespace std;
+
+namespace {
+
+// Single writer increment, cheaper than fetch_add.
+inline void Inc(atomic_uint64_t* val) {
+  val->store(val->load(memory_order_relaxed) + 1, memory_order_relaxed);
+}
+
+}  // namespace
+
+AdaptiveConcurrencyLimiter::Permit::Permit(AdaptiveConcurrencyLimiter* limiter)
+    : limiter_(limiter->TryAcquire() ? limiter : nullptr) {
+  if (limiter_)
+    start_ns_ = absl::GetCurrentTimeNanos();
+}
+
+AdaptiveConcurrencyLimiter::Permit::~Permit() {
+  if (limiter_)
+    limiter_->Release(absl::GetCurrentTimeNanos() - start_ns_);
+}
+
+void AdaptiveConcurrencyLimiter::Permit::Cancel() {
+  if (limiter_) {
+    limiter_->ReleaseNoSample();
+    limiter_ = nullptr;
+  }
+}
+
+AdaptiveConcurrencyLimiter::AdaptiveConcurrencyLimiter() : AdaptiveConcurrencyLimiter(Options{}) {
+}
+
+AdaptiveConcurrencyLimiter::AdaptiveConcurrencyLimiter(const Options& opts)
+    : opts_(opts), limit_(opts.initial_limit), limit_pub_(opts.initial_limit) {
+  CHECK_LE(opts_.min_limit, opts_.initial_limit);
+  CHECK_LE(opts_.initial_limit, opts_.max_limit);
+  CHECK_GT(opts_.window_size, 0u);
+  CHECK_GT(opts_.probe_windows, 0u);
+}
+
+bool AdaptiveConcurrencyLimiter::TryAcquire() {
+  if (in_flight_ >= limit_pub_.load(memory_order_relaxed)) {
+    Inc(&shed_);
+    return false;
+  }
+
+  ++in_flight_;
+  window_max_in_flight_ = max(window_max_in_flight_, in_flight_);
+  in_flight_pub_.store(in_flight_, memory_order_relaxed);
+  Inc(&accepted_);
+  return true;
+}
+
+void AdaptiveConcurrencyLimiter::Release(uint64_t latency_ns) {
+  ReleaseNoSample();
+
+  window_sum_ += latency_ns;
+  if (++window_cnt_ >= opts_.window_size) {
+    UpdateLimit();
+    window_sum_ = 0;
+    window_cnt_ = 0;
+    window_max_in_flight_ = in_flight_;
+  }
+}
+
+void AdaptiveConcurrencyLimiter::ReleaseNoSample() {
+  DCHECK_GT(in_flight_, 0u);
+  --in_flight_;
+  in_flight_pub_.store(in_flight_, memory_order_relaxed);
+}
+
+void AdaptiveConcurrencyLimiter::UpdateLimit() {
+  double short_rtt = double(window_sum_) / window_cnt_;
+  if (short_rtt <= 0)
+    return;
+
+  if (probing_) {
+    // Measured with the halved limit, so the queue had a chance to drain.
+    probing_ = false;
+    min_rtt_ = short_rtt;
+  } else if (min_rtt_ == 0 || short_rtt < min_rtt_) {
+    min_rtt_ = short_rtt;
+  }
+
+  if (++windows_ >= opts_.probe_windows) {
+    windows_ = 0;
+    probing_ = true;
+    limit_ = max<double>(limit_ / 2, opts_.min_limit);
+    limit_pub_.store(uint32_t(limit_), memory_order_relaxed);
+    return;
+  }
+
+  // When the load does not use the limit, latency says nothing about it.
+  if (window_max_in_flight_ < limit_ / 2)
+    return;
+
+  double gradient = clamp(opts_.tolerance * min_rtt_ / short_rtt, 0.5, 1.0);
+  double new_limit = limit_ * gradient + sqrt(limit_);
+  limit_ = limit_ * (1 - opts_.smoothing) + new_limit * opts_.smoothing;
+  limit_ = clamp<double>(limit_, opts_.min_limit, opts_.max_limit);
+
+  limit_pub_.store(uint32_t(limit_), memory_order_relaxed);
+}
+
+auto AdaptiveConcurrencyLimiter::GetStats() const -> Stats {
+  Stats res;
+  res.accepted = accepted_.load(memory_order_relaxed);
+  res.shed = shed_.load(memory_order_relaxed);
+  res.limit = limit_pub_.load(memory_order_relaxed);
+  res.in_flight = in_flight_pub_.load(memory_order_relaxed);
+  return res;
+}
+
+ProactorConcurrencyLimiter::ProactorConcurrencyLimiter(const char* varz_name)
+    : ProactorConcurrencyLimiter(varz_name, Options{}) {
+}
+
+ProactorConcurrencyLimiter::ProactorConcurrencyLimiter(const char* varz_name,
+                                                       const Options& opts)
+    : opts_(opts), varz_(varz_name, [this] {
+        Stats stats = GetStats();
+        VarzFunction::KeyValMap res;
+        res.emplace_back("accepted", base::VarzValue::FromInt(stats.accepted));
+        res.emplace_back("shed", base::VarzValue::FromInt(stats.shed));
+        res.emplace_back("limit", base::VarzValue::FromInt(stats.limit));
+        res.emplace_back("in_flight", base::VarzValue::FromInt(stats.in_flight));
+        return res;
+      }) {
+}
+
+ProactorConcurrencyLimiter::~ProactorConcurrencyLimiter() {
+}
+
+void ProactorConcurrencyLimiter::Init(ProactorPool* pp) {
+  CHECK(limiters_.empty());
+
+  limiters_.resize(pp->size());
+  for (auto& limiter : limiters_) {
+    limiter.reset(new AdaptiveConcurrencyLimiter(opts_));
+  }
+}
+
+AdaptiveConcurrencyLimiter* ProactorConcurrencyLimiter::local() {
+  int32_t index = ProactorBase::GetIndex();
+  DCHECK_GE(index, 0);
+  DCHECK_LT(unsigned(index), limiters_.size());
+  return limiters_[index].get();
+}
+
+auto ProactorConcurrencyLimiter::GetStats() const -> Stats {
+  Stats res;
+  for (const auto& limiter : limiters_) {
+    Stats stats = limiter->GetStats();
+    res.accepted += stats.accepted;
+    res.shed += stats.shed;
+    res.limit += stats.limit;
+    res.in_flight += stats.in_flight;
+  }
+  return res;
+}
+
+}  // namespace util
@@ -0,0 +1,144 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "util/varz.h"
+
+namespace util {
+
+class ProactorPool;
+
+// Limits the number of in-flight requests and adapts the limit to the observed latency,
+// similarly to the gradient algorithm of Netflix concurrency-limits. The no-load latency is
+// estimated as the minimal average latency of a window. While the latency of the last window
+// stays within tolerance of it, the limit grows by roughly sqrt(limit) per window. Once requests
+// start queueing and the latency grows, the limit shrinks proportionally.
+// Requests above the limit are shed, i.e. should fail fast instead of waiting.
+//
+// Not thread-safe, the counters can be read from other threads. See ProactorConcurrencyLimiter
+// for a per-thread set of limiters.
+class AdaptiveConcurrencyLimiter {
+ public:
+  struct Options {
+    uint32_t initial_limit = 32;
+    uint32_t min_limit = 4;
+    uint32_t max_limit = 4096;
+
+    // Latency samples per window, the limit is updated once per window.
+    uint32_t window_size = 32;
+
+    // The no-load latency is re-measured every that many windows with a halved limit,
+    // so that the limiter adapts when requests become inherently slower.
+    uint32_t probe_windows = 1000;
+
+    // The latency may exceed the no-load one by this factor without reducing the limit.
+    double tolerance = 1.5;
+
+    // Weight of the new limit estimation.
+    double smoothing = 0.2;
+  };
+
+  struct Stats {
+    uint64_t accepted = 0;
+    uint64_t shed = 0;
+    uint32_t limit = 0;
+    uint32_t in_flight = 0;
+  };
+
+  // RAII helper for a single request, measures its latency.
+  class Permit {
+   public:
+    explicit Permit(AdaptiveConcurrencyLimiter* limiter);
+    Permit(Permit&& other) noexcept : limiter_(other.limiter_), start_ns_(other.start_ns_) {
+      other.limiter_ = nullptr;
+    }
+    ~Permit();
+
+    Permit(const Permit&) = delete;
+    void operator=(const Permit&) = delete;
+
+    // False if the request was shed.
+    explicit operator bool() const {
+      return limiter_ != nullptr;
+    }
+
+    // Releases the permit without taking the latency into account, for example when the request
+    // failed for reasons unrelated to the load.
+    void Cancel();
+
+   private:
+    AdaptiveConcurrencyLimiter* limiter_;
+    uint64_t start_ns_ = 0;
+  };
+
+  AdaptiveConcurrencyLimiter();
+  explicit AdaptiveConcurrencyLimiter(const Options& opts);
+
+  // Returns false and counts a shed request if the number of in-flight requests reached
+  // the limit.
+  bool TryAcquire();
+
+  // Must be called once per successful TryAcquire() with the latency of the request.
+  void Release(uint64_t latency_ns);
+
+  // Releases without a latency sample.
+  void ReleaseNoSample();
+
+  uint32_t limit() const {
+    return limit_pub_.load(std::memory_order_relaxed);
+  }
+
+  Stats GetStats() const;
+
+ private:
+  void UpdateLimit();
+
+  Options opts_;
+
+  double limit_;
+  double min_rtt_ = 0;
+  uint32_t windows_ = 0;
+  bool probing_ = false;
+  uint64_t window_sum_ = 0;
+  uint32_t window_cnt_ = 0;
+  uint32_t window_max_in_flight_ = 0;
+  uint32_t in_flight_ = 0;
+
+  // Written only by the owning thread.
+  std::atomic_uint32_t limit_pub_, in_flight_pub_{0};
+  std::atomic_uint64_t accepted_{0}, shed_{0};
+};
+
+// Holds an AdaptiveConcurrencyLimiter per proactor thread, so that connections on different
+// threads do not share state, and exports their aggregated stats via varz.
+class ProactorConcurrencyLimiter {
+ public:
+  using Options = AdaptiveConcurrencyLimiter::Options;
+  using Stats = AdaptiveConcurrencyLimiter::Stats;
+
+  explicit ProactorConcurrencyLimiter(const char* varz_name);
+  ProactorConcurrencyLimiter(const char* varz_name, const Options& opts);
+  ~ProactorConcurrencyLimiter();
+
+  // Must be called before local() is used.
+  void Init(ProactorPool* pp);
+
+  // Returns the limiter of the calling proactor thread.
+  AdaptiveConcurrencyLimiter* local();
+
+  // Summed over all threads.
+  Stats GetStats() const;
+
+ private:
+  Options opts_;
+  std::vector<std::unique_ptr<AdaptiveConcurrencyLimiter>> limiters_;
+  VarzFunction varz_;
+};
+
+}  // namespace util
@@ -0,0 +1,129 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/concurrency_limiter.h"
+
+#include <vector>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace util {
+
+using namespace std;
+
+class ConcurrencyLimiterTest : public testing::Test {
+ protected:
+  struct Result {
+    double avg_latency_ms;
+    double throughput;  // requests per ms.
+  };
+
+  // Simulates a server that processes up to capacity requests in parallel and shares the
+  // capacity between in-flight requests beyond that. Each of num_clients sends 1ms requests
+  // in a closed loop and retries shed requests after 1ms.
+  Result Simulate(AdaptiveConcurrencyLimiter* limiter, double capacity, unsigned num_clients);
+};
+
+auto ConcurrencyLimiterTest::Simulate(AdaptiveConcurrencyLimiter* limiter, double capacity,
+                                      unsigned num_clients) -> Result {
+  struct Client {
+    bool active = false;
+    double work = 0, start = 0, next_try = 0;
+  };
+
+  constexpr double kStep = 0.01;
+  constexpr unsigned kSteps = 200000, kWarmup = 100000;
+
+  vector<Client> clients(num_clients);
+  uint64_t done = 0;
+  double latency_sum = 0;
+  unsigned in_flight = 0;
+
+  for (unsigned step = 0; step < kSteps; ++step) {
+    double now = step * kStep;
+    double rate = in_flight > capacity ? capacity / in_flight : 1;
+
+    for (Client& c : clients) {
+      if (c.active) {
+        c.work -= rate * kStep;
+        if (c.work > 0)
+          continue;
+        c.active = false;
+        --in_flight;
+        limiter->Release((now - c.start) * 1e6);
+        if (step >= kWarmup) {
+          ++done;
+          latency_sum += now - c.start;
+        }
+      } else if (now >= c.next_try) {
+        if (limiter->TryAcquire()) {
+          c = Client{true, 1, now, 0};
+          ++in_flight;
+        } else {
+          c.next_try = now + 1;
+        }
+      }
+    }
+  }
+
+  return Result{latency_sum / done, done / ((kSteps - kWarmup) * kStep)};
+}
+
+TEST_F(ConcurrencyLimiterTest, Basic) {
+  AdaptiveConcurrencyLimiter::Options opts;
+  opts.initial_limit = 2;
+  opts.min_limit = 1;
+  AdaptiveConcurrencyLimiter limiter(opts);
+
+  EXPECT_TRUE(limiter.TryAcquire());
+  EXPECT_TRUE(limiter.TryAcquire());
+  EXPECT_FALSE(limiter.TryAcquire());
+
+  {
+    AdaptiveConcurrencyLimiter::Permit permit(&limiter);
+    EXPECT_FALSE(permit);
+  }
+
+  limiter.Release(1000);
+  {
+    AdaptiveConcurrencyLimiter::Permit permit(&limiter);
+    EXPECT_TRUE(permit);
+    EXPECT_EQ(2, limiter.GetStats().in_flight);
+  }
+
+  limiter.ReleaseNoSample();
+  auto stats = limiter.GetStats();
+  EXPECT_EQ(0, stats.in_flight);
+  EXPECT_EQ(3, stats.accepted);
+  EXPECT_EQ(2, stats.shed);
+}
+
+TEST_F(ConcurrencyLimiterTest, Overload) {
+  AdaptiveConcurrencyLimiter limiter;
+
+  // 4 times more clients than the server can handle without queueing.
+  Result res = Simulate(&limiter, 50, 200);
+  auto stats = limiter.GetStats();
+  LOG(INFO) << "limit " << stats.limit << ", latency " << res.avg_latency_ms
+            << "ms, throughput " << res.throughput;
+
+  EXPECT_GT(stats.shed, 0);
+  EXPECT_GE(stats.limit, 25);
+  EXPECT_LE(stats.limit, 100);
+
+  // Without the limiter the latency would be 4ms.
+  EXPECT_LT(res.avg_latency_ms, 2.5);
+  EXPECT_GT(res.throughput, 45);
+}
+
+TEST_F(ConcurrencyLimiterTest, Underload) {
+  AdaptiveConcurrencyLimiter limiter;
+
+  Result res = Simulate(&limiter, 50, 30);
+  EXPECT_EQ(0, limiter.GetStats().shed);
+  EXPECT_LT(res.avg_latency_ms, 1.1);
+}
+
+}  // namespace util
@@ -45,7 +45,25 @@ class Connection {
   // calls OnShutdown().
   void Shutdown();
 
+  // Connections that want to participate in automatic rebalancing should call it once per
+  // handled request, and call MaybeMigrate() between requests.
+  void NoteRequest() {
+    ++num_requests_;
+  }
+
+  uint64_t num_requests() const {
+    return num_requests_;
+  }
+
+  ListenerInterface* owner() const {
+    return owner_;
+  }
+
  protected:
+  // Migrates the calling connection fiber if the rebalancer requested it.
+  // Must be called from HandleRequests(), at a point where the connection can switch threads.
+  // Returns true if the connection has been migrated.
+  bool MaybeMigrate();
 
   // The main loop for a connection. Runs in the same proactor thread as of socket_.
   virtual void HandleRequests() = 0;
@@ -57,7 +75,19 @@ class Connection {
   virtual void OnPostMigrateThread() {}
 
   std::unique_ptr<FiberSocketBase> socket_;
+
+ private:
+  ListenerInterface* owner_ = nullptr;
+  bool placed_ = false;  // whether the placement policy of the owner accounts the connection.
+
+  // Rebalancing state, accessed only from the connection thread.
+  int32_t migrate_to_ = -1;  // destination proactor index requested by the rebalancer.
+  uint64_t num_requests_ = 0;
+  uint64_t rebalance_last_requests_ = 0;
+  uint64_t last_migration_ns_ = 0;
+
   friend class ListenerInterface;
+  friend class ConnectionRebalancer;
 };
 
 }  // namespace util
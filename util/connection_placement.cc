@@ -0,0 +1,214 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/connection_placement.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/socket.h>
+
+#include "base/logging.h"
+#include "util/fiber_socket_base.h"
+#include "util/proactor_pool.h"
+
+#ifdef USE_FB2
+#include "util/fibers/detail/fiber_interface.h"
+#include "util/fibers/detail/scheduler.h"
+#endif
+
+namespace util {
+
+using namespace std;
+
+namespace {
+
+inline uint64_t ClockNs(clockid_t clock) {
+  timespec ts;
+  clock_gettime(clock, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+inline uint32_t ReadyFibers() {
+#ifdef USE_FB2
+  return fb2::detail::FiberActive()->scheduler()->ReadyQueueSize();
+#else
+  return 0;
+#endif
+}
+
+}  // namespace
+
+struct ProactorLoad::SamplerState {
+  clockid_t cpu_clock;
+  uint64_t last_ts_ns = 0;
+  uint64_t last_cpu_ns = 0;
+  uint32_t periodic_id = 0;
+  int pinned_cpu = -1;
+};
+
+ProactorLoad::ProactorLoad(unsigned num_proactors) : ProactorLoad(num_proactors, Options{}) {
+}
+
+ProactorLoad::ProactorLoad(unsigned num_proactors, const Options& opts)
+    : opts_(opts), entries_(num_proactors) {
+}
+
+ProactorLoad::~ProactorLoad() {
+  CHECK(pp_ == nullptr) << "Stop() was not called";
+}
+
+void ProactorLoad::Start(ProactorPool* pp, uint32_t period_ms) {
+  CHECK(pp_ == nullptr);
+  CHECK_EQ(pp->size(), entries_.size());
+
+  pp_ = pp;
+  samplers_.reset(new SamplerState[pp->size()]);
+
+  pp->AwaitFiberOnAll([this, period_ms](unsigned index, ProactorBase* pb) {
+    SamplerState& st = samplers_[index];
+    CHECK_EQ(0, pthread_getcpuclockid(pb->thread_id(), &st.cpu_clock));
+    st.last_cpu_ns = ClockNs(st.cpu_clock);
+    st.last_ts_ns = ClockNs(CLOCK_MONOTONIC);
+
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (pthread_getaffinity_np(pb->thread_id(), sizeof(cpus), &cpus) == 0 &&
+        CPU_COUNT(&cpus) == 1) {
+      for (unsigned cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+        if (CPU_ISSET(cpu, &cpus)) {
+          st.pinned_cpu = cpu;
+          break;
+        }
+      }
+    }
+
+    st.periodic_id = pb->AddPeriodic(period_ms, [this, index] {
+      SamplerState& sampler = samplers_[index];
+      uint64_t now = ClockNs(CLOCK_MONOTONIC);
+      uint64_t cpu_ns = ClockNs(sampler.cpu_clock);
+      if (now > sampler.last_ts_ns) {
+        Update(index, ReadyFibers(),
+               float(cpu_ns - sampler.last_cpu_ns) / (now - sampler.last_ts_ns));
+      }
+      sampler.last_ts_ns = now;
+      sampler.last_cpu_ns = cpu_ns;
+    });
+  });
+
+  for (unsigned i = 0; i < pp->size(); ++i) {
+    int cpu = samplers_[i].pinned_cpu;
+    if (cpu < 0)
+      continue;
+    if (unsigned(cpu) >= cpu_to_index_.size())
+      cpu_to_index_.resize(cpu + 1, -1);
+    cpu_to_index_[cpu] = i;
+  }
+}
+
+void ProactorLoad::Stop() {
+  if (!pp_)
+    return;
+
+  pp_->AwaitFiberOnAll([this](unsigned index, ProactorBase* pb) {
+    pb->CancelPeriodic(samplers_[index].periodic_id);
+  });
+  samplers_.reset();
+  pp_ = nullptr;
+}
+
+auto ProactorLoad::Get(unsigned index) const -> Signals {
+  const Entry& e = entries_[index];
+  Signals res;
+  res.connections = e.connections.load(memory_order_relaxed);
+  res.ready_fibers = e.ready_fibers.load(memory_order_relaxed);
+  res.busy_ratio = e.busy_ratio.load(memory_order_relaxed);
+  return res;
+}
+
+double ProactorLoad::Score(unsigned index) const {
+  Signals s = Get(index);
+  return opts_.connection_weight * s.connections + opts_.ready_weight * s.ready_fibers +
+         opts_.busy_weight * s.busy_ratio;
+}
+
+void ProactorLoad::Update(unsigned index, uint32_t ready_fibers, float busy_ratio) {
+  Entry& e = entries_[index];
+  e.ready_fibers.store(ready_fibers, memory_order_relaxed);
+  e.busy_ratio.store(busy_ratio, memory_order_relaxed);
+}
+
+PlacementPolicy::~PlacementPolicy() {
+}
+
+unsigned RoundRobinPlacement::Pick(LinuxSocketBase* sock) {
+  unsigned res = next_++;
+  if (next_ >= num_proactors_)
+    next_ = 0;
+  return res;
+}
+
+unsigned LoadAwarePlacement::Pick(LinuxSocketBase* sock) {
+  unsigned index = Choose(sock);
+  load_->AddConnections(index, 1);
+  return index;
+}
+
+void LoadAwarePlacement::OnConnectionClose(unsigned index) {
+  load_->AddConnections(index, -1);
+}
+
+void LoadAwarePlacement::OnMigrate(unsigned src, unsigned dest) {
+  load_->AddConnections(src, -1);
+  load_->AddConnections(dest, 1);
+}
+
+unsigned LeastLoadedPlacement::Choose(LinuxSocketBase* sock) {
+  unsigned best = 0;
+  double best_score = load_->Score(0);
+  for (unsigned i = 1; i < load_->size(); ++i) {
+    double score = load_->Score(i);
+    if (score < best_score) {
+      best = i;
+      best_score = score;
+    }
+  }
+  return best;
+}
+
+unsigned PowerOfTwoPlacement::Choose(LinuxSocketBase* sock) {
+  unsigned n = load_->size();
+  if (n == 1)
+    return 0;
+
+  unsigned a = rand_() % n;
+  unsigned b = rand_() % (n - 1);
+  if (b >= a)
+    ++b;
+  return load_->Score(a) <= load_->Score(b) ? a : b;
+}
+
+unsigned IncomingCpuPlacement::Choose(LinuxSocketBase* sock) {
+  int cpu = -1;
+  socklen_t len = sizeof(cpu);
+
+  if (sock &&
+      getsockopt(sock->native_handle(), SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 &&
+      cpu >= 0) {
+    int index = load_->ProactorForCpu(cpu);
+    if (index >= 0) {
+      double total = 0;
+      for (unsigned i = 0; i < load_->size(); ++i)
+        total += load_->Score(i);
+      double avg = total / load_->size();
+
+      // Add 1 so that an idle pool does not reject the local proactor.
+      if (load_->Score(index) <= max_overload_ * avg + 1)
+        return index;
+    }
+  }
+
+  return PowerOfTwoPlacement::Choose(sock);
+}
+
+}  // namespace util
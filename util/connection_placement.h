@@ -0,0 +1,184 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+#include "base/random.h"
+
+namespace util {
+
+#ifdef USE_FB2
+namespace fb2 {
+class ProactorBase;
+}  // namespace fb2
+
+using fb2::ProactorBase;
+
+#else
+class ProactorBase;
+#endif
+
+class ProactorPool;
+class LinuxSocketBase;
+
+// Live load signals of every proactor in a pool. Connection counts are updated by placement
+// policies, the rest is sampled periodically from each proactor thread once Start() is called.
+// Can be shared by multiple listeners.
+class ProactorLoad {
+ public:
+  struct Signals {
+    uint32_t connections = 0;
+    uint32_t ready_fibers = 0;  // length of the fiber ready queue, 0 for the legacy scheduler.
+    float busy_ratio = 0;       // fraction of the wall time the thread was on cpu.
+  };
+
+  // Weights of the signals when computing a load score.
+  struct Options {
+    double connection_weight = 1;
+    double ready_weight = 1;
+
+    // A fully busy proactor weighs as much as this many connections. Cpu usage is the main
+    // signal, connection counts reflect the placements the sampler has not observed yet.
+    double busy_weight = 256;
+  };
+
+  explicit ProactorLoad(unsigned num_proactors);
+  ProactorLoad(unsigned num_proactors, const Options& opts);
+  ~ProactorLoad();
+
+  // Samples ready_fibers, busy_ratio and cpu affinity of pp threads every period_ms.
+  void Start(ProactorPool* pp, uint32_t period_ms = 100);
+  void Stop();
+
+  unsigned size() const {
+    return entries_.size();
+  }
+
+  Signals Get(unsigned index) const;
+
+  // Lower is less loaded.
+  double Score(unsigned index) const;
+
+  void AddConnections(unsigned index, int32_t delta) {
+    entries_[index].connections.fetch_add(delta, std::memory_order_relaxed);
+  }
+
+  // Used by the sampler and by tests.
+  void Update(unsigned index, uint32_t ready_fibers, float busy_ratio);
+
+  // Returns the proactor index whose thread is pinned to cpu or -1 if there is none.
+  int ProactorForCpu(unsigned cpu) const {
+    return cpu < cpu_to_index_.size() ? cpu_to_index_[cpu] : -1;
+  }
+
+ private:
+  struct alignas(64) Entry {
+    std::atomic_uint32_t connections{0};
+    std::atomic_uint32_t ready_fibers{0};
+    std::atomic<float> busy_ratio{0};
+  };
+
+  struct SamplerState;
+
+  Options opts_;
+  std::vector<Entry> entries_;
+  std::vector<int> cpu_to_index_;
+
+  ProactorPool* pp_ = nullptr;
+  std::unique_ptr<SamplerState[]> samplers_;
+};
+
+// Decides which proactor handles a newly accepted connection.
+// Pick() is called from the accept fiber of a listener, the notifications are called from
+// the proactor threads of the connections, and only for the connections that Pick() placed.
+// Policies keep unsynchronized picking state, e.g. a round robin cursor or a random generator,
+// hence a policy instance must not be shared by listeners.
+class PlacementPolicy {
+ public:
+  virtual ~PlacementPolicy();
+
+  // Returns the proactor index for the socket.
+  virtual unsigned Pick(LinuxSocketBase* sock) = 0;
+
+  virtual void OnConnectionClose(unsigned index) {
+  }
+
+  virtual void OnMigrate(unsigned src, unsigned dest) {
+  }
+};
+
+class RoundRobinPlacement : public PlacementPolicy {
+ public:
+  explicit RoundRobinPlacement(unsigned num_proactors) : num_proactors_(num_proactors) {
+  }
+
+  unsigned Pick(LinuxSocketBase* sock) override;
+
+ private:
+  unsigned num_proactors_;
+  unsigned next_ = 0;
+};
+
+// Base class for the policies that use ProactorLoad. Accounts connections at the moment
+// they are placed, so that a burst of accepts does not land on the same proactor before
+// the sampler catches up.
+class LoadAwarePlacement : public PlacementPolicy {
+ public:
+  explicit LoadAwarePlacement(ProactorLoad* load) : load_(load) {
+  }
+
+  unsigned Pick(LinuxSocketBase* sock) final;
+  void OnConnectionClose(unsigned index) final;
+  void OnMigrate(unsigned src, unsigned dest) final;
+
+ protected:
+  virtual unsigned Choose(LinuxSocketBase* sock) = 0;
+
+  ProactorLoad* load_;
+};
+
+// Picks the proactor with the lowest score. O(N) per connection.
+class LeastLoadedPlacement : public LoadAwarePlacement {
+ public:
+  using LoadAwarePlacement::LoadAwarePlacement;
+
+ protected:
+  unsigned Choose(LinuxSocketBase* sock) override;
+};
+
+// Picks the less loaded of two random proactors. O(1) per connection and avoids herding
+// on a single proactor when the load signals are stale.
+class PowerOfTwoPlacement : public LoadAwarePlacement {
+ public:
+  explicit PowerOfTwoPlacement(ProactorLoad* load, uint64_t seed = 0x1234)
+      : LoadAwarePlacement(load), rand_(seed) {
+  }
+
+ protected:
+  unsigned Choose(LinuxSocketBase* sock) override;
+
+  base::SplitMix64 rand_;  // used only by the accept fiber, see PlacementPolicy.
+};
+
+// Places a connection on the proactor pinned to the cpu that received its packets
+// (SO_INCOMING_CPU), unless that proactor is overloaded relatively to the average by more
+// than max_overload. Falls back to power-of-two choices.
+class IncomingCpuPlacement : public PowerOfTwoPlacement {
+ public:
+  explicit IncomingCpuPlacement(ProactorLoad* load, double max_overload = 1.5)
+      : PowerOfTwoPlacement(load), max_overload_(max_overload) {
+  }
+
+ protected:
+  unsigned Choose(LinuxSocketBase* sock) override;
+
+ private:
+  double max_overload_;
+};
+
+}  // namespace util
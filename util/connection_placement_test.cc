@@ -0,0 +1,145 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/connection_placement.h"
+
+#include <algorithm>
+#include <numeric>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace util {
+
+using namespace std;
+
+class ConnectionPlacementTest : public testing::Test {};
+
+TEST_F(ConnectionPlacementTest, RoundRobin) {
+  RoundRobinPlacement rr(3);
+  EXPECT_EQ(0, rr.Pick(nullptr));
+  EXPECT_EQ(1, rr.Pick(nullptr));
+  EXPECT_EQ(2, rr.Pick(nullptr));
+  EXPECT_EQ(0, rr.Pick(nullptr));
+}
+
+TEST_F(ConnectionPlacementTest, LeastLoaded) {
+  ProactorLoad load(4);
+  LeastLoadedPlacement policy(&load);
+
+  load.Update(0, 0, 0.9);
+  load.Update(1, 100, 0);
+  load.Update(2, 0, 0.1);
+  load.Update(3, 0, 0.5);
+  EXPECT_EQ(2, policy.Pick(nullptr));
+  EXPECT_EQ(1, load.Get(2).connections);
+
+  policy.OnMigrate(2, 3);
+  EXPECT_EQ(0, load.Get(2).connections);
+  EXPECT_EQ(1, load.Get(3).connections);
+
+  policy.OnConnectionClose(3);
+  EXPECT_EQ(0, load.Get(3).connections);
+}
+
+TEST_F(ConnectionPlacementTest, PowerOfTwo) {
+  constexpr unsigned kNum = 8;
+  ProactorLoad load(kNum);
+  PowerOfTwoPlacement policy(&load);
+
+  for (unsigned i = 0; i < 8000; ++i) {
+    unsigned index = policy.Pick(nullptr);
+    ASSERT_LT(index, kNum);
+  }
+
+  uint32_t min_conn = UINT32_MAX, max_conn = 0;
+  for (unsigned i = 0; i < kNum; ++i) {
+    min_conn = min(min_conn, load.Get(i).connections);
+    max_conn = max(max_conn, load.Get(i).connections);
+  }
+
+  // With two choices the maximal gap is O(log log n).
+  EXPECT_LE(max_conn - min_conn, 10);
+}
+
+TEST_F(ConnectionPlacementTest, IncomingCpuFallback) {
+  ProactorLoad load(2);
+  IncomingCpuPlacement policy(&load);
+
+  // Without a socket it behaves like power-of-two.
+  load.Update(0, 0, 1);
+  EXPECT_EQ(1, policy.Pick(nullptr));
+  EXPECT_EQ(-1, load.ProactorForCpu(0));
+}
+
+// Simulates connections with heterogeneous costs: most are light, a few are heavy.
+// Busy ratios are refreshed every kSamplePeriod placements, like the periodic sampler does.
+// Reports the ratio between the most loaded proactor and the average, averaged over time.
+static void BM_PlacementImbalance(benchmark::State& state) {
+  constexpr unsigned kNum = 8;
+  constexpr unsigned kSamplePeriod = 16;
+  constexpr double kCapacity = 1000;
+
+  struct Conn {
+    unsigned index;
+    double cost;
+  };
+
+  double imbalance = 0;
+  while (state.KeepRunning()) {
+    ProactorLoad load(kNum);
+    unique_ptr<PlacementPolicy> policy;
+    switch (state.range(0)) {
+      case 0:
+        policy.reset(new RoundRobinPlacement(kNum));
+        break;
+      case 1:
+        policy.reset(new LeastLoadedPlacement(&load));
+        break;
+      default:
+        policy.reset(new PowerOfTwoPlacement(&load));
+    }
+
+    base::SplitMix64 rand(42);
+    vector<Conn> conns;
+    double cost[kNum] = {0};
+    double sum = 0;
+    unsigned count = 0;
+
+    for (unsigned i = 0; i < 20000; ++i) {
+      // 1 in 16 connections is 30 times heavier.
+      double c = rand() % 16 == 0 ? 30 : 1;
+      unsigned index = policy->Pick(nullptr);
+      conns.push_back(Conn{index, c});
+      cost[index] += c;
+
+      // Long-lived connections: close a random one from time to time.
+      if (conns.size() > 1000) {
+        size_t victim = rand() % conns.size();
+        cost[conns[victim].index] -= conns[victim].cost;
+        policy->OnConnectionClose(conns[victim].index);
+        conns[victim] = conns.back();
+        conns.pop_back();
+      }
+
+      if (i % kSamplePeriod == 0) {
+        for (unsigned j = 0; j < kNum; ++j) {
+          load.Update(j, 0, min(1.0, cost[j] / kCapacity));
+        }
+      }
+
+      // Skip the warmup.
+      if (i > 2000) {
+        double avg = accumulate(cost, cost + kNum, 0.0) / kNum;
+        sum += *max_element(cost, cost + kNum) / avg;
+        ++count;
+      }
+    }
+    imbalance = sum / count;
+  }
+  state.counters["max_to_avg"] = imbalance;
+}
+BENCHMARK(BM_PlacementImbalance)->Arg(0)->Arg(1)->Arg(2);
+
+}  // namespace util
@@ -0,0 +1,187 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/connection_rebalancer.h"
+
+#include <absl/time/clock.h>
+
+#include <algorithm>
+
+#include "base/logging.h"
+#include "util/connection.h"
+#include "util/listener_interface.h"
+#include "util/proactor_pool.h"
+
+namespace util {
+
+using namespace std;
+
+namespace {
+
+struct Candidate {
+  uint64_t rate;
+  Connection* conn;  // used only as an identity, never dereferenced outside of the traversal.
+};
+
+struct ProactorRound {
+  uint64_t rate = 0;
+  vector<Candidate> candidates;
+};
+
+struct Move {
+  Connection* conn;
+  unsigned src, dest;
+};
+
+}  // namespace
+
+ConnectionRebalancer::ConnectionRebalancer(ProactorPool* pp, ListenerInterface* listener)
+    : ConnectionRebalancer(pp, listener, Options{}) {
+}
+
+ConnectionRebalancer::ConnectionRebalancer(ProactorPool* pp, ListenerInterface* listener,
+                                           const Options& opts)
+    : pp_(pp), listener_(listener), opts_(opts), varz_("connection_rebalancer", [this] {
+        Stats stats = GetStats();
+        VarzFunction::KeyValMap res;
+        res.emplace_back("rounds", base::VarzValue::FromInt(stats.rounds));
+        res.emplace_back("scheduled_migrations",
+                         base::VarzValue::FromInt(stats.scheduled_migrations));
+        res.emplace_back("migrations", base::VarzValue::FromInt(stats.migrations));
+        res.emplace_back("imbalance", base::VarzValue::FromDouble(stats.imbalance));
+        return res;
+      }) {
+}
+
+ConnectionRebalancer::~ConnectionRebalancer() {
+  CHECK_EQ(0u, periodic_id_) << "Stop() was not called";
+}
+
+void ConnectionRebalancer::Start() {
+  CHECK_EQ(0u, periodic_id_);
+
+  ProactorBase* pb = pp_->at(0);
+  periodic_id_ = pb->AwaitBrief([this, pb] {
+    return pb->AddPeriodic(opts_.period_ms, [this, pb] {
+      // Periodic tasks can not block, so the round runs in its own fiber.
+      if (round_running_)
+        return;
+      round_running_ = true;
+      round_bc_.Add(1);
+      pb->Dispatch([this] {
+        RunRound();
+        round_running_ = false;
+        round_bc_.Dec();
+      });
+    });
+  });
+}
+
+void ConnectionRebalancer::Stop() {
+  if (periodic_id_ == 0)
+    return;
+
+  ProactorBase* pb = pp_->at(0);
+  pb->Await([this, pb] { pb->CancelPeriodic(periodic_id_); });
+  round_bc_.Wait();
+  periodic_id_ = 0;
+}
+
+void ConnectionRebalancer::RunRound() {
+  const unsigned num = pp_->size();
+  const uint64_t now = absl::GetCurrentTimeNanos();
+  const uint64_t cooldown_ns = uint64_t(opts_.cooldown_ms) * 1000000;
+
+  vector<ProactorRound> rounds(num);
+
+  // Every thread writes only into its own entry.
+  listener_->TraverseConnections([&](unsigned index, Connection* conn) {
+    uint64_t rate = conn->num_requests_ - conn->rebalance_last_requests_;
+    conn->rebalance_last_requests_ = conn->num_requests_;
+
+    ProactorRound& round = rounds[index];
+    round.rate += rate;
+    if (rate >= opts_.min_requests && conn->migrate_to_ < 0 &&
+        now - conn->last_migration_ns_ >= cooldown_ns) {
+      round.candidates.push_back(Candidate{rate, conn});
+    }
+  });
+  rounds_.fetch_add(1, memory_order_relaxed);
+
+  vector<double> load(num);
+  double total = 0;
+  for (unsigned i = 0; i < num; ++i) {
+    load[i] = rounds[i].rate;
+    total += load[i];
+    sort(rounds[i].candidates.begin(), rounds[i].candidates.end(),
+         [](const Candidate& a, const Candidate& b) { return a.rate > b.rate; });
+  }
+
+  if (total == 0) {
+    imbalance_.store(1, memory_order_relaxed);
+    return;
+  }
+
+  const double avg = total / num;
+  imbalance_.store(*max_element(load.begin(), load.end()) / avg, memory_order_relaxed);
+
+  vector<Move> moves;
+  vector<bool> exhausted(num, false);
+
+  while (moves.size() < opts_.max_migrations_per_round) {
+    int hot = -1;
+    unsigned cool = 0;
+    for (unsigned i = 0; i < num; ++i) {
+      if (!exhausted[i] && (hot < 0 || load[i] > load[hot]))
+        hot = i;
+      if (load[i] < load[cool])
+        cool = i;
+    }
+
+    if (hot < 0 || load[hot] <= avg * opts_.hot_ratio)
+      break;
+
+    // The largest connection that does not make the destination hotter than the source.
+    auto& cands = rounds[hot].candidates;
+    double gap = load[hot] - load[cool];
+    auto it = find_if(cands.begin(), cands.end(),
+                      [gap](const Candidate& c) { return c.rate > 0 && 2.0 * c.rate <= gap; });
+    if (it == cands.end()) {
+      exhausted[hot] = true;
+      continue;
+    }
+
+    load[hot] -= it->rate;
+    load[cool] += it->rate;
+    moves.push_back(Move{it->conn, unsigned(hot), cool});
+    cands.erase(it);
+  }
+
+  if (moves.empty())
+    return;
+
+  VLOG(1) << "Rebalancing " << moves.size() << " connections, imbalance "
+          << imbalance_.load(memory_order_relaxed);
+
+  listener_->TraverseConnections([&](unsigned index, Connection* conn) {
+    for (const Move& m : moves) {
+      if (m.src == index && m.conn == conn) {
+        conn->migrate_to_ = m.dest;
+        break;
+      }
+    }
+  });
+  scheduled_migrations_.fetch_add(moves.size(), memory_order_relaxed);
+}
+
+auto ConnectionRebalancer::GetStats() const -> Stats {
+  Stats res;
+  res.rounds = rounds_.load(memory_order_relaxed);
+  res.scheduled_migrations = scheduled_migrations_.load(memory_order_relaxed);
+  res.migrations = listener_->num_migrations();
+  res.imbalance = imbalance_.load(memory_order_relaxed);
+  return res;
+}
+
+}  // namespace util
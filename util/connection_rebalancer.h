@@ -0,0 +1,75 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+
+#include "util/fibers/fibers_ext.h"
+#include "util/varz.h"
+
+namespace util {
+
+class ListenerInterface;
+class ProactorPool;
+
+// Periodically moves busy connections of a listener from hot proactors to cool ones.
+// Each round measures the request rate of every connection (see Connection::NoteRequest),
+// and while the hottest proactor exceeds the average rate by hot_ratio, schedules the migration
+// of its busiest connection to the coolest proactor. Only connections that call
+// Connection::MaybeMigrate() are actually moved.
+// Hysteresis: a connection is moved only if it does not make the destination hotter than the
+// source becomes, and a migrated connection is not moved again during the cooldown period.
+class ConnectionRebalancer {
+ public:
+  struct Options {
+    uint32_t period_ms = 1000;
+
+    // A proactor is hot when its request rate exceeds the average by this factor.
+    double hot_ratio = 1.25;
+
+    unsigned max_migrations_per_round = 8;
+    uint32_t cooldown_ms = 10000;
+
+    // Connections with fewer requests per round are not worth moving.
+    uint32_t min_requests = 8;
+  };
+
+  struct Stats {
+    uint64_t rounds = 0;
+    uint64_t scheduled_migrations = 0;
+    uint64_t migrations = 0;  // completed migrations of the listener.
+    double imbalance = 1;     // max/avg request rate across proactors in the last round.
+  };
+
+  ConnectionRebalancer(ProactorPool* pp, ListenerInterface* listener);
+  ConnectionRebalancer(ProactorPool* pp, ListenerInterface* listener, const Options& opts);
+  ~ConnectionRebalancer();
+
+  // Must be called after the listener has been added to the AcceptServer and
+  // from a non-proactor thread.
+  void Start();
+  void Stop();
+
+  // Runs a single round synchronously. Must not run concurrently with Start().
+  void RunRound();
+
+  Stats GetStats() const;
+
+ private:
+  ProactorPool* pp_;
+  ListenerInterface* listener_;
+  Options opts_;
+
+  uint32_t periodic_id_ = 0;
+  bool round_running_ = false;  // accessed only from the thread of pp_->at(0).
+  BlockingCounter round_bc_{0};
+
+  std::atomic_uint64_t rounds_{0}, scheduled_migrations_{0};
+  std::atomic<double> imbalance_{1};
+
+  VarzFunction varz_;
+};
+
+}  // namespace util
@@ -0,0 +1,192 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/connection_rebalancer.h"
+
+#include <absl/time/clock.h>
+
+#include <algorithm>
+#include <thread>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "util/accept_server.h"
+#include "util/listener_interface.h"
+
+#ifdef USE_FB2
+#include "util/fibers/pool.h"
+#else
+#include "util/uring/uring_pool.h"
+#endif
+
+namespace util {
+
+using namespace std;
+
+namespace {
+
+constexpr unsigned kNumClients = 4;
+constexpr uint32_t kWorkUsec = 200;
+
+// Each request is a 4 byte cpu cost in microseconds, the response is a single byte.
+class SpinConnection : public Connection {
+ protected:
+  void HandleRequests() final {
+    uint32_t work_usec;
+    uint8_t resp = 1;
+
+    while (true) {
+      auto res = socket_->Read(io::MutableBytes(reinterpret_cast<uint8_t*>(&work_usec), 4));
+      if (!res || *res < 4)
+        break;
+
+      uint64_t until = absl::GetCurrentTimeNanos() + work_usec * 1000ULL;
+      while (absl::GetCurrentTimeNanos() < until) {
+      }
+
+      NoteRequest();
+      if (socket_->Write(io::Bytes(&resp, 1)))
+        break;
+      MaybeMigrate();
+    }
+  }
+};
+
+// Places all the connections on the first proactor.
+class FirstProactorPlacement : public PlacementPolicy {
+ public:
+  unsigned Pick(LinuxSocketBase* sock) final {
+    return 0;
+  }
+};
+
+class SpinListener : public ListenerInterface {
+ public:
+  SpinListener() {
+    SetPlacementPolicy(make_unique<FirstProactorPlacement>());
+  }
+
+  Connection* NewConnection(ProactorBase* pb) final {
+    return new SpinConnection;
+  }
+};
+
+ProactorPool* CreatePool(size_t size) {
+#ifdef USE_FB2
+  return fb2::Pool::IOUring(16, size);
+#else
+  return new uring::UringPool(16, size);
+#endif
+}
+
+}  // namespace
+
+class ConnectionRebalancerTest : public testing::Test {
+ protected:
+  void SetUp() final;
+  void TearDown() final;
+
+  // Each client sends num_requests requests. Returns the latencies in microseconds.
+  vector<uint64_t> RunClients(unsigned num_requests);
+
+  unique_ptr<ProactorPool> server_pool_, client_pool_;
+  unique_ptr<AcceptServer> as_;
+  SpinListener* listener_ = nullptr;
+  vector<unique_ptr<FiberSocketBase>> clients_;
+};
+
+void ConnectionRebalancerTest::SetUp() {
+  server_pool_.reset(CreatePool(2));
+  server_pool_->Run();
+  client_pool_.reset(CreatePool(kNumClients));
+  client_pool_->Run();
+
+  as_.reset(new AcceptServer{server_pool_.get(), false});
+  listener_ = new SpinListener;
+  uint16_t port = as_->AddListener(0, listener_);
+  as_->Run();
+
+  clients_.resize(kNumClients);
+  auto address = boost::asio::ip::make_address("127.0.0.1");
+  FiberSocketBase::endpoint_type ep{address, port};
+
+  client_pool_->AwaitFiberOnAll([&](unsigned index, ProactorBase* pb) {
+    clients_[index].reset(pb->CreateSocket());
+    auto ec = clients_[index]->Connect(ep);
+    CHECK(!ec) << ec;
+  });
+}
+
+void ConnectionRebalancerTest::TearDown() {
+  client_pool_->AwaitFiberOnAll([&](unsigned index, ProactorBase* pb) {
+    clients_[index]->Close();
+  });
+  as_->Stop(true);
+  client_pool_->Stop();
+  server_pool_->Stop();
+}
+
+vector<uint64_t> ConnectionRebalancerTest::RunClients(unsigned num_requests) {
+  vector<vector<uint64_t>> latencies(kNumClients);
+
+  client_pool_->AwaitFiberOnAll([&](unsigned index, ProactorBase* pb) {
+    uint32_t req = kWorkUsec;
+    uint8_t resp;
+    for (unsigned i = 0; i < num_requests; ++i) {
+      uint64_t start = absl::GetCurrentTimeNanos();
+      CHECK(!clients_[index]->Write(io::Bytes(reinterpret_cast<uint8_t*>(&req), 4)));
+      auto res = clients_[index]->Read(io::MutableBytes(&resp, 1));
+      CHECK(res && *res == 1);
+      latencies[index].push_back((absl::GetCurrentTimeNanos() - start) / 1000);
+    }
+  });
+
+  vector<uint64_t> res;
+  for (const auto& v : latencies)
+    res.insert(res.end(), v.begin(), v.end());
+  sort(res.begin(), res.end());
+  return res;
+}
+
+TEST_F(ConnectionRebalancerTest, SkewedLoad) {
+  auto before = RunClients(500);
+  uint64_t p99_before = before[before.size() * 99 / 100];
+
+  ConnectionRebalancer::Options opts;
+  opts.period_ms = 20;
+  opts.cooldown_ms = 100000;  // no ping-pong during the test.
+
+  ConnectionRebalancer rebalancer(server_pool_.get(), listener_, opts);
+  rebalancer.Start();
+
+  // Connections migrate only when they handle requests.
+  for (unsigned i = 0; i < 50 && rebalancer.GetStats().migrations == 0; ++i) {
+    RunClients(20);
+  }
+
+  auto after = RunClients(500);
+  uint64_t p99_after = after[after.size() * 99 / 100];
+  ConnectionRebalancer::Stats stats = rebalancer.GetStats();
+  rebalancer.Stop();
+
+  LOG(INFO) << "p99 before: " << p99_before << "us, after: " << p99_after
+            << "us, migrations: " << stats.migrations << ", imbalance: " << stats.imbalance;
+
+  EXPECT_GT(stats.migrations, 0);
+  EXPECT_LE(stats.scheduled_migrations, kNumClients);
+
+  // All the connections started on proactor 0, now both proactors serve some.
+  unsigned per_proactor[2] = {0, 0};
+  listener_->TraverseConnections(
+      [&](unsigned index, Connection* conn) { per_proactor[index]++; });
+  EXPECT_GT(per_proactor[0], 0);
+  EXPECT_GT(per_proactor[1], 0);
+
+  // Timing depends on the machine, require enough cores for both pools.
+  if (thread::hardware_concurrency() >= 2 + kNumClients) {
+    EXPECT_LT(p99_after, p99_before);
+  }
+}
+
+}  // namespace util
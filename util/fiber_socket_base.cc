@@ -4,6 +4,7 @@
 
 #include "util/fiber_socket_base.h"
 
+#include <fcntl.h>
 #include <netinet/in.h>
 #include <poll.h>
 
@@ -83,6 +84,30 @@ error_code LinuxSocketBase::Create(unsigned short pfamily) {
   return ec;
 }
 
+error_code LinuxSocketBase::Adopt(int fd) {
+  DCHECK_EQ(fd_, -1);
+
+  error_code ec;
+  int domain = 0;
+  socklen_t len = sizeof(domain);
+  if (posix_err_wrap(getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &len), &ec) < 0)
+    return ec;
+
+  int flags = fcntl(fd, F_GETFL, 0);
+  if (posix_err_wrap(flags, &ec) < 0)
+    return ec;
+  if (posix_err_wrap(fcntl(fd, F_SETFL, flags | O_NONBLOCK), &ec) < 0)
+    return ec;
+
+  fd_ = fd << 3;
+  if (domain == AF_UNIX) {
+    fd_ |= IS_UDS;
+  }
+
+  OnSetProactor();
+  return ec;
+}
+
 error_code LinuxSocketBase::Listen(uint16_t port, unsigned backlog) {
   sockaddr_in server_addr;
   memset(&server_addr, 0, sizeof(server_addr));
@@ -112,6 +112,10 @@ class LinuxSocketBase : public FiberSocketBase {
   /// Creates a socket. By default with AF_INET family (2).
   error_code Create(unsigned short protocol_family = 2);
 
+  /// Takes ownership over a socket created elsewhere, for example received from another process.
+  /// Must be called instead of Create().
+  error_code Adopt(int fd);
+
   ABSL_MUST_USE_RESULT error_code Listen(const struct sockaddr* bind_addr, unsigned addr_len,
                                          unsigned backlog);
 
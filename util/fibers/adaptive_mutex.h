@@ -0,0 +1,178 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/base/attributes.h>
+#include <absl/base/optimization.h>
+
+#include <atomic>
+#include <cstdint>
+#include <utility>
+
+#ifdef USE_FB2
+#include "util/fibers/synchronization.h"
+#else
+#include "util/fibers/event_count.h"
+#endif
+
+namespace util {
+
+// Reader-writer lock for fibers that may run on different threads. Contended acquisitions spin
+// for a short while, since critical sections are usually short, and then park the fiber on
+// EventCount so that other fibers of the proactor keep running. This is unlike folly::RWSpinLock
+// and base::SpinLock that burn the whole proactor thread when the holder is preempted by the OS.
+//
+// Writers have priority: once a writer waits, new readers do not enter. Therefore, a fiber must
+// not take the shared lock recursively.
+// Unlocking is a single atomic operation unless there are parked fibers.
+class AdaptiveSharedMutex {
+ public:
+  // Counters are updated only on the contended path.
+  struct Stats {
+    uint64_t contended = 0;      // acquisitions that did not succeed on the first try.
+    uint64_t spin_acquired = 0;  // contended acquisitions that succeeded while spinning.
+    uint64_t parked = 0;         // contended acquisitions that suspended the fiber.
+  };
+
+  static constexpr unsigned kDefaultSpinCount = 128;
+
+  AdaptiveSharedMutex() : AdaptiveSharedMutex(kDefaultSpinCount) {
+  }
+
+  // spin_count - number of acquisition attempts before parking, 0 parks immediately.
+  explicit AdaptiveSharedMutex(unsigned spin_count) : spin_count_(spin_count) {
+  }
+
+  AdaptiveSharedMutex(const AdaptiveSharedMutex&) = delete;
+  AdaptiveSharedMutex& operator=(const AdaptiveSharedMutex&) = delete;
+
+  bool try_lock() {
+    uint32_t expected = state_.load(std::memory_order_relaxed) & WRITER_PENDING;
+    return state_.compare_exchange_strong(expected, WRITER, std::memory_order_acquire,
+                                          std::memory_order_relaxed);
+  }
+
+  void lock() {
+    if (ABSL_PREDICT_FALSE(!try_lock()))
+      LockSlow();
+  }
+
+  void unlock() {
+    state_.fetch_and(~WRITER, std::memory_order_seq_cst);
+    WakeParked();
+  }
+
+  bool try_lock_shared() {
+    uint32_t value = state_.fetch_add(READER, std::memory_order_acquire);
+    if (ABSL_PREDICT_FALSE(value & (WRITER | WRITER_PENDING))) {
+      uint32_t prev = state_.fetch_sub(READER, std::memory_order_seq_cst);
+
+      // A pending writer could have seen our reader bits and parked. Moreover, the last real
+      // reader could have released meanwhile without waking it, since it counted us as a reader.
+      // Therefore, we wake the writer if it still waits and no readers remain after our
+      // back-off. A writer that holds the lock wakes the others when it unlocks.
+      if (prev - READER == WRITER_PENDING)
+        WakeParked();
+      return false;
+    }
+    return true;
+  }
+
+  void lock_shared() {
+    if (ABSL_PREDICT_FALSE(!try_lock_shared()))
+      LockSharedSlow();
+  }
+
+  void unlock_shared() {
+    uint32_t prev = state_.fetch_sub(READER, std::memory_order_seq_cst);
+
+    // Only the last reader can let a writer in.
+    if ((prev & ~(WRITER | WRITER_PENDING)) == READER)
+      WakeParked();
+  }
+
+  Stats GetStats() const {
+    Stats res;
+    res.contended = contended_.load(std::memory_order_relaxed);
+    res.spin_acquired = spin_acquired_.load(std::memory_order_relaxed);
+    res.parked = parked_.load(std::memory_order_relaxed);
+    return res;
+  }
+
+ private:
+#ifdef USE_FB2
+  using EventCount = fb2::EventCount;
+#else
+  using EventCount = fibers_ext::EventCount;
+#endif
+
+  enum : uint32_t { WRITER = 1, WRITER_PENDING = 2, READER = 4 };
+
+  static void CpuRelax() {
+#if defined(__x86_64__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+  }
+
+  // Tries to lock and returns true on success, otherwise announces a pending writer so that
+  // readers stop entering.
+  bool TryLockOrAnnounce() {
+    if (try_lock())
+      return true;
+    state_.fetch_or(WRITER_PENDING, std::memory_order_relaxed);
+    return false;
+  }
+
+  template <typename TryFn> ABSL_ATTRIBUTE_NOINLINE void AcquireSlow(TryFn&& try_fn) {
+    contended_.fetch_add(1, std::memory_order_relaxed);
+    for (unsigned i = 0; i < spin_count_; ++i) {
+      CpuRelax();
+      if (try_fn()) {
+        spin_acquired_.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+
+    // The waiter counter is published before the state is re-checked inside await, and
+    // the unlockers modify the state before they read the counter. Both sides are sequentially
+    // consistent, so either we see the released lock or the unlocker sees us.
+    num_waiters_.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (ec_.await(std::forward<TryFn>(try_fn)))
+      parked_.fetch_add(1, std::memory_order_relaxed);
+    num_waiters_.fetch_sub(1, std::memory_order_relaxed);
+  }
+
+  void LockSlow() {
+    AcquireSlow([this] { return TryLockOrAnnounce(); });
+  }
+
+  // Does not touch the state while a writer holds or waits for the lock. Otherwise, the back-off
+  // inside the await predicate would wake the parked fibers, including this one, and the fiber
+  // would spin without letting the writer on its thread run.
+  void LockSharedSlow() {
+    AcquireSlow([this] {
+      return (state_.load(std::memory_order_relaxed) & (WRITER | WRITER_PENDING)) == 0 &&
+             try_lock_shared();
+    });
+  }
+
+  void WakeParked() {
+    if (ABSL_PREDICT_FALSE(num_waiters_.load(std::memory_order_seq_cst) > 0))
+      ec_.notifyAll();
+  }
+
+  std::atomic_uint32_t state_{0};
+  std::atomic_uint32_t num_waiters_{0};
+  const unsigned spin_count_;
+
+  EventCount ec_;
+
+  std::atomic_uint64_t contended_{0}, spin_acquired_{0}, parked_{0};
+};
+
+}  // namespace util
@@ -0,0 +1,257 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/fibers/adaptive_mutex.h"
+
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+#include "base/RWSpinLock.h"
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "util/fibers/fibers_ext.h"
+
+#ifdef USE_FB2
+#include "util/fibers/pool.h"
+#else
+#include "util/uring/uring_pool.h"
+#endif
+
+namespace util {
+
+using namespace std;
+
+namespace {
+
+#ifdef USE_FB2
+using fb2::Fiber;
+#else
+using fibers_ext::Fiber;
+#endif
+
+ProactorPool* CreatePool(unsigned num_threads) {
+#ifdef USE_FB2
+  return fb2::Pool::IOUring(16, num_threads);
+#else
+  return new uring::UringPool(16, num_threads);
+#endif
+}
+
+// Runs num_fibers fibers on each proactor thread, each calling func(fiber_index) and waits
+// for all of them to finish.
+template <typename Func> void RunOnAll(ProactorPool* pp, unsigned num_fibers, Func&& func) {
+  pp->AwaitFiberOnAll([&](unsigned index, ProactorBase*) {
+    vector<Fiber> fibers;
+    for (unsigned i = 0; i < num_fibers; ++i) {
+      fibers.push_back(MakeFiber([&, i] { func(index * num_fibers + i); }));
+    }
+    for (auto& fb : fibers)
+      fb.Join();
+  });
+}
+
+}  // namespace
+
+class AdaptiveMutexTest : public testing::Test {
+ protected:
+  void SetUp() final {
+    pp_.reset(CreatePool(3));
+    pp_->Run();
+  }
+
+  void TearDown() final {
+    pp_->Stop();
+  }
+
+  unique_ptr<ProactorPool> pp_;
+};
+
+TEST_F(AdaptiveMutexTest, Basic) {
+  AdaptiveSharedMutex mu;
+
+  EXPECT_TRUE(mu.try_lock());
+  EXPECT_FALSE(mu.try_lock());
+  EXPECT_FALSE(mu.try_lock_shared());
+  mu.unlock();
+
+  EXPECT_TRUE(mu.try_lock_shared());
+  EXPECT_TRUE(mu.try_lock_shared());
+  EXPECT_FALSE(mu.try_lock());
+  mu.unlock_shared();
+  mu.unlock_shared();
+  EXPECT_TRUE(mu.try_lock());
+  mu.unlock();
+
+  AdaptiveSharedMutex::Stats stats = mu.GetStats();
+  EXPECT_EQ(0, stats.contended);
+}
+
+TEST_F(AdaptiveMutexTest, ParkSameThread) {
+  AdaptiveSharedMutex mu;
+
+  // The holder and the waiter run on the same thread, so the waiter must park to let the
+  // holder release the lock.
+  pp_->at(0)->Await([&] {
+    mu.lock();
+    auto fb = MakeFiber([&] {
+      lock_guard lk(mu);
+    });
+    ThisFiber::Yield();
+    mu.unlock();
+    fb.Join();
+  });
+
+  AdaptiveSharedMutex::Stats stats = mu.GetStats();
+  EXPECT_EQ(1, stats.contended);
+  EXPECT_EQ(1, stats.parked);
+}
+
+TEST_F(AdaptiveMutexTest, WriterPriority) {
+  AdaptiveSharedMutex mu(0);
+
+  pp_->at(0)->Await([&] {
+    vector<int> order;
+    mu.lock_shared();
+    auto writer = MakeFiber([&] {
+      lock_guard lk(mu);
+      order.push_back(1);
+    });
+    ThisFiber::Yield();  // the writer is pending.
+
+    auto reader = MakeFiber([&] {
+      shared_lock lk(mu);
+      order.push_back(2);
+    });
+    ThisFiber::Yield();
+    mu.unlock_shared();
+
+    writer.Join();
+    reader.Join();
+    EXPECT_EQ((vector<int>{1, 2}), order);
+  });
+}
+
+// A reader that backs off because of a pending writer races with the unlock of the last reader.
+// The last reader counts the backing-off reader and does not wake the parked writer, hence
+// the backing-off reader must do it.
+TEST_F(AdaptiveMutexTest, BackoffReaderWakesWriter) {
+  constexpr unsigned kRounds = 1000;
+
+  AdaptiveSharedMutex mu(0);
+  unsigned stuck = 0;
+
+  for (unsigned round = 0; round < kRounds; ++round) {
+    atomic_bool acquired{false}, stop{false};
+
+    pp_->at(0)->Await([&] { mu.lock_shared(); });
+    Fiber writer = pp_->at(1)->LaunchFiber([&] {
+      lock_guard lk(mu);
+      acquired.store(true);
+    });
+
+    // Wait for the writer to announce itself.
+    while (mu.try_lock_shared()) {
+      mu.unlock_shared();
+      this_thread::yield();
+    }
+
+    Fiber backoff = pp_->at(2)->LaunchFiber([&] {
+      while (!stop.load(memory_order_relaxed)) {
+        if (mu.try_lock_shared())
+          mu.unlock_shared();
+      }
+    });
+
+    pp_->at(0)->Await([&] { mu.unlock_shared(); });
+    stop.store(true);
+    pp_->at(2)->Await([&] { backoff.Join(); });
+
+    for (unsigned i = 0; i < 1000 && !acquired.load(); ++i) {
+      this_thread::sleep_for(1ms);
+    }
+
+    if (!acquired.load()) {
+      ++stuck;
+      pp_->at(2)->Await([&] { mu.try_lock_shared(); });  // unblocks the writer.
+    }
+    pp_->at(1)->Await([&] { writer.Join(); });
+  }
+  EXPECT_EQ(0u, stuck);
+}
+
+TEST_F(AdaptiveMutexTest, Stress) {
+  constexpr unsigned kFibers = 8;
+  constexpr unsigned kIters = 5000;
+
+  AdaptiveSharedMutex mu;
+  uint64_t a = 0, b = 0;
+  atomic_uint64_t reads{0}, failures{0};
+
+  RunOnAll(pp_.get(), kFibers, [&](unsigned id) {
+    for (unsigned i = 0; i < kIters; ++i) {
+      if ((i + id) % 4 == 0) {
+        lock_guard lk(mu);
+        ++a;
+        if (i % 64 == 0)
+          ThisFiber::Yield();
+        ++b;
+      } else {
+        shared_lock lk(mu);
+        if (a != b)
+          failures.fetch_add(1, memory_order_relaxed);
+        reads.fetch_add(1, memory_order_relaxed);
+      }
+    }
+  });
+
+  EXPECT_EQ(0, failures.load());
+  EXPECT_EQ(a, b);
+  EXPECT_EQ(3 * kFibers * kIters, a + reads.load());
+
+  AdaptiveSharedMutex::Stats stats = mu.GetStats();
+  LOG(INFO) << "contended: " << stats.contended << " spin_acquired: " << stats.spin_acquired
+            << " parked: " << stats.parked;
+}
+
+// Fibers on all proactor threads update a shared counter, 1 in `range(0)` operations is a
+// write. If range(1) is set, writers yield once in a while, emulating a preempted holder.
+// Spin locks can not be used in this mode since the waiters never let the holder run.
+template <typename Mutex> void BM_Contention(benchmark::State& state) {
+  constexpr unsigned kThreads = 3, kFibers = 4, kIters = 2000;
+
+  unique_ptr<ProactorPool> pp(CreatePool(kThreads));
+  pp->Run();
+
+  const unsigned write_ratio = state.range(0);
+  const bool yield = state.range(1);
+  Mutex mu;
+  uint64_t counter = 0;
+
+  while (state.KeepRunning()) {
+    RunOnAll(pp.get(), kFibers, [&](unsigned id) {
+      for (unsigned i = 0; i < kIters; ++i) {
+        if ((i + id) % write_ratio == 0) {
+          lock_guard lk(mu);
+          ++counter;
+          if (yield && i % 128 == 0)
+            ThisFiber::Yield();
+        } else {
+          shared_lock lk(mu);
+          benchmark::DoNotOptimize(counter);
+        }
+      }
+    });
+  }
+  state.SetItemsProcessed(state.iterations() * kThreads * kFibers * kIters);
+  pp->Stop();
+}
+
+BENCHMARK_TEMPLATE(BM_Contention, AdaptiveSharedMutex)
+    ->ArgsProduct({{2, 16}, {0, 1}})
+    ->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Contention, SharedMutex)->ArgsProduct({{2, 16}, {0, 1}})->UseRealTime();
+BENCHMARK_TEMPLATE(BM_Contention, folly::RWSpinLock)->ArgsProduct({{2, 16}, {0}})->UseRealTime();
+
+}  // namespace util
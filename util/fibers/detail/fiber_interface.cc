@@ -7,6 +7,7 @@
 #include <condition_variable>
 
 #include "base/logging.h"
+#include "base/memory_account.h"
 #include "util/fibers/detail/scheduler.h"
 
 namespace util {
@@ -18,6 +19,9 @@ namespace ctx = boost::context;
 
 namespace {
 
+// Worker fibers are created via fixedsize_stack with the default size, see fiber2.h.
+base::MemoryAccount fiber_stack_account("fiber_stacks");
+
 
 inline void CpuPause() {
 #if defined(__i386__) || defined(__amd64__)
@@ -152,6 +156,8 @@ ctx::fiber_context FiberInterface::Terminate() {
 
   scheduler_->ScheduleTermination(this);
   DVLOG(2) << "Terminating " << name_;
+  if (type_ == WORKER)
+    fiber_stack_account.Release(ctx::stack_traits::default_size());
 
   while (true) {
     uint16_t fprev = flags_.fetch_or(kTerminatedBit | kBusyBit, memory_order_acquire);
@@ -179,6 +185,8 @@ ctx::fiber_context FiberInterface::Terminate() {
 void FiberInterface::Start(Launch launch) {
   auto& fb_init = detail::FbInitializer();
   fb_init.sched->Attach(this);
+  if (type_ == WORKER)
+    fiber_stack_account.Charge(ctx::stack_traits::default_size());
 
   switch (launch) {
     case Launch::post:
@@ -7,6 +7,7 @@
 #include <mutex>
 
 #include "base/logging.h"
+#include "util/fibers/rcu.h"
 
 namespace util {
 namespace fb2 {
@@ -24,16 +25,6 @@ constexpr size_t kSizeOfLH = sizeof(FI_ListHook);
 
 
 #if PARKING_ENABLED
-template <typename T> void WriteOnce(T src, T* dest) {
-  std::atomic_store_explicit(reinterpret_cast<std::atomic<T>*>(dest), src,
-                             std::memory_order_relaxed);
-}
-
-template <typename T> T ReadOnce(T* src) {
-  return std::atomic_load_explicit(reinterpret_cast<std::atomic<T>*>(src),
-                                   std::memory_order_relaxed);
-}
-
 // Thomas Wang's 64 bit Mix Function.
 inline uint64_t MixHash(uint64_t key) {
   key += ~(key << 32);
@@ -102,46 +93,7 @@ class ParkingHT {
 
 // ParkingHT* g_parking_ht = nullptr;
 
-using QsbrEpoch = uint32_t;
-constexpr QsbrEpoch kEpochInc = 2;
-atomic<QsbrEpoch> qsbr_global_epoch{1};  // global is always non-zero.
-
 #if PARKING_ENABLED
-// TODO: we could move this checkpoint to the proactor loop.
-void qsbr_checkpoint() {
-  atomic_thread_fence(memory_order_seq_cst);
-
-  // syncs the local_epoch with the global_epoch.
-  WriteOnce(qsbr_global_epoch.load(memory_order_relaxed), &FbInitializer().local_epoch);
-}
-
-void qsbr_worker_fiber_offline() {
-  atomic_thread_fence(memory_order_release);
-  WriteOnce(0U, &FbInitializer().local_epoch);
-}
-
-void qsbr_worker_fiber_online() {
-  WriteOnce(qsbr_global_epoch.load(memory_order_relaxed), &FbInitializer().local_epoch);
-  atomic_thread_fence(memory_order_seq_cst);
-}
-
-bool qsbr_sync(uint64_t target) {
-  unique_lock lk(g_scheduler_lock, try_to_lock);
-
-  if (!lk)
-    return false;
-
-  FbInitializer().local_epoch = target;
-  for (TL_FiberInitializer* p = g_fiber_thread_list; p != nullptr; p = p->next) {
-    auto local_epoch = ReadOnce(&p->local_epoch);
-    if (local_epoch && local_epoch != target) {
-      return false;
-    }
-  }
-
-  return true;
-}
-
 ParkingHT::ParkingHT() {
   SizedBuckets* sb = new SizedBuckets(6);
   buckets_.store(sb, memory_order_release);
@@ -199,12 +151,8 @@ bool ParkingHT::Emplace(uint64_t token, FiberInterface* fi, absl::FunctionRef<bo
     if (num_items > sb->num_buckets) {
       TryRehash(sb);
     }
-  } else {
-    qsbr_checkpoint();
   }
 
-  // we do not call qsbr_checkpoint here because we are going to park
-  // and call qsbr_worker_fiber_offline.
   return res;
 }
 
@@ -228,7 +176,6 @@ FiberInterface* ParkingHT::Remove(uint64_t token, absl::FunctionRef<void(FiberIn
             auto prev = num_entries_.fetch_sub(1, memory_order_relaxed);
             DCHECK_GT(prev, 0u);
             on_hit(fi);
-            // qsbr_checkpoint();
 
             return fi;
           }
@@ -239,7 +186,6 @@ FiberInterface* ParkingHT::Remove(uint64_t token, absl::FunctionRef<void(FiberIn
     }
   }
 
-  qsbr_checkpoint();
   return nullptr;
 }
 
@@ -270,7 +216,6 @@ void ParkingHT::RemoveAll(uint64_t token, WaitQueue* wq) {
       }
     }
   }
-  qsbr_checkpoint();
 }
 
 void ParkingHT::TryRehash(SizedBuckets* cur_sb) {
@@ -311,9 +256,8 @@ void ParkingHT::TryRehash(SizedBuckets* cur_sb) {
     sb->arr[i].lock.Unlock();
   }
 
-  uint64_t next_epoch = qsbr_global_epoch.fetch_add(kEpochInc, memory_order_relaxed) + kEpochInc;
-
-  FbInitializer().sched->Defer(next_epoch, [sb] {
+  // Other threads may still scan the old buckets, their loops report quiescent states to rcu.
+  rcu::Retire([sb] {
     DVLOG(1) << "Destroying old SizedBuckets with " << sb->num_buckets << " buckets";
     delete sb;
   });
@@ -427,11 +371,9 @@ void DispatcherImpl::DefaultDispatch(Scheduler* sched) {
       sched->AddReady(this);
 
       DVLOG(2) << "Switching to " << fi->name();
-      // qsbr_worker_fiber_online();
       fi->SwitchTo();
       DCHECK(!list_hook.is_linked());
       DCHECK(FiberActive() == this);
-      // qsbr_worker_fiber_offline();
     } else {
       sched->DestroyTerminated();
 
@@ -602,26 +544,24 @@ void Scheduler::AttachCustomPolicy(DispatchPolicy* policy) {
 }
 
 void Scheduler::RunDeferred() {
-#if PARKING_ENABLED
-  bool skip_validation = false;
-
-  while (!deferred_cb_.empty()) {
-    const auto& k_v = deferred_cb_.back();
-    if (skip_validation) {
-      k_v.second();
-      deferred_cb_.pop_back();
+  if (deferred_cb_.empty())
+    return;
 
-      continue;
-    }
+  // Callbacks are deferred with increasing epochs.
+  uint64_t completed = rcu::CompletedEpoch();
+  auto it = deferred_cb_.begin();
+  while (it != deferred_cb_.end() && it->first <= completed)
+    ++it;
 
-    if (!qsbr_sync(k_v.first))
-      break;
+  if (it == deferred_cb_.begin())
+    return;
 
+  // Callbacks may defer more callbacks.
+  decltype(deferred_cb_) ready(make_move_iterator(deferred_cb_.begin()), make_move_iterator(it));
+  deferred_cb_.erase(deferred_cb_.begin(), it);
+  for (auto& k_v : ready) {
     k_v.second();
-    skip_validation = true;
-    deferred_cb_.pop_back();
   }
-#endif
 }
 
 #if PARKING_ENABLED
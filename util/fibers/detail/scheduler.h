@@ -40,6 +40,11 @@ class Scheduler {
     return !ready_queue_.empty();
   }
 
+  // O(n), intended for periodic load sampling.
+  size_t ReadyQueueSize() const {
+    return ready_queue_.size();
+  }
+
   ::boost::context::fiber_context Preempt();
 
   void WaitUntil(std::chrono::steady_clock::time_point tp, FiberInterface* me);
@@ -81,12 +86,18 @@ class Scheduler {
     return custom_policy_;
   }
 
+  // Runs fn in RunDeferred() once the grace period of epoch ends, see rcu::CompletedEpoch().
+  // Epochs must not decrease between the calls.
   void Defer(uint64_t epoch, std::function<void()> fn) {
     deferred_cb_.emplace_back(epoch, std::move(fn));
   }
 
   void RunDeferred();
 
+  bool HasDeferred() const {
+    return !deferred_cb_.empty();
+  }
+
   void DetachWorker() {
     --num_worker_fibers_;
   }
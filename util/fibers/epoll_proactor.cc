@@ -15,6 +15,7 @@
 #include "base/logging.h"
 #include "base/proc_util.h"
 #include "util/fibers/epoll_socket.h"
+#include "util/fibers/rcu.h"
 
 #define EV_CHECK(x)                                                           \
   do {                                                                        \
@@ -88,12 +89,15 @@ void EpollProactor::MainLoop(detail::Scheduler* scheduler) {
   uint32_t spin_loops = 0, num_task_runs = 0, task_interrupts = 0;
   uint32_t cqe_count = 0;
   uint64_t last_sleep_check = absl::base_internal::CycleClock::Now();
+  uint64_t last_deferred_check = last_sleep_check;
   const uint64_t cycles_per_10us = absl::base_internal::CycleClock::Frequency() / 100'000;
   Tasklet task;
+  rcu::RegisterThread();
 
   while (true) {
     ++loop_cnt;
     num_task_runs = 0;
+    rcu::QuiescentState();
 
     tq_seq = tq_seq_.load(memory_order_acquire);
 
@@ -168,7 +172,11 @@ void EpollProactor::MainLoop(detail::Scheduler* scheduler) {
       }
     }
 
+    if (timeout)
+      rcu::ThreadOffline();
     int epoll_res = epoll_wait(epoll_fd_, cevents, kBatchSize, timeout);
+    if (timeout)
+      rcu::ThreadOnline();
     if (epoll_res < 0) {
       epoll_res = errno;
       if (epoll_res == EINTR)
@@ -212,6 +220,15 @@ void EpollProactor::MainLoop(detail::Scheduler* scheduler) {
       }
     }
 
+    // Reclaim retired objects when the loop is busy as well.
+    if (scheduler->HasDeferred()) {
+      uint64_t now = absl::base_internal::CycleClock::Now();
+      if (now >= last_deferred_check + cycles_per_10us * 10) {
+        last_deferred_check = now;
+        scheduler->RunDeferred();
+      }
+    }
+
     // must be if and not while - see uring_proactor.cc for more details.
     if (scheduler->HasReady()) {
       FiberInterface* fi = scheduler->PopReady();
@@ -236,6 +253,8 @@ void EpollProactor::MainLoop(detail::Scheduler* scheduler) {
     ++spin_loops;
   }
 
+  rcu::UnregisterThread();
+
   VPRO(1) << "total/stalls/cqe_fetches/num_suspends: " << loop_cnt << "/" << num_stalls << "/"
           << cqe_fetches << "/" << num_suspends;
 
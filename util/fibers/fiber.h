@@ -4,12 +4,15 @@
 
 #pragma once
 
+#include <boost/context/fixedsize_stack.hpp>
 #include <boost/fiber/condition_variable.hpp>
 #include <boost/fiber/fiber.hpp>
 #include <boost/fiber/future.hpp>
 #include <boost/fiber/mutex.hpp>
 #include <boost/fiber/operations.hpp>
 
+#include "base/memory_account.h"
+
 namespace util {
 
 namespace fibers_ext {
@@ -18,18 +21,48 @@ namespace fibers_ext {
 // post - enqueues for activation
 using Launch = boost::fibers::launch;
 
+namespace detail {
+
+// Created on first use, so that binaries without boost fibers do not list it.
+inline base::MemoryAccount& FiberStackAccount() {
+  static base::MemoryAccount account("fiber_stacks");
+  return account;
+}
+
+// The default stack allocator of boost fibers that charges the stacks to FiberStackAccount().
+class TrackingStack {
+ public:
+  boost::context::stack_context allocate() {
+    boost::context::stack_context sctx = stack_.allocate();
+    FiberStackAccount().Charge(sctx.size);
+    return sctx;
+  }
+
+  void deallocate(boost::context::stack_context& sctx) noexcept {
+    FiberStackAccount().Release(sctx.size);
+    stack_.deallocate(sctx);
+  }
+
+ private:
+  boost::context::fixedsize_stack stack_;
+};
+
+}  // namespace detail
+
 class Fiber {
  public:
   Fiber() = default;
 
   template <typename Fn, typename... Arg>
   Fiber(Launch policy, Fn&& fn, Arg&&... arg)
-      : fb_(policy, std::forward<Fn>(fn), std::forward<Arg>(arg)...) {
+      : fb_(policy, std::allocator_arg, detail::TrackingStack{}, std::forward<Fn>(fn),
+            std::forward<Arg>(arg)...) {
   }
 
   template <typename Fn, typename... Arg>
   Fiber(Fn&& fn, Arg&&... arg)
-      : fb_(Launch::post, std::forward<Fn>(fn), std::forward<Arg>(arg)...) {
+      : fb_(Launch::post, std::allocator_arg, detail::TrackingStack{}, std::forward<Fn>(fn),
+            std::forward<Arg>(arg)...) {
   }
 
   Fiber(::boost::fibers::fiber fb) : fb_(std::move(fb)) {
@@ -5,11 +5,14 @@
 #include "util/fibers/fiber2.h"
 
 #include <absl/strings/str_cat.h>
+#include <sys/socket.h>
 
+#include <algorithm>
 #include <condition_variable>
 #include <mutex>
 #include <thread>
 
+#include "base/async_logger.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "util/fibers/epoll_proactor.h"
@@ -288,6 +291,104 @@ TEST_F(FiberTest, AsyncEvent) {
   done.Wait();
 }
 
+// IOPOLL rings complete only polled file I/O, but NOP is allowed and exercises the reaping.
+TEST_F(FiberTest, IoPoll) {
+  UringProactor proactor;
+  thread proactor_thread([&] {
+    proactor.Init(kRingDepth, -1, true);
+    proactor.Run();
+  });
+
+  Done done;
+  auto cb = [done](auto*, UringProactor::IoResult res, uint32_t) mutable {
+    EXPECT_EQ(0, res);
+    done.Notify();
+  };
+
+  EXPECT_TRUE(proactor.AwaitBrief([&] { return proactor.HasIoPoll(); }));
+  proactor.DispatchBrief([&, cb = std::move(cb)] {
+    SubmitEntry se = proactor.GetSubmitEntry(std::move(cb));
+    se.sqe()->opcode = IORING_OP_NOP;
+  });
+  done.Wait();
+
+  // Without I/O in flight the proactor stalls on its eventfd with the timeout of the next
+  // sleeping fiber, and is woken up by the tasks of other threads.
+  proactor.Await([] { ThisFiber::SleepFor(5ms); });
+  for (unsigned i = 0; i < 100; ++i) {
+    proactor.DispatchBrief([] {});
+  }
+  proactor.AwaitBrief([] {});
+
+  auto thread_cpu_usec = [] {
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+  };
+
+  // An idle proactor does not spin.
+  int64_t start_usec = proactor.AwaitBrief(thread_cpu_usec);
+  this_thread::sleep_for(200ms);
+  int64_t idle_usec = proactor.AwaitBrief(thread_cpu_usec) - start_usec;
+  EXPECT_LT(idle_usec, 50000);
+
+  proactor.Stop();
+  proactor_thread.join();
+}
+
+TEST_F(FiberTest, SubmitBatch) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  ProactorThread pth(0, ProactorBase::IOURING);
+  UringProactor* proactor = static_cast<UringProactor*>(pth.get());
+  UringProactor::SubmitStats before = proactor->AwaitBrief([&] {
+    return proactor->GetSubmitStats();
+  });
+
+  char buf[16] = {0};
+  vector<UringProactor::IoResult> results(4, -1);
+  proactor->Await([&] {
+    BlockingCounter bc(results.size());
+    auto cb = [&](unsigned index) {
+      return [&, index, bc](auto*, UringProactor::IoResult res, uint32_t) mutable {
+        results[index] = res;
+        bc.Dec();
+      };
+    };
+
+    SubmitBatch batch(proactor, results.size());
+    batch.Add(cb(0)).Prep<sqe_op::kNop>(-1, nullptr, 0);
+
+    // Linked entries are executed in order.
+    SubmitEntry se = batch.Add(cb(1));
+    se.Prep<sqe_op::kSend>(fds[0], "hello", 5);
+    se.sqe()->flags |= IOSQE_IO_LINK;
+    batch.Add(cb(2)).Prep<sqe_op::kRecv>(fds[1], buf, sizeof(buf));
+    batch.Add(cb(3)).Prep<sqe_op::kNop>(-1, nullptr, 0);
+    EXPECT_EQ(4u, batch.size());
+
+    // Flush also submits the entries that the proactor loop prepared but did not submit yet.
+    EXPECT_GE(batch.Flush(), 4u);
+    EXPECT_EQ(0u, batch.size());
+
+    bc.Wait();
+  });
+
+  EXPECT_EQ((vector<UringProactor::IoResult>{0, 5, 5, 0}), results);
+  EXPECT_STREQ("hello", buf);
+
+  UringProactor::SubmitStats stats = proactor->AwaitBrief([&] {
+    return proactor->GetSubmitStats();
+  });
+  EXPECT_EQ(1u, stats.flushes - before.flushes);
+  EXPECT_GE(stats.submitted - before.submitted, 4u);
+  EXPECT_GT(stats.per_enter(), 0);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
 TEST_P(ProactorTest, AsyncCall) {
   ASSERT_FALSE(UringProactor::IsProactorThread());
   ASSERT_EQ(-1, UringProactor::GetIndex());
@@ -416,5 +517,52 @@ TEST_P(ProactorTest, Migrate) {
   fb.Join();
 }
 
+// A proactor fiber logs 10k lines per second, in bursts of 10 lines every millisecond,
+// while the benchmark measures the latency of the proactor loop, i.e. how long a brief task
+// waits until the loop runs it. Arg(0) - synchronous glog file writes, Arg(1) - async logger.
+static void BM_LogLoopLatency(benchmark::State& state) {
+  if (state.range(0))
+    base::InstallAsyncLogger();
+
+  ProactorThread pth(0, ProactorBase::EPOLL);
+  atomic_bool stop{false};
+  Fiber logger = pth.get()->LaunchFiber([&] {
+    string payload(100, 'a');
+    while (!stop.load(memory_order_relaxed)) {
+      for (unsigned i = 0; i < 10; ++i) {
+        LOG(INFO) << "bench " << payload;
+      }
+      ThisFiber::SleepFor(1ms);
+    }
+  });
+
+  vector<uint64_t> latencies;
+  for (auto _ : state) {
+    auto start = chrono::steady_clock::now();
+    pth.get()->AwaitBrief([] {});
+    auto end = chrono::steady_clock::now();
+    latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(end - start).count());
+
+    // Probes at an interval that is not aligned with the logging bursts.
+    auto next = end + 37us;
+    while (chrono::steady_clock::now() < next) {
+    }
+  }
+
+  stop.store(true, memory_order_relaxed);
+  pth.get()->Await([&] { logger.Join(); });
+
+  if (state.range(0))
+    base::ShutdownAsyncLogger();
+
+  sort(latencies.begin(), latencies.end());
+  if (!latencies.empty()) {
+    state.counters["p50_ns"] = latencies[latencies.size() / 2];
+    state.counters["p99_ns"] = latencies[latencies.size() * 99 / 100];
+    state.counters["max_ns"] = latencies.back();
+  }
+}
+BENCHMARK(BM_LogLoopLatency)->Arg(0)->Arg(1)->Iterations(20000);
+
 }  // namespace fb2
 }  // namespace util
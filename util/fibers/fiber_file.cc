@@ -8,6 +8,7 @@
 #include <sys/uio.h>
 
 #include <atomic>
+#include <deque>
 
 #include "base/hash.h"
 #include "base/histogram.h"
@@ -336,6 +337,15 @@ void WriteFileImpl::AsyncWrite(std::string blob) {
 }
 #endif
 
+constexpr size_t kStatBatchSize = 256;
+constexpr size_t kStatMaxBatches = 16;  // in flight.
+
+struct StatBatch {
+  size_t start, end;
+  StatShortVec res;
+  Done done;
+};
+
 }  // namespace
 
 ReadonlyFileOrError OpenFiberReadFile(std::string_view name, FiberQueueThreadPool* tp,
@@ -358,4 +368,46 @@ WriteFileOrError OpenFiberWriteFile(std::string_view name, FiberQueueThreadPool*
   return new WriteFileImpl(res.value(), hash, tp);
 }
 
+error_code FiberStatFiles(string_view pattern, FiberQueueThreadPool* tp, const FiberStatCb& cb) {
+  vector<string> paths;
+  error_code ec = tp->Await([&] {
+    return ListFiles(pattern, [&](string_view path, unsigned char) { paths.emplace_back(path); });
+  });
+  if (ec)
+    return ec;
+
+  deque<StatBatch> batches;
+  auto flush_front = [&] {
+    StatBatch& batch = batches.front();
+    batch.done.Wait();
+    if (!batch.res.empty())
+      cb(std::move(batch.res));
+    batches.pop_front();
+  };
+
+  for (size_t start = 0; start < paths.size(); start += kStatBatchSize) {
+    if (batches.size() == kStatMaxBatches)
+      flush_front();
+
+    // Elements of deque are not moved when it grows or shrinks at the ends.
+    StatBatch* batch = &batches.emplace_back();
+    batch->start = start;
+    batch->end = min(paths.size(), start + kStatBatchSize);
+    tp->Add([batch, &paths] {
+      batch->res.reserve(batch->end - batch->start);
+      for (size_t i = batch->start; i < batch->end; ++i) {
+        Result<StatShort> sshort = StatFile(std::move(paths[i]));
+        if (sshort)
+          batch->res.emplace_back(std::move(*sshort));
+      }
+      batch->done.Notify();
+    });
+  }
+
+  while (!batches.empty())
+    flush_front();
+
+  return {};
+}
+
 }  // namespace util
@@ -3,6 +3,7 @@
 //
 
 #include "io/file.h"
+#include "io/file_util.h"
 #include "util/fibers/fiberqueue_threadpool.h"
 
 namespace util {
@@ -40,4 +41,12 @@ ABSL_MUST_USE_RESULT io::Result<io::WriteFile*> OpenFiberWriteFile(
     std::string_view name, fb_namesp::FiberQueueThreadPool* tp,
     const FiberWriteOptions& opts = FiberWriteOptions());
 
+// Fiber-friendly version of io::StatFiles for directories with many files. The directory walk
+// and the stat calls run in tp, the latter in parallel batches, so the calling thread is not
+// blocked. cb is called on the calling fiber with consecutive batches of results, in no
+// particular order.
+using FiberStatCb = std::function<void(io::StatShortVec)>;
+std::error_code FiberStatFiles(std::string_view pattern, fb_namesp::FiberQueueThreadPool* tp,
+                               const FiberStatCb& cb);
+
 }  // namespace util
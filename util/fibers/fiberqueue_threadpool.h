@@ -97,7 +97,7 @@ class FiberQueue {
   typedef std::function<void()> CbFunc;
 
 
-  using FuncQ = base::mpmc_bounded_queue<CbFunc>;
+  using FuncQ = base::mpmc_bounded_queue<CbFunc, true>;
   FuncQ queue_;
 
   EventCount push_ec_, pull_ec_;
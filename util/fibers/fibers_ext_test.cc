@@ -2,8 +2,11 @@
 // See LICENSE for licensing terms.
 //
 
+#include <absl/strings/str_cat.h>
 #include <absl/time/clock.h>
+#include <fcntl.h>
 #include <gmock/gmock.h>
+#include <sys/stat.h>
 
 #include <boost/context/continuation.hpp>
 
@@ -11,6 +14,7 @@
 #include "base/logging.h"
 #include "util/epoll/epoll_pool.h"
 #include "util/fibers/fiber.h"
+#include "util/fibers/fiber_file.h"
 #include "util/fibers/fiberqueue_threadpool.h"
 #include "util/fibers/simple_channel.h"
 #include "util/uring/uring_fiber_algo.h"
@@ -110,6 +114,60 @@ TEST_F(FibersTest, FQTP) {
   }
 }
 
+TEST_F(FibersTest, StatFiles) {
+  string dir = base::GetTestTempPath("fiber_stat");
+  ASSERT_EQ(0, mkdir(dir.c_str(), 0755));
+  for (unsigned i = 0; i < 1000; ++i) {
+    io::WriteStringToFileOrDie("foo", absl::StrCat(dir, "/f", i, ".txt"));
+  }
+  io::WriteStringToFileOrDie("foo", dir + "/other");
+
+  FiberQueueThreadPool pool(4);
+  vector<string> names;
+  error_code ec = FiberStatFiles(dir + "/*.txt", &pool, [&](io::StatShortVec vec) {
+    for (const auto& sshort : vec) {
+      EXPECT_EQ(3u, sshort.size);
+      names.push_back(sshort.name);
+    }
+  });
+  ASSERT_FALSE(ec);
+  sort(names.begin(), names.end());
+
+  io::Result<io::StatShortVec> expected = io::StatFiles(dir + "/*.txt");
+  ASSERT_TRUE(expected);
+  ASSERT_EQ(expected->size(), names.size());
+  for (size_t i = 0; i < names.size(); ++i) {
+    EXPECT_EQ(expected->at(i).name, names[i]);
+  }
+}
+
+// Stats a synthetic tree of 100k files with range(0) threads.
+void BM_FiberStatFiles(benchmark::State& state) {
+  static string dir = [] {
+    string dir = base::GetTestTempPath("fiber_stat_bench");
+    for (unsigned i = 0; i <= 100; ++i) {
+      string sub = i ? absl::StrCat(dir, "/d", i) : dir;
+      CHECK_EQ(0, mkdir(sub.c_str(), 0755));
+      for (unsigned j = 0; i && j < 1000; ++j) {
+        int fd = open(absl::StrCat(sub, "/seg", j, ".dat").c_str(), O_CREAT | O_WRONLY, 0644);
+        CHECK_GE(fd, 0);
+        close(fd);
+      }
+    }
+    return dir;
+  }();
+
+  FiberQueueThreadPool pool(state.range(0));
+  while (state.KeepRunning()) {
+    size_t count = 0;
+    error_code ec = FiberStatFiles(dir + "/*/seg*.dat", &pool,
+                                   [&](io::StatShortVec vec) { count += vec.size(); });
+    CHECK(!ec);
+    state.SetItemsProcessed(state.items_processed() + count);
+  }
+}
+BENCHMARK(BM_FiberStatFiles)->Arg(1)->Arg(4)->Arg(8)->Unit(benchmark::kMillisecond)->UseRealTime();
+
 TEST_F(FibersTest, FiberQueue) {
   epoll::EpollPool pool{1};
   pool.Run();
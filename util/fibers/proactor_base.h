@@ -246,7 +246,8 @@ class ProactorBase  {
   };
   static_assert(sizeof(Tasklet) == 32, "");
 
-  using FuncQ = base::mpmc_bounded_queue<Tasklet>;
+  // Cells are padded to cache lines so that threads enqueuing concurrently do not false-share.
+  using FuncQ = base::mpmc_bounded_queue<Tasklet, true>;
 
   FuncQ task_queue_;
   EventCount task_queue_avail_;
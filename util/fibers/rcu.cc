@@ -0,0 +1,148 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/fibers/rcu.h"
+
+#include <algorithm>
+#include <mutex>
+
+#include "base/logging.h"
+#include "util/fibers/fiber2.h"
+
+namespace util {
+namespace fb2 {
+namespace rcu {
+
+using namespace std;
+
+namespace {
+
+constexpr unsigned kMaxThreads = 512;
+
+// Epoch 0 means that the thread is offline.
+atomic_uint64_t global_epoch{1};
+
+// The epochs of the registered threads live in a fixed array, so that CompletedEpoch, which
+// runs on every loop iteration with pending retired objects, scans them without locking.
+// Each slot occupies its own cache line since its thread updates it on every loop iteration.
+// Unused slots hold 0, just like offline threads.
+struct alignas(64) EpochSlot {
+  atomic_uint64_t epoch{0};
+};
+
+EpochSlot epoch_slots[kMaxThreads];
+
+// Upper bound of the used slots, never decreases.
+atomic_uint32_t num_slots{0};
+
+struct ThreadRecord {
+  EpochSlot* slot = nullptr;
+};
+
+thread_local ThreadRecord tl_record;
+
+// Serializes the slot allocation.
+struct Registry {
+  mutex mu;
+  bool used[kMaxThreads] = {};
+};
+
+Registry& GetRegistry() {
+  static Registry* registry = new Registry;
+  return *registry;
+}
+
+}  // namespace
+
+void RegisterThread() {
+  ThreadRecord* rec = &tl_record;
+  CHECK(rec->slot == nullptr);
+
+  Registry& registry = GetRegistry();
+  {
+    lock_guard lk(registry.mu);
+    unsigned index = find(registry.used, registry.used + kMaxThreads, false) - registry.used;
+    CHECK_LT(index, kMaxThreads) << "Too many rcu threads";
+    registry.used[index] = true;
+    rec->slot = &epoch_slots[index];
+
+    // The slot must be visible before the thread goes online, see ThreadOnline.
+    if (index >= num_slots.load(memory_order_relaxed))
+      num_slots.store(index + 1, memory_order_release);
+  }
+  ThreadOnline();
+}
+
+void UnregisterThread() {
+  ThreadRecord* rec = &tl_record;
+  CHECK(rec->slot);
+  ThreadOffline();
+
+  Registry& registry = GetRegistry();
+  lock_guard lk(registry.mu);
+  registry.used[rec->slot - epoch_slots] = false;
+  rec->slot = nullptr;
+}
+
+void QuiescentState() {
+  EpochSlot& slot = *tl_record.slot;
+
+  // Acquire pairs with StartGracePeriod, so that the reads that follow see the data that was
+  // published before the epoch advanced.
+  uint64_t epoch = global_epoch.load(memory_order_acquire);
+
+  // Release makes sure our previous reads are done before the retired data is destroyed.
+  if (slot.epoch.load(memory_order_relaxed) != epoch)
+    slot.epoch.store(epoch, memory_order_release);
+}
+
+void ThreadOffline() {
+  tl_record.slot->epoch.store(0, memory_order_release);
+}
+
+void ThreadOnline() {
+  tl_record.slot->epoch.store(global_epoch.load(memory_order_acquire), memory_order_relaxed);
+
+  // Pairs with the fence in CompletedEpoch: either the writer sees us online or we see
+  // the published pointer.
+  atomic_thread_fence(memory_order_seq_cst);
+}
+
+uint64_t StartGracePeriod() {
+  return global_epoch.fetch_add(1, memory_order_seq_cst) + 1;
+}
+
+uint64_t CompletedEpoch() {
+  atomic_thread_fence(memory_order_seq_cst);
+
+  uint64_t res = global_epoch.load(memory_order_relaxed);
+  const EpochSlot* self = tl_record.slot;
+
+  unsigned count = num_slots.load(memory_order_acquire);
+  for (unsigned i = 0; i < count; ++i) {
+    const EpochSlot& slot = epoch_slots[i];
+    if (&slot == self)
+      continue;
+    uint64_t epoch = slot.epoch.load(memory_order_acquire);
+    if (epoch && epoch < res)
+      res = epoch;
+  }
+  return res;
+}
+
+void Retire(function<void()> fn) {
+  uint64_t epoch = StartGracePeriod();
+  detail::FiberActive()->scheduler()->Defer(epoch, std::move(fn));
+}
+
+void Synchronize() {
+  uint64_t epoch = StartGracePeriod();
+  while (CompletedEpoch() < epoch) {
+    ThisFiber::SleepFor(chrono::microseconds(50));
+  }
+}
+
+}  // namespace rcu
+}  // namespace fb2
+}  // namespace util
@@ -0,0 +1,100 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace util {
+namespace fb2 {
+
+// Quiescent state based reclamation (QSBR) for read-mostly data that is shared by proactor
+// threads, like configs, routing tables or ACLs.
+//
+// Proactor threads register themselves and report a quiescent state on every iteration of
+// their event loop, i.e. when none of their fibers runs. They go offline while they block in
+// the kernel, so idle proactors do not delay reclamation. Retired objects are destroyed via
+// Scheduler::Defer by the loop of the retiring thread, once all registered threads passed
+// a quiescent state.
+//
+// The rule for readers: a pointer to RCU-protected data must not be kept across a fiber
+// suspension point (i/o, locks, Yield etc), since the event loop may run in between.
+namespace rcu {
+
+// Registers the calling thread as a reader. Proactor threads are registered by their loops.
+void RegisterThread();
+void UnregisterThread();
+
+// Reports that the calling thread holds no references to RCU-protected data.
+void QuiescentState();
+
+// An offline thread does not read RCU-protected data and does not delay grace periods.
+// A registered thread is online by default.
+void ThreadOffline();
+void ThreadOnline();
+
+// Starts a new grace period and returns its epoch.
+uint64_t StartGracePeriod();
+
+// Returns the maximal epoch whose grace period has ended, i.e. all online threads besides
+// the calling one passed a quiescent state since it started.
+uint64_t CompletedEpoch();
+
+// Schedules fn to run on the calling thread once the current readers are done.
+// The calling thread must run a fiber scheduler.
+void Retire(std::function<void()> fn);
+
+// Suspends the calling fiber until the current readers are done.
+void Synchronize();
+
+}  // namespace rcu
+
+// A pointer to an immutable version of T that can be replaced while readers on other threads
+// access it. Reading is a single atomic load.
+// Writers must be serialized by the caller.
+template <typename T> class RcuPtr {
+ public:
+  RcuPtr() = default;
+
+  explicit RcuPtr(std::unique_ptr<T> val) : ptr_(val.release()) {
+  }
+
+  RcuPtr(const RcuPtr&) = delete;
+  RcuPtr& operator=(const RcuPtr&) = delete;
+
+  // Readers must be done before the destruction.
+  ~RcuPtr() {
+    delete ptr_.load(std::memory_order_relaxed);
+  }
+
+  // Returns the current version. It stays valid until the calling fiber suspends.
+  const T* Read() const {
+    return ptr_.load(std::memory_order_acquire);
+  }
+
+  // Publishes val and retires the previous version.
+  void Update(std::unique_ptr<T> val) {
+    T* prev = ptr_.exchange(val.release(), std::memory_order_seq_cst);
+    if (prev) {
+      rcu::Retire([prev] { delete prev; });
+    }
+  }
+
+  // Publishes a modified copy of the current version.
+  template <typename F> void Modify(F&& f) {
+    const T* cur = Read();
+    std::unique_ptr<T> next = cur ? std::make_unique<T>(*cur) : std::make_unique<T>();
+    f(next.get());
+    Update(std::move(next));
+  }
+
+ private:
+  std::atomic<T*> ptr_{nullptr};
+};
+
+}  // namespace fb2
+}  // namespace util
@@ -0,0 +1,193 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/fibers/rcu.h"
+
+#include <shared_mutex>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "util/fibers/pool.h"
+#include "util/fibers/synchronization.h"
+
+namespace util {
+namespace fb2 {
+
+using namespace std;
+
+namespace {
+
+struct Config {
+  static atomic_int alive;
+
+  Config(uint64_t v = 0) : a(v), b(v) {
+    alive.fetch_add(1, memory_order_relaxed);
+  }
+
+  Config(const Config& o) : a(o.a), b(o.b) {
+    alive.fetch_add(1, memory_order_relaxed);
+  }
+
+  ~Config() {
+    a = b = UINT64_MAX;  // poison
+    alive.fetch_sub(1, memory_order_relaxed);
+  }
+
+  uint64_t a, b;
+};
+
+atomic_int Config::alive{0};
+
+// Retired versions are destroyed asynchronously by the event loop of the retiring thread.
+void WaitAlive(int expected) {
+  for (unsigned i = 0; i < 1000 && Config::alive.load() > expected; ++i)
+    ThisFiber::SleepFor(1ms);
+}
+
+}  // namespace
+
+class RcuTest : public testing::Test {
+ protected:
+  void SetUp() final {
+    pp_.reset(Pool::IOUring(16, 3));
+    pp_->Run();
+  }
+
+  void TearDown() final {
+    pp_->Stop();
+    pp_.reset();
+    EXPECT_EQ(0, Config::alive.load());
+  }
+
+  unique_ptr<ProactorPool> pp_;
+};
+
+TEST_F(RcuTest, Synchronize) {
+  RcuPtr<Config> ptr(make_unique<Config>(1));
+
+  pp_->at(0)->Await([&] {
+    const Config* prev = ptr.Read();
+    EXPECT_EQ(1, prev->a);
+    ptr.Update(make_unique<Config>(2));
+    EXPECT_EQ(2, ptr.Read()->a);
+
+    // The previous version is retired but other proactors can still read it.
+    EXPECT_EQ(2, Config::alive.load());
+    EXPECT_EQ(1, prev->a);
+  });
+
+  // Idle proactors are offline and do not delay the reclamation.
+  pp_->at(0)->Await([&] {
+    rcu::Synchronize();
+    WaitAlive(1);
+  });
+  EXPECT_EQ(1, Config::alive.load());
+}
+
+TEST_F(RcuTest, Modify) {
+  RcuPtr<Config> ptr;
+
+  pp_->at(1)->Await([&] {
+    ptr.Modify([](Config* cfg) { cfg->a = cfg->b = 5; });
+    ptr.Modify([](Config* cfg) { ++cfg->a; });
+  });
+
+  EXPECT_EQ(6, ptr.Read()->a);
+  EXPECT_EQ(5, ptr.Read()->b);
+}
+
+TEST_F(RcuTest, ReadersAndWriter) {
+  constexpr unsigned kUpdates = 2000;
+
+  RcuPtr<Config> ptr(make_unique<Config>(0));
+  atomic_bool done{false};
+  atomic_uint64_t reads{0}, failures{0};
+
+  pp_->DispatchOnAll([&](unsigned index, ProactorBase*) {
+    if (index == 0)
+      return;
+    uint64_t last = 0;
+    for (unsigned i = 1; !done.load(memory_order_relaxed); ++i) {
+      const Config* cfg = ptr.Read();
+      if (cfg->a != cfg->b || cfg->a < last)
+        failures.fetch_add(1, memory_order_relaxed);
+      last = cfg->a;
+      reads.fetch_add(1, memory_order_relaxed);
+
+      // The pointer is not used after the fiber suspends.
+      if (i % 16 == 0)
+        ThisFiber::Yield();
+    }
+  });
+
+  pp_->at(0)->Await([&] {
+    for (uint64_t i = 1; i <= kUpdates; ++i) {
+      ptr.Update(make_unique<Config>(i));
+      if (i % 64 == 0)
+        ThisFiber::SleepFor(100us);
+    }
+    rcu::Synchronize();
+    WaitAlive(1);
+  });
+  done.store(true);
+
+  // Let the readers finish.
+  pp_->AwaitFiberOnAll([](ProactorBase*) {});
+
+  EXPECT_EQ(0, failures.load());
+  EXPECT_EQ(1, Config::alive.load());
+  LOG(INFO) << "reads: " << reads.load();
+}
+
+// Read-side cost of RcuPtr compared to the locks it replaces.
+template <typename Mutex> void BM_ReadLocked(benchmark::State& state) {
+  Mutex mu;
+  Config cfg(1);
+  while (state.KeepRunning()) {
+    shared_lock lk(mu);
+    benchmark::DoNotOptimize(cfg.a);
+  }
+}
+BENCHMARK_TEMPLATE(BM_ReadLocked, SharedMutex);
+
+void BM_ReadRcu(benchmark::State& state) {
+  RcuPtr<Config> ptr(make_unique<Config>(1));
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(ptr.Read()->a);
+  }
+}
+BENCHMARK(BM_ReadRcu);
+
+// Latency of Synchronize() with proactors that are busy reading (range(0) = 1) or idle.
+void BM_UpdateLatency(benchmark::State& state) {
+  unique_ptr<ProactorPool> pp(Pool::IOUring(16, 3));
+  pp->Run();
+
+  RcuPtr<Config> ptr(make_unique<Config>(0));
+  atomic_bool done{false};
+  if (state.range(0)) {
+    pp->DispatchOnAll([&](unsigned index, ProactorBase*) {
+      while (index && !done.load(memory_order_relaxed)) {
+        for (unsigned i = 0; i < 100; ++i)
+          benchmark::DoNotOptimize(ptr.Read()->a);
+        ThisFiber::Yield();
+      }
+    });
+  }
+
+  pp->at(0)->Await([&] {
+    uint64_t i = 0;
+    while (state.KeepRunning()) {
+      ptr.Update(make_unique<Config>(++i));
+      rcu::Synchronize();
+    }
+  });
+  done.store(true);
+  pp->AwaitFiberOnAll([](ProactorBase*) {});
+  pp->Stop();
+}
+BENCHMARK(BM_UpdateLatency)->Arg(0)->Arg(1)->UseRealTime();
+
+}  // namespace fb2
+}  // namespace util
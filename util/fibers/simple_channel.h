@@ -151,8 +151,8 @@ template <typename T> class QueueTraits<folly::ProducerConsumerQueue<T>> {
   }
 };
 
-template <typename T> class QueueTraits<base::mpmc_bounded_queue<T>> {
-  using Queue = base::mpmc_bounded_queue<T>;
+template <typename T, bool S> class QueueTraits<base::mpmc_bounded_queue<T, S>> {
+  using Queue = base::mpmc_bounded_queue<T, S>;
 
  public:
   template <typename... Args> static bool TryEnqueue(Queue& q, Args&&... args) noexcept {
@@ -14,8 +14,10 @@
 #include "base/flags.h"
 #include "base/histogram.h"
 #include "base/logging.h"
+#include "base/memory_account.h"
 #include "base/proc_util.h"
 #include "util/fibers/detail/scheduler.h"
+#include "util/fibers/rcu.h"
 #include "util/uring/uring_socket.h"
 
 ABSL_FLAG(bool, proactor_register_fd, false, "If true tries to register file descriptors");
@@ -53,11 +55,34 @@ void wait_for_cqe(io_uring* ring, unsigned wait_nr, __kernel_timespec* ts, sigse
   }
 }
 
+// IOPOLL rings reject poll requests, therefore their proactors stall on the eventfd directly.
+void wait_for_eventfd(int fd, const __kernel_timespec* ts) {
+  pollfd pfd{.fd = fd, .events = POLLIN, .revents = 0};
+  timespec tmo;
+  if (ts) {
+    tmo.tv_sec = ts->tv_sec;
+    tmo.tv_nsec = ts->tv_nsec;
+  }
+
+  int res = ppoll(&pfd, 1, ts ? &tmo : nullptr, nullptr);
+  if (res > 0) {
+    // Drain the counter. The eventfd is non-blocking.
+    uint64_t val;
+    ssize_t sz = read(fd, &val, sizeof(val));
+    (void)sz;
+  } else if (res < 0) {
+    LOG_IF(ERROR, errno != EINTR) << SafeErrorMessage(errno);
+  }
+}
+
 constexpr uint64_t kIgnoreIndex = 0;
 constexpr uint64_t kWakeIndex = 1;
 
 constexpr uint64_t kUserDataCbIndex = 1024;
 
+base::MemoryAccount ring_account("io_uring_rings");
+base::MemoryAccount registered_buf_account("io_uring_registered_buffers");
+
 }  // namespace
 
 UringProactor::UringProactor() : ProactorBase() {
@@ -68,10 +93,14 @@ UringProactor::~UringProactor() {
   if (thread_id_ != -1U) {
     io_uring_queue_exit(&ring_);
   }
+  if (ring_mem_size_)
+    ring_account.Release(ring_mem_size_);
+  if (buffer_pool_)
+    registered_buf_account.Release(buffer_pool_->capacity_bytes());
   VLOG(1) << "Closing wake_fd " << wake_fd_ << " ring fd: " << ring_.ring_fd;
 }
 
-void UringProactor::Init(size_t ring_size, int wq_fd) {
+void UringProactor::Init(size_t ring_size, int wq_fd, bool iopoll) {
   CHECK_EQ(0U, ring_size & (ring_size - 1));
   CHECK_GE(ring_size, 8U);
   CHECK_EQ(0U, thread_id_) << "Init was already called";
@@ -103,6 +132,10 @@ void UringProactor::Init(size_t ring_size, int wq_fd) {
     params.flags |= IORING_SETUP_SUBMIT_ALL | IORING_SETUP_COOP_TASKRUN;
   }
 
+  if (iopoll) {
+    params.flags |= IORING_SETUP_IOPOLL;
+  }
+
   // it seems that SQPOLL requires registering each fd, including sockets fds.
   // need to check if its worth pursuing.
   // For sure not in short-term.
@@ -124,10 +157,12 @@ void UringProactor::Init(size_t ring_size, int wq_fd) {
                << SafeErrorMessage(init_res);
   }
   sqpoll_f_ = (params.flags & IORING_SETUP_SQPOLL) != 0;
+  iopoll_f_ = (params.flags & IORING_SETUP_IOPOLL) != 0;
 
   io_uring_probe* uring_probe = io_uring_get_probe_ring(&ring_);
 
-  msgring_f_ = io_uring_opcode_supported(uring_probe, IORING_OP_MSG_RING);
+  // MSG_RING is rejected by IOPOLL rings, therefore such proactors wake others via eventfd.
+  msgring_f_ = !iopoll_f_ && io_uring_opcode_supported(uring_probe, IORING_OP_MSG_RING);
   io_uring_free_probe(uring_probe);
   VLOG_IF(1, msgring_f_) << "msgring supported!";
 
@@ -156,8 +191,17 @@ void UringProactor::Init(size_t ring_size, int wq_fd) {
   LOG_FIRST_N(INFO, 1) << "IORing with " << params.sq_entries << " entries, allocated " << sz
                        << " bytes, cq_entries is " << *ring_.cq.kring_entries;
   CHECK_EQ(ring_size, params.sq_entries);  // Sanity.
+  sq_entries_ = params.sq_entries;
+
+  // With IORING_FEAT_SINGLE_MMAP both rings share the same mapping.
+  ring_mem_size_ = std::max(ring_.sq.ring_sz, ring_.cq.ring_sz) +
+                   params.sq_entries * sizeof(struct io_uring_sqe);
+  ring_account.Charge(ring_mem_size_);
 
-  ArmWakeupEvent();
+  // IOPOLL proactors do not arm the wakeup poller, see wait_for_eventfd.
+  if (!iopoll_f_) {
+    ArmWakeupEvent();
+  }
   centries_.resize(params.sq_entries);  // .val = -1
   next_free_ce_ = 0;
   for (size_t i = 0; i < centries_.size() - 1; ++i) {
@@ -205,10 +249,19 @@ void UringProactor::DispatchCqe(detail::FiberInterface* current, const io_uring_
 }
 
 SubmitEntry UringProactor::GetSubmitEntry(CbType cb, int64_t payload) {
+  io_uring_sqe* res = NextSqe();
+  memset(res, 0, sizeof(io_uring_sqe));
+  AssignCallback(res, std::move(cb));
+
+  return SubmitEntry{res};
+}
+
+io_uring_sqe* UringProactor::NextSqe() {
   io_uring_sqe* res = io_uring_get_sqe(&ring_);
   if (res == NULL) {
     ++get_entry_sq_full_;
-    int submitted = io_uring_submit(&ring_);
+    ++submit_stats_.sq_full;
+    int submitted = Submit();
     if (submitted > 0) {
       res = io_uring_get_sqe(&ring_);
     } else {
@@ -216,73 +269,89 @@ SubmitEntry UringProactor::GetSubmitEntry(CbType cb, int64_t payload) {
       LOG(FATAL) << "Fatal error submitting to iouring: " << -submitted;
     }
   }
+  return res;
+}
 
-  memset(res, 0, sizeof(io_uring_sqe));
-
+void UringProactor::AssignCallback(io_uring_sqe* sqe, CbType cb, int64_t unused) {
   if (cb) {
     if (next_free_ce_ < 0) {
       RegrowCentries();
       DCHECK_GT(next_free_ce_, 0);
     }
-    res->user_data = next_free_ce_ + kUserDataCbIndex;
+    sqe->user_data = next_free_ce_ + kUserDataCbIndex;
     DCHECK_LT(unsigned(next_free_ce_), centries_.size());
 
     auto& e = centries_[next_free_ce_];
     DCHECK(!e.cb);  // cb is undefined.
-    DVLOG(3) << "GetSubmitEntry: index: " << next_free_ce_ << ", payload: " << payload;
+    DVLOG(3) << "GetSubmitEntry: index: " << next_free_ce_;
 
     next_free_ce_ = e.index;
     e.cb = std::move(cb);
     ++pending_cb_cnt_;
   } else {
-    res->user_data = kIgnoreIndex;
+    sqe->user_data = kIgnoreIndex;
   }
+}
 
-  return SubmitEntry{res};
+int UringProactor::Submit() {
+  int res = io_uring_submit(&ring_);
+  if (res > 0) {
+    ++submit_stats_.enter_calls;
+    submit_stats_.submitted += res;
+  }
+  return res;
 }
 
-int UringProactor::RegisterBuffers() {
-  unique_ptr<uint8_t[]> reg_buf(new uint8_t[1U << 16]);
-  iovec vec[1];
-  vec[0].iov_base = reg_buf.get();
-  vec[0].iov_len = 1U << 16;
-  int res = io_uring_register_buffers(&ring_, vec, 1);
-  if (res < 0) {
-    return -res;
+int UringProactor::RegisterBufferPool(const RegisteredBufferPool::Options& opts) {
+  if (buffer_pool_) {
+    if (buffer_pool_->GetStats().in_use)
+      return EBUSY;
+    int res = io_uring_unregister_buffers(&ring_);
+    if (res < 0)
+      return -res;
+    registered_buf_account.Release(buffer_pool_->capacity_bytes());
+    buffer_pool_.reset();
+    socket_buffers_ = false;
   }
 
-  free_req_buf_id_ = 0;
-  for (int i = 0; i < 1024; ++i) {
-    uint8_t* next = reg_buf.get() + i * 64;
-    absl::little_endian::Store16(next, i + 1);
+  unique_ptr<RegisteredBufferPool> pool(new RegisteredBufferPool(opts));
+  const vector<iovec>& vecs = pool->iovecs();
+  int res = io_uring_register_buffers(&ring_, vecs.data(), vecs.size());
+  if (res < 0) {
+    return -res;
   }
 
-  registered_buf_ = std::move(reg_buf);
+  registered_buf_account.Charge(pool->capacity_bytes());
+  buffer_pool_ = std::move(pool);
+  socket_buffers_ = false;
   return 0;
 }
 
-uint8_t* UringProactor::ProvideRegisteredBuffer() {
-  if (free_req_buf_id_ < 0 || free_req_buf_id_ >= 1024)
+int UringProactor::RegisterBuffers() {
+  RegisteredBufferPool::Options opts;
+  opts.classes = {{64, 1024}};
+  int res = RegisterBufferPool(opts);
+  if (res == 0)
+    socket_buffers_ = true;
+  return res;
+}
+
+uint8_t* UringProactor::ProvideRegisteredBuffer(uint16_t* buf_index) {
+  if (!socket_buffers_)
     return nullptr;
 
-  int res = free_req_buf_id_;
-  free_req_buf_id_ = absl::little_endian::Load16(&registered_buf_[free_req_buf_id_ * 64]);
-  return registered_buf_.get() + res * 64;
+  uint16_t index;
+  return buffer_pool_->Allocate(64, buf_index ? buf_index : &index);
 }
 
 void UringProactor::ReturnRegisteredBuffer(uint8_t* addr) {
-  DCHECK(registered_buf_);
-  intptr_t offs = addr - registered_buf_.get();
-  DCHECK_GE(offs, 0);
-  DCHECK_LT(offs, 1 << 16);
-
-  unsigned buf_id = offs / 64;
-  absl::little_endian::Store16(&registered_buf_[buf_id * 64], free_req_buf_id_);
-  free_req_buf_id_ = buf_id;
+  DCHECK(buffer_pool_);
+  buffer_pool_->Free(addr);
 }
 
 UringProactor::EpollIndex UringProactor::EpollAdd(int fd, EpollCB cb, uint32_t event_mask) {
   CHECK_GT(event_mask, 0U);
+  CHECK(!iopoll_f_) << "IOPOLL rings do not support poll requests";
 
   if (next_epoll_free_ == -1) {
     size_t prev = epoll_entries_.size();
@@ -353,6 +422,8 @@ void UringProactor::ArmWakeupEvent() {
 }
 
 void UringProactor::SchedulePeriodic(uint32_t id, PeriodicItem* item) {
+  CHECK(!iopoll_f_) << "IOPOLL rings do not support timeouts";
+
   SubmitEntry se = GetSubmitEntry(
       [this, id, item](detail::FiberInterface*, IoResult res, uint32_t flags) {
         this->PeriodicCb(res, id, std::move(item));
@@ -443,8 +514,9 @@ void UringProactor::MainLoop(detail::Scheduler* scheduler) {
   struct io_uring_cqe cqes[kBatchSize];
   static_assert(sizeof(cqes) == 2048);
 
-  uint64_t num_stalls = 0, cqe_fetches = 0, loop_cnt = 0, num_submits = 0;
+  uint64_t num_stalls = 0, cqe_fetches = 0, loop_cnt = 0;
   uint64_t last_sleep_check = absl::base_internal::CycleClock::Now();
+  uint64_t last_deferred_check = last_sleep_check;
   uint64_t cycles_per_10us = absl::base_internal::CycleClock::Frequency() / 100'000;
   uint32_t tq_seq = 0;
   uint32_t spin_loops = 0, num_task_runs = 0, task_interrupts = 0;
@@ -452,15 +524,22 @@ void UringProactor::MainLoop(detail::Scheduler* scheduler) {
   Tasklet task;
 
   FiberInterface* dispatcher = detail::FiberActive();
+  rcu::RegisterThread();
 
   while (true) {
     ++loop_cnt;
+    rcu::QuiescentState();
 
-    int num_submitted = io_uring_submit(&ring_);
+    int num_submitted = Submit();
     bool ring_busy = false;
 
+    // Completions of IOPOLL rings are posted only when the device is polled via io_uring_enter.
+    // Submit() polls as well, but it may skip the syscall when the SQ is empty.
+    if (iopoll_f_ && num_submitted == 0 && pending_cb_cnt_ > 0) {
+      wait_for_cqe(&ring_, 0, nullptr);
+    }
+
     if (num_submitted >= 0) {
-      num_submits += (num_submitted != 0);
       if (num_submitted) {
         DVLOG(3) << "Submitted " << num_submitted;
       }
@@ -541,6 +620,15 @@ void UringProactor::MainLoop(detail::Scheduler* scheduler) {
       }
     }
 
+    // Reclaim retired objects when the loop is busy as well.
+    if (scheduler->HasDeferred()) {
+      uint64_t now = absl::base_internal::CycleClock::Now();
+      if (now >= last_deferred_check + cycles_per_10us * 10) {
+        last_deferred_check = now;
+        scheduler->RunDeferred();
+      }
+    }
+
     // must be if and not while (or at most k iterations for while) because
     // otherwise fibers that yield won't allow dispatcher to grab i/o events since it will be
     // stuck here.
@@ -586,6 +674,14 @@ void UringProactor::MainLoop(detail::Scheduler* scheduler) {
 
     spin_loops = 0;  // Reset the spinning.
 
+    // IOPOLL rings post completions only when polled, hence the loop does not stall while
+    // there is I/O in flight.
+    if (iopoll_f_ && pending_cb_cnt_ > 0) {
+      if (is_stopped_)
+        break;
+      continue;
+    }
+
     /**
      * If tq_seq_ has changed since it was cached into tq_seq, then
      * EmplaceTaskQueue succeeded and we might have more tasks to execute - lets
@@ -617,7 +713,13 @@ void UringProactor::MainLoop(detail::Scheduler* scheduler) {
           }
           ts_arg = &ts;
         }
-        wait_for_cqe(&ring_, 1, ts_arg);
+        rcu::ThreadOffline();
+        if (iopoll_f_) {
+          wait_for_eventfd(wake_fd_, ts_arg);
+        } else {
+          wait_for_cqe(&ring_, 1, ts_arg);
+        }
+        rcu::ThreadOnline();
         VPRO(2) << "Woke up after wait_for_cqe ";
 
         ++num_stalls;
@@ -629,14 +731,17 @@ void UringProactor::MainLoop(detail::Scheduler* scheduler) {
     }
   }
 
+  rcu::UnregisterThread();
+
   VPRO(1) << "total/stalls/cqe_fetches/num_submits: " << loop_cnt << "/" << num_stalls << "/"
-          << cqe_fetches << "/" << num_submits;
+          << cqe_fetches << "/" << submit_stats_.enter_calls;
   VPRO(1) << "Tasks/loop: " << double(num_task_runs) / loop_cnt;
   VPRO(1) << "tq_wakeups/tq_wakeup_saved/tq_full/tq_task_int: " << tq_wakeup_ev_.load() << "/"
           << tq_wakeup_save_ev_.load() << "/" << tq_full_ev_.load() << "/" << task_interrupts;
   VPRO(1) << "busy_sq/get_entry_sq_full/get_entry_sq_err/get_entry_awaits/pending_callbacks: "
           << busy_sq_cnt << "/" << get_entry_sq_full_ << "/" << get_entry_submit_fail_ << "/"
           << get_entry_await_ << "/" << pending_cb_cnt_;
+  VPRO(1) << "submitted/flushes: " << submit_stats_.submitted << "/" << submit_stats_.flushes;
 
   VPRO(1) << "centries size: " << centries_.size();
   centries_.clear();
@@ -651,7 +756,8 @@ void UringProactor::WakeRing() {
 
   DCHECK(caller != this);
 
-  if (caller && caller->msgring_f_) {
+  // IOPOLL proactors stall on the eventfd and do not see MSG_RING completions.
+  if (caller && caller->msgring_f_ && !iopoll_f_) {
     SubmitEntry se = caller->GetSubmitEntry(nullptr);
     se.PrepMsgRing(ring_.ring_fd, 0, 0);
   } else {
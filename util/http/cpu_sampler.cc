@@ -0,0 +1,254 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/http/cpu_sampler.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/debugging/stacktrace.h>
+#include <absl/debugging/symbolize.h>
+#include <absl/strings/str_cat.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <ucontext.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "base/logging.h"
+
+namespace util {
+namespace http {
+
+using namespace std;
+
+namespace {
+
+constexpr unsigned kMaxDepth = 48;
+constexpr unsigned kTagLen = 40;
+
+struct Sample {
+  void* pcs[kMaxDepth];
+  char tag[kTagLen];
+  uint16_t depth;
+
+  // pcs[0] is the interrupted instruction rather than a return address.
+  bool leaf;
+  atomic_bool ready;
+};
+
+// Session state. Accessed from the signal handler, therefore plain globals.
+atomic_bool session_active{false};
+atomic<Sample*> samples{nullptr};
+atomic_size_t sample_cap{0};
+atomic_size_t next_sample{0};
+atomic_size_t dropped_samples{0};
+atomic<CpuSampler::TagFn> tag_fn{nullptr};
+
+// Number of handlers that are running right now. Run() waits for it to drop to zero before
+// it releases the session state. Sequentially consistent together with sample_cap: a handler
+// that enters after Run() has observed zero is guaranteed to see sample_cap == 0.
+atomic_uint32_t handlers_in_flight{0};
+
+// Returns the pc of the interrupted instruction or nullptr if not supported on this platform.
+void* InterruptedPc(void* ucontext) {
+#if defined(__x86_64__)
+  return reinterpret_cast<void*>(static_cast<ucontext_t*>(ucontext)->uc_mcontext.gregs[REG_RIP]);
+#elif defined(__aarch64__)
+  return reinterpret_cast<void*>(static_cast<ucontext_t*>(ucontext)->uc_mcontext.pc);
+#else
+  return nullptr;
+#endif
+}
+
+void SigProfHandler(int sig, siginfo_t* info, void* ucontext) {
+  int saved_errno = errno;
+  handlers_in_flight.fetch_add(1);
+
+  // Other sessions may not start before handlers_in_flight drops, hence cap, samples and tag_fn
+  // belong to the same session.
+  size_t cap = sample_cap.load();
+  if (cap == 0) {
+    handlers_in_flight.fetch_sub(1);
+    errno = saved_errno;
+    return;
+  }
+
+  size_t index = next_sample.fetch_add(1, memory_order_relaxed);
+  if (index >= cap) {
+    dropped_samples.fetch_add(1, memory_order_relaxed);
+  } else {
+    Sample& s = samples.load(memory_order_relaxed)[index];
+
+    // The unwinder returns only the return addresses of the interrupted thread, hence the
+    // function that was running is added from the signal context.
+    unsigned depth = 0;
+    void* pc = InterruptedPc(ucontext);
+    if (pc)
+      s.pcs[depth++] = pc;
+    s.leaf = pc != nullptr;
+
+    // skip the signal trampoline frame.
+    int res = absl::GetStackTraceWithContext(s.pcs + depth, kMaxDepth - depth, 1, ucontext,
+                                             nullptr);
+    s.depth = depth + (res > 0 ? res : 0);
+    s.tag[0] = '\0';
+    if (CpuSampler::TagFn fn = tag_fn.load(memory_order_relaxed))
+      fn(s.tag, kTagLen);
+    s.ready.store(true, memory_order_release);
+  }
+
+  handlers_in_flight.fetch_sub(1);
+  errno = saved_errno;
+}
+
+// The handler stays installed after a session ends. Restoring the previous disposition
+// (normally SIG_DFL) would kill the process on a SIGPROF that is still pending.
+// Other profilers, i.e. gperftools ProfilerStart, install their own SIGPROF handler, hence
+// every session checks the current disposition and reinstalls ours if it was replaced.
+void InstallHandler() {
+  struct sigaction sa;
+  CHECK_EQ(0, sigaction(SIGPROF, nullptr, &sa));
+  if ((sa.sa_flags & SA_SIGINFO) && sa.sa_sigaction == SigProfHandler)
+    return;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = SigProfHandler;
+  sa.sa_flags = SA_RESTART | SA_SIGINFO;
+  sigemptyset(&sa.sa_mask);
+  CHECK_EQ(0, sigaction(SIGPROF, &sa, nullptr));
+}
+
+void SetTimer(unsigned frequency_hz) {
+  itimerval timer;
+  memset(&timer, 0, sizeof(timer));
+  if (frequency_hz) {
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = 1000000 / frequency_hz;
+    timer.it_value = timer.it_interval;
+  }
+  CHECK_EQ(0, setitimer(ITIMER_PROF, &timer, nullptr));
+}
+
+const string& SymbolizePc(void* pc, bool leaf, absl::flat_hash_map<void*, string>* cache) {
+  // Return addresses point past the call instruction, step back into it for symbolization.
+  void* lookup = leaf ? pc : reinterpret_cast<char*>(pc) - 1;
+  auto [it, inserted] = cache->try_emplace(lookup);
+  if (inserted) {
+    char buf[1024];
+
+    if (absl::Symbolize(lookup, buf, sizeof(buf))) {
+      it->second = buf;
+    } else {
+      it->second = absl::StrCat("0x", absl::Hex(reinterpret_cast<uintptr_t>(pc)));
+    }
+
+    // ';' and ' ' are separators in folded format.
+    replace(it->second.begin(), it->second.end(), ';', ':');
+    replace(it->second.begin(), it->second.end(), ' ', '_');
+  }
+  return it->second;
+}
+
+string Fold(const Sample* arr, size_t count) {
+  absl::flat_hash_map<void*, string> symbols;
+  absl::flat_hash_map<string, size_t> stacks;
+
+  string key;
+  for (size_t i = 0; i < count; ++i) {
+    const Sample& s = arr[i];
+    if (!s.ready.load(memory_order_acquire))
+      continue;
+
+    key.clear();
+    if (s.tag[0]) {
+      key.append(s.tag, strnlen(s.tag, kTagLen));
+    } else {
+      key.append("unknown");
+    }
+
+    // Folded format lists frames from the root to the leaf.
+    for (int j = int(s.depth) - 1; j >= 0; --j) {
+      key.push_back(';');
+      key.append(SymbolizePc(s.pcs[j], j == 0 && s.leaf, &symbols));
+    }
+    ++stacks[key];
+  }
+
+  vector<pair<size_t, const string*>> sorted;
+  sorted.reserve(stacks.size());
+  for (const auto& k_v : stacks) {
+    sorted.emplace_back(k_v.second, &k_v.first);
+  }
+  sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+
+  string res;
+  for (const auto& [cnt, stack] : sorted) {
+    absl::StrAppend(&res, *stack, " ", cnt, "\n");
+  }
+  return res;
+}
+
+}  // namespace
+
+bool CpuSampler::IsRunning() {
+  return session_active.load(memory_order_acquire);
+}
+
+bool CpuSampler::Run(const Options& opts, std::string* folded, Stats* stats) {
+  bool expected = false;
+  if (!session_active.compare_exchange_strong(expected, true, memory_order_acq_rel))
+    return false;
+
+  unsigned frequency = clamp(opts.frequency_hz, 1u, kMaxFrequency);
+  size_t cap = clamp<size_t>(opts.max_samples, 1, kMaxSamples);
+  absl::Duration duration = clamp(opts.duration, absl::Milliseconds(10), kMaxDuration);
+
+  unique_ptr<Sample[]> storage(new Sample[cap]);
+  for (size_t i = 0; i < cap; ++i)
+    storage[i].ready.store(false, memory_order_relaxed);
+
+  samples.store(storage.get(), memory_order_relaxed);
+  tag_fn.store(opts.tag_fn, memory_order_relaxed);
+  next_sample.store(0, memory_order_relaxed);
+  dropped_samples.store(0, memory_order_relaxed);
+  sample_cap.store(cap);
+
+  // Make sure the unwinder is fully loaded before it runs inside a signal handler.
+  void* warmup[4];
+  absl::GetStackTrace(warmup, 4, 0);
+
+  InstallHandler();
+
+  VLOG(1) << "Starting cpu sampling for " << duration << " at " << frequency << "hz";
+  SetTimer(frequency);
+  this_thread::sleep_for(absl::ToChronoNanoseconds(duration));
+  SetTimer(0);
+  sample_cap.store(0);
+
+  // Handlers that are still running on other threads may write into their slots or call
+  // tag_fn, hence we wait for them before folding and releasing the storage.
+  while (handlers_in_flight.load() != 0) {
+    this_thread::yield();
+  }
+  size_t count = min(next_sample.load(memory_order_relaxed), cap);
+
+  if (stats) {
+    stats->samples = count;
+    stats->dropped = dropped_samples.load(memory_order_relaxed);
+  }
+  *folded = Fold(storage.get(), count);
+
+  samples.store(nullptr, memory_order_relaxed);
+  tag_fn.store(nullptr, memory_order_relaxed);
+  session_active.store(false, memory_order_release);
+
+  return true;
+}
+
+}  // namespace http
+}  // namespace util
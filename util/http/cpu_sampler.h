@@ -0,0 +1,53 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/time/time.h>
+
+#include <string>
+
+namespace util {
+namespace http {
+
+// SIGPROF based sampling profiler. Unlike gperftools profiler it keeps the samples in memory,
+// tags each sample with a short label describing the thread that was interrupted
+// (proactor index, fiber name) and aggregates them into folded-stack format that can be fed
+// directly into flamegraph.pl or speedscope.
+// There is a single process-wide session at a time since SIGPROF is process-wide.
+class CpuSampler {
+ public:
+  // Writes a null-terminated label for the interrupted thread into buf. Frames are separated
+  // by ';'. Runs inside the signal handler, hence must be async-signal-safe.
+  using TagFn = void (*)(char* buf, size_t len);
+
+  struct Options {
+    unsigned frequency_hz = 99;
+    absl::Duration duration = absl::Seconds(10);
+
+    // Bounds the memory of the session. Samples beyond this limit are dropped and counted.
+    size_t max_samples = 1 << 14;
+    TagFn tag_fn = nullptr;
+  };
+
+  struct Stats {
+    size_t samples = 0;
+    size_t dropped = 0;
+  };
+
+  // Samples the process for opts.duration and returns the folded stacks, one unique stack
+  // per line followed by its count, sorted by count. Blocks the calling thread.
+  // Returns false if another session is running.
+  static bool Run(const Options& opts, std::string* folded, Stats* stats);
+
+  static bool IsRunning();
+
+  // Upper bounds for Options, enforced by Run().
+  static constexpr unsigned kMaxFrequency = 1000;
+  static constexpr size_t kMaxSamples = 1 << 18;
+  static constexpr absl::Duration kMaxDuration = absl::Seconds(120);
+};
+
+}  // namespace http
+}  // namespace util
@@ -0,0 +1,96 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/http/cpu_sampler.h"
+
+#include <signal.h>
+
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace util {
+namespace http {
+
+using namespace std;
+
+atomic_bool burn_stop{false};
+atomic_uint64_t burn_sink{0};
+
+// Non-static and not inlined so that it is symbolized by its name.
+__attribute__((noinline)) void CpuSamplerTestBurn() {
+  uint64_t val = 1;
+  while (!burn_stop.load(memory_order_relaxed)) {
+    for (unsigned i = 0; i < 10000; ++i) {
+      val = val * 6364136223846793005ULL + 1442695040888963407ULL;
+    }
+    burn_sink.store(val, memory_order_relaxed);
+  }
+}
+
+class CpuSamplerTest : public testing::Test {
+ protected:
+  void SetUp() final {
+    burn_stop.store(false);
+    burner_ = thread(CpuSamplerTestBurn);
+  }
+
+  void TearDown() final {
+    burn_stop.store(true);
+    burner_.join();
+  }
+
+  static CpuSampler::Options Opts() {
+    CpuSampler::Options opts;
+    opts.frequency_hz = 1000;
+    opts.duration = absl::Milliseconds(200);
+    return opts;
+  }
+
+  thread burner_;
+};
+
+TEST_F(CpuSamplerTest, Folded) {
+  string folded;
+  CpuSampler::Stats stats;
+  ASSERT_TRUE(CpuSampler::Run(Opts(), &folded, &stats));
+  EXPECT_FALSE(CpuSampler::IsRunning());
+  EXPECT_GT(stats.samples, 0u);
+  EXPECT_EQ(0u, stats.dropped);
+  EXPECT_NE(string::npos, folded.find("CpuSamplerTestBurn")) << folded;
+}
+
+TEST_F(CpuSamplerTest, Dropped) {
+  CpuSampler::Options opts = Opts();
+  opts.max_samples = 1;
+
+  string folded;
+  CpuSampler::Stats stats;
+  ASSERT_TRUE(CpuSampler::Run(opts, &folded, &stats));
+  EXPECT_EQ(1u, stats.samples);
+  EXPECT_GT(stats.dropped, 0u);
+}
+
+// Another profiler, like gperftools, may replace the SIGPROF handler between sessions.
+TEST_F(CpuSamplerTest, HandlerReplaced) {
+  string folded;
+  CpuSampler::Stats stats;
+  ASSERT_TRUE(CpuSampler::Run(Opts(), &folded, &stats));
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = SIG_IGN;
+  sigemptyset(&sa.sa_mask);
+  ASSERT_EQ(0, sigaction(SIGPROF, &sa, nullptr));
+
+  ASSERT_TRUE(CpuSampler::Run(Opts(), &folded, &stats));
+  EXPECT_GT(stats.samples, 0u);
+  EXPECT_NE(string::npos, folded.find("CpuSamplerTestBurn")) << folded;
+}
+
+}  // namespace http
+}  // namespace util
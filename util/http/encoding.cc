@@ -38,4 +38,26 @@ std::string UrlEncode(std::string_view src) {
   return out;
 }
 
+std::string UrlDecode(std::string_view src) {
+  auto hex = [](char ch) -> int {
+    if (ch >= '0' && ch <= '9')
+      return ch - '0';
+    ch = std::toupper(ch);
+    return (ch >= 'A' && ch <= 'F') ? ch - 'A' + 10 : -1;
+  };
+
+  std::string out;
+  out.reserve(src.size());
+  for (size_t i = 0; i < src.size(); ++i) {
+    if (src[i] == '%' && i + 2 < src.size() && hex(src[i + 1]) >= 0 && hex(src[i + 2]) >= 0) {
+      out.push_back(char(hex(src[i + 1]) * 16 + hex(src[i + 2])));
+      i += 2;
+    } else {
+      out.push_back(src[i]);
+    }
+  }
+
+  return out;
+}
+
 }  // namespace util::http
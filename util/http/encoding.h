@@ -11,4 +11,7 @@ namespace util::http {
 // Replace all invalid characters with percent encoding.
 std::string UrlEncode(std::string_view part);
 
+// Reverses UrlEncode. Malformed escapes are kept as is.
+std::string UrlDecode(std::string_view part);
+
 }  // namespace util::http
@@ -280,6 +280,11 @@ bool HttpListenerBase::HandleRoot(const RequestType& request, HttpContext* cntx)
     return true;
   }
 
+  if (path == "/memz") {
+    cntx->Invoke(MemzHandler(args));
+    return true;
+  }
+
   if (enable_metrics_ && path == "/metrics") {
     MetricsHandler(args, cntx);
     return true;
@@ -311,6 +316,8 @@ error_code HttpConnection::ParseFromBuffer(io::Bytes buf) {
   while (!buf.empty()) {
     ParserType parser{move(request)};
     parser.eager(true);
+    if (owner_->body_limit_)
+      parser.body_limit(owner_->body_limit_);
 
     size_t consumed = parser.put(boost::asio::const_buffer{buf.data(), buf.size()}, ec);
     if (ec)
@@ -349,6 +356,8 @@ void HttpConnection::HandleRequests() {
   while (true) {
     ParserType parser{move(request)};
     parser.eager(true);
+    if (owner_->body_limit_)
+      parser.body_limit(owner_->body_limit_);
 
     h2::read(asa, req_buffer_, parser, ec);
     if (ec) {
@@ -80,6 +80,11 @@ class HttpListenerBase : public ListenerInterface {
     enable_metrics_ = true;
   }
 
+  // Maximal size of a request body, 0 keeps the beast default of 1MB.
+  void set_body_limit(size_t limit) {
+    body_limit_ = limit;
+  }
+
  private:
   bool HandleRoot(const RequestType& rt, HttpContext* cntx) const;
 
@@ -90,6 +95,7 @@ class HttpListenerBase : public ListenerInterface {
 
   std::string favicon_url_;
   std::string resource_prefix_;
+  size_t body_limit_ = 0;
   bool enable_metrics_ = false;
 };
 
@@ -108,7 +114,8 @@ class HttpConnection : public Connection {
   void HandleRequests() final;
 
  protected:
-  void HandleSingleRequest(const RequestType& req, HttpContext* cntx);
+  // Can be overridden by handlers that serve requests other than the registered GET callbacks.
+  virtual void HandleSingleRequest(const RequestType& req, HttpContext* cntx);
 
  private:
   const HttpListenerBase* owner_;
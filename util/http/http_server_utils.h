@@ -27,6 +27,10 @@ inline StringResponse MakeStringResponse(
 StringResponse BuildStatusPage(const QueryArgs& args, std::string_view resource_prefix);
 StringResponse ProfilezHandler(const QueryArgs& args);
 
+// Reports process memory together with the subsystems tracked via base::MemoryAccount.
+// Pass "malloc=1" to append mimalloc/jemalloc stats when one of them is linked in.
+StringResponse MemzHandler(const QueryArgs& args);
+
 extern const char kProfilesFolder[];
 
 }  // namespace http
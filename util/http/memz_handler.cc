@@ -0,0 +1,101 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_format.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base/memory_account.h"
+#include "io/proc_reader.h"
+#include "util/http/http_common.h"
+#include "util/http/http_server_utils.h"
+
+// Allocator stats are printed only if the corresponding allocator is linked into the binary.
+extern "C" {
+void mi_stats_print_out(void (*out)(const char* msg, void* arg), void* arg)
+    __attribute__((weak));
+void malloc_stats_print(void (*write_cb)(void*, const char*), void* cbopaque, const char* opts)
+    __attribute__((weak));
+}
+
+namespace util {
+namespace http {
+
+using namespace std;
+using boost::beast::http::field;
+namespace h2 = ::boost::beast::http;
+
+namespace {
+
+struct AccountSnapshot {
+  string name;
+  size_t used, peak;
+  int64_t live;
+  uint64_t total;
+};
+
+void AppendAccounts(string* res) {
+  vector<AccountSnapshot> accounts;
+  base::MemoryAccount::Iterate([&](const base::MemoryAccount& acc) {
+    accounts.push_back(
+        AccountSnapshot{acc.name(), acc.used(), acc.peak(), acc.live(), acc.total_charges()});
+  });
+  sort(accounts.begin(), accounts.end(),
+       [](const auto& a, const auto& b) { return a.used > b.used; });
+
+  absl::StrAppend(res, "Subsystems:\n");
+  absl::StrAppendFormat(res, "  %-32s %16s %16s %12s %12s\n", "name", "used", "peak", "live",
+                        "total");
+  size_t sum = 0;
+  for (const auto& acc : accounts) {
+    absl::StrAppendFormat(res, "  %-32s %16u %16u %12d %12u\n", acc.name, acc.used, acc.peak,
+                          acc.live, acc.total);
+    sum += acc.used;
+  }
+  absl::StrAppendFormat(res, "  %-32s %16u\n\n", "tracked_total", sum);
+}
+
+}  // namespace
+
+StringResponse MemzHandler(const QueryArgs& args) {
+  StringResponse response(h2::status::ok, 11);
+  SetMime(kTextMime, &response);
+
+  bool malloc_stats = false;
+  for (const auto& k_v : args) {
+    if (k_v.first == "malloc")
+      malloc_stats = (k_v.second != "0");
+  }
+
+  string& res = response.body();
+  auto sdata = io::ReadStatusInfo();
+  if (sdata) {
+    absl::StrAppend(&res, "Process:\n", "  vm_rss: ", sdata->vm_rss, "\n",
+                    "  vm_peak: ", sdata->vm_peak, "\n", "  vm_size: ", sdata->vm_size, "\n\n");
+  }
+
+  AppendAccounts(&res);
+
+  if (!malloc_stats)
+    return response;
+
+  if (mi_stats_print_out) {
+    absl::StrAppend(&res, "mimalloc:\n");
+    mi_stats_print_out(
+        [](const char* msg, void* arg) { static_cast<string*>(arg)->append(msg); }, &res);
+  } else if (malloc_stats_print) {
+    absl::StrAppend(&res, "jemalloc:\n");
+    malloc_stats_print(
+        [](void* arg, const char* msg) { static_cast<string*>(arg)->append(msg); }, &res, "");
+  } else {
+    absl::StrAppend(&res, "No allocator stats available\n");
+  }
+
+  return response;
+}
+
+}  // namespace http
+}  // namespace util
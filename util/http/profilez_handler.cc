@@ -2,6 +2,8 @@
 // See LICENSE for licensing terms.
 //
 
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
 #include <absl/time/clock.h>
 #include <absl/time/time.h>
 #include <gperftools/profiler.h>
@@ -14,14 +16,20 @@
 
 #include "base/logging.h"
 #include "base/proc_util.h"
+#include "util/http/cpu_sampler.h"
 #include "util/http/http_common.h"
 #include "util/http/http_server_utils.h"
 
 #ifdef USE_FB2
+#include "util/fibers/detail/fiber_interface.h"
+#include "util/fibers/proactor_base.h"
 #include "util/fibers/synchronization.h"
 using util::fb2::Done;
+using util::fb2::ProactorBase;
 #else
+#include "util/fiber_sched_algo.h"
 #include "util/fibers/fibers_ext.h"
+#include "util/proactor_base.h"
 using util::fibers_ext::Done;
 #endif
 
@@ -39,6 +47,84 @@ typedef h2::response<h2::string_body> StringResponse;
 
 const char kProfilesFolder[] = "/tmp/profile/";
 
+// Runs inside SIGPROF handler. Touches only thread-local state of the interrupted thread.
+static void ProactorFiberTag(char* buf, size_t len) {
+  const char* fiber_name = nullptr;
+  int32_t index = -1;
+
+  if (ProactorBase::IsProactorThread()) {
+    index = ProactorBase::GetIndex();
+#ifdef USE_FB2
+    fiber_name = fb2::detail::FiberActive()->name();
+#else
+    auto* props = static_cast<FiberProps*>(::boost::fibers::context::active()->get_properties());
+    if (props)
+      fiber_name = props->name().c_str();
+#endif
+  }
+
+  size_t pos = 0;
+  auto append = [&](const char* src) {
+    for (; *src && pos + 1 < len; ++src) {
+      char c = *src;
+      buf[pos++] = (c == ';' || c == ' ') ? '_' : c;
+    }
+  };
+
+  if (index < 0) {
+    append("other");
+  } else {
+    char num[16];
+    char* end = num + sizeof(num);
+    char* p = end;
+    *--p = '\0';
+    unsigned val = index;
+    do {
+      *--p = '0' + val % 10;
+      val /= 10;
+    } while (val);
+    append("proactor");
+    append(p);
+  }
+
+  if (fiber_name && *fiber_name && pos + 1 < len) {
+    buf[pos++] = ';';
+    append(fiber_name);
+  }
+  buf[pos] = '\0';
+}
+
+// Runs a bounded SIGPROF sampling session and returns folded stacks, suitable for flamegraphs.
+static void HandleCpuSampling(const CpuSampler::Options& opts, StringResponse* response) {
+  response->set(h2::field::cache_control, "no-cache, no-store, must-revalidate");
+  response->set(h2::field::pragma, "no-cache");
+
+  if (last_profile_suffix[0]) {
+    response->set(field::content_type, kHtmlMime);
+    response->body().append("<p>gperftools profiler is active, stop it first</p>\n");
+    response->result(h2::status::conflict);
+    return;
+  }
+
+  string folded;
+  CpuSampler::Stats stats;
+  if (!CpuSampler::Run(opts, &folded, &stats)) {
+    response->set(field::content_type, kHtmlMime);
+    response->body().append("<p>Another sampling session is running</p>\n");
+    response->result(h2::status::conflict);
+    return;
+  }
+
+  LOG(INFO) << "Cpu sampling finished with " << stats.samples << " samples, dropped "
+            << stats.dropped;
+  string file_name = absl::StrCat(
+      base::ProgramBaseName(),
+      absl::FormatTime("_%d%m%Y_%H%M%S.folded", absl::Now(), absl::UTCTimeZone()));
+  response->set(field::content_type, kTextMime);
+  response->set(field::content_disposition, absl::StrCat("attachment; filename=", file_name));
+  response->body() = std::move(folded);
+}
+
 static void HandleCpuProfile(bool enable, StringResponse* response) {
   std::filesystem::create_directory(kProfilesFolder);
   string profile_name = kProfilesFolder + base::ProgramBaseName();
@@ -49,7 +135,7 @@ static void HandleCpuProfile(bool enable, StringResponse* response) {
   auto& body = response->body();
 
   if (enable) {
-    if (last_profile_suffix[0]) {
+    if (last_profile_suffix[0] || CpuSampler::IsRunning()) {
       body.append("<p> Yo, already profiling, stupid!</p>\n");
     } else {
       string suffix = absl::FormatTime("_%d%m%Y_%H%M%S.prof", absl::Now(), absl::UTCTimeZone());
@@ -108,9 +194,22 @@ static void HandleCpuProfile(bool enable, StringResponse* response) {
 StringResponse ProfilezHandler(const QueryArgs& args) {
   bool enable = false;
   bool heap = false;
+  bool sample = false;
+  CpuSampler::Options sample_opts;
+  sample_opts.tag_fn = ProactorFiberTag;
+
   for (const auto& k_v : args) {
     if (k_v.first == "profile") {
       enable = (k_v.second == "on");
+      sample = (k_v.second == "sample");
+    } else if (k_v.first == "seconds") {
+      uint32_t seconds = 0;
+      if (absl::SimpleAtoi(k_v.second, &seconds))
+        sample_opts.duration = absl::Seconds(seconds);
+    } else if (k_v.first == "hz") {
+      absl::SimpleAtoi(k_v.second, &sample_opts.frequency_hz);
+    } else if (k_v.first == "max_samples") {
+      absl::SimpleAtoi(k_v.second, &sample_opts.max_samples);
     } else if (k_v.first == "heap") {
       heap = true;
       enable = (k_v.second == "on");
@@ -120,7 +219,9 @@ StringResponse ProfilezHandler(const QueryArgs& args) {
   Done done;
   StringResponse response;
   std::thread([=, &response]() mutable {
-    if (!heap) {
+    if (sample) {
+      HandleCpuSampling(sample_opts, &response);
+    } else if (!heap) {
       HandleCpuProfile(enable, &response);
     } else {
       // TBD.
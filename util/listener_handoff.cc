@@ -0,0 +1,190 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/listener_handoff.h"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include "base/logging.h"
+
+namespace util {
+
+using namespace std;
+using nonstd::make_unexpected;
+
+namespace {
+
+// Well below SCM_MAX_FD.
+constexpr unsigned kMaxFds = 64;
+
+inline error_code LastError() {
+  return error_code{errno, system_category()};
+}
+
+error_code MakeAddr(const char* path, sockaddr_un* addr) {
+  size_t len = strlen(path);
+  if (len + 1 >= sizeof(addr->sun_path))
+    return make_error_code(errc::filename_too_long);
+
+  memset(addr, 0, sizeof(*addr));
+  addr->sun_family = AF_UNIX;
+  memcpy(addr->sun_path, path, len);
+  return error_code{};
+}
+
+}  // namespace
+
+error_code SendFds(int sock, const vector<int>& fds) {
+  if (fds.empty() || fds.size() > kMaxFds)
+    return make_error_code(errc::invalid_argument);
+
+  // The payload carries the number of fds so that the receiver can detect truncation.
+  uint32_t count = fds.size();
+  iovec iov{&count, sizeof(count)};
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+
+  cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+  memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * count);
+
+  ssize_t res;
+  do {
+    res = sendmsg(sock, &msg, MSG_NOSIGNAL);
+  } while (res < 0 && errno == EINTR);
+
+  if (res < 0)
+    return LastError();
+  return error_code{};
+}
+
+io::Result<vector<int>> RecvFds(int sock) {
+  uint32_t count = 0;
+  iovec iov{&count, sizeof(count)};
+
+  alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int) * kMaxFds)];
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+
+  ssize_t res;
+  do {
+    res = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+  } while (res < 0 && errno == EINTR);
+
+  if (res < 0)
+    return make_unexpected(LastError());
+  if (res == 0)
+    return make_unexpected(make_error_code(errc::connection_aborted));
+
+  vector<int> fds;
+  for (cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+      continue;
+    size_t num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    size_t offset = fds.size();
+    fds.resize(offset + num);
+    memcpy(fds.data() + offset, CMSG_DATA(cmsg), num * sizeof(int));
+  }
+
+  if (size_t(res) != sizeof(count) || (msg.msg_flags & MSG_CTRUNC) || fds.size() != count) {
+    LOG(ERROR) << "Malformed fd message, expected " << count << " fds, got " << fds.size();
+    for (int fd : fds)
+      close(fd);
+    return make_unexpected(make_error_code(errc::bad_message));
+  }
+
+  return fds;
+}
+
+error_code ServeListenerFds(const char* path, const vector<int>& fds, uint32_t timeout_ms) {
+  sockaddr_un addr;
+  error_code ec = MakeAddr(path, &addr);
+  if (ec)
+    return ec;
+
+  int lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (lfd < 0)
+    return LastError();
+
+  unlink(path);
+  if (bind(lfd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 || listen(lfd, 1) < 0) {
+    ec = LastError();
+    close(lfd);
+    return ec;
+  }
+
+  pollfd pfd{lfd, POLLIN, 0};
+  int res;
+  do {
+    res = poll(&pfd, 1, timeout_ms);
+  } while (res < 0 && errno == EINTR);
+
+  if (res <= 0) {
+    ec = res == 0 ? make_error_code(errc::timed_out) : LastError();
+  } else {
+    int peer = accept4(lfd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (peer < 0) {
+      ec = LastError();
+    } else {
+      ec = SendFds(peer, fds);
+      close(peer);
+    }
+  }
+
+  close(lfd);
+  unlink(path);
+
+  VLOG(1) << "Served " << fds.size() << " listener fds on " << path << ": " << ec.message();
+  return ec;
+}
+
+io::Result<vector<int>> ReceiveListenerFds(const char* path, uint32_t timeout_ms) {
+  sockaddr_un addr;
+  error_code ec = MakeAddr(path, &addr);
+  if (ec)
+    return make_unexpected(ec);
+
+  auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+  while (true) {
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+      return make_unexpected(LastError());
+
+    if (connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0) {
+      auto res = RecvFds(fd);
+      close(fd);
+      return res;
+    }
+
+    ec = LastError();
+    close(fd);
+
+    // The serving process has not started listening yet.
+    bool retry = ec == errc::no_such_file_or_directory || ec == errc::connection_refused;
+    if (!retry || chrono::steady_clock::now() >= deadline)
+      return make_unexpected(ec);
+    this_thread::sleep_for(chrono::milliseconds(10));
+  }
+}
+
+}  // namespace util
@@ -0,0 +1,40 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <system_error>
+#include <vector>
+
+#include "io/io.h"
+
+namespace util {
+
+// Passing listening sockets between processes for zero downtime restarts.
+// The old process drains its AcceptServer and serves the fds of its listeners:
+//
+//   as->Drain(10s);
+//   ServeListenerFds(path, as->GetListenerFds(), 5000);
+//   as->Wait();
+//
+// The new process receives them and passes each one to AcceptServer::AdoptListener().
+// Connections that arrive in between are queued in the backlog of the listening sockets.
+// All the functions below are blocking and should not be called from proactor threads.
+
+// Sends fds over a connected unix domain socket using SCM_RIGHTS.
+std::error_code SendFds(int sock, const std::vector<int>& fds);
+
+// Receives fds sent by SendFds. The received fds have O_CLOEXEC set.
+io::Result<std::vector<int>> RecvFds(int sock);
+
+// Listens on a unix domain socket at path, waits up to timeout_ms for a single peer to connect
+// and sends it the fds. The path is unlinked before returning.
+std::error_code ServeListenerFds(const char* path, const std::vector<int>& fds,
+                                 uint32_t timeout_ms);
+
+// Connects to a unix domain socket at path and receives the fds sent by ServeListenerFds.
+// Retries for up to timeout_ms if the peer does not listen yet.
+io::Result<std::vector<int>> ReceiveListenerFds(const char* path, uint32_t timeout_ms);
+
+}  // namespace util
@@ -0,0 +1,241 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/listener_handoff.h"
+
+#include <netinet/in.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <atomic>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+#include "util/accept_server.h"
+#include "util/listener_interface.h"
+
+#ifdef USE_FB2
+#include "util/fibers/pool.h"
+#else
+#include "util/uring/uring_pool.h"
+#endif
+
+namespace util {
+
+using namespace std;
+
+namespace {
+
+// Responds with its tag to every byte it receives.
+class TagConnection : public Connection {
+ public:
+  explicit TagConnection(uint8_t tag) : tag_(tag) {
+  }
+
+ protected:
+  void HandleRequests() final {
+    uint8_t c;
+    while (true) {
+      auto res = socket_->Recv(io::MutableBytes(&c, 1));
+      if (!res || *res == 0)
+        break;
+      if (socket_->Write(io::Bytes(&tag_, 1)))
+        break;
+    }
+  }
+
+  uint8_t tag_;
+};
+
+class TagListener : public ListenerInterface {
+ public:
+  explicit TagListener(uint8_t tag) : tag_(tag) {
+  }
+
+  Connection* NewConnection(ProactorBase* pb) final {
+    return new TagConnection(tag_);
+  }
+
+ private:
+  uint8_t tag_;
+};
+
+ProactorPool* CreatePool(size_t size) {
+#ifdef USE_FB2
+  return fb2::Pool::IOUring(16, size);
+#else
+  return new uring::UringPool(16, size);
+#endif
+}
+
+int ConnectTo(uint16_t port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  CHECK_GE(fd, 0);
+
+  sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  CHECK_EQ(0, connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)));
+  return fd;
+}
+
+// Returns the tag of the responding process or 0 if the connection was closed.
+uint8_t Request(int fd) {
+  uint8_t c = 1;
+  if (write(fd, &c, 1) != 1)
+    return 0;
+  return read(fd, &c, 1) == 1 ? c : 0;
+}
+
+constexpr char kHandoffEnv[] = "LISTENER_HANDOFF_PATH";
+
+}  // namespace
+
+// Runs in the new process that the TwoProcesses test starts by re-executing this binary.
+// Adopts the listener fds and serves until SIGTERM.
+TEST(ListenerHandoffNewProcess, Serve) {
+  const char* path = getenv(kHandoffEnv);
+  if (!path)
+    return;
+
+  auto fds = ReceiveListenerFds(path, 10000);
+  ASSERT_TRUE(fds);
+  ASSERT_EQ(1, fds->size());
+
+  unique_ptr<ProactorPool> pp(CreatePool(2));
+  pp->Run();
+
+  {
+    AcceptServer as(pp.get(), true);
+    EXPECT_FALSE(as.AdoptListener(fds->front(), new TagListener('N')));
+    as.Run();
+    as.Wait();
+  }
+  pp->Stop();
+}
+
+class ListenerHandoffTest : public testing::Test {
+ protected:
+  void SetUp() final {
+    pp_.reset(CreatePool(2));
+    pp_->Run();
+    as_.reset(new AcceptServer{pp_.get(), false});
+    listener_ = new TagListener('O');
+    port_ = as_->AddListener(0, listener_);
+    as_->Run();
+  }
+
+  void TearDown() final {
+    as_->Stop(true);
+    as_.reset();
+    pp_->Stop();
+  }
+
+  unique_ptr<ProactorPool> pp_;
+  unique_ptr<AcceptServer> as_;
+  ListenerInterface* listener_ = nullptr;
+  uint16_t port_ = 0;
+};
+
+TEST_F(ListenerHandoffTest, SendRecvFds) {
+  int sv[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, sv));
+
+  ASSERT_FALSE(SendFds(sv[0], as_->GetListenerFds()));
+  auto fds = RecvFds(sv[1]);
+  ASSERT_TRUE(fds);
+  ASSERT_EQ(1, fds->size());
+
+  // The received fd refers to the same listening socket.
+  sockaddr_in addr;
+  socklen_t len = sizeof(addr);
+  ASSERT_EQ(0, getsockname(fds->front(), reinterpret_cast<sockaddr*>(&addr), &len));
+  EXPECT_EQ(port_, ntohs(addr.sin_port));
+
+  close(fds->front());
+  close(sv[0]);
+  close(sv[1]);
+}
+
+TEST_F(ListenerHandoffTest, DrainTimeout) {
+  int fd = ConnectTo(port_);
+  ASSERT_EQ('O', Request(fd));
+
+  // The idle connection does not close on its own and is shut down after the timeout.
+  as_->Drain(50ms);
+  as_->Wait();
+  EXPECT_EQ(0, Request(fd));
+  close(fd);
+}
+
+TEST_F(ListenerHandoffTest, AcceptedWhileDraining) {
+  // Blocks the accept thread, so that a client and the wakeup connection of Drain queue up in
+  // the backlog, the client first.
+  atomic_bool blocked{false};
+  listener_->socket()->proactor()->DispatchBrief([&] {
+    blocked.store(true);
+    usleep(200000);
+  });
+  while (!blocked.load())
+    usleep(100);
+
+  int fd = ConnectTo(port_);
+  as_->Drain(5s);
+
+  // The client is served rather than closed as the wakeup connection.
+  EXPECT_EQ('O', Request(fd));
+  close(fd);
+  as_->Wait();
+}
+
+TEST_F(ListenerHandoffTest, TwoProcesses) {
+  string path = "/tmp/listener_handoff_test." + to_string(getpid());
+
+  int fd = ConnectTo(port_);
+  ASSERT_EQ('O', Request(fd));
+
+  pid_t child = fork();
+  ASSERT_GE(child, 0);
+  if (child == 0) {
+    setenv(kHandoffEnv, path.c_str(), 1);
+    execl("/proc/self/exe", "listener_handoff_test",
+          "--gtest_filter=ListenerHandoffNewProcess.Serve", nullptr);
+    _exit(127);
+  }
+
+  as_->Drain(10s);
+  ASSERT_FALSE(ServeListenerFds(path.c_str(), as_->GetListenerFds(), 10000));
+
+  // In-flight connections are still served by the old process,
+  // new ones are accepted by the new process.
+  EXPECT_EQ('O', Request(fd));
+  int fd2 = ConnectTo(port_);
+  EXPECT_EQ('N', Request(fd2));
+
+  // The drain finishes as soon as the old connections close.
+  close(fd);
+  auto start = chrono::steady_clock::now();
+  as_->Wait();
+  EXPECT_LT(chrono::steady_clock::now() - start, 5s);
+
+  // Stopping the old server does not break the socket of the new process.
+  as_->Stop(true);
+  EXPECT_EQ('N', Request(fd2));
+  int fd3 = ConnectTo(port_);
+  EXPECT_EQ('N', Request(fd3));
+  close(fd2);
+  close(fd3);
+
+  ASSERT_EQ(0, kill(child, SIGTERM));
+  int status = 0;
+  ASSERT_EQ(child, waitpid(child, &status, 0));
+  ASSERT_TRUE(WIFEXITED(status));
+  EXPECT_EQ(0, WEXITSTATUS(status));
+}
+
+}  // namespace util
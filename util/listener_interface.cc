@@ -4,7 +4,11 @@
 
 #include "util/listener_interface.h"
 
+#include <absl/base/attributes.h>
+#include <absl/time/clock.h>
+#include <netinet/in.h>
 #include <signal.h>
+#include <sys/un.h>
 
 // #include <boost/fiber/operations.hpp>
 
@@ -39,6 +43,104 @@ auto native_handle(const Connection& conn) {
   return ls->native_handle();
 }
 
+// A short lived connection to the listening socket that wakes up the accept fiber without
+// shutting the socket down, since the socket may be shared with another process.
+// The socket is bound before it connects, so that the accept fiber recognizes it by its address.
+class WakeUpConnection {
+ public:
+  explicit WakeUpConnection(int listen_fd);
+
+  ~WakeUpConnection() {
+    if (fd_ >= 0)
+      close(fd_);
+  }
+
+  // Returns false if the socket could not be prepared.
+  bool GetLocalAddress(sockaddr_storage* addr, socklen_t* len) const;
+
+  void Connect();
+
+ private:
+  sockaddr_storage dest_;
+  socklen_t dest_len_ = sizeof(dest_);
+  int fd_ = -1;
+};
+
+WakeUpConnection::WakeUpConnection(int listen_fd) {
+  if (getsockname(listen_fd, reinterpret_cast<sockaddr*>(&dest_), &dest_len_) < 0) {
+    LOG(ERROR) << "getsockname failed " << strerror(errno);
+    return;
+  }
+
+  sockaddr_storage local = dest_;
+  socklen_t local_len = dest_len_;
+  if (dest_.ss_family == AF_INET) {
+    auto* sin = reinterpret_cast<sockaddr_in*>(&dest_);
+    if (sin->sin_addr.s_addr == htonl(INADDR_ANY))
+      sin->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    local = dest_;
+    reinterpret_cast<sockaddr_in*>(&local)->sin_port = 0;
+  } else if (dest_.ss_family == AF_INET6) {
+    auto* sin6 = reinterpret_cast<sockaddr_in6*>(&dest_);
+    if (IN6_IS_ADDR_UNSPECIFIED(&sin6->sin6_addr))
+      sin6->sin6_addr = in6addr_loopback;
+    local = dest_;
+    reinterpret_cast<sockaddr_in6*>(&local)->sin6_port = 0;
+  } else if (dest_.ss_family == AF_UNIX) {
+    local_len = sizeof(sa_family_t);  // autobind to a unique abstract address.
+  }
+
+  fd_ = socket(dest_.ss_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd_ < 0) {
+    LOG(ERROR) << "Could not create a socket " << strerror(errno);
+    return;
+  }
+
+  if (bind(fd_, reinterpret_cast<sockaddr*>(&local), local_len) < 0) {
+    LOG(ERROR) << "Could not bind the wakeup socket " << strerror(errno);
+    close(fd_);
+    fd_ = -1;
+  }
+}
+
+bool WakeUpConnection::GetLocalAddress(sockaddr_storage* addr, socklen_t* len) const {
+  *len = sizeof(*addr);
+  return fd_ >= 0 && getsockname(fd_, reinterpret_cast<sockaddr*>(addr), len) == 0;
+}
+
+void WakeUpConnection::Connect() {
+  if (fd_ < 0)
+    return;
+
+  // If the backlog is full, the acceptor is going to wake up anyway.
+  timeval tv{0, 100000};
+  setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+  if (connect(fd_, reinterpret_cast<sockaddr*>(&dest_), dest_len_) < 0) {
+    VLOG(1) << "Could not connect to the listener " << strerror(errno);
+  }
+}
+
+bool SameAddress(const sockaddr_storage& a, socklen_t a_len, const sockaddr_storage& b,
+                 socklen_t b_len) {
+  if (a.ss_family != b.ss_family)
+    return false;
+
+  if (a.ss_family == AF_INET) {
+    auto* sa = reinterpret_cast<const sockaddr_in*>(&a);
+    auto* sb = reinterpret_cast<const sockaddr_in*>(&b);
+    return sa->sin_port == sb->sin_port && sa->sin_addr.s_addr == sb->sin_addr.s_addr;
+  }
+
+  if (a.ss_family == AF_INET6) {
+    auto* sa = reinterpret_cast<const sockaddr_in6*>(&a);
+    auto* sb = reinterpret_cast<const sockaddr_in6*>(&b);
+    return sa->sin6_port == sb->sin6_port &&
+           memcmp(&sa->sin6_addr, &sb->sin6_addr, sizeof(in6_addr)) == 0;
+  }
+
+  return a_len == b_len && memcmp(&a, &b, a_len) == 0;
+}
+
 using ListType =
     intrusive::slist<Connection, Connection::member_hook_t, intrusive::constant_time_size<true>,
                      intrusive::cache_last<false>>;
@@ -81,6 +183,17 @@ struct ListenerInterface::TLConnList {
     Await(empty_cv, [this] { return this->list.empty(); });
     DVLOG(1) << "AwaitEmpty finished ";
   }
+
+  // Returns false if the deadline was reached before the list became empty.
+  bool AwaitEmpty(chrono::steady_clock::time_point tp) {
+    auto pred = [this] { return this->list.empty(); };
+#ifdef USE_FB2
+    fb2::NoOpLock lock;
+    return empty_cv.wait_until(lock, tp, pred);
+#else
+    return fibers_ext::AwaitFor(empty_cv, pred, tp - chrono::steady_clock::now());
+#endif
+  }
 };
 
 thread_local unordered_map<ListenerInterface*, ListenerInterface::TLConnList*>
@@ -103,7 +216,8 @@ void ListenerInterface::RunAcceptLoop() {
     conn_list.emplace(this, new TLConnList{});
   });
 
-  while (true) {
+  // accept_bc_ has been incremented by AcceptServer::Run before launching this fiber.
+  while (!draining_.load(memory_order_acquire)) {
     FiberSocketBase::AcceptResult res = sock_->Accept();
     if (!res.has_value()) {
       FiberSocketBase::error_code ec = res.error();
@@ -115,19 +229,40 @@ void ListenerInterface::RunAcceptLoop() {
 
     unique_ptr<LinuxSocketBase> peer{static_cast<LinuxSocketBase*>(res.value())};
 
+    // The wakeup connection of StopAccepting must not reach the handlers. A client that was
+    // accepted before it is served as usual and the loop stops right after it. In that case
+    // the wakeup connection stays in the backlog and is closed together with the listening
+    // socket, or is accepted by the process that adopted it and reads EOF.
+    if (draining_.load(memory_order_acquire) && IsWakeUpConnection(*peer)) {
+      VSOCK(1, *peer) << "Closing the wakeup connection";
+      peer->Close();
+      break;
+    }
+
     VSOCK(2, *peer) << "Accepted " << peer->RemoteEndpoint();
 
     // Most probably next is in another thread.
+    placement_picked_ = false;
     ProactorBase* next = PickConnectionProactor(peer.get());
+    bool placed = placement_picked_;
+    if (!AdmitConnection(&next, placed)) {
+      VSOCK(1, *peer) << "Rejecting connection";
+      OnConnectionRejected(peer.get());
+      peer->Close();
+      continue;
+    }
 
     peer->SetProactor(next);
     Connection* conn = NewConnection(next);
     conn->SetSocket(peer.release());
+    conn->owner_ = this;
+    conn->placed_ = placed;
 
     // Run cb in its Proactor thread.
     next->Dispatch([this, conn] {
       RunSingleConnection(conn); });
   }
+  accept_bc_.Dec();
 
   PreShutdown();
 
@@ -139,6 +274,20 @@ void ListenerInterface::RunAcceptLoop() {
   // callback to unwind and run.
   fibers_ext::SleepFor(10ms);
 #endif
+
+  if (draining_.load(memory_order_acquire)) {
+    VLOG(1) << "Listener - " << ep.port() << " draining connections";
+
+    auto deadline = chrono::steady_clock::now() + drain_timeout_;
+    atomic_uint32_t timed_out{0};
+    pool_->AwaitFiberOnAll([&](auto* pb) {
+      if (!conn_list.find(this)->second->AwaitEmpty(deadline))
+        timed_out.fetch_add(1, memory_order_relaxed);
+    });
+    LOG_IF(INFO, timed_out > 0) << "Listener - " << ep.port() << " drain timed out on "
+                                << timed_out << " threads";
+  }
+
   atomic_uint32_t cur_conn_cnt{0};
 
   pool_->AwaitFiberOnAll([&](auto* pb) {
@@ -199,6 +348,10 @@ void ListenerInterface::RunSingleConnection(Connection* conn) {
 
   clist = conn_list.find(this)->second;
   clist->Unlink(conn);
+  if (conn->placed_)
+    placement_->OnConnectionClose(ProactorBase::GetIndex());
+  proactor_connections_[ProactorBase::GetIndex()].fetch_sub(1, memory_order_relaxed);
+  num_connections_.fetch_sub(1, memory_order_relaxed);
 
   guard.reset();
 }
@@ -209,6 +362,8 @@ void ListenerInterface::RegisterPool(ProactorPool* pool) {
   CHECK(pool_ == nullptr || pool_ == pool);
 
   pool_ = pool;
+  if (!proactor_connections_)
+    proactor_connections_.reset(new atomic_uint32_t[pool->size()]());
 }
 
 error_code ListenerInterface::ConfigureServerSocket(int fd) {
@@ -220,9 +375,85 @@ error_code ListenerInterface::ConfigureServerSocket(int fd) {
 }
 
 ProactorBase* ListenerInterface::PickConnectionProactor(LinuxSocketBase* sock) {
+  if (placement_) {
+    placement_picked_ = true;
+    return pool_->at(placement_->Pick(sock));
+  }
   return pool_->GetNextProactor();
 }
 
+void ListenerInterface::StopAccepting(chrono::steady_clock::duration drain_timeout) {
+  CHECK(sock_);
+
+  if (draining_.load(memory_order_acquire))
+    return;
+
+  drain_timeout_ = drain_timeout;
+
+  // The address is published before draining_, the accept fiber reads it after it sees draining_.
+  WakeUpConnection wakeup(sock_->native_handle());
+  if (!wakeup.GetLocalAddress(&wakeup_addr_, &wakeup_addr_len_))
+    wakeup_addr_len_ = 0;
+  draining_.store(true, memory_order_release);
+
+  wakeup.Connect();
+  accept_bc_.Wait();
+}
+
+bool ListenerInterface::IsWakeUpConnection(const LinuxSocketBase& peer) const {
+  if (wakeup_addr_len_ == 0)
+    return false;
+
+  sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  if (getpeername(peer.native_handle(), reinterpret_cast<sockaddr*>(&addr), &len) < 0)
+    return false;
+  return SameAddress(addr, len, wakeup_addr_, wakeup_addr_len_);
+}
+
+bool ListenerInterface::AdmitConnection(ProactorBase** next, bool placed) {
+  unsigned index = 0;
+  while (index < pool_->size() && pool_->at(index) != *next)
+    ++index;
+  CHECK_LT(index, pool_->size()) << "The connection proactor is not in the pool";
+
+  bool admit = true;
+  uint32_t max_conn = max_connections_.load(memory_order_relaxed);
+  if (max_conn && num_connections_.load(memory_order_relaxed) >= max_conn)
+    admit = false;
+
+  uint32_t max_proactor_conn = max_proactor_connections_.load(memory_order_relaxed);
+  if (admit && max_proactor_conn &&
+      proactor_connections_[index].load(memory_order_relaxed) >= max_proactor_conn) {
+    unsigned best = 0;
+    for (unsigned i = 1; i < pool_->size(); ++i) {
+      if (proactor_connections_[i].load(memory_order_relaxed) <
+          proactor_connections_[best].load(memory_order_relaxed))
+        best = i;
+    }
+
+    if (proactor_connections_[best].load(memory_order_relaxed) >= max_proactor_conn) {
+      admit = false;
+    } else {
+      if (placed)
+        placement_->OnMigrate(index, best);
+      index = best;
+      *next = pool_->at(best);
+    }
+  }
+
+  if (!admit) {
+    if (placed)
+      placement_->OnConnectionClose(index);
+    num_rejected_.fetch_add(1, memory_order_relaxed);
+    return false;
+  }
+
+  proactor_connections_[index].fetch_add(1, memory_order_relaxed);
+  num_connections_.fetch_add(1, memory_order_relaxed);
+  return true;
+}
+
 void ListenerInterface::TraverseConnections(TraverseCB cb) {
   pool_->Await([&](unsigned index, auto* pb) {
     auto it = conn_list.find(this);
@@ -248,18 +479,47 @@ void ListenerInterface::Migrate(Connection* conn, ProactorBase* dest) {
   auto* clist = conn_list.find(this)->second;
   clist->Unlink(conn);
 
+  int32_t src_index = ProactorBase::GetIndex();
   src_proactor->Migrate(dest);
+  LinkMigrated(conn, dest, src_index, clist);
+}
 
+// The compiler may reuse thread-local addresses and pthread_self() computed before the fiber
+// switched threads, hence everything after the switch runs in a separate function.
+ABSL_ATTRIBUTE_NOINLINE void ListenerInterface::LinkMigrated(Connection* conn, ProactorBase* dest,
+                                                             int32_t src_index,
+                                                             const TLConnList* src_list) {
   DCHECK(dest->InMyThread());  // We are running in the updated thread.
+  int32_t dest_index = ProactorBase::GetIndex();
+  if (conn->placed_)
+    placement_->OnMigrate(src_index, dest_index);
+  proactor_connections_[src_index].fetch_sub(1, memory_order_relaxed);
+  proactor_connections_[dest_index].fetch_add(1, memory_order_relaxed);
+
   conn->socket()->SetProactor(dest);
 
-  auto* clist2 = conn_list.find(this)->second;
-  DCHECK(clist2 != clist);
+  auto* clist = conn_list.find(this)->second;
+  DCHECK(clist != src_list);
 
-  clist2->Link(conn);
+  clist->Link(conn);
+  num_migrations_.fetch_add(1, memory_order_relaxed);
   conn->OnPostMigrateThread();
 }
 
+bool Connection::MaybeMigrate() {
+  if (migrate_to_ < 0)
+    return false;
+
+  int32_t dest = migrate_to_;
+  migrate_to_ = -1;
+  if (!owner_ || dest == ProactorBase::GetIndex())
+    return false;
+
+  owner_->Migrate(this, owner_->pool_->at(dest));
+  last_migration_ns_ = absl::GetCurrentTimeNanos();
+  return true;
+}
+
 void Connection::Shutdown() {
   auto ec = socket_->Shutdown(SHUT_RDWR);
   VLOG_IF(1, ec) << "Error during shutdown " << ec.message();
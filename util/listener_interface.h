@@ -4,10 +4,16 @@
 
 #pragma once
 
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <memory>
 
+#include "util/connection_placement.h"
 #include "util/fiber_socket_base.h"
+#include "util/fibers/fibers_ext.h"
 #include <unordered_map>
 
 namespace util {
@@ -48,8 +54,14 @@ class ListenerInterface {
   // bind is called.
   virtual std::error_code ConfigureServerSocket(int fd);
 
+  // By default round-robins over the pool unless a placement policy is set.
   virtual ProactorBase* PickConnectionProactor(LinuxSocketBase* sock);
 
+  // Must be called before the listener starts accepting connections.
+  void SetPlacementPolicy(std::unique_ptr<PlacementPolicy> policy) {
+    placement_ = std::move(policy);
+  }
+
   // This callback should not preempt because we traverse the list of connections
   // without locking it.
   // TraverseCB accepts the thread index and the connection pointer.
@@ -65,6 +77,41 @@ class ListenerInterface {
   // Updates socket_ and listener interface bookeepings.
   void Migrate(Connection* conn, ProactorBase* dest);
 
+  // Stops accepting new connections without closing the listening socket, so that it can be
+  // handed off to another process (see listener_handoff.h). Existing connections are given up to
+  // drain_timeout to close on their own, the remaining ones are shut down afterwards.
+  // Blocks until the accept fiber stops accepting, therefore must be called from a non-proactor
+  // thread or from a fiber. One more connection may be accepted and served after this call
+  // starts. Repeated calls are no-op.
+  void StopAccepting(std::chrono::steady_clock::duration drain_timeout);
+
+  // Connections can check it to close once they finish their current request.
+  bool IsDraining() const {
+    return draining_.load(std::memory_order_acquire);
+  }
+
+  // Admission control: connections above the limits are closed right after they are accepted.
+  // If the proactor picked for a connection is at its limit, the least loaded one is used instead.
+  // 0 means no limit. Can be changed at any time.
+  void SetMaxConnections(uint32_t per_listener, uint32_t per_proactor) {
+    max_connections_.store(per_listener, std::memory_order_relaxed);
+    max_proactor_connections_.store(per_proactor, std::memory_order_relaxed);
+  }
+
+  uint32_t num_connections() const {
+    return num_connections_.load(std::memory_order_relaxed);
+  }
+
+  // Number of connections rejected due to the limits.
+  uint64_t num_rejected() const {
+    return num_rejected_.load(std::memory_order_relaxed);
+  }
+
+  // Number of connections migrated between threads.
+  uint64_t num_migrations() const {
+    return num_migrations_.load(std::memory_order_relaxed);
+  }
+
   LinuxSocketBase* socket() {
     return sock_.get();
   }
@@ -80,19 +127,57 @@ class ListenerInterface {
   virtual void OnConnectionClose(Connection* conn) {
   }
 
+  // Called from the accept fiber before a connection is rejected due to the connection limits,
+  // for example to send an error to the client. Should not block for long.
+  virtual void OnConnectionRejected(LinuxSocketBase* sock) {
+  }
+
  private:
   void RunAcceptLoop();
 
   void RunSingleConnection(Connection* conn);
 
+  // Returns true if peer is the connection that StopAccepting opened to wake up the accept fiber.
+  bool IsWakeUpConnection(const LinuxSocketBase& peer) const;
+
+  // Checks the connection limits and accounts the connection if it is admitted.
+  // May change next to a less loaded proactor. placed tells whether the placement policy
+  // picked next, only then it is notified about the changes.
+  bool AdmitConnection(ProactorBase** next, bool placed);
+
   struct TLConnList;  // threadlocal connection list. contains connections for that thread.
 
+  // The part of Migrate that runs in the destination thread.
+  void LinkMigrated(Connection* conn, ProactorBase* dest, int32_t src_index,
+                    const TLConnList* src_list);
+
   static thread_local std::unordered_map<ListenerInterface*, TLConnList*> conn_list;
 
   std::unique_ptr<LinuxSocketBase> sock_;
+  std::unique_ptr<PlacementPolicy> placement_;
+
+  // Set when placement_ picks a proactor, so that overrides of PickConnectionProactor that do
+  // not use the policy do not notify it. Accessed only by the accept fiber.
+  bool placement_picked_ = false;
 
   ProactorPool* pool_ = nullptr;
+  std::atomic_uint64_t num_migrations_{0};
+
+  std::atomic_uint32_t max_connections_{0}, max_proactor_connections_{0};
+  std::atomic_uint32_t num_connections_{0};
+  std::unique_ptr<std::atomic_uint32_t[]> proactor_connections_;
+  std::atomic_uint64_t num_rejected_{0};
+
+  std::atomic_bool draining_{false};
+  std::chrono::steady_clock::duration drain_timeout_{0};
+  BlockingCounter accept_bc_{0};  // non-zero while the accept loop runs.
+
+  // The local address of the wakeup connection, valid once draining_ is set.
+  sockaddr_storage wakeup_addr_;
+  socklen_t wakeup_addr_len_ = 0;
+
   friend class AcceptServer;
+  friend class Connection;
 };
 
 }  // namespace util
@@ -6,6 +6,7 @@
 #include <shared_mutex>
 
 #include "base/logging.h"
+#include "base/memory_account.h"
 #include "util/proactor_pool.h"
 
 namespace util {
@@ -22,6 +23,7 @@ namespace {
 
 shared_mutex list_mu;
 Family* family_list = nullptr;
+base::MemoryAccount tuple_account("metric_label_tuples");
 
 }  // namespace
 
@@ -53,6 +55,12 @@ void Family::InitBase(ProactorPool* pp, initializer_list<Label> list) {
 }
 
 void Family::ShutdownBase() {
+  if (pp_) {
+    size_t tuple_bytes = TupleBytes();
+    for (size_t i = 0; i < label_values_.size(); ++i)
+      tuple_account.Release(tuple_bytes);
+  }
+
   lock_guard lk(list_mu);
   if (next_)
     next_->prev_ = prev_;
@@ -97,6 +105,7 @@ auto Family::Emplace(uint64_t hash, absl::Span<const std::string_view> label_val
     auto [global_it, inserted] = label_map_.emplace(hash, dense_id);
     if (inserted) {  // new hash value
       label_values_.emplace_back(std::move(lvals));
+      tuple_account.Charge(TupleBytes());
     } else {
       it->second = global_it->second;  // update the local map.
     }
@@ -105,6 +114,12 @@ auto Family::Emplace(uint64_t hash, absl::Span<const std::string_view> label_val
   return make_pair(it->second, inserted);
 }
 
+size_t Family::TupleBytes() const {
+  size_t per_thread = sizeof(LabelMap::value_type) + cardinality_ * sizeof(double);
+  return label_names_.size() * sizeof(string_view) + sizeof(LabelValues) +
+         sizeof(LabelMap::value_type) + pp_->size() * per_thread;
+}
+
 ObservationDescriptor Family::GetDescriptor() const {
   ObservationDescriptor res;
   res.type = metric_type_;
@@ -113,6 +113,9 @@ class Family {
 
   ObservationDescriptor GetDescriptor() const;
 
+  // Estimated memory of a single label tuple across the global and the per-thread stores.
+  size_t TupleBytes() const;
+
   // Combines values into dest. Dest is ordered by cardinality,
   // i.e. first metric and all its tuples, then the next one and so on.
   virtual void Combine(unsigned thread_index, absl::Span<double> dest) const = 0;
@@ -132,7 +135,7 @@ class Family {
 
   SharedMutex mu_;
 
-  ProactorPool* pp_;
+  ProactorPool* pp_ = nullptr;
   Family* next_ = nullptr;
   Family* prev_ = nullptr;
   unsigned cardinality_ = 1;
@@ -0,0 +1,126 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/metrics/proactor_stats.h"
+
+#include <absl/strings/str_cat.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "base/logging.h"
+#include "util/proactor_pool.h"
+
+namespace util {
+namespace metrics {
+
+using namespace std;
+
+namespace {
+
+inline uint64_t ClockNs(clockid_t clock) {
+  timespec ts;
+  clock_gettime(clock, &ts);
+  return uint64_t(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+}  // namespace
+
+ProactorThreadStats::ProactorThreadStats()
+    : cpu_util_("proactor_cpu_utilization", "Fraction of wall time the proactor ran on cpu"),
+      wait_ratio_("proactor_runqueue_wait_ratio",
+                  "Fraction of wall time the proactor waited on a runqueue"),
+      cpu_seconds_("proactor_cpu_seconds", "Cpu time consumed by the proactor thread"),
+      wait_seconds_("proactor_runqueue_wait_seconds",
+                    "Time the proactor thread spent waiting on a runqueue") {
+}
+
+ProactorThreadStats::~ProactorThreadStats() {
+  CHECK(pp_ == nullptr) << "Stop() was not called";
+}
+
+void ProactorThreadStats::Start(ProactorPool* pp, uint32_t period_ms) {
+  CHECK(pp_ == nullptr);
+  pp_ = pp;
+  per_thread_.reset(new PerThread[pp->size()]);
+
+  for (GaugeFamily* family : {&cpu_util_, &wait_ratio_, &cpu_seconds_, &wait_seconds_}) {
+    family->Init(pp, {"proactor"});
+  }
+
+  pp->AwaitFiberOnAll([this, period_ms](unsigned index, ProactorBase* pb) {
+    InitThread(index, pb);
+    per_thread_[index].periodic_id = pb->AddPeriodic(period_ms, [this, index] { Sample(index); });
+  });
+}
+
+void ProactorThreadStats::Stop() {
+  if (!pp_)
+    return;
+
+  pp_->AwaitFiberOnAll([this](unsigned index, ProactorBase* pb) {
+    pb->CancelPeriodic(per_thread_[index].periodic_id);
+  });
+
+  for (GaugeFamily* family : {&cpu_util_, &wait_ratio_, &cpu_seconds_, &wait_seconds_}) {
+    family->Shutdown();
+  }
+  per_thread_.reset();
+  pp_ = nullptr;
+}
+
+void ProactorThreadStats::InitThread(unsigned index, ProactorBase* pb) {
+  PerThread& pt = per_thread_[index];
+  pt.label = absl::StrCat(index);
+
+  int res = pthread_getcpuclockid(pb->thread_id(), &pt.cpu_clock);
+  CHECK_EQ(0, res);
+
+  pt.sched_reader.reset(new io::SchedStatReader(gettid()));
+  auto sched = pt.sched_reader->Read();
+  if (sched) {
+    pt.last_wait_ns = sched->wait_ns;
+  } else {
+    LOG_FIRST_N(WARNING, 1) << "Can not read schedstat: " << sched.error().message();
+    pt.sched_reader.reset();
+  }
+
+  pt.last_cpu_ns = ClockNs(pt.cpu_clock);
+  pt.last_ts_ns = ClockNs(CLOCK_MONOTONIC);
+
+  // Create the metric rows from the fiber context, since it may lock,
+  // so that Sample() which runs from the I/O loop only updates them.
+  string_view labels[] = {pt.label};
+  for (GaugeFamily* family : {&cpu_util_, &wait_ratio_, &cpu_seconds_, &wait_seconds_}) {
+    family->Set(labels, 0);
+  }
+}
+
+void ProactorThreadStats::Sample(unsigned index) {
+  PerThread& pt = per_thread_[index];
+  uint64_t now = ClockNs(CLOCK_MONOTONIC);
+  uint64_t cpu_ns = ClockNs(pt.cpu_clock);
+  uint64_t wait_ns = pt.last_wait_ns;
+
+  if (pt.sched_reader) {
+    auto sched = pt.sched_reader->Read();
+    if (sched)
+      wait_ns = sched->wait_ns;
+  }
+
+  string_view labels[] = {pt.label};
+  uint64_t delta = now - pt.last_ts_ns;
+  if (delta > 0) {
+    cpu_util_.Set(labels, double(cpu_ns - pt.last_cpu_ns) / delta);
+    wait_ratio_.Set(labels, double(wait_ns - pt.last_wait_ns) / delta);
+  }
+  cpu_seconds_.Set(labels, cpu_ns * 1e-9);
+  wait_seconds_.Set(labels, wait_ns * 1e-9);
+
+  pt.last_ts_ns = now;
+  pt.last_cpu_ns = cpu_ns;
+  pt.last_wait_ns = wait_ns;
+}
+
+}  // namespace metrics
+}  // namespace util
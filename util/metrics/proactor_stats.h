@@ -0,0 +1,69 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <time.h>
+
+#include <memory>
+#include <string>
+
+#include "io/proc_reader.h"
+#include "util/metrics/metrics.h"
+
+namespace util {
+
+#ifdef USE_FB2
+namespace fb2 {
+class ProactorBase;
+}  // namespace fb2
+
+using fb2::ProactorBase;
+
+#else
+class ProactorBase;
+#endif
+
+class ProactorPool;
+
+namespace metrics {
+
+// Periodically samples cpu time and run-queue delay of every proactor thread and exports them
+// as gauges labeled by proactor index:
+//   proactor_cpu_utilization - fraction of the wall time the thread ran on a cpu.
+//   proactor_runqueue_wait_ratio - fraction of the wall time the thread was runnable but
+//                                  waited for a cpu, i.e. was descheduled by other tasks.
+//   proactor_cpu_seconds, proactor_runqueue_wait_seconds - cumulative values.
+// The metric families are process-wide, hence there should be a single instance of this class.
+class ProactorThreadStats {
+ public:
+  ProactorThreadStats();
+  ~ProactorThreadStats();
+
+  // Must be called from a non-proactor thread or from a fiber that does not run in pp.
+  void Start(ProactorPool* pp, uint32_t period_ms = 1000);
+  void Stop();
+
+ private:
+  struct PerThread {
+    clockid_t cpu_clock;
+    std::unique_ptr<io::SchedStatReader> sched_reader;
+    uint64_t last_ts_ns = 0;
+    uint64_t last_cpu_ns = 0;
+    uint64_t last_wait_ns = 0;
+    uint32_t periodic_id = 0;
+    std::string label;
+  };
+
+  void InitThread(unsigned index, ProactorBase* pb);
+  void Sample(unsigned index);
+
+  ProactorPool* pp_ = nullptr;
+  std::unique_ptr<PerThread[]> per_thread_;
+
+  GaugeFamily cpu_util_, wait_ratio_, cpu_seconds_, wait_seconds_;
+};
+
+}  // namespace metrics
+}  // namespace util
@@ -0,0 +1,95 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/metrics/proactor_stats.h"
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/strings/numbers.h>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+#ifdef USE_FB2
+#include "util/fibers/pool.h"
+#else
+#include "util/uring/uring_pool.h"
+#endif
+
+namespace util {
+namespace metrics {
+
+using namespace std;
+
+class ProactorStatsTest : public testing::Test {
+ protected:
+  void SetUp() final {
+#ifdef USE_FB2
+    pp_.reset(fb2::Pool::IOUring(16, 2));
+#else
+    pp_.reset(new uring::UringPool(16, 2));
+#endif
+    pp_->Run();
+  }
+
+  void TearDown() final {
+    pp_->Stop();
+  }
+
+  // Returns metric name -> values indexed by the proactor label.
+  absl::flat_hash_map<string, vector<double>> Collect() {
+    absl::flat_hash_map<string, vector<double>> res;
+    Iterate([&](const ObservationDescriptor& od, absl::Span<const double> vals) {
+      vector<double>& dest = res[string(od.metric_name)];
+      dest.resize(od.label_values.size());
+      for (size_t i = 0; i < od.label_values.size(); ++i) {
+        unsigned index = 0;
+        CHECK(absl::SimpleAtoi(od.label_values[i][0], &index));
+        CHECK_LT(index, dest.size());
+        dest[index] = vals[i];
+      }
+    });
+    return res;
+  }
+
+  unique_ptr<ProactorPool> pp_;
+};
+
+TEST_F(ProactorStatsTest, Publish) {
+  ProactorThreadStats stats;
+  stats.Start(pp_.get(), 10);
+
+  // Keeps proactor 0 busy, while proactor 1 stays idle.
+  pp_->at(0)->Await([] {
+    timespec start, now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &start);
+    do {
+      clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    } while ((now.tv_sec - start.tv_sec) * 1000000000L + now.tv_nsec - start.tv_nsec < 50000000);
+  });
+  usleep(50000);
+
+  auto res = Collect();
+  for (const char* name : {"proactor_cpu_utilization", "proactor_runqueue_wait_ratio",
+                           "proactor_cpu_seconds", "proactor_runqueue_wait_seconds"}) {
+    ASSERT_TRUE(res.contains(name)) << name;
+    const vector<double>& vals = res[name];
+    ASSERT_EQ(2u, vals.size()) << name;
+    for (double val : vals) {
+      EXPECT_GE(val, 0) << name;
+    }
+  }
+
+  const vector<double>& cpu_seconds = res["proactor_cpu_seconds"];
+  EXPECT_GE(cpu_seconds[0], 0.05);
+  EXPECT_GT(cpu_seconds[0], cpu_seconds[1]);
+  EXPECT_LE(res["proactor_cpu_utilization"][1], 0.5);
+
+  stats.Stop();
+
+  // The families are unregistered.
+  EXPECT_FALSE(Collect().contains("proactor_cpu_seconds"));
+}
+
+}  // namespace metrics
+}  // namespace util
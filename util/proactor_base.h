@@ -150,7 +150,7 @@ class ProactorBase {
     fibers_ext::Fiber fb;
 
     // It's safe to use & capture since we await before returning.
-    AwaitBrief([&] { fb = boost::fibers::fiber(std::forward<Args>(args)...); });
+    AwaitBrief([&] { fb = fibers_ext::Fiber(std::forward<Args>(args)...); });
     return fb;
   }
 
@@ -250,7 +250,8 @@ class ProactorBase {
   };
   static_assert(sizeof(Tasklet) == 32, "");
 
-  using FuncQ = base::mpmc_bounded_queue<Tasklet>;
+  // Cells are padded to cache lines so that threads enqueuing concurrently do not false-share.
+  using FuncQ = base::mpmc_bounded_queue<Tasklet, true>;
 
   using EventCount = fibers_ext::EventCount;
 
@@ -7,6 +7,7 @@
 #include <openssl/err.h>
 
 #include "base/logging.h"
+#include "base/memory_account.h"
 
 #if OPENSSL_VERSION_NUMBER < 0x10100000L
 #error Please update your libssl to libssl1.1 - install libssl-dev
@@ -16,6 +17,13 @@ namespace util {
 
 namespace tls {
 
+namespace {
+
+// Does not include the memory that OpenSSL allocates for the SSL object itself.
+base::MemoryAccount bio_account("tls_bio_buffers");
+
+}  // namespace
+
 Engine::Engine(SSL_CTX* context) : ssl_(::SSL_new(context)) {
   CHECK(ssl_);
 
@@ -26,6 +34,8 @@ Engine::Engine(SSL_CTX* context) : ssl_(::SSL_new(context)) {
   ::BIO* int_bio = 0;
 
   BIO_new_bio_pair(&int_bio, 0, &external_bio_, 0);
+  bio_bytes_ = BIO_get_write_buf_size(int_bio, 0) + BIO_get_write_buf_size(external_bio_, 0);
+  bio_account.Charge(bio_bytes_);
 
   // SSL_set0_[rw]bio take ownership of the passed reference,
   // so if we call both with the same BIO, we need the refcount to be 2.
@@ -39,6 +49,7 @@ Engine::~Engine() {
 
   ::BIO_free(external_bio_);
   ::SSL_free(ssl_);
+  bio_account.Release(bio_bytes_);
 }
 
 auto Engine::ToOpResult(const SSL* ssl, int result) -> Engine::OpResult {
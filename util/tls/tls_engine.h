@@ -110,6 +110,7 @@ class Engine {
 
   SSL* ssl_;
   BIO* external_bio_;
+  size_t bio_bytes_ = 0;  // buffers of the BIO pair, reported via MemoryAccount.
 };
 
 }  // namespace tls
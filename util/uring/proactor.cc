@@ -16,6 +16,7 @@
 #include "base/flags.h"
 #include "base/histogram.h"
 #include "base/logging.h"
+#include "base/memory_account.h"
 #include "base/proc_util.h"
 #include "util/uring/uring_fiber_algo.h"
 #include "util/uring/uring_socket.h"
@@ -80,6 +81,9 @@ constexpr uint64_t kWakeIndex = 1;
 
 constexpr uint64_t kUserDataCbIndex = 1024;
 
+base::MemoryAccount ring_account("io_uring_rings");
+base::MemoryAccount registered_buf_account("io_uring_registered_buffers");
+
 }  // namespace
 
 Proactor::Proactor() : ProactorBase() {
@@ -90,6 +94,10 @@ Proactor::~Proactor() {
   if (thread_id_ != -1U) {
     io_uring_queue_exit(&ring_);
   }
+  if (ring_mem_size_)
+    ring_account.Release(ring_mem_size_);
+  if (buffer_pool_)
+    registered_buf_account.Release(buffer_pool_->capacity_bytes());
   VLOG(1) << "Closing wake_fd " << wake_fd_ << " ring fd: " << ring_.ring_fd;
 }
 
@@ -122,7 +130,7 @@ void Proactor::Run() {
   while (true) {
     ++loop_cnt;
 
-    int num_submitted = io_uring_submit(&ring_);
+    int num_submitted = Submit();
     bool ring_busy = false;
 
     if (num_submitted >= 0) {
@@ -333,6 +341,8 @@ void Proactor::Run() {
   VPRO(1) << "busy_sq/get_entry_sq_full/get_entry_sq_err/get_entry_awaits/pending_callbacks: "
           << busy_sq_cnt << "/" << get_entry_sq_full_ << "/" << get_entry_submit_fail_ << "/"
           << get_entry_await_ << "/" << pending_cb_cnt_;
+  VPRO(1) << "enter_calls/submitted/flushes: " << submit_stats_.enter_calls << "/"
+          << submit_stats_.submitted << "/" << submit_stats_.flushes;
 
   VPRO(1) << "centries size: " << centries_.size();
   centries_.clear();
@@ -428,6 +438,12 @@ void Proactor::Init(size_t ring_size, int wq_fd) {
   LOG_FIRST_N(INFO, 1) << "IORing with " << params.sq_entries << " entries, allocated " << sz
                        << " bytes, cq_entries is " << *ring_.cq.kring_entries;
   CHECK_EQ(ring_size, params.sq_entries);  // Sanity.
+  sq_entries_ = params.sq_entries;
+
+  // With IORING_FEAT_SINGLE_MMAP both rings share the same mapping.
+  ring_mem_size_ = std::max(ring_.sq.ring_sz, ring_.cq.ring_sz) +
+                   params.sq_entries * sizeof(struct io_uring_sqe);
+  ring_account.Charge(ring_mem_size_);
 
   ArmWakeupEvent();
   centries_.resize(params.sq_entries);  // .val = -1
@@ -481,10 +497,19 @@ void Proactor::DispatchCompletions(io_uring_cqe* cqes, unsigned count) {
 }
 
 SubmitEntry Proactor::GetSubmitEntry(CbType cb, int64_t payload) {
+  io_uring_sqe* res = NextSqe();
+  memset(res, 0, sizeof(io_uring_sqe));
+  AssignCallback(res, std::move(cb), payload);
+
+  return SubmitEntry{res};
+}
+
+io_uring_sqe* Proactor::NextSqe() {
   io_uring_sqe* res = io_uring_get_sqe(&ring_);
   if (res == NULL) {
     ++get_entry_sq_full_;
-    int submitted = io_uring_submit(&ring_);
+    ++submit_stats_.sq_full;
+    int submitted = Submit();
     if (submitted > 0) {
       res = io_uring_get_sqe(&ring_);
     } else {
@@ -505,16 +530,17 @@ SubmitEntry Proactor::GetSubmitEntry(CbType cb, int64_t payload) {
       CHECK(res);
     }
   }
+  return res;
+}
 
-  memset(res, 0, sizeof(io_uring_sqe));
-
+void Proactor::AssignCallback(io_uring_sqe* sqe, CbType cb, int64_t payload) {
   if (cb) {
     if (next_free_ce_ < 0) {
       RegrowCentries();
       DCHECK_GT(next_free_ce_, 0);
     }
 
-    res->user_data = next_free_ce_ + kUserDataCbIndex;
+    sqe->user_data = next_free_ce_ + kUserDataCbIndex;
     DCHECK_LT(unsigned(next_free_ce_), centries_.size());
 
     auto& e = centries_[next_free_ce_];
@@ -526,50 +552,64 @@ SubmitEntry Proactor::GetSubmitEntry(CbType cb, int64_t payload) {
     e.val = payload;
     ++pending_cb_cnt_;
   } else {
-    res->user_data = kIgnoreIndex;
+    sqe->user_data = kIgnoreIndex;
   }
+}
 
-  return SubmitEntry{res};
+int Proactor::Submit() {
+  int res = io_uring_submit(&ring_);
+  if (res > 0) {
+    ++submit_stats_.enter_calls;
+    submit_stats_.submitted += res;
+  }
+  return res;
 }
 
-int Proactor::RegisterBuffers() {
-  unique_ptr<uint8_t[]> reg_buf(new uint8_t[1U << 16]);
-  iovec vec[1];
-  vec[0].iov_base = reg_buf.get();
-  vec[0].iov_len = 1U << 16;
-  int res = io_uring_register_buffers(&ring_, vec, 1);
-  if (res < 0) {
-    return -res;
+int Proactor::RegisterBufferPool(const RegisteredBufferPool::Options& opts) {
+  if (buffer_pool_) {
+    if (buffer_pool_->GetStats().in_use)
+      return EBUSY;
+    int res = io_uring_unregister_buffers(&ring_);
+    if (res < 0)
+      return -res;
+    registered_buf_account.Release(buffer_pool_->capacity_bytes());
+    buffer_pool_.reset();
+    socket_buffers_ = false;
   }
 
-  free_req_buf_id_ = 0;
-  for (int i = 0; i < 1024; ++i) {
-    uint8_t* next = reg_buf.get() + i * 64;
-    absl::little_endian::Store16(next, i + 1);
+  unique_ptr<RegisteredBufferPool> pool(new RegisteredBufferPool(opts));
+  const vector<iovec>& vecs = pool->iovecs();
+  int res = io_uring_register_buffers(&ring_, vecs.data(), vecs.size());
+  if (res < 0) {
+    return -res;
   }
 
-  registered_buf_ = std::move(reg_buf);
+  registered_buf_account.Charge(pool->capacity_bytes());
+  buffer_pool_ = std::move(pool);
+  socket_buffers_ = false;
   return 0;
 }
 
-uint8_t* Proactor::ProvideRegisteredBuffer() {
-  if (free_req_buf_id_ < 0 || free_req_buf_id_ >= 1024)
+int Proactor::RegisterBuffers() {
+  RegisteredBufferPool::Options opts;
+  opts.classes = {{64, 1024}};
+  int res = RegisterBufferPool(opts);
+  if (res == 0)
+    socket_buffers_ = true;
+  return res;
+}
+
+uint8_t* Proactor::ProvideRegisteredBuffer(uint16_t* buf_index) {
+  if (!socket_buffers_)
     return nullptr;
 
-  int res = free_req_buf_id_;
-  free_req_buf_id_ = absl::little_endian::Load16(&registered_buf_[free_req_buf_id_ * 64]);
-  return registered_buf_.get() + res * 64;
+  uint16_t index;
+  return buffer_pool_->Allocate(64, buf_index ? buf_index : &index);
 }
 
 void Proactor::ReturnRegisteredBuffer(uint8_t* addr) {
-  DCHECK(registered_buf_);
-  intptr_t offs = addr - registered_buf_.get();
-  DCHECK_GE(offs, 0);
-  DCHECK_LT(offs, 1 << 16);
-
-  unsigned buf_id = offs / 64;
-  absl::little_endian::Store16(&registered_buf_[buf_id * 64], free_req_buf_id_);
-  free_req_buf_id_ = buf_id;
+  DCHECK(buffer_pool_);
+  buffer_pool_->Free(addr);
 }
 
 void Proactor::RegrowCentries() {
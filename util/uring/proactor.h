@@ -12,6 +12,8 @@
 #include <pthread.h>
 
 #include "util/proactor_base.h"
+#include "util/uring/registered_buffer_pool.h"
+#include "util/uring/submit_batch.h"
 #include "util/uring/submit_entry.h"
 
 namespace util {
@@ -53,13 +55,30 @@ class Proactor : public ProactorBase {
    * This method might block the calling fiber therefore it should not be called within proactor
    * context. In other words it can not be called from  *Brief([]...) calls to Proactor.
    * In addition, this method can not be used for introducing IOSQE_IO_LINK chains since they
-   * require atomic SQE allocation.
-   * @todo We should add GetSubmitEntries that can allocate multiple SQEs atomically.
-   *       In that case we will need RegisterCallback function that takes an unregistered SQE
-   *       and assigns a callback to it. GetSubmitEntry will be implemented using those functions.
+   * require atomic SQE allocation. See SubmitBatch for that.
    */
   SubmitEntry GetSubmitEntry(CbType cb, int64_t payload);
 
+  struct SubmitStats {
+    // Number of io_uring_enter calls that submitted entries, and the number of entries
+    // they submitted.
+    uint64_t enter_calls = 0;
+    uint64_t submitted = 0;
+
+    // How many times SubmitBatch::Flush and GetSubmitEntry on a full ring submitted.
+    uint64_t flushes = 0;
+    uint64_t sq_full = 0;
+
+    double per_enter() const {
+      return enter_calls ? double(submitted) / enter_calls : 0;
+    }
+  };
+
+  // Must be called from the proactor thread.
+  SubmitStats GetSubmitStats() const {
+    return submit_stats_;
+  }
+
   // Returns number of entries available for submitting to io_uring.
   uint32_t GetSubmitRingAvailability() const {
     return io_uring_sq_space_left(&ring_);
@@ -96,16 +115,30 @@ class Proactor : public ProactorBase {
     return IOURING;
   }
 
-  // Currently only a single bin of 1024 buffers of size 64 bytes (total 64K) is supported.
-  // Returns 0 on success, errno on failure.
+  // Registers a pool of fixed buffers with the ring, replacing the previous one.
+  // Returns 0 on success, errno on failure. Fails with EBUSY if buffers of the previous pool
+  // are still in use, for example by in-flight UringSocket writes.
+  // The pool does not change how sockets write, see RegisterBuffers().
+  int RegisterBufferPool(const RegisteredBufferPool::Options& opts);
+
+  // Registers a single bin of 1024 buffers of size 64 bytes (total 64K) and lets UringSocket
+  // send short writes from them with WRITE_FIXED. Such writes are reported as written before
+  // they complete. Returns 0 on success, errno on failure.
   int RegisterBuffers();
 
+  // True if the buffers of RegisterBuffers() are registered.
   bool HasRegisteredBuffers() const {
-    return bool(registered_buf_);
+    return socket_buffers_;
   }
 
-  // Returns a buffer of size 64 or null if no buffers are found.
-  uint8_t* ProvideRegisteredBuffer();
+  // Null if no buffers have been registered.
+  RegisteredBufferPool* buffer_pool() {
+    return buffer_pool_.get();
+  }
+
+  // Returns a 64 byte buffer registered by RegisterBuffers() or null if no buffers are found
+  // or none were registered.
+  uint8_t* ProvideRegisteredBuffer(uint16_t* buf_index = nullptr);
   void ReturnRegisteredBuffer(uint8_t* addr);
 
  private:
@@ -120,6 +153,13 @@ class Proactor : public ProactorBase {
 
   void WakeRing() final;
 
+  // Returns an entry that is not initialized besides user_data. Submits if the ring is full.
+  io_uring_sqe* NextSqe();
+  void AssignCallback(io_uring_sqe* sqe, CbType cb, int64_t payload);
+
+  // io_uring_submit that updates the stats.
+  int Submit();
+
   io_uring ring_;
 
   int wake_fixed_fd_;
@@ -154,11 +194,18 @@ class Proactor : public ProactorBase {
   uint32_t pending_cb_cnt_ = 0;
   uint32_t next_free_fd_ = 0;  // next available fd for register files.
   uint32_t get_entry_sq_full_ = 0, get_entry_submit_fail_ = 0, get_entry_await_ = 0;
+  uint32_t sq_entries_ = 0;
+  SubmitStats submit_stats_;
+
+  std::unique_ptr<RegisteredBufferPool> buffer_pool_;
+  bool socket_buffers_ = false;  // buffer_pool_ was registered by RegisterBuffers().
+  size_t ring_mem_size_ = 0;     // memory mapped by the ring, reported via MemoryAccount.
 
-  int32_t free_req_buf_id_ = -1;
-  std::unique_ptr<uint8_t[]> registered_buf_;
+  template <typename> friend class SubmitBatchBase;
 };
 
+using SubmitBatch = SubmitBatchBase<Proactor>;
+
 class FiberCall {
   FiberCall(const FiberCall&) = delete;
   void operator=(const FiberCall&) = delete;
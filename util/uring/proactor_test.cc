@@ -136,6 +136,51 @@ TEST_F(ProactorTest, SqeOverflow) {
   close(fd);
 }
 
+TEST_F(ProactorTest, SubmitBatch) {
+  int fds[2];
+  ASSERT_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  Proactor::SubmitStats before = proactor_->AwaitBrief([&] { return proactor_->GetSubmitStats(); });
+
+  char buf[16] = {0};
+  vector<IoResult> results(4, -1);
+  proactor_->Await([&] {
+    fibers_ext::BlockingCounter bc(results.size());
+    auto cb = [&](unsigned index) {
+      return [&, index, bc](IoResult res, uint32_t, int64_t) mutable {
+        results[index] = res;
+        bc.Dec();
+      };
+    };
+
+    SubmitBatch batch(proactor_.get(), results.size());
+    batch.Add(cb(0)).Prep<sqe_op::kNop>(-1, nullptr, 0);
+
+    // Linked entries are executed in order.
+    SubmitEntry se = batch.Add(cb(1));
+    se.Prep<sqe_op::kSend>(fds[0], "hello", 5);
+    se.sqe()->flags |= IOSQE_IO_LINK;
+    batch.Add(cb(2)).Prep<sqe_op::kRecv>(fds[1], buf, sizeof(buf));
+    batch.Add(cb(3)).Prep<sqe_op::kNop>(-1, nullptr, 0);
+    EXPECT_EQ(4u, batch.size());
+    EXPECT_EQ(4u, batch.Flush());
+    EXPECT_EQ(0u, batch.size());
+
+    bc.Wait();
+  });
+
+  EXPECT_THAT(results, ElementsAre(0, 5, 5, 0));
+  EXPECT_STREQ("hello", buf);
+
+  Proactor::SubmitStats stats = proactor_->AwaitBrief([&] { return proactor_->GetSubmitStats(); });
+  EXPECT_EQ(1u, stats.flushes - before.flushes);
+  EXPECT_GE(stats.submitted - before.submitted, 4u);
+  EXPECT_GT(stats.per_enter(), 0);
+
+  close(fds[0]);
+  close(fds[1]);
+}
+
 TEST_F(ProactorTest, SqPoll) {
   io_uring_params params;
   memset(&params, 0, sizeof(params));
@@ -455,6 +500,62 @@ TEST_F(ProactorTest, LinuxFile) {
   std::free(buf);
 }
 
+TEST_F(ProactorTest, BufferPool) {
+  RegisteredBufferPool::Options opts;
+  opts.classes = {{4096, 2}, {1 << 16, 1}};
+
+  int res = proactor_->Await([&] { return proactor_->RegisterBufferPool(opts); });
+  if (res != 0) {
+    LOG(ERROR) << "RegisterBufferPool failed " << res << " skipping tests";
+    return;
+  }
+
+  string path = base::GetTestTempPath("fixed.bin");
+  proactor_->Await([&] {
+    RegisteredBufferPool* pool = proactor_->buffer_pool();
+    ASSERT_TRUE(pool);
+    EXPECT_EQ(2u * 4096 + (1 << 16), pool->capacity_bytes());
+
+    // Falls back to the larger class once the smaller one is exhausted.
+    RegisteredBufferPool::Buffer b1 = pool->Lease(100);
+    RegisteredBufferPool::Buffer b2 = pool->Lease(4096);
+    RegisteredBufferPool::Buffer b3 = pool->Lease(10);
+    ASSERT_TRUE(b1 && b2 && b3);
+    EXPECT_EQ(0, b1.buf_index());
+    EXPECT_EQ(0, b2.buf_index());
+    EXPECT_EQ(1, b3.buf_index());
+    EXPECT_EQ(1u << 16, b3.size());
+    EXPECT_FALSE(pool->Lease(1));
+    EXPECT_FALSE(pool->Lease((1 << 16) + 1));
+
+    b3.Release();
+    EXPECT_EQ(2u, pool->GetStats().in_use);
+    EXPECT_EQ(2u, pool->GetStats().failures);
+
+    // The pool can not be replaced while its buffers are in use.
+    EXPECT_EQ(EBUSY, proactor_->RegisterBufferPool(opts));
+    EXPECT_EQ(pool, proactor_->buffer_pool());
+
+    auto res = OpenLinux(path, O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0666);
+    ASSERT_TRUE(res);
+    unique_ptr<LinuxFile> file = std::move(res.value());
+
+    memset(b1.data(), 'a', b1.size());
+    auto write_res = file->WriteSomeFixed(io::Bytes{b1.data(), b1.size()}, 0, b1.buf_index());
+    ASSERT_TRUE(write_res);
+    EXPECT_EQ(4096u, *write_res);
+
+    // The buffer may start anywhere within the registered region.
+    auto read_res = file->ReadSomeFixed(b2.bytes().subspan(100, 200), 10, b2.buf_index());
+    ASSERT_TRUE(read_res);
+    EXPECT_EQ(200u, *read_res);
+    EXPECT_EQ(string(200, 'a'), string(reinterpret_cast<char*>(b2.data()) + 100, 200));
+    file->Close();
+  });
+
+  EXPECT_EQ(0u, proactor_->AwaitBrief([&] { return proactor_->buffer_pool()->GetStats().in_use; }));
+}
+
 #if 0
 TEST_F(ProactorTest, Splice) {
   string path = base::GetTestTempPath("input.txt");
@@ -526,5 +627,166 @@ void BM_AwaitCall(benchmark::State& state) {
 }
 BENCHMARK(BM_AwaitCall);
 
+// Submits state.range(0) NOPs per iteration and waits for their completions. With state.range(1)
+// the entries are prepared via SubmitBatch and flushed at once, otherwise via GetSubmitEntry
+// and submitted by the proactor loop.
+void BM_SubmitNop(benchmark::State& state) {
+  Proactor proactor;
+  std::thread t([&] {
+    proactor.Init(128);
+    proactor.Run();
+  });
+
+  const unsigned num = state.range(0);
+  const bool batched = state.range(1);
+  fibers_ext::BlockingCounter bc(0);
+  auto cb = [bc](Proactor::IoResult, uint32_t, int64_t) mutable { bc.Dec(); };
+
+  proactor.Await([&] {
+    while (state.KeepRunning()) {
+      bc.Add(num);
+      if (batched) {
+        SubmitBatch batch(&proactor, num);
+        for (unsigned i = 0; i < num; ++i) {
+          batch.Add(cb).Prep<sqe_op::kNop>(-1, nullptr, 0);
+        }
+        batch.Flush();
+      } else {
+        for (unsigned i = 0; i < num; ++i) {
+          proactor.GetSubmitEntry(cb, 0).PrepNOP();
+        }
+      }
+      bc.Wait();
+    }
+  });
+
+  Proactor::SubmitStats stats = proactor.AwaitBrief([&] { return proactor.GetSubmitStats(); });
+  state.counters["sqes_per_enter"] = stats.per_enter();
+  state.SetItemsProcessed(state.iterations() * num);
+  proactor.Stop();
+  t.join();
+}
+BENCHMARK(BM_SubmitNop)->ArgsProduct({{1, 8, 32}, {0, 1}});
+
+// Sends and receives state.range(0) 64 byte messages over a socket pair per iteration.
+void BM_SubmitRecv(benchmark::State& state) {
+  Proactor proactor;
+  std::thread t([&] {
+    proactor.Init(128);
+    proactor.Run();
+  });
+
+  int fds[2];
+  CHECK_EQ(0, socketpair(AF_UNIX, SOCK_STREAM, 0, fds));
+
+  const unsigned num = state.range(0);
+  const bool batched = state.range(1);
+  char send_buf[64] = {0};
+  vector<char> recv_buf(num * sizeof(send_buf));
+  fibers_ext::BlockingCounter bc(0);
+  auto cb = [bc](Proactor::IoResult res, uint32_t, int64_t) mutable {
+    CHECK_GT(res, 0);
+    bc.Dec();
+  };
+
+  proactor.Await([&] {
+    while (state.KeepRunning()) {
+      bc.Add(num * 2);
+      if (batched) {
+        SubmitBatch batch(&proactor, num * 2);
+        for (unsigned i = 0; i < num; ++i) {
+          batch.Add(cb).Prep<sqe_op::kSend>(fds[0], send_buf, sizeof(send_buf));
+          batch.Add(cb).Prep<sqe_op::kRecv>(fds[1], &recv_buf[i * sizeof(send_buf)],
+                                            sizeof(send_buf));
+        }
+        batch.Flush();
+      } else {
+        for (unsigned i = 0; i < num; ++i) {
+          proactor.GetSubmitEntry(cb, 0).PrepSend(fds[0], send_buf, sizeof(send_buf), 0);
+          proactor.GetSubmitEntry(cb, 0).PrepRecv(fds[1], &recv_buf[i * sizeof(send_buf)],
+                                                  sizeof(send_buf), 0);
+        }
+      }
+      bc.Wait();
+    }
+  });
+
+  Proactor::SubmitStats stats = proactor.AwaitBrief([&] { return proactor.GetSubmitStats(); });
+  state.counters["sqes_per_enter"] = stats.per_enter();
+  state.SetItemsProcessed(state.iterations() * num);
+  proactor.Stop();
+  t.join();
+  close(fds[0]);
+  close(fds[1]);
+}
+BENCHMARK(BM_SubmitRecv)->ArgsProduct({{1, 8, 32}, {0, 1}});
+
+// Random 4KB reads from a 16MB file with state.range(1) reads in flight. With state.range(0)
+// the reads use READ_FIXED with buffers from the registered pool, otherwise plain READ into
+// the same buffers, i.e. the kernel pins the pages on every read. The file is created under
+// the test temp dir, which is usually tmpfs, so that the page pinning is not hidden by the disk.
+void BM_FileReadIops(benchmark::State& state) {
+  constexpr size_t kFileSize = 16 << 20;
+  constexpr size_t kBlockSize = 4096;
+
+  Proactor proactor;
+  std::thread t([&] {
+    proactor.Init(128);
+    proactor.Run();
+  });
+
+  string path = base::GetTestTempPath("iops.bin");
+  int fd = open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC | O_CLOEXEC, 0666);
+  CHECK_GE(fd, 0);
+  string block(kBlockSize, 'a');
+  for (size_t offs = 0; offs < kFileSize; offs += kBlockSize) {
+    CHECK_EQ(ssize_t(kBlockSize), pwrite(fd, block.data(), kBlockSize, offs));
+  }
+
+  const bool fixed = state.range(0);
+  const unsigned depth = state.range(1);
+  RegisteredBufferPool::Options opts;
+  opts.classes = {{kBlockSize, depth}};
+  CHECK_EQ(0, proactor.Await([&] { return proactor.RegisterBufferPool(opts); }));
+
+  fibers_ext::BlockingCounter bc(0);
+  auto cb = [bc](Proactor::IoResult res, uint32_t, int64_t) mutable {
+    CHECK_EQ(int(kBlockSize), res);
+    bc.Dec();
+  };
+
+  proactor.Await([&] {
+    vector<RegisteredBufferPool::Buffer> bufs(depth);
+    for (auto& buf : bufs) {
+      buf = proactor.buffer_pool()->Lease(kBlockSize);
+      CHECK(buf);
+    }
+
+    uint64_t seed = 1;
+    while (state.KeepRunning()) {
+      bc.Add(depth);
+      for (const auto& buf : bufs) {
+        seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+        size_t offs = (seed >> 33) % (kFileSize / kBlockSize) * kBlockSize;
+        SubmitEntry se = proactor.GetSubmitEntry(cb, 0);
+        if (fixed) {
+          se.PrepReadFixed(fd, buf.data(), kBlockSize, offs, buf.buf_index());
+        } else {
+          se.PrepRead(fd, buf.data(), kBlockSize, offs);
+        }
+      }
+      bc.Wait();
+    }
+  });
+
+  state.SetItemsProcessed(state.iterations() * depth);
+  state.SetBytesProcessed(state.iterations() * depth * kBlockSize);
+  proactor.Stop();
+  t.join();
+  close(fd);
+  unlink(path.c_str());
+}
+BENCHMARK(BM_FileReadIops)->ArgsProduct({{0, 1}, {1, 8, 32}});
+
 }  // namespace uring
 }  // namespace util
@@ -0,0 +1,149 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "util/uring/registered_buffer_pool.h"
+
+#include <sys/mman.h>
+
+#include "base/logging.h"
+
+namespace util {
+
+#ifdef USE_FB2
+namespace fb2 {
+#else
+namespace uring {
+#endif
+
+using namespace std;
+
+RegisteredBufferPool::Buffer::Buffer(Buffer&& o) noexcept
+    : pool_(o.pool_), data_(o.data_), size_(o.size_), buf_index_(o.buf_index_) {
+  o.pool_ = nullptr;
+  o.data_ = nullptr;
+}
+
+auto RegisteredBufferPool::Buffer::operator=(Buffer&& o) noexcept -> Buffer& {
+  if (this != &o) {
+    Release();
+    swap(pool_, o.pool_);
+    swap(data_, o.data_);
+    size_ = o.size_;
+    buf_index_ = o.buf_index_;
+  }
+  return *this;
+}
+
+void RegisteredBufferPool::Buffer::Release() {
+  if (data_) {
+    pool_->Free(data_);
+    pool_ = nullptr;
+    data_ = nullptr;
+  }
+}
+
+RegisteredBufferPool::RegisteredBufferPool(const Options& opts) {
+  CHECK(!opts.classes.empty());
+  CHECK_LE(opts.classes.size(), 1U << 16);
+
+  classes_.reserve(opts.classes.size());
+  iovecs_.reserve(opts.classes.size());
+
+  uint32_t prev_size = 0;
+  for (const SizeClass& sc : opts.classes) {
+    CHECK_GT(sc.buf_size, prev_size) << "size classes must be sorted";
+    CHECK_GT(sc.count, 0u);
+    prev_size = sc.buf_size;
+
+    size_t len = size_t(sc.buf_size) * sc.count;
+
+    // mmap provides page aligned memory that is not shared with other allocations,
+    // which is preferable for pages pinned by the kernel for the lifetime of the registration.
+    void* ptr = mmap(nullptr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    CHECK(ptr != MAP_FAILED) << "Could not allocate " << len << " bytes: " << errno;
+
+    Class cl;
+    cl.arena = reinterpret_cast<uint8_t*>(ptr);
+    cl.buf_size = sc.buf_size;
+
+    // Reversed, so that the lower addresses are leased first.
+    cl.free_ids.resize(sc.count);
+    for (uint32_t i = 0; i < sc.count; ++i) {
+      cl.free_ids[i] = sc.count - 1 - i;
+    }
+    classes_.push_back(std::move(cl));
+    iovecs_.push_back(iovec{.iov_base = ptr, .iov_len = len});
+    capacity_bytes_ += len;
+  }
+}
+
+RegisteredBufferPool::~RegisteredBufferPool() {
+  // Buffers provided via Allocate() may still be in use when the proactor shuts down, say by
+  // writes that have not completed. Their memory is released together with the ring.
+  for (const iovec& vec : iovecs_) {
+    munmap(vec.iov_base, vec.iov_len);
+  }
+}
+
+auto RegisteredBufferPool::Lease(size_t size) -> Buffer {
+  Buffer res;
+  uint16_t buf_index;
+  uint32_t buf_size;
+  res.data_ = Allocate(size, &buf_index, &buf_size);
+  if (res.data_) {
+    res.pool_ = this;
+    res.size_ = buf_size;
+    res.buf_index_ = buf_index;
+  }
+  return res;
+}
+
+uint8_t* RegisteredBufferPool::Allocate(size_t size, uint16_t* buf_index, uint32_t* buf_size) {
+  for (size_t i = 0; i < classes_.size(); ++i) {
+    Class& cl = classes_[i];
+    if (cl.buf_size < size || cl.free_ids.empty())
+      continue;
+
+    uint32_t id = cl.free_ids.back();
+    cl.free_ids.pop_back();
+    ++leases_;
+    ++in_use_;
+
+    *buf_index = i;
+    if (buf_size)
+      *buf_size = cl.buf_size;
+    return cl.arena + size_t(id) * cl.buf_size;
+  }
+
+  ++failures_;
+  return nullptr;
+}
+
+void RegisteredBufferPool::Free(uint8_t* addr) {
+  for (size_t i = 0; i < classes_.size(); ++i) {
+    Class& cl = classes_[i];
+    if (addr < cl.arena || addr >= cl.arena + iovecs_[i].iov_len)
+      continue;
+
+    size_t offs = addr - cl.arena;
+    DCHECK_EQ(0u, offs % cl.buf_size);
+    cl.free_ids.push_back(offs / cl.buf_size);
+    DCHECK_GT(in_use_, 0u);
+    --in_use_;
+    return;
+  }
+  LOG(DFATAL) << "Address does not belong to the pool";
+}
+
+auto RegisteredBufferPool::GetStats() const -> Stats {
+  Stats res;
+  res.leases = leases_;
+  res.failures = failures_;
+  res.in_use = in_use_;
+  res.capacity_bytes = capacity_bytes_;
+  return res;
+}
+
+}  // namespace uring
+}  // namespace util
@@ -0,0 +1,138 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <sys/uio.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "io/io.h"
+
+namespace util {
+
+#ifdef USE_FB2
+namespace fb2 {
+#else
+namespace uring {
+#endif
+
+// Set of buffers grouped into size classes that are registered with io_uring via
+// io_uring_register_buffers. Each size class occupies a single page-aligned arena that is
+// registered as one iovec, hence the buf_index of any buffer leased from the class equals
+// the class index. READ_FIXED/WRITE_FIXED accept any address range inside the registered iovec,
+// and the kernel does not need to pin the pages on every I/O.
+//
+// The pool itself is not thread-safe and belongs to a single proactor, see
+// Proactor::RegisterBufferPool.
+class RegisteredBufferPool {
+ public:
+  struct SizeClass {
+    uint32_t buf_size;
+    uint32_t count;
+  };
+
+  struct Options {
+    // Must be sorted by buf_size.
+    std::vector<SizeClass> classes = {{4096, 128}, {1U << 16, 16}, {1U << 20, 2}};
+  };
+
+  struct Stats {
+    uint64_t leases = 0;
+
+    // Leases that failed because all the fitting buffers were in use.
+    uint64_t failures = 0;
+    size_t in_use = 0;
+    size_t capacity_bytes = 0;
+  };
+
+  // RAII lease of a registered buffer. Returns the buffer to the pool upon destruction,
+  // hence must not outlive the pool.
+  class Buffer {
+   public:
+    Buffer() = default;
+    Buffer(Buffer&& o) noexcept;
+    ~Buffer() {
+      Release();
+    }
+
+    Buffer& operator=(Buffer&& o) noexcept;
+
+    explicit operator bool() const {
+      return data_ != nullptr;
+    }
+
+    uint8_t* data() const {
+      return data_;
+    }
+
+    // The size of the buffer, which may be larger than the requested size.
+    size_t size() const {
+      return size_;
+    }
+
+    io::MutableBytes bytes() const {
+      return io::MutableBytes{data_, size_};
+    }
+
+    // To be passed to PrepReadFixed/PrepWriteFixed.
+    uint16_t buf_index() const {
+      return buf_index_;
+    }
+
+    void Release();
+
+   private:
+    friend class RegisteredBufferPool;
+
+    RegisteredBufferPool* pool_ = nullptr;
+    uint8_t* data_ = nullptr;
+    uint32_t size_ = 0;
+    uint16_t buf_index_ = 0;
+  };
+
+  explicit RegisteredBufferPool(const Options& opts);
+  ~RegisteredBufferPool();
+
+  RegisteredBufferPool(const RegisteredBufferPool&) = delete;
+  void operator=(const RegisteredBufferPool&) = delete;
+
+  // Leases a buffer from the smallest size class that fits size and has free buffers.
+  // Returns an empty buffer if none is available.
+  Buffer Lease(size_t size);
+
+  // Low level interface for the callers that return the buffer from the completion callback.
+  // Returns null if no buffer is available.
+  uint8_t* Allocate(size_t size, uint16_t* buf_index, uint32_t* buf_size = nullptr);
+  void Free(uint8_t* addr);
+
+  // The iovec table to pass to io_uring_register_buffers, one entry per size class.
+  const std::vector<iovec>& iovecs() const {
+    return iovecs_;
+  }
+
+  size_t capacity_bytes() const {
+    return capacity_bytes_;
+  }
+
+  Stats GetStats() const;
+
+ private:
+  struct Class {
+    uint8_t* arena;
+    uint32_t buf_size;
+    std::vector<uint32_t> free_ids;
+  };
+
+  std::vector<Class> classes_;
+  std::vector<iovec> iovecs_;
+  size_t capacity_bytes_ = 0;
+
+  uint64_t leases_ = 0, failures_ = 0;
+  size_t in_use_ = 0;
+};
+
+}  // namespace uring
+}  // namespace util
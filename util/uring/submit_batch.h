@@ -0,0 +1,89 @@
+// Copyright 2023, Roman Gershman.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <liburing.h>
+
+#include "base/logging.h"
+#include "util/uring/submit_entry.h"
+
+namespace util {
+
+#ifdef USE_FB2
+namespace fb2 {
+#else
+namespace uring {
+#endif
+
+/**
+ * @brief Prepares several SQEs and submits them with a single io_uring_enter.
+ *
+ * The entries are reserved upfront, therefore Add() does not trigger intermediate submits and
+ * the batch may contain IOSQE_IO_LINK chains. Entries returned by Add() are not zeroed and must
+ * be initialized with SubmitEntry::Prep<>():
+ *
+ *   SubmitBatch batch(proactor, 2);
+ *   batch.Add(send_cb).Prep<sqe_op::kSend>(fd, buf, len);
+ *   batch.Add(recv_cb).Prep<sqe_op::kRecv>(fd, rbuf, rlen);
+ *   batch.Flush();
+ *
+ * Must be used within a fiber of the proactor thread. The fiber should not suspend between
+ * the construction and Flush(), otherwise other fibers may use the reserved entries, in which
+ * case Add() falls back to GetSubmitEntry(). Entries that were not flushed are submitted
+ * by the proactor loop.
+ *
+ * Shared by both uring proactors, see the SubmitBatch aliases in util/uring/proactor.h and
+ * util/fibers/uring_proactor.h.
+ */
+template <typename ProactorT> class SubmitBatchBase {
+  SubmitBatchBase(const SubmitBatchBase&) = delete;
+  void operator=(const SubmitBatchBase&) = delete;
+
+ public:
+  using CbType = typename ProactorT::CbType;
+
+  // Waits till capacity entries are available. capacity must not exceed the ring size.
+  SubmitBatchBase(ProactorT* proactor, uint32_t capacity)
+      : proactor_(proactor), capacity_(capacity) {
+    CHECK_LE(capacity, proactor->sq_entries_);
+    proactor->WaitTillAvailable(capacity);
+  }
+
+  // payload is ignored by the fb2 proactor, similarly to GetSubmitEntry.
+  SubmitEntry Add(CbType cb, int64_t payload = 0) {
+    DCHECK_LT(size_, capacity_);
+    ++size_;
+
+    io_uring_sqe* sqe = io_uring_get_sqe(&proactor_->ring_);
+    if (sqe == NULL)  // The reserved entries were taken by other fibers.
+      return proactor_->GetSubmitEntry(std::move(cb), payload);
+
+    proactor_->AssignCallback(sqe, std::move(cb), payload);
+    return SubmitEntry{sqe};
+  }
+
+  // Returns the number of submitted entries, including the entries that were prepared but not
+  // submitted by other fibers or the proactor loop.
+  unsigned Flush() {
+    size_ = 0;
+    ++proactor_->submit_stats_.flushes;
+    int res = proactor_->Submit();
+
+    // On errors, like EBUSY, the entries stay in the ring and are submitted by the proactor loop.
+    return res > 0 ? res : 0;
+  }
+
+  uint32_t size() const {
+    return size_;
+  }
+
+ private:
+  ProactorT* proactor_;
+  uint32_t capacity_;
+  uint32_t size_ = 0;
+};
+
+}  // namespace uring
+}  // namespace util
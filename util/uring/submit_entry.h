@@ -6,6 +6,8 @@
 
 #include <liburing/io_uring.h>
 
+#include <cstdint>
+
 namespace util {
 #ifdef USE_FB2
 namespace fb2 {
@@ -15,6 +17,31 @@ namespace uring {
 class Proactor;
 #endif
 
+/**
+ * @brief Compile-time descriptor of an io_uring operation for SubmitEntry::Prep<>().
+ *
+ * Maps the generic (fd, addr, len, offset, op_flags) arguments onto the SQE. Since the
+ * descriptor is known at compile time, Prep<>() compiles down to the stores of a single
+ * 64 byte entry.
+ */
+struct SqeOp {
+  uint8_t opcode;
+
+  // Whether the operation reads the offset field. Socket operations ignore it.
+  bool has_offset;
+};
+
+namespace sqe_op {
+
+inline constexpr SqeOp kNop{IORING_OP_NOP, false};
+inline constexpr SqeOp kRecv{IORING_OP_RECV, false};
+inline constexpr SqeOp kSend{IORING_OP_SEND, false};
+inline constexpr SqeOp kRead{IORING_OP_READ, true};
+inline constexpr SqeOp kWrite{IORING_OP_WRITE, true};
+inline constexpr SqeOp kReadV{IORING_OP_READV, true};
+inline constexpr SqeOp kWriteV{IORING_OP_WRITEV, true};
+
+}  // namespace sqe_op
 
 /**
  * @brief Wraps and prepares SQE for submission.
@@ -196,6 +223,25 @@ class SubmitEntry {
     PrepFd(IORING_OP_NOP, -1);
   }
 
+  // Initializes all the fields of the entry besides user_data. Unlike Prep* methods above,
+  // does not rely on the entry being zeroed by GetSubmitEntry, hence must be used with
+  // the entries of SubmitBatch. op_flags are msg_flags for socket operations and rw_flags
+  // for file operations.
+  template <const SqeOp& kOp>
+  void Prep(int fd, const void* addr, uint32_t len, uint64_t offset = 0, uint32_t op_flags = 0) {
+    io_uring_sqe sqe{};
+    sqe.opcode = kOp.opcode;
+    sqe.fd = fd;
+    sqe.addr = (unsigned long)addr;
+    sqe.len = len;
+    if constexpr (kOp.has_offset) {
+      sqe.off = offset;
+    }
+    sqe.rw_flags = op_flags;
+    sqe.user_data = sqe_->user_data;
+    *sqe_ = sqe;
+  }
+
   // Used only by Proactor.
   explicit SubmitEntry(io_uring_sqe* sqe) : sqe_(sqe) {
   }
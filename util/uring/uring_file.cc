@@ -6,6 +6,7 @@
 
 #include <fcntl.h>
 #include <sys/stat.h>
+#include <unistd.h>
 
 #include "base/logging.h"
 
@@ -75,6 +76,24 @@ class WriteFileImpl final : public WriteFile {
   off_t offs_ = 0;
 };
 
+class DirectWriteFileImpl final : public DirectWriteFile {
+ public:
+  DirectWriteFileImpl(Proactor* p, std::string_view file_name, size_t prealloc_size)
+      : DirectWriteFile(file_name, prealloc_size), proactor_(p) {
+  }
+
+  ~DirectWriteFileImpl();
+
+  error_code Open(int flags, bool append);
+
+ private:
+  error_code WriteAt(Bytes data, off_t offset) final;
+  error_code Allocate(off_t offset, off_t len) final;
+  error_code CloseHandle() final;
+
+  Proactor* proactor_;
+};
+
 class LinuxFileImpl : public LinuxFile {
  public:
   LinuxFileImpl(int fd, Proactor* p) : proactor_(p) {
@@ -92,6 +111,9 @@ class LinuxFileImpl : public LinuxFile {
   io::Result<size_t> ReadSome(const struct iovec* iov, unsigned iovcnt, off_t offset,
                               unsigned flags) final;
 
+  io::Result<size_t> WriteSomeFixed(io::Bytes src, off_t offset, uint16_t buf_index) final;
+  io::Result<size_t> ReadSomeFixed(io::MutableBytes dest, off_t offset, uint16_t buf_index) final;
+
   std::error_code Close() final;
 
  protected:
@@ -109,7 +131,33 @@ class LinuxFileImpl : public LinuxFile {
 //                 |_|
 */
 
+// IOPOLL rings accept only reads and writes, therefore other file operations are issued as
+// plain syscalls on such proactors.
+inline bool UseSyscalls(Proactor* p) {
+#ifdef USE_FB2
+  return p->HasIoPoll();
+#else
+  return false;
+#endif
+}
+
+// Returns the file descriptor or -errno, similarly to FiberCall::Get().
+int OpenFile(const char* path, int flags, mode_t mode, Proactor* p) {
+  if (UseSyscalls(p)) {
+    int fd = open(path, flags, mode);
+    return fd < 0 ? -errno : fd;
+  }
+
+  FiberCall fc(p);
+  fc->PrepOpenAt(AT_FDCWD, path, flags, mode);
+  return fc.Get();
+}
+
 error_code CloseFile(int fd, Proactor* p) {
+  if (fd > 0 && UseSyscalls(p)) {
+    return close(fd) == 0 ? error_code{} : error_code{errno, system_category()};
+  }
+
   if (fd > 0) {
     FiberCall fc(p);
     fc->PrepClose(fd);
@@ -244,10 +292,7 @@ WriteFileImpl::~WriteFileImpl() {
 error_code WriteFileImpl::Open(int flags) {
   CHECK_EQ(fd_, -1);
 
-  FiberCall fc(proactor_);
-  fc->PrepOpenAt(AT_FDCWD, create_file_name_.c_str(), flags, 0644);
-  FiberCall::IoResult io_res = fc.Get();
-
+  int io_res = OpenFile(create_file_name_.c_str(), flags, 0644, proactor_);
   if (io_res < 0) {
     return error_code{-io_res, system_category()};
   }
@@ -270,6 +315,49 @@ Result<size_t> WriteFileImpl::WriteSome(const iovec* v, uint32_t len) {
   return res;
 }
 
+DirectWriteFileImpl::~DirectWriteFileImpl() {
+  CloseFile(fd_, proactor_);
+}
+
+error_code DirectWriteFileImpl::Open(int flags, bool append) {
+  int io_res = OpenFile(create_file_name_.c_str(), flags, 0644, proactor_);
+  if (io_res < 0) {
+    return error_code{-io_res, system_category()};
+  }
+  return Init(io_res, append);
+}
+
+error_code DirectWriteFileImpl::WriteAt(Bytes data, off_t offset) {
+  while (!data.empty()) {
+    iovec v{const_cast<uint8_t*>(data.data()), data.size()};
+    Result<size_t> res = WriteSomeInternal(fd_, &v, 1, offset, 0, proactor_);
+    if (!res)
+      return res.error();
+    data.remove_prefix(*res);
+    offset += *res;
+  }
+  return {};
+}
+
+error_code DirectWriteFileImpl::Allocate(off_t offset, off_t len) {
+  if (UseSyscalls(proactor_)) {
+    return fallocate(fd_, FALLOC_FL_KEEP_SIZE, offset, len) == 0
+               ? error_code{}
+               : error_code{errno, system_category()};
+  }
+
+  FiberCall fc(proactor_);
+  fc->PrepFallocate(fd_, FALLOC_FL_KEEP_SIZE, offset, len);
+  FiberCall::IoResult io_res = fc.Get();
+  return io_res < 0 ? error_code{-io_res, system_category()} : error_code{};
+}
+
+error_code DirectWriteFileImpl::CloseHandle() {
+  error_code ec = CloseFile(fd_, proactor_);
+  fd_ = -1;
+  return ec;
+}
+
 LinuxFileImpl::~LinuxFileImpl() {
   CloseFile(fd_, proactor_);
 }
@@ -287,6 +375,32 @@ io::Result<size_t> LinuxFileImpl::ReadSome(const struct iovec* iov, unsigned iov
   return ReadSomeInternal(fd_, iov, iovcnt, offset, flags, proactor_);
 }
 
+io::Result<size_t> LinuxFileImpl::WriteSomeFixed(io::Bytes src, off_t offset,
+                                                 uint16_t buf_index) {
+  CHECK_GE(fd_, 0);
+
+  FiberCall fc(proactor_);
+  fc->PrepWriteFixed(fd_, const_cast<uint8_t*>(src.data()), src.size(), offset, buf_index);
+  FiberCall::IoResult io_res = fc.Get();
+  if (io_res < 0) {
+    return make_unexpected(error_code{-io_res, system_category()});
+  }
+  return io_res;
+}
+
+io::Result<size_t> LinuxFileImpl::ReadSomeFixed(io::MutableBytes dest, off_t offset,
+                                                uint16_t buf_index) {
+  CHECK_GE(fd_, 0);
+
+  FiberCall fc(proactor_);
+  fc->PrepReadFixed(fd_, dest.data(), dest.size(), offset, buf_index);
+  FiberCall::IoResult io_res = fc.Get();
+  if (io_res < 0) {
+    return make_unexpected(error_code{-io_res, system_category()});
+  }
+  return io_res;
+}
+
 std::error_code LinuxFileImpl::Close() {
   error_code ec = CloseFile(fd_, proactor_);
   fd_ = -1;
@@ -296,17 +410,26 @@ std::error_code LinuxFileImpl::Close() {
 }  // namespace
 
 io::Result<io::WriteFile*> OpenWrite(std::string_view path, io::WriteFile::Options opts) {
+  ProactorBase* me = ProactorBase::me();
+  DCHECK(me->GetKind() == ProactorBase::IOURING);
+
+  Proactor* p = static_cast<Proactor*>(CHECK_NOTNULL(me));
+
+  if (opts.direct) {
+    int flags = O_CREAT | O_RDWR | O_CLOEXEC | O_DIRECT | (opts.append ? 0 : O_TRUNC);
+    unique_ptr<DirectWriteFileImpl> file(new DirectWriteFileImpl{p, path, opts.prealloc_size});
+    error_code ec = file->Open(flags, opts.append);
+    if (ec)
+      return make_unexpected(ec);
+    return file.release();
+  }
+
   int flags = O_CREAT | O_WRONLY | O_CLOEXEC;
   if (opts.append)
     flags |= O_APPEND;
   else
     flags |= O_TRUNC;
 
-  ProactorBase* me = ProactorBase::me();
-  DCHECK(me->GetKind() == ProactorBase::IOURING);
-
-  Proactor* p = static_cast<Proactor*>(CHECK_NOTNULL(me));
-
   unique_ptr<WriteFileImpl> impl(new WriteFileImpl{p, path});
   error_code ec = impl->Open(flags);
   if (ec)
@@ -322,16 +445,9 @@ io::Result<io::ReadonlyFile*> OpenRead(std::string_view path) {
   DCHECK(me->GetKind() == ProactorBase::IOURING);
 
   Proactor* p = static_cast<Proactor*>(CHECK_NOTNULL(me));
-  FiberCall::IoResult io_res;
-
-  {
-    FiberCall fc(p);
-    fc->PrepOpenAt(AT_FDCWD, path.data(), flags, 0);
-    io_res = fc.Get();
-
-    if (io_res < 0) {
-      return make_unexpected(error_code{-io_res, system_category()});
-    }
+  FiberCall::IoResult io_res = OpenFile(path.data(), flags, 0, p);
+  if (io_res < 0) {
+    return make_unexpected(error_code{-io_res, system_category()});
   }
 
   int fd = io_res;
@@ -342,15 +458,17 @@ io::Result<io::ReadonlyFile*> OpenRead(std::string_view path) {
     return make_unexpected(error_code{e, system_category()});
   }
 
-  {
+  if (UseSyscalls(p)) {
+    io_res = -posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  } else {
     FiberCall fc(p);
     fc->PrepFadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
     io_res = fc.Get();
-    if (io_res < 0) {
-      int e = errno;
-      close(fd);
-      return make_unexpected(error_code{e, system_category()});
-    }
+  }
+
+  if (io_res < 0) {
+    close(fd);
+    return make_unexpected(error_code{-io_res, system_category()});
   }
 
   return new ReadFileImpl(fd, sb.st_size, p);
@@ -385,16 +503,9 @@ io::Result<std::unique_ptr<LinuxFile>> OpenLinux(std::string_view path, int flag
   DCHECK(me->GetKind() == ProactorBase::IOURING);
 
   Proactor* p = static_cast<Proactor*>(CHECK_NOTNULL(me));
-  FiberCall::IoResult io_res;
-
-  {
-    FiberCall fc(p);
-    fc->PrepOpenAt(AT_FDCWD, path.data(), flags, mode);
-    io_res = fc.Get();
-
-    if (io_res < 0) {
-      return make_unexpected(error_code{-io_res, system_category()});
-    }
+  FiberCall::IoResult io_res = OpenFile(path.data(), flags, mode, p);
+  if (io_res < 0) {
+    return make_unexpected(error_code{-io_res, system_category()});
   }
   return make_unique<LinuxFileImpl>(io_res, p);
 }
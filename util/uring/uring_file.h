@@ -18,6 +18,8 @@ namespace uring {
 // The following functions must be called in the context of Proactor thread.
 // The objects should be accessed and used in the context of the same thread where
 // they have been opened.
+// On IOPOLL proactors (fb2 only) files are opened, allocated and closed with synchronous
+// syscalls, and reads and writes require O_DIRECT.
 io::Result<io::WriteFile*> OpenWrite(std::string_view path,
                                      io::WriteFile::Options opts = io::WriteFile::Options());
 
@@ -39,6 +41,13 @@ class LinuxFile {
   virtual io::Result<size_t> ReadSome(const struct iovec* iov, unsigned iovcnt, off_t offset,
                                       unsigned flags) = 0;
 
+  // Single buffer variants that use IORING_OP_READ_FIXED/WRITE_FIXED. The buffer must lie
+  // within the registered buffer buf_index, for example leased from the proactor buffer pool
+  // (see RegisteredBufferPool), which spares the kernel from pinning its pages on every call.
+  virtual io::Result<size_t> WriteSomeFixed(io::Bytes src, off_t offset, uint16_t buf_index) = 0;
+  virtual io::Result<size_t> ReadSomeFixed(io::MutableBytes dest, off_t offset,
+                                           uint16_t buf_index) = 0;
+
   virtual std::error_code Close() = 0;
 
   int fd() const {
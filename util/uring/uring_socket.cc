@@ -153,6 +153,7 @@ auto UringSocket::WriteSome(const iovec* ptr, uint32_t len) -> Result<size_t> {
   ssize_t res = 0;
   size_t short_len = 0;
   uint8_t* reg_buf = nullptr;
+  uint16_t buf_index = 0;
 
   // WARNING: raw, experimental code.
   if (p->HasRegisteredBuffers() && len < 16) {
@@ -161,7 +162,7 @@ auto UringSocket::WriteSome(const iovec* ptr, uint32_t len) -> Result<size_t> {
     }
 
     if (short_len <= 64) {
-      reg_buf = p->ProvideRegisteredBuffer();
+      reg_buf = p->ProvideRegisteredBuffer(&buf_index);
     }
   }
 
@@ -181,7 +182,7 @@ auto UringSocket::WriteSome(const iovec* ptr, uint32_t len) -> Result<size_t> {
     };
 
     SubmitEntry se = p->GetSubmitEntry(move(cb), 0);
-    se.PrepWriteFixed(fd, reg_buf, short_len, 0, 0);
+    se.PrepWriteFixed(fd, reg_buf, short_len, 0, buf_index);
     se.sqe()->flags |= register_flag();
 
     return short_len;  // optimistic
@@ -4,6 +4,8 @@
 
 #include "util/uring/uring_socket.h"
 
+#include <thread>
+
 #include "base/gtest.h"
 #include "base/logging.h"
 
@@ -21,6 +23,7 @@ using Proactor = fb2::UringProactor;
 using fb2::Fiber;
 using fb2::Done;
 using fb2::UringSocket;
+using fb2::RegisteredBufferPool;
 #else
 using fibers_ext::Fiber;
 using fibers_ext::Done;
@@ -108,6 +111,49 @@ TEST_F(UringSocketTest, Basic) {
   });
 }
 
+TEST_F(UringSocketTest, RegisteredBuffers) {
+  // A pool for file I/O does not change how sockets write.
+  RegisteredBufferPool::Options opts;
+  opts.classes = {{4096, 2}};
+  int res = proactor_->Await([&] { return proactor_->RegisterBufferPool(opts); });
+  if (res != 0) {
+    LOG(ERROR) << "RegisterBufferPool failed " << res << " skipping tests";
+    return;
+  }
+  EXPECT_FALSE(proactor_->HasRegisteredBuffers());
+
+  unique_ptr<LinuxSocketBase> sock(proactor_->CreateSocket());
+  const uint8_t kMsg[] = "0123456789abcdef";
+  auto send_recv = [&] {
+    auto write_res = sock->WriteSome(io::Bytes(kMsg, 16));
+    EXPECT_EQ(16, write_res.value_or(0));
+
+    uint8_t buf[16];
+    auto read_res = conn_socket_->Recv(io::MutableBytes(buf), MSG_WAITALL);
+    ASSERT_EQ(16, read_res.value_or(0));
+    EXPECT_EQ(0, memcmp(kMsg, buf, 16));
+  };
+
+  proactor_->Await([&] {
+    error_code ec = sock->Connect(listen_ep_);
+    EXPECT_FALSE(ec);
+    accept_fb_.Join();
+    ASSERT_FALSE(accept_ec_);
+    send_recv();
+  });
+  EXPECT_EQ(0u, proactor_->AwaitBrief([&] { return proactor_->buffer_pool()->GetStats().leases; }));
+
+  // RegisterBuffers enables WRITE_FIXED for short socket writes.
+  ASSERT_EQ(0, proactor_->Await([&] { return proactor_->RegisterBuffers(); }));
+  EXPECT_TRUE(proactor_->HasRegisteredBuffers());
+  proactor_->Await(send_recv);
+
+  RegisteredBufferPool::Stats stats =
+      proactor_->AwaitBrief([&] { return proactor_->buffer_pool()->GetStats(); });
+  EXPECT_EQ(1u, stats.leases);
+  EXPECT_EQ(0u, stats.in_use);
+}
+
 TEST_F(UringSocketTest, Timeout) {
   unique_ptr<LinuxSocketBase> sock[2];
   for (size_t i = 0; i < 2; ++i) {